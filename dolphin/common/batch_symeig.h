@@ -0,0 +1,625 @@
+/**
+ * @file batch_symeig.h
+ *
+ * @brief Batched eigen-decomposition of small symmetric matrices
+ *
+ * @author Dahua Lin
+ */
+
+#ifdef _MSC_VER
+#pragma once
+#endif
+
+#ifndef DOLPHIN_BATCH_SYMEIG_H_
+#define DOLPHIN_BATCH_SYMEIG_H_
+
+#include <dolphin/common/import_lmat.h>
+#include <dolphin/common/parallel.h>
+#include <cmath>
+#include <limits>
+#include <vector>
+#include <algorithm>
+
+namespace dolphin
+{
+	namespace internal
+	{
+		/********************************************
+		 *
+		 *  closed form: 2 x 2
+		 *
+		 ********************************************/
+
+		template<typename T>
+		inline void symeig2(const T *a, T *evs, T *U)
+		{
+			const T p = a[0];
+			const T q = a[1];
+			const T r = a[3];
+
+			const T m = (p + r) * T(0.5);
+			const T d = (p - r) * T(0.5);
+			const T h = std::hypot(d, q);
+
+			evs[0] = m + h;
+			evs[1] = m - h;
+
+			if (U)
+			{
+				// (c, s) is the eigenvector of the larger eigenvalue,
+				// with cos(2 theta) = d / h and sin(2 theta) = q / h
+
+				T c, s;
+				if (h == T(0))
+				{
+					c = T(1);
+					s = T(0);
+				}
+				else if (d >= T(0))
+				{
+					c = std::sqrt((h + d) / (T(2) * h));
+					s = q / (T(2) * h * c);
+				}
+				else
+				{
+					s = std::sqrt((h - d) / (T(2) * h));
+					c = q / (T(2) * h * s);
+				}
+
+				U[0] = c;  U[2] = -s;
+				U[1] = s;  U[3] = c;
+			}
+		}
+
+
+		/********************************************
+		 *
+		 *  closed form: 3 x 3
+		 *
+		 *  Eigenvalues from the trigonometric solution
+		 *  of the characteristic cubic. Eigenvectors
+		 *  are computed without iteration: the one of
+		 *  the best-separated eigenvalue from a cross
+		 *  product of rows of (A - lambda I), the next
+		 *  from the 2 x 2 problem in its orthogonal
+		 *  complement, and the last by a cross product.
+		 *  This remains accurate with repeated roots.
+		 *
+		 ********************************************/
+
+		template<typename T>
+		DOLPHIN_ENSURE_INLINE
+		inline void cross3(const T *u, const T *v, T *w)
+		{
+			w[0] = u[1] * v[2] - u[2] * v[1];
+			w[1] = u[2] * v[0] - u[0] * v[2];
+			w[2] = u[0] * v[1] - u[1] * v[0];
+		}
+
+		template<typename T>
+		DOLPHIN_ENSURE_INLINE
+		inline T dot3(const T *u, const T *v)
+		{
+			return u[0] * v[0] + u[1] * v[1] + u[2] * v[2];
+		}
+
+		// a00, a01, a02, a11, a12, a22
+		template<typename T>
+		inline void symeig3_evec0(const T *s, T ev, T *v)
+		{
+			const T r0[3] = {s[0] - ev, s[1], s[2]};
+			const T r1[3] = {s[1], s[3] - ev, s[4]};
+			const T r2[3] = {s[2], s[4], s[5] - ev};
+
+			T c01[3], c02[3], c12[3];
+			cross3(r0, r1, c01);
+			cross3(r0, r2, c02);
+			cross3(r1, r2, c12);
+
+			const T d01 = dot3(c01, c01);
+			const T d02 = dot3(c02, c02);
+			const T d12 = dot3(c12, c12);
+
+			const T *c = c01;
+			T dm = d01;
+			if (d02 > dm) { c = c02; dm = d02; }
+			if (d12 > dm) { c = c12; dm = d12; }
+
+			const T inv = T(1) / std::sqrt(dm);
+			v[0] = c[0] * inv;
+			v[1] = c[1] * inv;
+			v[2] = c[2] * inv;
+		}
+
+		template<typename T>
+		inline void symeig3_evec1(const T *s, const T *w, T ev, T *v)
+		{
+			// orthonormal basis (u, t) of the complement of w
+
+			T u[3], t[3];
+			if (std::abs(w[0]) > std::abs(w[1]))
+			{
+				const T inv = T(1) / std::sqrt(w[0] * w[0] + w[2] * w[2]);
+				u[0] = -w[2] * inv; u[1] = T(0); u[2] = w[0] * inv;
+			}
+			else
+			{
+				const T inv = T(1) / std::sqrt(w[1] * w[1] + w[2] * w[2]);
+				u[0] = T(0); u[1] = w[2] * inv; u[2] = -w[1] * inv;
+			}
+			cross3(w, u, t);
+
+			const T au[3] = {
+				s[0] * u[0] + s[1] * u[1] + s[2] * u[2],
+				s[1] * u[0] + s[3] * u[1] + s[4] * u[2],
+				s[2] * u[0] + s[4] * u[1] + s[5] * u[2] };
+
+			const T at[3] = {
+				s[0] * t[0] + s[1] * t[1] + s[2] * t[2],
+				s[1] * t[0] + s[3] * t[1] + s[4] * t[2],
+				s[2] * t[0] + s[4] * t[1] + s[5] * t[2] };
+
+			T m00 = dot3(u, au) - ev;
+			T m01 = dot3(u, at);
+			T m11 = dot3(t, at) - ev;
+
+			const T a00 = std::abs(m00);
+			const T a01 = std::abs(m01);
+			const T a11 = std::abs(m11);
+
+			T cu = T(1), ct = T(0);
+
+			if (a00 >= a11)
+			{
+				if (a00 > T(0) || a01 > T(0))
+				{
+					if (a00 >= a01)
+					{
+						m01 /= m00;
+						m00 = T(1) / std::sqrt(T(1) + m01 * m01);
+						m01 *= m00;
+					}
+					else
+					{
+						m00 /= m01;
+						m01 = T(1) / std::sqrt(T(1) + m00 * m00);
+						m00 *= m01;
+					}
+					cu = m01; ct = -m00;
+				}
+			}
+			else
+			{
+				if (a11 >= a01)
+				{
+					m01 /= m11;
+					m11 = T(1) / std::sqrt(T(1) + m01 * m01);
+					m01 *= m11;
+				}
+				else
+				{
+					m11 /= m01;
+					m01 = T(1) / std::sqrt(T(1) + m11 * m11);
+					m11 *= m01;
+				}
+				cu = m11; ct = -m01;
+			}
+
+			v[0] = cu * u[0] + ct * t[0];
+			v[1] = cu * u[1] + ct * t[1];
+			v[2] = cu * u[2] + ct * t[2];
+		}
+
+		template<typename T>
+		inline void symeig3(const T *a, T *evs, T *U)
+		{
+			// scale to avoid overflow and underflow
+
+			T amax = std::abs(a[0]);
+			const index_t lidx[5] = {1, 2, 4, 5, 8};
+			for (index_t i = 0; i < 5; ++i)
+			{
+				T v = std::abs(a[lidx[i]]);
+				if (v > amax) amax = v;
+			}
+
+			if (amax == T(0))
+			{
+				evs[0] = evs[1] = evs[2] = T(0);
+				if (U)
+				{
+					for (index_t i = 0; i < 9; ++i) U[i] = T(0);
+					U[0] = U[4] = U[8] = T(1);
+				}
+				return;
+			}
+
+			const T sc = T(1) / amax;
+			const T s[6] = {a[0] * sc, a[1] * sc, a[2] * sc, a[4] * sc, a[5] * sc, a[8] * sc};
+
+			const T q = (s[0] + s[3] + s[5]) / T(3);
+			const T b00 = s[0] - q;
+			const T b11 = s[3] - q;
+			const T b22 = s[5] - q;
+
+			const T p = std::sqrt((b00 * b00 + b11 * b11 + b22 * b22 +
+					T(2) * (s[1] * s[1] + s[2] * s[2] + s[4] * s[4])) / T(6));
+
+			if (p == T(0))
+			{
+				// a multiple of identity
+				evs[0] = evs[1] = evs[2] = q * amax;
+				if (U)
+				{
+					for (index_t i = 0; i < 9; ++i) U[i] = T(0);
+					U[0] = U[4] = U[8] = T(1);
+				}
+				return;
+			}
+
+			const T c00 = b11 * b22 - s[4] * s[4];
+			const T c01 = s[1] * b22 - s[4] * s[2];
+			const T c02 = s[1] * s[4] - b11 * s[2];
+			const T det = (b00 * c00 - s[1] * c01 + s[2] * c02) / (p * p * p);
+
+			T hdet = det * T(0.5);
+			if (hdet < T(-1)) hdet = T(-1);
+			if (hdet > T(1)) hdet = T(1);
+
+			const T angle = std::acos(hdet) / T(3);
+			const T two_pi_3 = T(2.09439510239319549);
+			const T beta2 = std::cos(angle) * T(2);
+			const T beta0 = std::cos(angle + two_pi_3) * T(2);
+			const T beta1 = -(beta0 + beta2);
+
+			// ascending
+			const T e0 = q + p * beta0;
+			const T e1 = q + p * beta1;
+			const T e2 = q + p * beta2;
+
+			T v[9];
+			T *v0 = v;		// for e2 (largest)
+			T *v1 = v + 3;
+			T *v2 = v + 6;	// for e0 (smallest)
+
+			if (hdet >= T(0))
+			{
+				symeig3_evec0(s, e2, v0);
+				symeig3_evec1(s, v0, e1, v1);
+				cross3(v0, v1, v2);
+			}
+			else
+			{
+				symeig3_evec0(s, e0, v2);
+				symeig3_evec1(s, v2, e1, v1);
+				cross3(v1, v2, v0);
+			}
+
+			// The roots of the cubic lose about half of the digits
+			// near a repeated root, whereas the vectors span the
+			// right subspaces, so the eigenvalues are re-evaluated
+			// as Rayleigh quotients.
+
+			T e[3];
+			for (index_t i = 0; i < 3; ++i)
+			{
+				const T *u = v + i * 3;
+				const T au[3] = {
+					s[0] * u[0] + s[1] * u[1] + s[2] * u[2],
+					s[1] * u[0] + s[3] * u[1] + s[4] * u[2],
+					s[2] * u[0] + s[4] * u[1] + s[5] * u[2] };
+				e[i] = dot3(u, au);
+			}
+
+			index_t o[3] = {0, 1, 2};
+			if (e[o[0]] < e[o[1]]) std::swap(o[0], o[1]);
+			if (e[o[1]] < e[o[2]]) std::swap(o[1], o[2]);
+			if (e[o[0]] < e[o[1]]) std::swap(o[0], o[1]);
+
+			for (index_t i = 0; i < 3; ++i)
+			{
+				evs[i] = e[o[i]] * amax;
+				if (U)
+				{
+					const T *u = v + o[i] * 3;
+					U[i * 3] = u[0];
+					U[i * 3 + 1] = u[1];
+					U[i * 3 + 2] = u[2];
+				}
+			}
+		}
+
+
+		/********************************************
+		 *
+		 *  cyclic Jacobi over a group of matrices
+		 *
+		 *  The matrices of a group are interleaved
+		 *  (structure of arrays), i.e. entry (i, j)
+		 *  of the b-th matrix is at (i + j * n) * W + b,
+		 *  so that every rotation step is a branch-free
+		 *  loop over the W lanes that the compiler can
+		 *  vectorize.
+		 *
+		 ********************************************/
+
+		const index_t symeig_jacobi_width = 8;
+		const int symeig_jacobi_max_sweeps = 30;
+
+		template<typename T>
+		void symeig_jacobi_group(index_t n, T *A, T *V, T *buf)
+		{
+			const index_t W = symeig_jacobi_width;
+			const T eps = std::numeric_limits<T>::epsilon();
+
+			T *c = buf;
+			T *s = buf + W;
+			T *fro = buf + 2 * W;
+
+			for (index_t b = 0; b < W; ++b) fro[b] = T(0);
+			for (index_t k = 0; k < n * n; ++k)
+			{
+				const T *ak = A + k * W;
+				for (index_t b = 0; b < W; ++b) fro[b] += ak[b] * ak[b];
+			}
+
+			if (V)
+			{
+				for (index_t k = 0; k < n * n * W; ++k) V[k] = T(0);
+				for (index_t i = 0; i < n; ++i)
+				{
+					T *vi = V + (i + i * n) * W;
+					for (index_t b = 0; b < W; ++b) vi[b] = T(1);
+				}
+			}
+
+			for (int sweep = 0; sweep < symeig_jacobi_max_sweeps; ++sweep)
+			{
+				// convergence test: off-diagonal mass relative to the total
+
+				bool conv = true;
+				for (index_t b = 0; b < W; ++b)
+				{
+					T off(0);
+					for (index_t q = 1; q < n; ++q)
+						for (index_t p = 0; p < q; ++p)
+						{
+							T v = A[(p + q * n) * W + b];
+							off += v * v;
+						}
+					if (off > eps * eps * fro[b]) { conv = false; break; }
+				}
+				if (conv) break;
+
+				for (index_t p = 0; p < n - 1; ++p)
+				for (index_t q = p + 1; q < n; ++q)
+				{
+					const T *app = A + (p + p * n) * W;
+					const T *aqq = A + (q + q * n) * W;
+					const T *apq = A + (p + q * n) * W;
+
+					for (index_t b = 0; b < W; ++b)
+					{
+						const bool z = (apq[b] == T(0));
+						const T den = z ? T(1) : T(2) * apq[b];
+						const T theta = (aqq[b] - app[b]) / den;
+						const T at = std::abs(theta);
+						T t = T(1) / (at + std::sqrt(theta * theta + T(1)));
+						t = theta < T(0) ? -t : t;
+						t = z ? T(0) : t;
+
+						const T cv = T(1) / std::sqrt(t * t + T(1));
+						c[b] = cv;
+						s[b] = t * cv;
+					}
+
+					// columns p and q: A <- A J
+
+					T *cp = A + p * n * W;
+					T *cq = A + q * n * W;
+					for (index_t k = 0; k < n * W; k += W)
+						for (index_t b = 0; b < W; ++b)
+						{
+							const T x = cp[k + b];
+							const T y = cq[k + b];
+							cp[k + b] = c[b] * x - s[b] * y;
+							cq[k + b] = s[b] * x + c[b] * y;
+						}
+
+					// rows p and q: A <- J^T A
+
+					for (index_t k = 0; k < n; ++k)
+					{
+						T *rp = A + (p + k * n) * W;
+						T *rq = A + (q + k * n) * W;
+						for (index_t b = 0; b < W; ++b)
+						{
+							const T x = rp[b];
+							const T y = rq[b];
+							rp[b] = c[b] * x - s[b] * y;
+							rq[b] = s[b] * x + c[b] * y;
+						}
+					}
+
+					T *apq_ = A + (p + q * n) * W;
+					T *aqp_ = A + (q + p * n) * W;
+					for (index_t b = 0; b < W; ++b) apq_[b] = aqp_[b] = T(0);
+
+					if (V)
+					{
+						T *vp = V + p * n * W;
+						T *vq = V + q * n * W;
+						for (index_t k = 0; k < n * W; k += W)
+							for (index_t b = 0; b < W; ++b)
+							{
+								const T x = vp[k + b];
+								const T y = vq[k + b];
+								vp[k + b] = c[b] * x - s[b] * y;
+								vq[k + b] = s[b] * x + c[b] * y;
+							}
+					}
+				}
+			}
+		}
+
+		template<typename T>
+		void symeig_jacobi(index_t n, index_t nb, const T *a, T *evs, T *U)
+		{
+			const index_t W = symeig_jacobi_width;
+			const index_t nn = n * n;
+			const index_t ngrps = (nb + W - 1) / W;
+
+			parallel_for_chunks(ngrps, 16, [&](index_t g0, index_t g1)
+			{
+				std::vector<T> A(static_cast<size_t>(nn * W));
+				std::vector<T> V(U ? static_cast<size_t>(nn * W) : 0);
+				std::vector<index_t> perm(static_cast<size_t>(n));
+				T buf[3 * symeig_jacobi_width];
+
+				for (index_t g = g0; g < g1; ++g)
+				{
+					const index_t b0 = g * W;
+					const index_t nl = nb - b0 < W ? nb - b0 : W;
+
+					// interleave, padding the tail with zero matrices
+
+					for (index_t k = 0; k < nn; ++k)
+					{
+						T *ak = A.data() + k * W;
+						for (index_t b = 0; b < nl; ++b) ak[b] = a[(b0 + b) * nn + k];
+						for (index_t b = nl; b < W; ++b) ak[b] = T(0);
+					}
+
+					symeig_jacobi_group(n, A.data(), U ? V.data() : static_cast<T*>(0), buf);
+
+					// de-interleave, in descending order of eigenvalues
+
+					for (index_t b = 0; b < nl; ++b)
+					{
+						for (index_t i = 0; i < n; ++i)
+						{
+							const T e = A[(i + i * n) * W + b];
+							index_t j = i;
+							for (; j > 0 && A[(perm[j-1] + perm[j-1] * n) * W + b] < e; --j)
+								perm[j] = perm[j-1];
+							perm[j] = i;
+						}
+
+						T *ev = evs + (b0 + b) * n;
+						for (index_t i = 0; i < n; ++i)
+							ev[i] = A[(perm[i] + perm[i] * n) * W + b];
+
+						if (U)
+						{
+							T *u = U + (b0 + b) * nn;
+							for (index_t j = 0; j < n; ++j)
+							{
+								const T *vj = V.data() + perm[j] * n * W + b;
+								for (index_t i = 0; i < n; ++i) u[i + j * n] = vj[i * W];
+							}
+						}
+					}
+				}
+			});
+		}
+	}
+
+
+	/**
+	 * Eigen-decomposition of a batch of nb symmetric n x n matrices.
+	 *
+	 * The matrices are stacked in a, with the b-th one occupying
+	 * a[b * n * n, (b+1) * n * n) in column-major order. The eigenvalues
+	 * of each matrix are written to evs[b * n, (b+1) * n) in descending
+	 * order, and, unless U is null, the corresponding eigenvectors to
+	 * the columns of U[b * n * n, (b+1) * n * n).
+	 *
+	 * 2 x 2 and 3 x 3 matrices are solved in closed form; larger ones by
+	 * cyclic Jacobi, vectorized across groups of matrices. The latter is
+	 * intended for small n, for which it beats per-matrix LAPACK calls.
+	 */
+	template<typename T>
+	void batch_symeig(index_t n, index_t nb, const T *a, T *evs, T *U)
+	{
+		static_assert(std::is_floating_point<T>::value,
+				"T must be floating-point types.");
+
+		check_arg(n >= 1, "batch_symeig: n must be positive.");
+
+		const index_t nn = n * n;
+
+		if (n == 1)
+		{
+			for (index_t b = 0; b < nb; ++b)
+			{
+				evs[b] = a[b];
+				if (U) U[b] = T(1);
+			}
+		}
+		else if (n == 2)
+		{
+			parallel_for_chunks(nb, 1024, [&](index_t b0, index_t b1)
+			{
+				for (index_t b = b0; b < b1; ++b)
+					internal::symeig2(a + b * nn, evs + b * n, U ? U + b * nn : U);
+			});
+		}
+		else if (n == 3)
+		{
+			parallel_for_chunks(nb, 1024, [&](index_t b0, index_t b1)
+			{
+				for (index_t b = b0; b < b1; ++b)
+					internal::symeig3(a + b * nn, evs + b * n, U ? U + b * nn : U);
+			});
+		}
+		else
+		{
+			internal::symeig_jacobi(n, nb, a, evs, U);
+		}
+	}
+
+	template<typename T>
+	DOLPHIN_ENSURE_INLINE
+	inline void batch_symeig(index_t n, index_t nb, const T *a, T *evs)
+	{
+		batch_symeig(n, nb, a, evs, static_cast<T*>(0));
+	}
+
+	/**
+	 * Batched eigen-decomposition with matrices as the columns of a
+	 * ((n * n) x nb), eigenvalues as the columns of evs (n x nb), and
+	 * eigenvectors as the columns of U ((n * n) x nb).
+	 */
+	template<typename T, class A, class E>
+	inline void batch_symeig(index_t n, const IRegularMatrix<A, T>& a, IRegularMatrix<E, T>& evs)
+	{
+		static_assert(is_contiguous<A>::value, "a must be contiguous");
+		static_assert(is_contiguous<E>::value, "evs must be contiguous");
+
+		const index_t nb = a.ncolumns();
+		check_arg(a.nrows() == n * n, "batch_symeig: the size of a is invalid.");
+		check_arg(evs.nrows() == n && evs.ncolumns() == nb, "batch_symeig: the size of evs is invalid.");
+
+		batch_symeig(n, nb, a.derived().ptr_data(), evs.derived().ptr_data());
+	}
+
+	template<typename T, class A, class E, class U>
+	inline void batch_symeig(index_t n, const IRegularMatrix<A, T>& a, IRegularMatrix<E, T>& evs,
+			IRegularMatrix<U, T>& evecs)
+	{
+		static_assert(is_contiguous<A>::value, "a must be contiguous");
+		static_assert(is_contiguous<E>::value, "evs must be contiguous");
+		static_assert(is_contiguous<U>::value, "evecs must be contiguous");
+
+		const index_t nb = a.ncolumns();
+		check_arg(a.nrows() == n * n, "batch_symeig: the size of a is invalid.");
+		check_arg(evs.nrows() == n && evs.ncolumns() == nb, "batch_symeig: the size of evs is invalid.");
+		check_arg(evecs.nrows() == n * n && evecs.ncolumns() == nb, "batch_symeig: the size of evecs is invalid.");
+
+		batch_symeig(n, nb, a.derived().ptr_data(), evs.derived().ptr_data(),
+				evecs.derived().ptr_data());
+	}
+
+}
+
+#endif
@@ -14,6 +14,8 @@
 #define DOLPHIN_COMMON_CALC_H_
 
 #include <dolphin/common/import_lmat.h>
+#include <dolphin/common/mixed_precision.h>
+#include <limits>
 
 namespace dolphin
 {
@@ -74,6 +76,84 @@ namespace dolphin
 	};
 
 
+	/**
+	 * Computes r[j] = log(sum_i exp(a(i, j))) for each column of a,
+	 * shifting each column by its maximum. With no rows, each r[j]
+	 * is the logsumexp of an empty set, i.e. -inf.
+	 */
+	template<typename T, class A, class R>
+	void colwise_logsumexp(const IRegularMatrix<A, T>& a, IRegularMatrix<R, T>& r)
+	{
+		static_assert(is_percol_contiguous<A>::value, "a must be percol-contiguous");
+		static_assert(supports_linear_index<R>::value, "r must support linear indexing");
+
+		const index_t m = a.nrows();
+		const index_t n = a.ncolumns();
+		LMAT_CHECK_DIMS( r.nelems() == n )
+
+		const A& a_ = a.derived();
+		R& r_ = r.derived();
+
+		if (m == 0)
+		{
+			for (index_t j = 0; j < n; ++j) r_[j] = -std::numeric_limits<T>::infinity();
+			return;
+		}
+
+		for (index_t j = 0; j < n; ++j)
+		{
+			const T *aj = a_.ptr_col(j);
+
+			T mx = aj[0];
+			for (index_t i = 1; i < m; ++i) if (aj[i] > mx) mx = aj[i];
+
+			T s(0);
+			for (index_t i = 0; i < m; ++i) s += math::exp(aj[i] - mx);
+			r_[j] = mx + math::log(s);
+		}
+	}
+
+	/**
+	 * Replaces each column of a by exp(a(:, j)) / sum(exp(a(:, j))),
+	 * and writes the log-normalizers (logsumexp of the columns) to r.
+	 * With no rows, a is left as is and each r[j] is -inf.
+	 */
+	template<typename T, class A, class R>
+	void colwise_nrmexp_inplace(IRegularMatrix<A, T>& a, IRegularMatrix<R, T>& r)
+	{
+		static_assert(is_percol_contiguous<A>::value, "a must be percol-contiguous");
+		static_assert(supports_linear_index<R>::value, "r must support linear indexing");
+
+		const index_t m = a.nrows();
+		const index_t n = a.ncolumns();
+		LMAT_CHECK_DIMS( r.nelems() == n )
+
+		A& a_ = a.derived();
+		R& r_ = r.derived();
+
+		if (m == 0)
+		{
+			for (index_t j = 0; j < n; ++j) r_[j] = -std::numeric_limits<T>::infinity();
+			return;
+		}
+
+		for (index_t j = 0; j < n; ++j)
+		{
+			T *aj = a_.ptr_col(j);
+
+			T mx = aj[0];
+			for (index_t i = 1; i < m; ++i) if (aj[i] > mx) mx = aj[i];
+
+			T s(0);
+			for (index_t i = 0; i < m; ++i) s += (aj[i] = math::exp(aj[i] - mx));
+
+			const T c = math::rcp(s);
+			for (index_t i = 0; i < m; ++i) aj[i] *= c;
+			r_[j] = mx + math::log(s);
+		}
+	}
+
+
 	template<typename T, class P>
 	inline T entropy(const IEWiseMatrix<P, T>& p)
 	{
@@ -95,6 +175,73 @@ namespace dolphin
 	}
 
 
+	// entropies of stored values, accumulated in a wider type
+
+	template<typename TIn, typename TAcc, typename TOut, class P>
+	inline TOut entropy(const IEWiseMatrix<P, TIn>& p, mixed_precision<TIn, TAcc, TOut>)
+	{
+		typedef mixed_precision<TIn, TAcc, TOut> policy_t;
+
+		const index_t n = p.nelems();
+		auto rd = lmat::make_vec_accessor(lmat::scalar_(), in_(p.derived()));
+
+		TAcc s(0);
+		for (index_t i = 0; i < n; ++i) s += math::xlogx(policy_t::widen(rd.scalar(i)));
+		return policy_t::narrow(-s);
+	}
+
+	template<typename TIn, typename TAcc, typename TOut, class P, class R>
+	void colwise_entropy(const IRegularMatrix<P, TIn>& p, IRegularMatrix<R, TOut>& r,
+			mixed_precision<TIn, TAcc, TOut>)
+	{
+		static_assert(is_percol_contiguous<P>::value, "p must be percol-contiguous");
+		static_assert(supports_linear_index<R>::value, "r must support linear indexing");
+		typedef mixed_precision<TIn, TAcc, TOut> policy_t;
+
+		const index_t m = p.nrows();
+		const index_t n = p.ncolumns();
+		LMAT_CHECK_DIMS( r.nelems() == n )
+
+		const P& p_ = p.derived();
+		R& r_ = r.derived();
+
+		for (index_t j = 0; j < n; ++j)
+		{
+			const TIn *pj = p_.ptr_col(j);
+
+			TAcc s(0);
+			for (index_t i = 0; i < m; ++i) s += math::xlogx(policy_t::widen(pj[i]));
+			r_[j] = policy_t::narrow(-s);
+		}
+	}
+
+	template<typename TIn, typename TAcc, typename TOut, class P, class R>
+	void rowwise_entropy(const IRegularMatrix<P, TIn>& p, IRegularMatrix<R, TOut>& r,
+			mixed_precision<TIn, TAcc, TOut>)
+	{
+		static_assert(is_percol_contiguous<P>::value, "p must be percol-contiguous");
+		static_assert(supports_linear_index<R>::value, "r must support linear indexing");
+		typedef mixed_precision<TIn, TAcc, TOut> policy_t;
+
+		const index_t m = p.nrows();
+		const index_t n = p.ncolumns();
+		LMAT_CHECK_DIMS( r.nelems() == m )
+
+		const P& p_ = p.derived();
+		R& r_ = r.derived();
+
+		dense_col<TAcc> s(m, zero());
+		for (index_t j = 0; j < n; ++j)
+		{
+			const TIn *pj = p_.ptr_col(j);
+			for (index_t i = 0; i < m; ++i) s[i] += math::xlogx(policy_t::widen(pj[i]));
+		}
+
+		for (index_t i = 0; i < m; ++i) r_[i] = policy_t::narrow(-s[i]);
+	}
+
+
+
 }
 
 #endif
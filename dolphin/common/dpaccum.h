@@ -14,6 +14,7 @@
 #define LIGHTMAT_DPACCUM_H_
 
 #include <dolphin/common/import_lmat.h>
+#include <dolphin/common/mixed_precision.h>
 #include <light_mat/mateval/mat_reduce.h>
 
 namespace dolphin
@@ -156,6 +157,52 @@ namespace dolphin
 		dispatch_accum(values, I, result, lmat::minimum_kernel<T>());
 	}
 
+	/**
+	 * dispatch_sum of stored values, accumulated in a wider type:
+	 * result is widened, updated, and narrowed back once.
+	 */
+	template<typename TI, class ISubs, typename TIn, typename TAcc, typename TOut,
+		class Values, class Result>
+	inline typename std::enable_if<
+		lmat::supports_linear_access<ISubs>::value &&
+		lmat::supports_linear_access<Values>::value &&
+		supports_linear_index<Result>::value,
+	void>::type
+	dispatch_sum(
+			const IEWiseMatrix<Values, TIn>& values,
+			const IEWiseMatrix<ISubs, TI>& I,
+			IRegularMatrix<Result, TOut>& result,
+			mixed_precision<TIn, TAcc, TOut>)
+	{
+		typedef mixed_precision<TIn, TAcc, TOut> policy_t;
+
+		const Values& v = values.derived();
+		Result& r = result.derived();
+
+		const index_t n = v.nelems();
+		const index_t K = r.nelems();
+
+		check_arg(I.nelems() == n, "The sizes of I and values are inconsistent.");
+
+		auto rd_l = lmat::make_vec_accessor(lmat::scalar_(), in_(I.derived()));
+		auto rd_v = lmat::make_vec_accessor(lmat::scalar_(), in_(v));
+
+		dense_col<TAcc> acc(K);
+		for (index_t k = 0; k < K; ++k) acc[k] = static_cast<TAcc>(r[k]);
+
+		for (index_t i = 0; i < n; ++i)
+		{
+			index_t k = static_cast<index_t>(rd_l.scalar(i));
+
+			if (k >= 0 && k < K)
+			{
+				acc[k] += policy_t::widen(rd_v.scalar(i));
+			}
+		}
+
+		for (index_t k = 0; k < K; ++k) r[k] = policy_t::narrow(acc[k]);
+	}
+
 
 	template<typename TI, class ISubs, class JSubs,
 		typename T, class Values, class Result, class Kernel>
@@ -228,6 +275,58 @@ namespace dolphin
 		dispatch_accum(values, I, J, result, lmat::minimum_kernel<T>());
 	}
 
+	template<typename TI, class ISubs, class JSubs, typename TIn, typename TAcc, typename TOut,
+		class Values, class Result>
+	inline typename std::enable_if<
+		lmat::supports_linear_access<ISubs>::value &&
+		lmat::supports_linear_access<JSubs>::value &&
+		lmat::supports_linear_access<Values>::value &&
+		supports_linear_index<Result>::value,
+	void>::type
+	dispatch_sum(
+			const IEWiseMatrix<Values, TIn>& values,
+			const IEWiseMatrix<ISubs, TI>& I,
+			const IEWiseMatrix<JSubs, TI>& J,
+			IRegularMatrix<Result, TOut>& result,
+			mixed_precision<TIn, TAcc, TOut>)
+	{
+		typedef mixed_precision<TIn, TAcc, TOut> policy_t;
+
+		const Values& v = values.derived();
+		Result& r = result.derived();
+
+		const index_t n = v.nelems();
+		const index_t M = r.nrows();
+		const index_t N = r.ncolumns();
+
+		check_arg(I.nelems() == n && J.nelems() == n,
+				"The sizes of I, J, and values are inconsistent.");
+
+		auto rd_i = lmat::make_vec_accessor(lmat::scalar_(), in_(I));
+		auto rd_j = lmat::make_vec_accessor(lmat::scalar_(), in_(J));
+		auto rd_v = lmat::make_vec_accessor(lmat::scalar_(), in_(v));
+
+		dense_matrix<TAcc> acc(M, N);
+		for (index_t cj = 0; cj < N; ++cj)
+			for (index_t ci = 0; ci < M; ++ci)
+				acc(ci, cj) = static_cast<TAcc>(r(ci, cj));
+
+		for (index_t i = 0; i < n; ++i)
+		{
+			index_t ci = static_cast<index_t>(rd_i.scalar(i));
+			index_t cj = static_cast<index_t>(rd_j.scalar(i));
+
+			if (ci >= 0 && ci < M && cj >= 0 && cj < N)
+			{
+				acc(ci, cj) += policy_t::widen(rd_v.scalar(i));
+			}
+		}
+
+		for (index_t cj = 0; cj < N; ++cj)
+			for (index_t ci = 0; ci < M; ++ci)
+				r(ci, cj) = policy_t::narrow(acc(ci, cj));
+	}
+
 
 	template<typename TI, class JSubs, typename T, class Values, class Result, class Kernel>
 	inline typename std::enable_if<
@@ -305,6 +404,60 @@ namespace dolphin
 		dispatch_accum_cols(values, J, result, lmat::minimum_kernel<T>());
 	}
 
+	template<typename TI, class JSubs, typename TIn, typename TAcc, typename TOut,
+		class Values, class Result>
+	inline typename std::enable_if<
+		lmat::supports_linear_access<JSubs>::value &&
+		is_percol_contiguous<Values>::value &&
+		is_percol_contiguous<Result>::value,
+	void>::type
+	dispatch_sum_cols(
+			const IEWiseMatrix<Values, TIn>& values,
+			const IEWiseMatrix<JSubs, TI>& J,
+			IRegularMatrix<Result, TOut>& result,
+			mixed_precision<TIn, TAcc, TOut>)
+	{
+		typedef mixed_precision<TIn, TAcc, TOut> policy_t;
+
+		const Values& v = values.derived();
+		Result& r = result.derived();
+
+		const index_t m = v.nrows();
+		const index_t n = v.ncolumns();
+		const index_t K = r.ncolumns();
+
+		check_arg( J.nelems() == n, "The sizes of J and values are inconsistent" );
+		check_arg( r.nrows() == m, "The numbers of rows in values and result are inconsistent." );
+
+		auto rd_j = lmat::make_vec_accessor(lmat::scalar_(), in_(J.derived()));
+
+		dense_matrix<TAcc> acc(m, K);
+		for (index_t k = 0; k < K; ++k)
+		{
+			const TOut *rk = r.ptr_col(k);
+			TAcc *ak = acc.ptr_col(k);
+			for (index_t i = 0; i < m; ++i) ak[i] = static_cast<TAcc>(rk[i]);
+		}
+
+		for (index_t j = 0; j < n; ++j)
+		{
+			index_t cj = static_cast<index_t>(rd_j.scalar(j));
+			if (cj >= 0 && cj < K)
+			{
+				const TIn *vj = v.ptr_col(j);
+				TAcc *ak = acc.ptr_col(cj);
+				for (index_t i = 0; i < m; ++i) ak[i] += policy_t::widen(vj[i]);
+			}
+		}
+
+		for (index_t k = 0; k < K; ++k)
+		{
+			const TAcc *ak = acc.ptr_col(k);
+			TOut *rk = r.ptr_col(k);
+			for (index_t i = 0; i < m; ++i) rk[i] = policy_t::narrow(ak[i]);
+		}
+	}
+
 
 	template<typename TI, class ISubs, typename T, class Values, class Result, class Kernel>
 	inline typename std::enable_if<
@@ -0,0 +1,247 @@
+/**
+ * @file half.h
+ *
+ * @brief 16-bit floating-point storage types
+ *
+ * @author Dahua Lin
+ */
+
+#ifdef _MSC_VER
+#pragma once
+#endif
+
+#ifndef DOLPHIN_HALF_H_
+#define DOLPHIN_HALF_H_
+
+#include <dolphin/common/mixed_precision.h>
+#include <cstring>
+
+#if defined(__F16C__) || defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+namespace dolphin
+{
+	/********************************************
+	 *
+	 *  half_t and bfloat16_t
+	 *
+	 *  Storage-only types: IEEE binary16, and the
+	 *  upper half of a binary32 (bfloat16). They
+	 *  convert explicitly to and from float (with
+	 *  rounding to nearest even), and arithmetic
+	 *  is done on the converted values, e.g. with
+	 *  the mixed-precision metrics under the
+	 *  half_acc_float and bf16_acc_float policies.
+	 *
+	 ********************************************/
+
+	namespace internal
+	{
+		DOLPHIN_ENSURE_INLINE
+		inline uint32_t float_bits(float x)
+		{
+			uint32_t u;
+			std::memcpy(&u, &x, sizeof(u));
+			return u;
+		}
+
+		DOLPHIN_ENSURE_INLINE
+		inline float bits_float(uint32_t u)
+		{
+			float x;
+			std::memcpy(&x, &u, sizeof(x));
+			return x;
+		}
+
+		inline float half_to_float(uint16_t h)
+		{
+#if defined(__F16C__)
+			return _cvtsh_ss(h);
+#else
+			const uint32_t sign = uint32_t(h & 0x8000) << 16;
+			const uint32_t em = h & 0x7fff;
+
+			if (em >= 0x7c00)		// inf or nan
+				return bits_float(sign | 0x7f800000 | ((em & 0x3ff) << 13));
+
+			if (em >= 0x0400)		// normal
+				return bits_float(sign | ((em + ((127 - 15) << 10)) << 13));
+
+			// zero or subnormal: em * 2^-24, exact in float
+			const float v = float(em) * 5.9604644775390625e-8f;
+			return bits_float(sign | float_bits(v));
+#endif
+		}
+
+		inline uint16_t float_to_half(float x)
+		{
+#if defined(__F16C__)
+			return static_cast<uint16_t>(_cvtss_sh(x, 0));
+#else
+			const uint32_t u = float_bits(x);
+			const uint16_t sign = static_cast<uint16_t>((u >> 16) & 0x8000);
+			const uint32_t a = u & 0x7fffffff;
+
+			if (a >= 0x7f800000)	// inf or nan (kept quiet)
+				return sign | (a > 0x7f800000 ? 0x7e00 : 0x7c00);
+
+			if (a >= 0x477ff000)	// rounds beyond the largest half
+				return sign | 0x7c00;
+
+			if (a < 0x38800000)		// below the smallest normal half
+			{
+				// the float sum rounds a to a multiple of 2^-24
+				const float v = bits_float(a) + 0.5f;
+				return sign | static_cast<uint16_t>(float_bits(v) - float_bits(0.5f));
+			}
+
+			// round the 13 dropped mantissa bits to nearest even
+			const uint32_t r = a + ((uint32_t(15 - 127) << 23) + 0xfff + ((a >> 13) & 1));
+			return sign | static_cast<uint16_t>(r >> 13);
+#endif
+		}
+
+		DOLPHIN_ENSURE_INLINE
+		inline float bf16_to_float(uint16_t h)
+		{
+			return bits_float(uint32_t(h) << 16);
+		}
+
+		inline uint16_t float_to_bf16(float x)
+		{
+			const uint32_t u = float_bits(x);
+			if ((u & 0x7fffffff) > 0x7f800000)	// nan (kept quiet)
+				return static_cast<uint16_t>((u >> 16) | 0x0040);
+
+			return static_cast<uint16_t>((u + 0x7fff + ((u >> 16) & 1)) >> 16);
+		}
+	}
+
+
+	struct half_t
+	{
+		uint16_t bits;
+
+		DOLPHIN_ENSURE_INLINE
+		half_t() { }
+
+		DOLPHIN_ENSURE_INLINE
+		explicit half_t(float x) : bits(internal::float_to_half(x)) { }
+
+		DOLPHIN_ENSURE_INLINE
+		explicit operator float() const
+		{
+			return internal::half_to_float(bits);
+		}
+
+		DOLPHIN_ENSURE_INLINE
+		explicit operator double() const
+		{
+			return internal::half_to_float(bits);
+		}
+	};
+
+	struct bfloat16_t
+	{
+		uint16_t bits;
+
+		DOLPHIN_ENSURE_INLINE
+		bfloat16_t() { }
+
+		DOLPHIN_ENSURE_INLINE
+		explicit bfloat16_t(float x) : bits(internal::float_to_bf16(x)) { }
+
+		DOLPHIN_ENSURE_INLINE
+		explicit operator float() const
+		{
+			return internal::bf16_to_float(bits);
+		}
+
+		DOLPHIN_ENSURE_INLINE
+		explicit operator double() const
+		{
+			return internal::bf16_to_float(bits);
+		}
+	};
+
+	typedef mixed_precision<half_t, float, float> half_acc_float;
+	typedef mixed_precision<bfloat16_t, float, float> bf16_acc_float;
+
+
+	/********************************************
+	 *
+	 *  bulk conversion
+	 *
+	 *  widen_values overloads for the loops that
+	 *  widen blocks of stored values (see
+	 *  mixed_precision::widen_n), eight values
+	 *  per instruction with F16C, AVX2 or SSE2.
+	 *
+	 ********************************************/
+
+	inline void widen_values(const half_t *src, float *dst, index_t n)
+	{
+		index_t i = 0;
+
+#if defined(__F16C__)
+		for (; i + 8 <= n; i += 8)
+		{
+			__m128i h = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+			_mm256_storeu_ps(dst + i, _mm256_cvtph_ps(h));
+		}
+#endif
+		for (; i < n; ++i) dst[i] = internal::half_to_float(src[i].bits);
+	}
+
+	inline void widen_values(const bfloat16_t *src, float *dst, index_t n)
+	{
+		index_t i = 0;
+
+#if defined(__AVX2__)
+		for (; i + 8 <= n; i += 8)
+		{
+			__m128i h = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+			__m256i w = _mm256_slli_epi32(_mm256_cvtepu16_epi32(h), 16);
+			_mm256_storeu_ps(dst + i, _mm256_castsi256_ps(w));
+		}
+#elif defined(__SSE2__)
+		const __m128i z = _mm_setzero_si128();
+		for (; i + 8 <= n; i += 8)
+		{
+			__m128i h = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+			_mm_storeu_ps(dst + i, _mm_castsi128_ps(_mm_unpacklo_epi16(z, h)));
+			_mm_storeu_ps(dst + i + 4, _mm_castsi128_ps(_mm_unpackhi_epi16(z, h)));
+		}
+#endif
+		for (; i < n; ++i) dst[i] = internal::bf16_to_float(src[i].bits);
+	}
+
+	/**
+	 * Converts n floats to half_t, rounding to nearest even.
+	 */
+	inline void narrow_values(const float *src, half_t *dst, index_t n)
+	{
+		index_t i = 0;
+
+#if defined(__F16C__)
+		for (; i + 8 <= n; i += 8)
+		{
+			__m128i h = _mm256_cvtps_ph(_mm256_loadu_ps(src + i), 0);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), h);
+		}
+#endif
+		for (; i < n; ++i) dst[i].bits = internal::float_to_half(src[i]);
+	}
+
+	/**
+	 * Converts n floats to bfloat16_t, rounding to nearest even.
+	 */
+	inline void narrow_values(const float *src, bfloat16_t *dst, index_t n)
+	{
+		for (index_t i = 0; i < n; ++i) dst[i].bits = internal::float_to_bf16(src[i]);
+	}
+
+}
+
+#endif
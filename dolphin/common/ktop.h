@@ -0,0 +1,608 @@
+/**
+ * @file ktop.h
+ *
+ * @brief Finding k smallest/largest values
+ *
+ * @author Dahua Lin
+ */
+
+#ifdef _MSC_VER
+#pragma once
+#endif
+
+#ifndef DOLPHIN_KTOP_H_
+#define DOLPHIN_KTOP_H_
+
+#include <dolphin/common/import_lmat.h>
+#include <dolphin/common/parallel.h>
+#include <functional>
+#include <vector>
+#include <cstring>
+#include <type_traits>
+
+namespace dolphin
+{
+	namespace internal
+	{
+		/********************************************
+		 *
+		 *  NaN policy
+		 *
+		 *  For floating-point values, NaNs rank after
+		 *  all numbers under any order, so they are
+		 *  selected only when there are fewer than k
+		 *  numbers. ktop_order wraps the comparator
+		 *  accordingly; other types use it as is.
+		 *
+		 ********************************************/
+
+		template<typename T, class Comp>
+		struct nan_last
+		{
+			Comp comp;
+
+			DOLPHIN_ENSURE_INLINE
+			explicit nan_last(const Comp& c) : comp(c) { }
+
+			DOLPHIN_ENSURE_INLINE
+			bool operator() (const T& a, const T& b) const
+			{
+				return a == a && (b != b || comp(a, b));
+			}
+		};
+
+		template<typename T, class Comp, bool IsFP=std::is_floating_point<T>::value>
+		struct ktop_order
+		{
+			typedef Comp type;
+
+			DOLPHIN_ENSURE_INLINE
+			static const Comp& get(const Comp& c) { return c; }
+		};
+
+		template<typename T, class Comp>
+		struct ktop_order<T, Comp, true>
+		{
+			typedef nan_last<T, Comp> type;
+
+			DOLPHIN_ENSURE_INLINE
+			static type get(const Comp& c) { return type(c); }
+		};
+
+
+		/********************************************
+		 *
+		 *  bounded heap
+		 *
+		 *  The heap lives in the output buffers. Its
+		 *  root is the worst of the kept values under
+		 *  comp (e.g. the largest for std::less), so
+		 *  a new value enters iff comp(v, root).
+		 *
+		 ********************************************/
+
+		template<typename T, class Comp>
+		DOLPHIN_ENSURE_INLINE
+		inline void ktop_sift_down(T *vals, index_t *inds, index_t len, index_t pos,
+				const T& v, index_t idx, const Comp& comp)
+		{
+			index_t c;
+			while ((c = 2 * pos + 1) < len)
+			{
+				if (c + 1 < len && comp(vals[c], vals[c + 1])) ++c;
+				if (!comp(v, vals[c])) break;
+
+				vals[pos] = vals[c];
+				if (inds) inds[pos] = inds[c];
+				pos = c;
+			}
+
+			vals[pos] = v;
+			if (inds) inds[pos] = idx;
+		}
+
+		template<typename T, class Comp>
+		inline void ktop_heapify(T *vals, index_t *inds, index_t k, const Comp& comp)
+		{
+			for (index_t p = k / 2 - 1; p >= 0; --p)
+			{
+				const T v = vals[p];
+				const index_t idx = inds ? inds[p] : 0;
+				ktop_sift_down(vals, inds, k, p, v, idx, comp);
+			}
+		}
+
+		template<typename T, class Comp>
+		inline void ktop_heapsort(T *vals, index_t *inds, index_t k, const Comp& comp)
+		{
+			for (index_t e = k - 1; e > 0; --e)
+			{
+				const T v = vals[e];
+				const index_t idx = inds ? inds[e] : 0;
+
+				vals[e] = vals[0];
+				if (inds) inds[e] = inds[0];
+
+				ktop_sift_down(vals, inds, e, 0, v, idx, comp);
+			}
+		}
+
+		/**
+		 * Streams x[i0, n) through a full heap of size k.
+		 *
+		 * Elements are tested against the current threshold in
+		 * chunks, with a branch-free test that the compiler can
+		 * vectorize, so that the common case of no candidate in a
+		 * chunk costs one predictable branch per chunk.
+		 */
+		template<typename T, class Comp>
+		inline void ktop_stream(const T *x, index_t i0, index_t n,
+				T *vals, index_t *inds, index_t k, const Comp& comp)
+		{
+			const index_t W = 16;
+			index_t i = i0;
+
+			for (; i + W <= n; i += W)
+			{
+				const T thres = vals[0];
+
+				int hit = 0;
+				for (index_t u = 0; u < W; ++u)
+					hit |= int(comp(x[i + u], thres));
+
+				if (hit)
+				{
+					for (index_t u = 0; u < W; ++u)
+					{
+						if (comp(x[i + u], vals[0]))
+							ktop_sift_down(vals, inds, k, 0, x[i + u], i + u, comp);
+					}
+				}
+			}
+
+			for (; i < n; ++i)
+			{
+				if (comp(x[i], vals[0]))
+					ktop_sift_down(vals, inds, k, 0, x[i], i, comp);
+			}
+		}
+
+
+		/********************************************
+		 *
+		 *  radix select
+		 *
+		 *  Values are mapped to unsigned keys whose
+		 *  integer order agrees with the value order
+		 *  (inverted for descending selection), and
+		 *  the key of the k-th element is located
+		 *  one byte at a time, most significant byte
+		 *  first, from 256-bin histograms.
+		 *
+		 *  ordered(v, flip) gives the key in the
+		 *  selection order, with all NaNs mapped to
+		 *  the largest key (i.e. ranked last).
+		 *
+		 ********************************************/
+
+		template<typename T> struct radix_key;
+
+		template<> struct radix_key<float>
+		{
+			typedef uint32_t type;
+
+			DOLPHIN_ENSURE_INLINE
+			static type get(float v)
+			{
+				uint32_t u;
+				std::memcpy(&u, &v, sizeof(u));
+				return u ^ (static_cast<uint32_t>(-static_cast<int32_t>(u >> 31)) | 0x80000000u);
+			}
+
+			DOLPHIN_ENSURE_INLINE
+			static type ordered(float v, type flip)
+			{
+				return v == v ? get(v) ^ flip : ~type(0);
+			}
+		};
+
+		template<> struct radix_key<double>
+		{
+			typedef uint64_t type;
+
+			DOLPHIN_ENSURE_INLINE
+			static type get(double v)
+			{
+				uint64_t u;
+				std::memcpy(&u, &v, sizeof(u));
+				return u ^ (static_cast<uint64_t>(-static_cast<int64_t>(u >> 63)) | 0x8000000000000000ULL);
+			}
+
+			DOLPHIN_ENSURE_INLINE
+			static type ordered(double v, type flip)
+			{
+				return v == v ? get(v) ^ flip : ~type(0);
+			}
+		};
+
+		template<> struct radix_key<int32_t>
+		{
+			typedef uint32_t type;
+
+			DOLPHIN_ENSURE_INLINE
+			static type get(int32_t v)
+			{
+				return static_cast<uint32_t>(v) ^ 0x80000000u;
+			}
+
+			DOLPHIN_ENSURE_INLINE
+			static type ordered(int32_t v, type flip)
+			{
+				return get(v) ^ flip;
+			}
+		};
+
+		template<typename T, class Comp>
+		struct radix_order
+		{
+			static const bool supported = false;
+			static const bool descending = false;
+		};
+
+		template<typename T>
+		struct radix_order<T, std::less<T> >
+		{
+			static const bool supported = true;
+			static const bool descending = false;
+		};
+
+		template<typename T>
+		struct radix_order<T, std::greater<T> >
+		{
+			static const bool supported = true;
+			static const bool descending = true;
+		};
+
+		template<typename T, class Comp>
+		struct radix_ktop_applicable
+		{
+			static const bool value = radix_order<T, Comp>::supported && (
+					std::is_same<T, float>::value ||
+					std::is_same<T, double>::value ||
+					std::is_same<T, int32_t>::value);
+		};
+
+		// find_ktop switches to radix select when n >= radix_ktop_min_n
+		// and k >= n / radix_ktop_max_ratio. For smaller k, most chunks
+		// of the stream never reach the heap, which makes the streaming
+		// heap the faster of the two.
+
+		const index_t radix_ktop_min_n = index_t(1) << 16;
+		const index_t radix_ktop_max_ratio = 64;
+
+		template<typename T, class Comp>
+		inline typename radix_key<T>::type radix_ktop_threshold(const T *x, index_t n, index_t k,
+				index_t& neq)
+		{
+			typedef typename radix_key<T>::type key_t;
+			const key_t flip = radix_order<T, Comp>::descending ? ~key_t(0) : key_t(0);
+
+			index_t rank = k - 1;	// rank of the k-th element among the candidates
+			index_t cnt[256];
+
+			int shift = static_cast<int>(sizeof(key_t) * 8) - 8;
+
+			// first pass: over the whole input
+
+			std::fill(cnt, cnt + 256, index_t(0));
+			for (index_t i = 0; i < n; ++i)
+				++cnt[(radix_key<T>::ordered(x[i], flip) >> shift) & 0xff];
+
+			key_t b = 0;
+			while (rank >= cnt[b]) rank -= cnt[b++];
+
+			key_t prefix = b << shift;
+			index_t m = cnt[b];
+
+			// subsequent passes: over the gathered candidates
+
+			std::vector<key_t> cand;
+			if (shift > 0 && m > 1)
+			{
+				cand.resize(static_cast<size_t>(m));
+				index_t p = 0;
+				for (index_t i = 0; i < n; ++i)
+				{
+					key_t v = radix_key<T>::ordered(x[i], flip);
+					if ((v >> shift) == (prefix >> shift)) cand[p++] = v;
+				}
+			}
+			else if (m == 1)
+			{
+				for (index_t i = 0; i < n; ++i)
+				{
+					key_t v = radix_key<T>::ordered(x[i], flip);
+					if ((v >> shift) == (prefix >> shift)) { prefix = v; break; }
+				}
+				shift = 0;
+			}
+
+			while (shift > 0 && m > 1)
+			{
+				shift -= 8;
+
+				std::fill(cnt, cnt + 256, index_t(0));
+				for (index_t i = 0; i < m; ++i)
+					++cnt[(cand[i] >> shift) & 0xff];
+
+				b = 0;
+				while (rank >= cnt[b]) rank -= cnt[b++];
+				prefix |= b << shift;
+
+				index_t p = 0;
+				for (index_t i = 0; i < m; ++i)
+				{
+					if (((cand[i] >> shift) & 0xff) == b) cand[p++] = cand[i];
+				}
+				m = p;
+
+				if (m == 1)
+				{
+					prefix = cand[0];
+					shift = 0;
+				}
+			}
+
+			// all remaining candidates equal the threshold key, and
+			// the first rank + 1 of them are selected
+
+			neq = rank + 1;
+			return prefix;
+		}
+
+		template<typename T, class Comp>
+		void radix_ktop(const T *x, index_t n, index_t k, const Comp& comp, T *vals, index_t *inds)
+		{
+			typedef typename radix_key<T>::type key_t;
+			const key_t flip = radix_order<T, Comp>::descending ? ~key_t(0) : key_t(0);
+
+			index_t neq;
+			const key_t t = radix_ktop_threshold<T, Comp>(x, n, k, neq);
+
+			// one filtered pass gathers the selected elements in
+			// input order, then they are sorted in place
+
+			index_t p = 0;
+			for (index_t i = 0; i < n && p < k; ++i)
+			{
+				key_t v = radix_key<T>::ordered(x[i], flip);
+				if (v < t || (v == t && neq > 0))
+				{
+					if (v == t) --neq;
+					vals[p] = x[i];
+					if (inds) inds[p] = i;
+					++p;
+				}
+			}
+
+			typename ktop_order<T, Comp>::type ord = ktop_order<T, Comp>::get(comp);
+			ktop_heapify(vals, inds, k, ord);
+			ktop_heapsort(vals, inds, k, ord);
+		}
+
+		template<typename T, class Comp>
+		DOLPHIN_ENSURE_INLINE
+		inline bool try_radix_ktop(const T *x, index_t n, index_t k, const Comp& comp,
+				T *vals, index_t *inds, std::true_type)
+		{
+			if (n >= radix_ktop_min_n && k * radix_ktop_max_ratio >= n)
+			{
+				radix_ktop(x, n, k, comp, vals, inds);
+				return true;
+			}
+			return false;
+		}
+
+		template<typename T, class Comp>
+		DOLPHIN_ENSURE_INLINE
+		inline bool try_radix_ktop(const T *, index_t, index_t, const Comp&,
+				T *, index_t *, std::false_type)
+		{
+			return false;
+		}
+	}
+
+
+	/**
+	 * Finds the k top elements of x[0, n) under comp.
+	 *
+	 * By default, this is a single streaming pass through a bounded
+	 * heap, with no scratch beyond the outputs. For float, double and
+	 * int32_t values with std::less or std::greater, large inputs with
+	 * a large k go through radix select instead.
+	 *
+	 * With std::less<T>, these are the k smallest values, written to
+	 * vals in ascending order; with std::greater<T>, the k largest,
+	 * in descending order. The (0-based) indices of the selected
+	 * elements are written to inds, unless inds is null.
+	 *
+	 * For floating-point values, NaNs rank after all numbers (under
+	 * either order), and fill the last slots only when x has fewer
+	 * than k numbers.
+	 */
+	template<typename T, class Comp>
+	void find_ktop(const T *x, index_t n, index_t k, Comp comp, T *vals, index_t *inds)
+	{
+		check_arg(k >= 0 && k <= n, "find_ktop: k must be within [0, n].");
+		if (k == 0) return;
+
+		typedef std::integral_constant<bool,
+				internal::radix_ktop_applicable<T, Comp>::value> use_radix;
+
+		if (internal::try_radix_ktop(x, n, k, comp, vals, inds, use_radix())) return;
+
+		typename internal::ktop_order<T, Comp>::type ord = internal::ktop_order<T, Comp>::get(comp);
+
+		for (index_t i = 0; i < k; ++i)
+		{
+			vals[i] = x[i];
+			if (inds) inds[i] = i;
+		}
+
+		internal::ktop_heapify(vals, inds, k, ord);
+		internal::ktop_stream(x, k, n, vals, inds, k, ord);
+		internal::ktop_heapsort(vals, inds, k, ord);
+	}
+
+	template<typename T, class Comp>
+	DOLPHIN_ENSURE_INLINE
+	inline void find_ktop(const T *x, index_t n, index_t k, Comp comp, T *vals)
+	{
+		find_ktop(x, n, k, comp, vals, static_cast<index_t*>(0));
+	}
+
+	/**
+	 * Same as find_ktop, but always uses radix select.
+	 */
+	template<typename T, class Comp>
+	void radix_ktop(const T *x, index_t n, index_t k, Comp comp, T *vals, index_t *inds = 0)
+	{
+		static_assert(internal::radix_ktop_applicable<T, Comp>::value,
+				"radix_ktop only supports float, double, and int32_t with std::less or std::greater.");
+
+		check_arg(k >= 0 && k <= n, "radix_ktop: k must be within [0, n].");
+		if (k == 0) return;
+
+		internal::radix_ktop(x, n, k, comp, vals, inds);
+	}
+
+	/**
+	 * Returns the k-th (1-based) element of x[0, n) in the order
+	 * given by comp (std::less or std::greater), via radix select
+	 * without writing any output array.
+	 *
+	 * NaNs rank after all numbers, as in find_ktop, so the result
+	 * is NaN only when x has fewer than k numbers.
+	 */
+	template<typename T, class Comp>
+	T find_kth(const T *x, index_t n, index_t k, Comp)
+	{
+		static_assert(internal::radix_ktop_applicable<T, Comp>::value,
+				"find_kth only supports float, double, and int32_t with std::less or std::greater.");
+
+		check_arg(k >= 1 && k <= n, "find_kth: k must be within [1, n].");
+
+		typedef typename internal::radix_key<T>::type key_t;
+		const key_t flip = internal::radix_order<T, Comp>::descending ? ~key_t(0) : key_t(0);
+
+		index_t neq;
+		const key_t t = internal::radix_ktop_threshold<T, Comp>(x, n, k, neq);
+
+		index_t i = 0;
+		while (internal::radix_key<T>::ordered(x[i], flip) != t) ++i;
+		return x[i];
+	}
+
+
+	template<typename T, class A, class Comp, class R>
+	inline void find_ktop(const IRegularMatrix<A, T>& a, index_t k, Comp comp,
+			IRegularMatrix<R, T>& r)
+	{
+		static_assert(is_contiguous<A>::value, "a must be contiguous");
+		static_assert(is_contiguous<R>::value, "r must be contiguous");
+		check_arg(r.nelems() == k, "find_ktop: the size of r is invalid.");
+
+		find_ktop(a.derived().ptr_data(), a.nelems(), k, comp, r.derived().ptr_data());
+	}
+
+	template<typename T, class A, class Comp, class R, class I>
+	inline void find_ktop(const IRegularMatrix<A, T>& a, index_t k, Comp comp,
+			IRegularMatrix<R, T>& r, IRegularMatrix<I, index_t>& ri)
+	{
+		static_assert(is_contiguous<A>::value, "a must be contiguous");
+		static_assert(is_contiguous<R>::value, "r must be contiguous");
+		static_assert(is_contiguous<I>::value, "ri must be contiguous");
+		check_arg(r.nelems() == k && ri.nelems() == k, "find_ktop: the size of r or ri is invalid.");
+
+		find_ktop(a.derived().ptr_data(), a.nelems(), k, comp,
+				r.derived().ptr_data(), ri.derived().ptr_data());
+	}
+
+
+	/********************************************
+	 *
+	 *  column-wise k-top
+	 *
+	 *  Columns are processed in parallel. Each
+	 *  thread reuses one index buffer of length
+	 *  k, so the per-column cost involves no
+	 *  allocation.
+	 *
+	 ********************************************/
+
+	template<typename T, class A, class Comp, class R>
+	void colwise_ktop(const IRegularMatrix<A, T>& a, index_t k, Comp comp,
+			IRegularMatrix<R, T>& r)
+	{
+		static_assert(is_percol_contiguous<A>::value, "a must be percol-contiguous");
+		static_assert(is_percol_contiguous<R>::value, "r must be percol-contiguous");
+
+		const index_t m = a.nrows();
+		const index_t n = a.ncolumns();
+		check_arg(k >= 0 && k <= m, "colwise_ktop: k must be within [0, nrows].");
+		check_arg(r.nrows() == k && r.ncolumns() == n, "colwise_ktop: the size of r is invalid.");
+
+		const A& a_ = a.derived();
+		R& r_ = r.derived();
+
+		parallel_for_chunks(n, 16, [&](index_t j0, index_t j1)
+		{
+			for (index_t j = j0; j < j1; ++j)
+				find_ktop(a_.ptr_col(j), m, k, comp, r_.ptr_col(j));
+		});
+	}
+
+	/**
+	 * Column-wise k-top with indices, where ri(i, j) is set to
+	 * base + (row index of r(i, j) in a). A base of 1 gives
+	 * MATLAB-style indices.
+	 */
+	template<typename T, class A, class Comp, class R, typename TI, class I>
+	void colwise_ktop(const IRegularMatrix<A, T>& a, index_t k, Comp comp,
+			IRegularMatrix<R, T>& r, IRegularMatrix<I, TI>& ri, index_t base = 0)
+	{
+		static_assert(is_percol_contiguous<A>::value, "a must be percol-contiguous");
+		static_assert(is_percol_contiguous<R>::value, "r must be percol-contiguous");
+		static_assert(is_percol_contiguous<I>::value, "ri must be percol-contiguous");
+
+		const index_t m = a.nrows();
+		const index_t n = a.ncolumns();
+		check_arg(k >= 0 && k <= m, "colwise_ktop: k must be within [0, nrows].");
+		check_arg(r.nrows() == k && r.ncolumns() == n, "colwise_ktop: the size of r is invalid.");
+		check_arg(ri.nrows() == k && ri.ncolumns() == n, "colwise_ktop: the size of ri is invalid.");
+
+		const A& a_ = a.derived();
+		R& r_ = r.derived();
+		I& ri_ = ri.derived();
+
+		std::vector<std::vector<index_t> > scratch(static_cast<size_t>(max_num_threads()),
+				std::vector<index_t>(static_cast<size_t>(k > 0 ? k : 1)));
+
+		parallel_for_chunks(n, 16, [&](index_t j0, index_t j1)
+		{
+			index_t *inds = scratch[thread_rank()].data();
+
+			for (index_t j = j0; j < j1; ++j)
+			{
+				find_ktop(a_.ptr_col(j), m, k, comp, r_.ptr_col(j), inds);
+
+				TI *pi = ri_.ptr_col(j);
+				for (index_t i = 0; i < k; ++i)
+					pi[i] = static_cast<TI>(inds[i] + base);
+			}
+		});
+	}
+
+}
+
+#endif
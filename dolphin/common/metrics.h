@@ -14,30 +14,47 @@
 #define DOLPHIN_METRICS_H_
 
 #include <dolphin/common/import_lmat.h>
+#include <dolphin/common/half.h>
 #include <light_mat/linalg/blas_l3.h>
+#include <vector>
 #include <tuple>
+#include <limits>
+#include <cstdint>
+#include <type_traits>
 
-#define DOLPHIN_DEF_GENERIC_METRIC_TRAITS(Name, RT, IsPosDef, IsSym) \
+#if defined(__AVX__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#define DOLPHIN_DEF_GENERIC_METRIC_TRAITS_EX(Name, RT, IsPosDef, IsSym, IsGemmDec) \
 	template<typename T> \
 	struct metric_traits<Name<T> > { \
 		typedef T input_type; \
 		typedef RT result_type; \
 		static const bool is_positive_definite = IsPosDef; \
 		static const bool is_symmetric = IsSym; \
+		static const bool is_gemm_decomposable = IsGemmDec; \
 	};
 
-#define DOLPHIN_DEF_GENERIC_WMETRIC_TRAITS(Name, RT, IsPosDef, IsSym) \
+#define DOLPHIN_DEF_GENERIC_WMETRIC_TRAITS_EX(Name, RT, IsPosDef, IsSym, IsGemmDec) \
 	template<typename T, typename W> \
 	struct metric_traits<Name<T, W> > { \
 		typedef T input_type; \
 		typedef RT result_type; \
 		static const bool is_positive_definite = IsPosDef; \
 		static const bool is_symmetric = IsSym; \
+		static const bool is_gemm_decomposable = IsGemmDec; \
 	};
 
-#define DOLPHIN_DEF_GENERIC_METRIC(Name, RT, IsPosDef, IsSym) \
+#define DOLPHIN_DEF_GENERIC_METRIC_TRAITS(Name, RT, IsPosDef, IsSym) \
+	DOLPHIN_DEF_GENERIC_METRIC_TRAITS_EX(Name, RT, IsPosDef, IsSym, false)
+
+#define DOLPHIN_DEF_GENERIC_WMETRIC_TRAITS(Name, RT, IsPosDef, IsSym) \
+	DOLPHIN_DEF_GENERIC_WMETRIC_TRAITS_EX(Name, RT, IsPosDef, IsSym, false)
+
+#define DOLPHIN_DEF_GENERIC_METRIC_EX(Name, RT, IsPosDef, IsSym, IsGemmDec) \
 	template<typename T> class Name; \
-	DOLPHIN_DEF_GENERIC_METRIC_TRAITS(Name, RT, IsPosDef, IsSym) \
+	DOLPHIN_DEF_GENERIC_METRIC_TRAITS_EX(Name, RT, IsPosDef, IsSym, IsGemmDec) \
 	template<typename T> \
 	class Name : public dolphin::IMetric<Name<T> > { \
 	public: \
@@ -49,9 +66,9 @@
 	template<class A, class B> \
 	inline RT Name<T>::operator() (const IEWiseMatrix<A, T>& a, const IEWiseMatrix<B, T>& b) const
 
-#define DOLPHIN_DEF_GENERIC_WMETRIC(Name, RT, IsPosDef, IsSym) \
+#define DOLPHIN_DEF_GENERIC_WMETRIC_EX(Name, RT, IsPosDef, IsSym, IsGemmDec) \
 	template<typename T, typename W> class Name; \
-	DOLPHIN_DEF_GENERIC_WMETRIC_TRAITS(Name, RT, IsPosDef, IsSym) \
+	DOLPHIN_DEF_GENERIC_WMETRIC_TRAITS_EX(Name, RT, IsPosDef, IsSym, IsGemmDec) \
 	template<typename T, typename W> \
 	class Name : public dolphin::IMetric<Name<T, W> > { \
 	public: \
@@ -71,6 +88,73 @@
 	template<class A, class B> \
 	inline RT Name<T, W>::operator() (const IEWiseMatrix<A, T>& a, const IEWiseMatrix<B, T>& b) const
 
+#define DOLPHIN_DEF_MP_METRIC(Name, IsPosDef, IsSym) \
+	template<class Policy> class Name; \
+	template<class Policy> \
+	struct metric_traits<Name<Policy> > { \
+		typedef typename Policy::input_type input_type; \
+		typedef typename Policy::output_type result_type; \
+		static const bool is_positive_definite = IsPosDef; \
+		static const bool is_symmetric = IsSym; \
+		static const bool is_gemm_decomposable = false; \
+	}; \
+	template<class Policy> \
+	class Name : public dolphin::IMetric<Name<Policy> > { \
+	public: \
+		typedef Policy policy_type; \
+		typedef typename Policy::input_type input_type; \
+		typedef typename Policy::accum_type accum_type; \
+		typedef typename Policy::output_type result_type; \
+		template<class A, class B> \
+		inline typename Policy::output_type operator() ( \
+				const IEWiseMatrix<A, typename Policy::input_type>& a, \
+				const IEWiseMatrix<B, typename Policy::input_type>& b) const; }; \
+	template<class Policy> \
+	template<class A, class B> \
+	inline typename Policy::output_type Name<Policy>::operator() ( \
+			const IEWiseMatrix<A, typename Policy::input_type>& a, \
+			const IEWiseMatrix<B, typename Policy::input_type>& b) const
+
+#define DOLPHIN_DEF_WIDENED_METRIC(Name, Base) \
+	template<class Policy> \
+	struct widened_metric<Name<Policy> > { \
+		static const bool value = true; \
+		typedef Base<typename Policy::accum_type> type; };
+
+#define DOLPHIN_DEF_INT8_METRIC(Name, T, RT, IsPosDef, IsSym, Op) \
+	template<> \
+	struct metric_traits<Name<T> > { \
+		typedef T input_type; \
+		typedef RT result_type; \
+		static const bool is_positive_definite = IsPosDef; \
+		static const bool is_symmetric = IsSym; \
+		static const bool is_gemm_decomposable = false; \
+	}; \
+	template<> \
+	class Name<T> : public dolphin::IMetric<Name<T> > { \
+	public: \
+		typedef T input_type; \
+		typedef RT result_type; \
+		template<class A, class B> \
+		DOLPHIN_ENSURE_INLINE \
+		RT operator() (const IEWiseMatrix<A, T>& a, const IEWiseMatrix<B, T>& b) const { \
+			return static_cast<RT>(internal::int8_eval<internal::Op>(a.derived(), b.derived())); } \
+	};
+
+#define DOLPHIN_DEF_INT8_SMALL_DIM_KERNEL(Name, T, Op) \
+	template<> \
+	struct small_dim_kernel<Name<T> > \
+	: public int8_small_dim_kernel<T, Op> { \
+		DOLPHIN_ENSURE_INLINE \
+		small_dim_kernel(const Name<T>&, index_t d) { int8_check_dim<Op>(d); } \
+	};
+
+#define DOLPHIN_DEF_GENERIC_METRIC(Name, RT, IsPosDef, IsSym) \
+	DOLPHIN_DEF_GENERIC_METRIC_EX(Name, RT, IsPosDef, IsSym, false)
+
+#define DOLPHIN_DEF_GENERIC_WMETRIC(Name, RT, IsPosDef, IsSym) \
+	DOLPHIN_DEF_GENERIC_WMETRIC_EX(Name, RT, IsPosDef, IsSym, false)
+
 
 
 
@@ -85,6 +169,27 @@ namespace dolphin
 	template<class Metric>
 	struct metric_traits;
 
+	/**
+	 * The GEMM decomposition of a metric whose traits set
+	 * is_gemm_decomposable, with which pairwise evaluation computes
+	 *
+	 *   d(a_i, b_j) = finish( combine(sa_i, sb_j, <f(a_i), g(b_j)>) )
+	 *
+	 * where sa and sb are per-column statistics and f and g are
+	 * optional column transforms that keep the sizes, so that all inner
+	 * products come from a single GEMM. A specialization provides:
+	 *
+	 *   - a constructor from the metric;
+	 *   - transforms_a and transforms_b: whether f and g are not
+	 *     identities, and if so, transform_a(a, fa), transform_b(b, gb);
+	 *   - stats_a(a, sa) and stats_b(b, sb), into columns;
+	 *   - combine(sa_i, sb_j, ab) and finish(v).
+	 *
+	 * Positive definite metrics are clamped at zero before finish.
+	 */
+	template<class Metric>
+	class gemm_decomposition;
+
 
 	template<class Derived>
 	class IMetric
@@ -149,6 +254,52 @@ namespace dolphin
 	 *
 	 ********************************************/
 
+	/**
+	 * How pairwise results are computed:
+	 *
+	 *   - PAIRWISE_GEMM:   one GEMM for all inner products, followed
+	 *                      by a per-entry combination (only for metrics
+	 *                      with a GEMM decomposition);
+	 *   - PAIRWISE_TILED:  the structure-of-arrays kernels, run across
+	 *                      blocks of columns (only for metrics with a
+	 *                      small_dim_kernel);
+	 *   - PAIRWISE_DIRECT: the metric evaluated on each pair.
+	 *
+	 * PAIRWISE_AUTO leaves the choice to plan_pairwise.
+	 */
+	enum pairwise_method
+	{
+		PAIRWISE_AUTO,
+		PAIRWISE_GEMM,
+		PAIRWISE_TILED,
+		PAIRWISE_DIRECT
+	};
+
+	/**
+	 * Options of pairwise evaluation.
+	 *
+	 * With refine_rtol > 0, the GEMM method of the (weighted, squared)
+	 * Euclidean distances recomputes the entries whose squared value
+	 * is below refine_rtol * (|a|^2 + |b|^2) directly as sum((a - b)^2).
+	 * These are where the cancellation in |a|^2 + |b|^2 - 2 <a, b>
+	 * destroys the relative precision, e.g. between near-duplicates.
+	 * The other entries keep a relative error of about
+	 * eps / refine_rtol.
+	 */
+	struct pairwise_options
+	{
+		pairwise_method method;
+		double refine_rtol;
+
+		pairwise_options(pairwise_method method_=PAIRWISE_AUTO, double refine_rtol_=0.0)
+		: method(method_), refine_rtol(refine_rtol_) { }
+	};
+
+	inline pairwise_options pairwise_refined(double rtol=1.0e-3)
+	{
+		return pairwise_options(PAIRWISE_AUTO, rtol);
+	}
+
 	template<class Metric, class Arg1, class Arg2>
 	class pairwise_metric_expr
 	: public lmat::matrix_xpr_base<pairwise_metric_expr<Metric, Arg1, Arg2> >
@@ -160,9 +311,10 @@ namespace dolphin
 		typedef Arg1 arg1_type;
 		typedef Arg2 arg2_type;
 
-		pairwise_metric_expr(const Metric& metric, const Arg1& a1, const Arg2& a2)
+		pairwise_metric_expr(const Metric& metric, const Arg1& a1, const Arg2& a2,
+				const pairwise_options& opts=pairwise_options())
 		: base_t(a1.ncolumns(), a2.ncolumns())
-		, m_metric(metric), m_arg1(a1), m_arg2(a2) { }
+		, m_metric(metric), m_arg1(a1), m_arg2(a2), m_opts(opts) { }
 
 		DOLPHIN_ENSURE_INLINE const Metric& metric() const
 		{
@@ -179,10 +331,16 @@ namespace dolphin
 			return m_arg2;
 		}
 
+		DOLPHIN_ENSURE_INLINE const pairwise_options& options() const
+		{
+			return m_opts;
+		}
+
 	private:
 		const Metric& m_metric;
 		const Arg1& m_arg1;
 		const Arg2& m_arg2;
+		pairwise_options m_opts;
 	};
 
 	template<class Metric, class Arg>
@@ -195,9 +353,10 @@ namespace dolphin
 		typedef Metric metric_type;
 		typedef Arg arg_type;
 
-		self_pairwise_metric_expr(const Metric& metric, const Arg& a)
+		self_pairwise_metric_expr(const Metric& metric, const Arg& a,
+				const pairwise_options& opts=pairwise_options())
 		: base_t(a.ncolumns(), a.ncolumns())
-		, m_metric(metric), m_arg(a) { }
+		, m_metric(metric), m_arg(a), m_opts(opts) { }
 
 		DOLPHIN_ENSURE_INLINE const Metric& metric() const
 		{
@@ -209,9 +368,15 @@ namespace dolphin
 			return m_arg;
 		}
 
+		DOLPHIN_ENSURE_INLINE const pairwise_options& options() const
+		{
+			return m_opts;
+		}
+
 	private:
 		const Metric& m_metric;
 		const Arg& m_arg;
+		pairwise_options m_opts;
 	};
 
 
@@ -235,6 +400,33 @@ namespace dolphin
 		return self_pairwise_metric_expr<Metric, Arg>(metric.derived(), a.derived());
 	}
 
+	/**
+	 * pairwise with explicit options, e.g. the evaluation method
+	 * (in place of the choice of plan_pairwise), or pairwise_refined().
+	 * A method that is not available for the metric falls back to
+	 * the per-pair loops.
+	 */
+	template<class Metric, class Arg1, class Arg2>
+	DOLPHIN_ENSURE_INLINE
+	inline pairwise_metric_expr<Metric, Arg1, Arg2>
+	pairwise(const IMetric<Metric>& metric,
+			const IRegularMatrix<Arg1, typename metric_traits<Metric>::input_type>& a1,
+			const IRegularMatrix<Arg2, typename metric_traits<Metric>::input_type>& a2,
+			const pairwise_options& opts)
+	{
+		return pairwise_metric_expr<Metric, Arg1, Arg2>(metric.derived(), a1.derived(), a2.derived(), opts);
+	}
+
+	template<class Metric, class Arg>
+	DOLPHIN_ENSURE_INLINE
+	inline self_pairwise_metric_expr<Metric, Arg>
+	pairwise(const IMetric<Metric>& metric,
+			const IRegularMatrix<Arg, typename metric_traits<Metric>::input_type>& a,
+			const pairwise_options& opts)
+	{
+		return self_pairwise_metric_expr<Metric, Arg>(metric.derived(), a.derived(), opts);
+	}
+
 
 	/********************************************
 	 *
@@ -244,12 +436,12 @@ namespace dolphin
 
 	// Euclidean
 
-	DOLPHIN_DEF_GENERIC_METRIC(euclidean_distance, T, true, true)
+	DOLPHIN_DEF_GENERIC_METRIC_EX(euclidean_distance, T, true, true, true)
 	{
 		return norm(a - b, norms::L2_());
 	}
 
-	DOLPHIN_DEF_GENERIC_WMETRIC(weuclidean_distance, T, true, true)
+	DOLPHIN_DEF_GENERIC_WMETRIC_EX(weuclidean_distance, T, true, true, true)
 	{
 		return math::sqrt(sum(weights() * sqr(a - b)));
 	}
@@ -264,12 +456,12 @@ namespace dolphin
 
 	// Squared Euclidean
 
-	DOLPHIN_DEF_GENERIC_METRIC(sqeuclidean_distance, T, true, true)
+	DOLPHIN_DEF_GENERIC_METRIC_EX(sqeuclidean_distance, T, true, true, true)
 	{
 		return sqsum(a - b);
 	}
 
-	DOLPHIN_DEF_GENERIC_WMETRIC(wsqeuclidean_distance, T, true, true)
+	DOLPHIN_DEF_GENERIC_WMETRIC_EX(wsqeuclidean_distance, T, true, true, true)
 	{
 		return sum(weights() * sqr(a - b));
 	}
@@ -282,6 +474,13 @@ namespace dolphin
 		return wsqeuclidean_distance<T, W>(weights.derived());
 	}
 
+	// Dot product (a similarity, not a distance)
+
+	DOLPHIN_DEF_GENERIC_METRIC_EX(dot_product, T, false, true, true)
+	{
+		return sum(a * b);
+	}
+
 	// City block
 
 	DOLPHIN_DEF_GENERIC_METRIC(cityblock_distance, T, true, true)
@@ -477,7 +676,7 @@ namespace dolphin
 		LMAT_DEFINE_AGGREG_SIMD_FOLDKERNEL(cosine_dist_stat, cosine_dist_kernel, 2)
 	}
 
-	DOLPHIN_DEF_GENERIC_METRIC(cosine_distance, T, true, true)
+	DOLPHIN_DEF_GENERIC_METRIC_EX(cosine_distance, T, true, true, true)
 	{
 		const A& a_ = a.derived();
 		const B& b_ = b.derived();
@@ -486,353 +685,2741 @@ namespace dolphin
 		return T(1) - ( r.xy / math::sqrt(r.xx * r.yy) );
 	}
 
-}
 
+	// divergences between distributions
+	//
+	// The columns are expected to be (discrete) distributions, with
+	// the convention 0 log 0 = 0.
 
-namespace lmat
-{
-	// matrix traits for pairwise metrics
+	namespace internal
+	{
+		// sum_i a_i log(a_i / b_i)
 
-	template<class Dist, class Arg1, class Arg2>
-	struct matrix_traits<dolphin::pairwise_metric_expr<Dist, Arg1, Arg2> >
-	: public lmat::matrix_xpr_traits_base<
-	  typename Dist::result_type,
-	  meta::ncols<Arg1>::value,
-	  meta::ncols<Arg2>::value,
-	  typename meta::common_domain<Arg1, Arg2>::type> { };
+		template<typename T>
+		struct kl_div_stat
+		{
+			T v;
 
-	template<class Dist, class Arg>
-	struct matrix_traits<dolphin::self_pairwise_metric_expr<Dist, Arg> >
-	: public lmat::matrix_xpr_traits_base<
-	  typename Dist::result_type,
-	  meta::ncols<Arg>::value,
-	  meta::ncols<Arg>::value,
-	  typename meta::domain_of<Arg>::type> { };
+			DOLPHIN_ENSURE_INLINE
+			kl_div_stat() { }
 
+			DOLPHIN_ENSURE_INLINE
+			kl_div_stat(const T& x, const T& y)
+			: v(math::xlogx(x) - math::xlogy(x, y))
+			{ }
 
-	// introduce SIMD support to cosine_dist_kernel
+			DOLPHIN_ENSURE_INLINE
+			void update(const T& x, const T& y)
+			{
+				v += math::xlogx(x) - math::xlogy(x, y);
+			}
 
-	LMAT_DEF_SIMD_SUPPORT(dolphin::internal::cosine_dist_kernel)
+			DOLPHIN_ENSURE_INLINE
+			void update(const kl_div_stat& b)
+			{
+				v += b.v;
+			}
+		};
 
+		template<typename T, typename Kind>
+		DOLPHIN_ENSURE_INLINE
+		inline kl_div_stat<T> reduce_impl(const kl_div_stat<lmat::simd_pack<T, Kind> >& s)
+		{
+			kl_div_stat<T> r;
+			r.v = sum(s.v);
+			return r;
+		}
 
-	/********************************************
-	 *
-	 *  generic pairwise evaluation
-	 *
-	 ********************************************/
+		// sum_i a_i log b_i
 
-	template<typename Metric, class A, class B, class D>
-	void _evaluate(const dolphin::pairwise_metric_expr<Metric, A, B>& expr,
-			IRegularMatrix<D, typename dolphin::metric_traits<Metric>::result_type>& dst)
-	{
-		D& dst_ = dst.derived();
-		const index_t m = expr.nrows();
-		const index_t n = expr.ncolumns();
+		template<typename T>
+		struct cross_entropy_stat
+		{
+			T v;
 
-		const A& a = expr.arg1();
-		const B& b = expr.arg2();
+			DOLPHIN_ENSURE_INLINE
+			cross_entropy_stat() { }
 
-		for (index_t j = 0; j < n; ++j)
-		{
-			auto bj = b.column(j);
+			DOLPHIN_ENSURE_INLINE
+			cross_entropy_stat(const T& x, const T& y)
+			: v(math::xlogy(x, y))
+			{ }
 
-			for (index_t i = 0; i < m; ++i)
+			DOLPHIN_ENSURE_INLINE
+			void update(const T& x, const T& y)
 			{
-				dst_(i, j) = expr.metric()(a.column(i), bj);
+				v += math::xlogy(x, y);
 			}
-		}
-	}
 
-	template<typename Metric, class A, class D>
-	void _evaluate(const dolphin::self_pairwise_metric_expr<Metric, A>& expr,
-			IRegularMatrix<D, typename dolphin::metric_traits<Metric>::result_type>& dst)
-	{
-		D& dst_ = dst.derived();
-		const index_t n = expr.ncolumns();
+			DOLPHIN_ENSURE_INLINE
+			void update(const cross_entropy_stat& b)
+			{
+				v += b.v;
+			}
+		};
 
-		const A& a = expr.arg();
+		template<typename T, typename Kind>
+		DOLPHIN_ENSURE_INLINE
+		inline cross_entropy_stat<T> reduce_impl(const cross_entropy_stat<lmat::simd_pack<T, Kind> >& s)
+		{
+			cross_entropy_stat<T> r;
+			r.v = sum(s.v);
+			return r;
+		}
 
-		const bool is_pos_def = dolphin::metric_traits<Metric>::is_positive_definite;
-		const bool is_symmetric = dolphin::metric_traits<Metric>::is_symmetric;
-		typedef typename dolphin::metric_traits<Metric>::result_type RT;
+		// with m = (a + b) / 2, m log m = ((a + b) log(a + b) - (a + b) log 2) / 2,
+		// so JS = (sum h + log 2 * sum s) / 2, where
+		// h = a log a + b log b - (a + b) log(a + b) and s = a + b
 
-		if (is_symmetric)
+		template<typename T>
+		struct js_div_stat
 		{
-			if (is_pos_def)
-			{
-				for (index_t j = 0; j < n; ++j)
-				{
-					auto aj = a.column(j);
+			T h;
+			T s;
 
-					for (index_t i = 0; i < j; ++i)
-						dst_(i, j) = dst_(j, i);
+			DOLPHIN_ENSURE_INLINE
+			js_div_stat() { }
 
-					dst_(j, j) = RT(0);
+			DOLPHIN_ENSURE_INLINE
+			js_div_stat(const T& x, const T& y)
+			: h(math::xlogx(x) + math::xlogx(y) - math::xlogx(x + y))
+			, s(x + y)
+			{ }
 
-					for (index_t i = j+1; i < n; ++i)
-						dst_(i, j) = expr.metric()(a.column(i), aj);
-				}
-			}
-			else
+			DOLPHIN_ENSURE_INLINE
+			void update(const T& x, const T& y)
 			{
-				for (index_t j = 0; j < n; ++j)
-				{
-					auto aj = a.column(j);
-
-					for (index_t i = 0; i < j; ++i)
-						dst_(i, j) = dst_(j, i);
-
-					for (index_t i = j; i < n; ++i)
-						dst_(i, j) = expr.metric()(a.column(i), aj);
-				}
+				T xy = x + y;
+				h += math::xlogx(x) + math::xlogx(y) - math::xlogx(xy);
+				s += xy;
 			}
-		}
-		else
-		{
-			if (is_pos_def)
-			{
-				for (index_t j = 0; j < n; ++j)
-				{
-					auto aj = a.column(j);
-
-					for (index_t i = 0; i < j; ++i)
-						dst_(i, j) = expr.metric()(a.column(i), aj);
-
-					dst_(j, j) = RT(0);
 
-					for (index_t i = j+1; i < n; ++i)
-						dst_(i, j) = expr.metric()(a.column(i), aj);
-				}
-			}
-			else
+			DOLPHIN_ENSURE_INLINE
+			void update(const js_div_stat& b)
 			{
-				for (index_t j = 0; j < n; ++j)
-				{
-					auto aj = a.column(j);
-
-					for (index_t i = 0; i < n; ++i)
-						dst_(i, j) = expr.metric()(a.column(i), aj);
-				}
+				h += b.h;
+				s += b.s;
 			}
+		};
+
+		template<typename T, typename Kind>
+		DOLPHIN_ENSURE_INLINE
+		inline js_div_stat<T> reduce_impl(const js_div_stat<lmat::simd_pack<T, Kind> >& s)
+		{
+			js_div_stat<T> r;
+			r.h = sum(s.h);
+			r.s = sum(s.s);
+			return r;
 		}
-	}
 
+		LMAT_DEFINE_AGGREG_SIMD_FOLDKERNEL(kl_div_stat, kl_div_kernel, 2)
+		LMAT_DEFINE_AGGREG_SIMD_FOLDKERNEL(cross_entropy_stat, cross_entropy_kernel, 2)
+		LMAT_DEFINE_AGGREG_SIMD_FOLDKERNEL(js_div_stat, js_div_kernel, 2)
+	}
 
-	template<class Metric, class A, class B, class D>
-	inline void evaluate(const dolphin::pairwise_metric_expr<Metric, A, B>& expr,
-			IRegularMatrix<D, typename dolphin::metric_traits<Metric>::result_type>& dst)
+	/**
+	 * KL(a || b) = sum_i a_i log(a_i / b_i).
+	 */
+	DOLPHIN_DEF_GENERIC_METRIC_EX(kl_divergence, T, true, false, true)
 	{
-		_evaluate(expr, dst);
+		const A& a_ = a.derived();
+		const B& b_ = b.derived();
+
+		auto r = fold(internal::kl_div_kernel<T>())(common_shape(a_, b_), in_(a_), in_(b_));
+		return r.v;
 	}
 
-	template<class Metric, class A, class D>
-	inline void evaluate(const dolphin::self_pairwise_metric_expr<Metric, A>& expr,
-			IRegularMatrix<D, typename dolphin::metric_traits<Metric>::result_type>& dst)
+	/**
+	 * H(a, b) = - sum_i a_i log b_i.
+	 */
+	DOLPHIN_DEF_GENERIC_METRIC_EX(cross_entropy, T, false, false, true)
 	{
-		_evaluate(expr, dst);
-	}
+		const A& a_ = a.derived();
+		const B& b_ = b.derived();
 
+		auto r = fold(internal::cross_entropy_kernel<T>())(common_shape(a_, b_), in_(a_), in_(b_));
+		return - r.v;
+	}
 
-	/********************************************
-	 *
-	 *  specialized pairwise evaluation
+	/**
+	 * JS(a, b) = (KL(a || m) + KL(b || m)) / 2, with m = (a + b) / 2.
 	 *
-	 ********************************************/
+	 * The logarithm of a sum does not decompose into inner products,
+	 * so pairwise evaluation goes through the per-pair kernel.
+	 */
+	DOLPHIN_DEF_GENERIC_METRIC(js_divergence, T, true, true)
+	{
+		const A& a_ = a.derived();
+		const B& b_ = b.derived();
 
-	// sqeuclidean_distance
+		auto r = fold(internal::js_div_kernel<T>())(common_shape(a_, b_), in_(a_), in_(b_));
+		T v = T(0.5) * (r.h + T(0.69314718055994530942) * r.s);
+		return v > T(0) ? v : T(0);
+	}
 
-	template<typename T, class D>
-	DOLPHIN_ENSURE_INLINE
-	inline void _postprocess_posdef_metrics(IRegularMatrix<D, T>& dst, bool selfpw)
-	{
-		D& dst_ = dst.derived();
 
-		dst_ = max(dst_, T(0));
+	// correlation distance (cosine distance between centered vectors)
+	//
+	// All evaluation paths center the columns by their means before
+	// forming any product (two passes), rather than correcting raw
+	// moments, which loses all precision for data with a large offset.
+	// A constant column takes its value as its exact mean, so it
+	// centers to zeros; having no defined correlation, it is at
+	// distance 1 from every other column.
 
-		if (selfpw)
+	namespace internal
+	{
+		template<typename T>
+		DOLPHIN_ENSURE_INLINE
+		inline T correlation_from_moments(const T& sxx, const T& sxy, const T& syy)
+		{
+			return sxx > T(0) && syy > T(0) ? T(1) - ( sxy / math::sqrt(sxx * syy) ) : T(1);
+		}
+
+		template<class Policy, class A, class B>
+		inline typename Policy::accum_type correlation_two_pass(const A& a, const B& b)
+		{
+			typedef typename Policy::accum_type TAcc;
+
+			const index_t n = a.nelems();
+			LMAT_CHECK_DIMS( n == b.nelems() )
+			if (n == 0) return TAcc(1);
+
+			auto rd_a = lmat::make_vec_accessor(lmat::scalar_(), in_(a));
+			auto rd_b = lmat::make_vec_accessor(lmat::scalar_(), in_(b));
+
+			// means
+
+			const TAcc x0 = Policy::widen(rd_a.scalar(0));
+			const TAcc y0 = Policy::widen(rd_b.scalar(0));
+
+			TAcc sx(0), sy(0);
+			bool cx = true, cy = true;
+			for (index_t i = 0; i < n; ++i)
+			{
+				const TAcc x = Policy::widen(rd_a.scalar(i));
+				const TAcc y = Policy::widen(rd_b.scalar(i));
+				sx += x;
+				sy += y;
+				cx &= (x == x0);
+				cy &= (y == y0);
+			}
+
+			const TAcc c = math::rcp(TAcc(n));
+			const TAcc mx = cx ? x0 : sx * c;
+			const TAcc my = cy ? y0 : sy * c;
+
+			// centered moments
+
+			TAcc sxx(0), sxy(0), syy(0);
+			for (index_t i = 0; i < n; ++i)
+			{
+				const TAcc u = Policy::widen(rd_a.scalar(i)) - mx;
+				const TAcc v = Policy::widen(rd_b.scalar(i)) - my;
+				sxx += u * u;
+				sxy += u * v;
+				syy += v * v;
+			}
+
+			return correlation_from_moments(sxx, sxy, syy);
+		}
+	}
+
+	/**
+	 * 1 - r(a, b), where r is the Pearson correlation coefficient
+	 * between the entries of a and b (with r = 0 when a or b is
+	 * constant).
+	 */
+	DOLPHIN_DEF_GENERIC_METRIC(correlation_distance, T, true, true)
+	{
+		return internal::correlation_two_pass<mixed_precision<T> >(a.derived(), b.derived());
+	}
+
+
+	// Mahalanobis
+
+	/**
+	 * The squared Mahalanobis distance (a - b)' P (a - b), where the
+	 * precision matrix P is given by its lower Cholesky factor L, with
+	 * P = L L', so that the distance is |L' (a - b)|^2.
+	 */
+	template<typename T, typename L> class sqmahalanobis_distance;
+	DOLPHIN_DEF_GENERIC_WMETRIC_TRAITS(sqmahalanobis_distance, T, true, true)
+
+	template<typename T, typename L>
+	class sqmahalanobis_distance : public IMetric<sqmahalanobis_distance<T, L> >
+	{
+		static_assert(is_percol_contiguous<L>::value, "L must be percol-contiguous");
+
+	public:
+		typedef T input_type;
+		typedef T result_type;
+
+		DOLPHIN_ENSURE_INLINE
+		sqmahalanobis_distance(const L& chol)
+		: m_chol(chol) { }
+
+		DOLPHIN_ENSURE_INLINE
+		const L& chol_factor() const
+		{
+			return m_chol;
+		}
+
+		template<class A, class B>
+		T operator() (const IEWiseMatrix<A, T>& a, const IEWiseMatrix<B, T>& b) const
+		{
+			const index_t d = m_chol.nrows();
+			LMAT_CHECK_DIMS( a.nelems() == d && b.nelems() == d )
+
+			// the differences are formed on the fly, so that no
+			// temporary is allocated per call
+
+			auto rd_a = lmat::make_vec_accessor(lmat::scalar_(), in_(a));
+			auto rd_b = lmat::make_vec_accessor(lmat::scalar_(), in_(b));
+
+			T s(0);
+			for (index_t j = 0; j < d; ++j)
+			{
+				const T *lj = m_chol.ptr_col(j);
+				T u(0);
+				for (index_t i = j; i < d; ++i) u += lj[i] * (rd_a.scalar(i) - rd_b.scalar(i));
+				s += u * u;
+			}
+			return s;
+		}
+
+	private:
+		const L& m_chol;
+	};
+
+	template<typename T, typename L> class mahalanobis_distance;
+	DOLPHIN_DEF_GENERIC_WMETRIC_TRAITS(mahalanobis_distance, T, true, true)
+
+	template<typename T, typename L>
+	class mahalanobis_distance : public IMetric<mahalanobis_distance<T, L> >
+	{
+	public:
+		typedef T input_type;
+		typedef T result_type;
+
+		DOLPHIN_ENSURE_INLINE
+		mahalanobis_distance(const L& chol)
+		: m_sqdist(chol) { }
+
+		DOLPHIN_ENSURE_INLINE
+		const L& chol_factor() const
+		{
+			return m_sqdist.chol_factor();
+		}
+
+		template<class A, class B>
+		DOLPHIN_ENSURE_INLINE
+		T operator() (const IEWiseMatrix<A, T>& a, const IEWiseMatrix<B, T>& b) const
+		{
+			return math::sqrt(m_sqdist(a, b));
+		}
+
+	private:
+		sqmahalanobis_distance<T, L> m_sqdist;
+	};
+
+	template<typename T, typename L>
+	DOLPHIN_ENSURE_INLINE
+	inline sqmahalanobis_distance<T, L> sqmahalanobis(const IRegularMatrix<L, T>& chol)
+	{
+		LMAT_CHECK_DIMS( chol.nrows() == chol.ncolumns() );
+		return sqmahalanobis_distance<T, L>(chol.derived());
+	}
+
+	template<typename T, typename L>
+	DOLPHIN_ENSURE_INLINE
+	inline mahalanobis_distance<T, L> mahalanobis(const IRegularMatrix<L, T>& chol)
+	{
+		LMAT_CHECK_DIMS( chol.nrows() == chol.ncolumns() );
+		return mahalanobis_distance<T, L>(chol.derived());
+	}
+
+
+	/********************************************
+	 *
+	 *  mixed-precision metrics
+	 *
+	 *  mp_<metric><Policy> computes <metric> on
+	 *  inputs of Policy::input_type, accumulating
+	 *  in Policy::accum_type, and returns a value
+	 *  of Policy::output_type, e.g.
+	 *
+	 *    mp_cosine_distance<float_to_double>
+	 *    mp_sqeuclidean_distance<half_acc_float>
+	 *
+	 *  Pairwise evaluation widens blocks of columns
+	 *  into panels, and runs the metric on the
+	 *  accumulation type (its widened_metric) over
+	 *  them, with GEMM, tiled or direct kernels.
+	 *
+	 ********************************************/
+
+	namespace internal
+	{
+		// packed doubles, for the stats of float inputs accumulated in
+		// double: 2 * width floats are widened at a time, and the
+		// stats keep several packs of partial sums
+
+#if defined(__AVX__) || defined(__SSE2__)
+#define DOLPHIN_MP_SIMD
+
+		struct mp_dpack
+		{
+#if defined(__AVX__)
+			typedef __m256d type;
+			static const index_t width = 4;
+#else
+			typedef __m128d type;
+			static const index_t width = 2;
+#endif
+			type v;
+
+			DOLPHIN_ENSURE_INLINE mp_dpack() { }
+			DOLPHIN_ENSURE_INLINE mp_dpack(type v_) : v(v_) { }
+
+#if defined(__AVX__)
+			DOLPHIN_ENSURE_INLINE
+			static mp_dpack zero() { return _mm256_setzero_pd(); }
+
+			DOLPHIN_ENSURE_INLINE
+			static void widen2(const float *p, mp_dpack& x0, mp_dpack& x1)
+			{
+				__m256 f = _mm256_loadu_ps(p);
+				x0.v = _mm256_cvtps_pd(_mm256_castps256_ps128(f));
+				x1.v = _mm256_cvtps_pd(_mm256_extractf128_ps(f, 1));
+			}
+
+			DOLPHIN_ENSURE_INLINE
+			double sum() const
+			{
+				__m128d s = _mm_add_pd(_mm256_castpd256_pd128(v), _mm256_extractf128_pd(v, 1));
+				return _mm_cvtsd_f64(_mm_add_sd(s, _mm_unpackhi_pd(s, s)));
+			}
+#else
+			DOLPHIN_ENSURE_INLINE
+			static mp_dpack zero() { return _mm_setzero_pd(); }
+
+			DOLPHIN_ENSURE_INLINE
+			static void widen2(const float *p, mp_dpack& x0, mp_dpack& x1)
+			{
+				__m128 f = _mm_loadu_ps(p);
+				x0.v = _mm_cvtps_pd(f);
+				x1.v = _mm_cvtps_pd(_mm_movehl_ps(f, f));
+			}
+
+			DOLPHIN_ENSURE_INLINE
+			double sum() const
+			{
+				return _mm_cvtsd_f64(_mm_add_sd(v, _mm_unpackhi_pd(v, v)));
+			}
+#endif
+		};
+
+#if defined(__AVX__)
+		DOLPHIN_ENSURE_INLINE
+		inline mp_dpack operator + (mp_dpack a, mp_dpack b) { return _mm256_add_pd(a.v, b.v); }
+
+		DOLPHIN_ENSURE_INLINE
+		inline mp_dpack operator - (mp_dpack a, mp_dpack b) { return _mm256_sub_pd(a.v, b.v); }
+
+		DOLPHIN_ENSURE_INLINE
+		inline mp_dpack operator * (mp_dpack a, mp_dpack b) { return _mm256_mul_pd(a.v, b.v); }
+
+		DOLPHIN_ENSURE_INLINE
+		inline mp_dpack mp_abs(mp_dpack a) { return _mm256_andnot_pd(_mm256_set1_pd(-0.0), a.v); }
+#else
+		DOLPHIN_ENSURE_INLINE
+		inline mp_dpack operator + (mp_dpack a, mp_dpack b) { return _mm_add_pd(a.v, b.v); }
+
+		DOLPHIN_ENSURE_INLINE
+		inline mp_dpack operator - (mp_dpack a, mp_dpack b) { return _mm_sub_pd(a.v, b.v); }
+
+		DOLPHIN_ENSURE_INLINE
+		inline mp_dpack operator * (mp_dpack a, mp_dpack b) { return _mm_mul_pd(a.v, b.v); }
+
+		DOLPHIN_ENSURE_INLINE
+		inline mp_dpack mp_abs(mp_dpack a) { return _mm_andnot_pd(_mm_set1_pd(-0.0), a.v); }
+#endif
+
+		DOLPHIN_ENSURE_INLINE
+		inline mp_dpack& operator += (mp_dpack& a, mp_dpack b) { a = a + b; return a; }
+#endif
+
+		template<typename T>
+		DOLPHIN_ENSURE_INLINE
+		inline T mp_abs(const T& x)
+		{
+			return math::abs(x);
+		}
+
+		template<typename T>
+		struct sqdiff_stat
+		{
+			T v;
+
+			DOLPHIN_ENSURE_INLINE
+			sqdiff_stat(const T& x, const T& y)
+			: v((x - y) * (x - y)) { }
+
+			DOLPHIN_ENSURE_INLINE
+			void update(const T& x, const T& y)
+			{
+				T u = x - y;
+				v += u * u;
+			}
+
+			DOLPHIN_ENSURE_INLINE
+			void update(const sqdiff_stat& b)
+			{
+				v += b.v;
+			}
+		};
+
+		template<typename T>
+		struct absdiff_stat
+		{
+			T v;
+
+			DOLPHIN_ENSURE_INLINE
+			absdiff_stat(const T& x, const T& y)
+			: v(mp_abs(x - y)) { }
+
+			DOLPHIN_ENSURE_INLINE
+			void update(const T& x, const T& y)
+			{
+				v += mp_abs(x - y);
+			}
+
+			DOLPHIN_ENSURE_INLINE
+			void update(const absdiff_stat& b)
+			{
+				v += b.v;
+			}
+		};
+
+		template<typename T>
+		struct dot_stat
+		{
+			T v;
+
+			DOLPHIN_ENSURE_INLINE
+			dot_stat(const T& x, const T& y)
+			: v(x * y) { }
+
+			DOLPHIN_ENSURE_INLINE
+			void update(const T& x, const T& y)
+			{
+				v += x * y;
+			}
+
+			DOLPHIN_ENSURE_INLINE
+			void update(const dot_stat& b)
+			{
+				v += b.v;
+			}
+		};
+
+		// the stats folded over packs of widened floats: pack_type is
+		// the stat on mp_dpack, and reduce sums its lanes
+
+		template<class Stat>
+		struct mp_simd_stat
+		{
+			static const bool value = false;
+		};
+
+#ifdef DOLPHIN_MP_SIMD
+		template<>
+		struct mp_simd_stat<sqdiff_stat<double> >
+		{
+			static const bool value = true;
+			typedef sqdiff_stat<mp_dpack> pack_type;
+
+			DOLPHIN_ENSURE_INLINE
+			static sqdiff_stat<double> reduce(const pack_type& s)
+			{
+				sqdiff_stat<double> r(0.0, 0.0);
+				r.v = s.v.sum();
+				return r;
+			}
+		};
+
+		template<>
+		struct mp_simd_stat<absdiff_stat<double> >
+		{
+			static const bool value = true;
+			typedef absdiff_stat<mp_dpack> pack_type;
+
+			DOLPHIN_ENSURE_INLINE
+			static absdiff_stat<double> reduce(const pack_type& s)
+			{
+				absdiff_stat<double> r(0.0, 0.0);
+				r.v = s.v.sum();
+				return r;
+			}
+		};
+
+		template<>
+		struct mp_simd_stat<dot_stat<double> >
+		{
+			static const bool value = true;
+			typedef dot_stat<mp_dpack> pack_type;
+
+			DOLPHIN_ENSURE_INLINE
+			static dot_stat<double> reduce(const pack_type& s)
+			{
+				dot_stat<double> r(0.0, 0.0);
+				r.v = s.v.sum();
+				return r;
+			}
+		};
+
+		template<>
+		struct mp_simd_stat<cosine_dist_stat<double> >
+		{
+			static const bool value = true;
+			typedef cosine_dist_stat<mp_dpack> pack_type;
+
+			DOLPHIN_ENSURE_INLINE
+			static cosine_dist_stat<double> reduce(const pack_type& s)
+			{
+				cosine_dist_stat<double> r;
+				r.xx = s.xx.sum();
+				r.xy = s.xy.sum();
+				r.yy = s.yy.sum();
+				return r;
+			}
+		};
+#endif
+
+		// folds a stat of the accumulation type over widened pairs; a
+		// stat constructed from two zeros is zero. Contiguous float
+		// inputs accumulated in double take the packed fold, with four
+		// packs of partial sums, and the scalar loop only for the tail.
+		// The divergences, whose terms take logarithms, and the other
+		// policies keep the scalar loop.
+
+		template<class Stat, class Policy, class A, class B>
+		inline Stat mp_fold(const A& a, const B& b, std::false_type)
+		{
+			typedef typename Policy::accum_type TAcc;
+
+			auto rd_a = lmat::make_vec_accessor(lmat::scalar_(), in_(a));
+			auto rd_b = lmat::make_vec_accessor(lmat::scalar_(), in_(b));
+
+			const index_t n = a.nelems();
+			Stat s(TAcc(0), TAcc(0));
+			for (index_t i = 0; i < n; ++i)
+				s.update(Policy::widen(rd_a.scalar(i)), Policy::widen(rd_b.scalar(i)));
+			return s;
+		}
+
+#ifdef DOLPHIN_MP_SIMD
+		template<class Stat, class Policy, class A, class B>
+		inline Stat mp_fold(const A& a, const B& b, std::true_type)
+		{
+			typedef mp_simd_stat<Stat> simd_t;
+			typedef typename simd_t::pack_type pstat_t;
+
+			const float *x = a.ptr_data();
+			const float *y = b.ptr_data();
+			const index_t n = a.nelems();
+			const index_t w = 2 * mp_dpack::width;
+
+			const mp_dpack z = mp_dpack::zero();
+			pstat_t s0(z, z), s1(z, z), s2(z, z), s3(z, z);
+
+			index_t i = 0;
+			for (; i + 2 * w <= n; i += 2 * w)
+			{
+				mp_dpack x0, x1, x2, x3, y0, y1, y2, y3;
+				mp_dpack::widen2(x + i, x0, x1);
+				mp_dpack::widen2(y + i, y0, y1);
+				mp_dpack::widen2(x + i + w, x2, x3);
+				mp_dpack::widen2(y + i + w, y2, y3);
+
+				s0.update(x0, y0);
+				s1.update(x1, y1);
+				s2.update(x2, y2);
+				s3.update(x3, y3);
+			}
+
+			s0.update(s1);
+			s2.update(s3);
+			s0.update(s2);
+
+			Stat s = simd_t::reduce(s0);
+			for (; i < n; ++i)
+				s.update(double(x[i]), double(y[i]));
+			return s;
+		}
+#endif
+
+		template<class Stat, class Policy, class A, class B>
+		DOLPHIN_ENSURE_INLINE
+		inline Stat mp_fold(const A& a, const B& b)
+		{
+			LMAT_CHECK_DIMS( a.nelems() == b.nelems() )
+
+			return mp_fold<Stat, Policy>(a, b, std::integral_constant<bool,
+					mp_simd_stat<Stat>::value &&
+					std::is_same<typename Policy::input_type, float>::value &&
+					std::is_same<typename Policy::accum_type, double>::value &&
+					is_contiguous<A>::value && is_contiguous<B>::value>());
+		}
+	}
+
+	DOLPHIN_DEF_MP_METRIC(mp_sqeuclidean_distance, true, true)
+	{
+		typedef typename Policy::accum_type TAcc;
+		auto r = internal::mp_fold<internal::sqdiff_stat<TAcc>, Policy>(a.derived(), b.derived());
+		return Policy::narrow(r.v);
+	}
+
+	DOLPHIN_DEF_MP_METRIC(mp_euclidean_distance, true, true)
+	{
+		typedef typename Policy::accum_type TAcc;
+		auto r = internal::mp_fold<internal::sqdiff_stat<TAcc>, Policy>(a.derived(), b.derived());
+		return Policy::narrow(math::sqrt(r.v));
+	}
+
+	DOLPHIN_DEF_MP_METRIC(mp_cityblock_distance, true, true)
+	{
+		typedef typename Policy::accum_type TAcc;
+		auto r = internal::mp_fold<internal::absdiff_stat<TAcc>, Policy>(a.derived(), b.derived());
+		return Policy::narrow(r.v);
+	}
+
+	DOLPHIN_DEF_MP_METRIC(mp_dot_product, false, true)
+	{
+		typedef typename Policy::accum_type TAcc;
+		auto r = internal::mp_fold<internal::dot_stat<TAcc>, Policy>(a.derived(), b.derived());
+		return Policy::narrow(r.v);
+	}
+
+	DOLPHIN_DEF_MP_METRIC(mp_cosine_distance, true, true)
+	{
+		typedef typename Policy::accum_type TAcc;
+		auto r = internal::mp_fold<internal::cosine_dist_stat<TAcc>, Policy>(a.derived(), b.derived());
+		return Policy::narrow(TAcc(1) - ( r.xy / math::sqrt(r.xx * r.yy) ));
+	}
+
+	DOLPHIN_DEF_MP_METRIC(mp_correlation_distance, true, true)
+	{
+		return Policy::narrow(internal::correlation_two_pass<Policy>(a.derived(), b.derived()));
+	}
+
+	DOLPHIN_DEF_MP_METRIC(mp_kl_divergence, true, false)
+	{
+		typedef typename Policy::accum_type TAcc;
+		auto r = internal::mp_fold<internal::kl_div_stat<TAcc>, Policy>(a.derived(), b.derived());
+		return Policy::narrow(r.v);
+	}
+
+	DOLPHIN_DEF_MP_METRIC(mp_cross_entropy, false, false)
+	{
+		typedef typename Policy::accum_type TAcc;
+		auto r = internal::mp_fold<internal::cross_entropy_stat<TAcc>, Policy>(a.derived(), b.derived());
+		return Policy::narrow(- r.v);
+	}
+
+	DOLPHIN_DEF_MP_METRIC(mp_js_divergence, true, true)
+	{
+		typedef typename Policy::accum_type TAcc;
+		auto r = internal::mp_fold<internal::js_div_stat<TAcc>, Policy>(a.derived(), b.derived());
+		TAcc v = TAcc(0.5) * (r.h + TAcc(0.69314718055994530942) * r.s);
+		return Policy::narrow(v > TAcc(0) ? v : TAcc(0));
+	}
+
+	namespace internal
+	{
+		template<class Metric>
+		struct widened_metric
+		{
+			static const bool value = false;
+		};
+
+		DOLPHIN_DEF_WIDENED_METRIC(mp_sqeuclidean_distance, sqeuclidean_distance)
+		DOLPHIN_DEF_WIDENED_METRIC(mp_euclidean_distance, euclidean_distance)
+		DOLPHIN_DEF_WIDENED_METRIC(mp_cityblock_distance, cityblock_distance)
+		DOLPHIN_DEF_WIDENED_METRIC(mp_dot_product, dot_product)
+		DOLPHIN_DEF_WIDENED_METRIC(mp_cosine_distance, cosine_distance)
+		DOLPHIN_DEF_WIDENED_METRIC(mp_correlation_distance, correlation_distance)
+		DOLPHIN_DEF_WIDENED_METRIC(mp_kl_divergence, kl_divergence)
+		DOLPHIN_DEF_WIDENED_METRIC(mp_cross_entropy, cross_entropy)
+		DOLPHIN_DEF_WIDENED_METRIC(mp_js_divergence, js_divergence)
+
+		// the columns of each side widened together in pairwise evaluation
+
+		const index_t pairwise_panel_cols = 256;
+	}
+
+
+
+	/********************************************
+	 *
+	 *  GEMM decompositions
+	 *
+	 ********************************************/
+
+	namespace internal
+	{
+		// the left or right GEMM operand: the input itself, or its
+		// transform (written to buf) when the decomposition has one
+
+		template<class Dec, bool Transform>
+		struct gemm_operand
+		{
+			template<class A, typename T>
+			DOLPHIN_ENSURE_INLINE
+			static const A& lhs(const Dec&, const A& a, dense_matrix<T>&)
+			{
+				return a;
+			}
+
+			template<class B, typename T>
+			DOLPHIN_ENSURE_INLINE
+			static const B& rhs(const Dec&, const B& b, dense_matrix<T>&)
+			{
+				return b;
+			}
+		};
+
+		template<class Dec>
+		struct gemm_operand<Dec, true>
+		{
+			template<class A, typename T>
+			static const dense_matrix<T>& lhs(const Dec& dec, const A& a, dense_matrix<T>& buf)
+			{
+				buf.resize(a.nrows(), a.ncolumns());
+				dec.transform_a(a, buf);
+				return buf;
+			}
+
+			template<class B, typename T>
+			static const dense_matrix<T>& rhs(const Dec& dec, const B& b, dense_matrix<T>& buf)
+			{
+				buf.resize(b.nrows(), b.ncolumns());
+				dec.transform_b(b, buf);
+				return buf;
+			}
+		};
+
+		// |a - b|^2 = |a|^2 + |b|^2 - 2 <a, b>
+
+		template<typename T>
+		struct sqeuclidean_decomposition
+		{
+			static const bool transforms_a = false;
+			static const bool transforms_b = false;
+
+			template<class A>
+			DOLPHIN_ENSURE_INLINE
+			void stats_a(const A& a, dense_col<T>& sa) const
+			{
+				colwise_sqsum(a, sa);
+			}
+
+			template<class B>
+			DOLPHIN_ENSURE_INLINE
+			void stats_b(const B& b, dense_col<T>& sb) const
+			{
+				colwise_sqsum(b, sb);
+			}
+
+			DOLPHIN_ENSURE_INLINE
+			T combine(T sa, T sb, T ab) const
+			{
+				return sa + sb - T(2) * ab;
+			}
+		};
+
+		// sum_i w_i (a_i - b_i)^2, with the weights applied to a
+
+		template<typename T, typename W>
+		class wsqeuclidean_decomposition
+		{
+		public:
+			static const bool transforms_a = true;
+			static const bool transforms_b = false;
+
+			DOLPHIN_ENSURE_INLINE
+			explicit wsqeuclidean_decomposition(const W& w) : m_w(w) { }
+
+			template<class A>
+			DOLPHIN_ENSURE_INLINE
+			void transform_a(const A& a, dense_matrix<T>& fa) const
+			{
+				fa = a * repcol(m_w, a.ncolumns());
+			}
+
+			template<class A>
+			DOLPHIN_ENSURE_INLINE
+			void stats_a(const A& a, dense_col<T>& sa) const
+			{
+				colwise_sum(sqr(a) * repcol(m_w, a.ncolumns()), sa);
+			}
+
+			template<class B>
+			DOLPHIN_ENSURE_INLINE
+			void stats_b(const B& b, dense_col<T>& sb) const
+			{
+				colwise_sum(sqr(b) * repcol(m_w, b.ncolumns()), sb);
+			}
+
+			DOLPHIN_ENSURE_INLINE
+			T combine(T sa, T sb, T ab) const
+			{
+				return sa + sb - T(2) * ab;
+			}
+
+		private:
+			const W& m_w;
+		};
+	}
+
+	template<typename T>
+	class gemm_decomposition<sqeuclidean_distance<T> >
+	: public internal::sqeuclidean_decomposition<T>
+	{
+	public:
+		DOLPHIN_ENSURE_INLINE
+		explicit gemm_decomposition(const sqeuclidean_distance<T>&) { }
+
+		DOLPHIN_ENSURE_INLINE
+		T finish(T v) const { return v; }
+	};
+
+	template<typename T>
+	class gemm_decomposition<euclidean_distance<T> >
+	: public internal::sqeuclidean_decomposition<T>
+	{
+	public:
+		DOLPHIN_ENSURE_INLINE
+		explicit gemm_decomposition(const euclidean_distance<T>&) { }
+
+		DOLPHIN_ENSURE_INLINE
+		T finish(T v) const { return math::sqrt(v); }
+	};
+
+	template<typename T, typename W>
+	class gemm_decomposition<wsqeuclidean_distance<T, W> >
+	: public internal::wsqeuclidean_decomposition<T, W>
+	{
+	public:
+		DOLPHIN_ENSURE_INLINE
+		explicit gemm_decomposition(const wsqeuclidean_distance<T, W>& metric)
+		: internal::wsqeuclidean_decomposition<T, W>(metric.weights()) { }
+
+		DOLPHIN_ENSURE_INLINE
+		T finish(T v) const { return v; }
+	};
+
+	template<typename T, typename W>
+	class gemm_decomposition<weuclidean_distance<T, W> >
+	: public internal::wsqeuclidean_decomposition<T, W>
+	{
+	public:
+		DOLPHIN_ENSURE_INLINE
+		explicit gemm_decomposition(const weuclidean_distance<T, W>& metric)
+		: internal::wsqeuclidean_decomposition<T, W>(metric.weights()) { }
+
+		DOLPHIN_ENSURE_INLINE
+		T finish(T v) const { return math::sqrt(v); }
+	};
+
+	// 1 - <a, b> / (|a| |b|), with the reciprocal norms as statistics
+
+	template<typename T>
+	class gemm_decomposition<cosine_distance<T> >
+	{
+	public:
+		static const bool transforms_a = false;
+		static const bool transforms_b = false;
+
+		DOLPHIN_ENSURE_INLINE
+		explicit gemm_decomposition(const cosine_distance<T>&) { }
+
+		template<class A>
+		void stats_a(const A& a, dense_col<T>& sa) const
+		{
+			for (index_t i = 0; i < a.ncolumns(); ++i)
+				sa[i] = math::rcp(math::sqrt(sqsum(a.column(i))));
+		}
+
+		template<class B>
+		void stats_b(const B& b, dense_col<T>& sb) const
+		{
+			stats_a(b, sb);
+		}
+
+		DOLPHIN_ENSURE_INLINE
+		T combine(T sa, T sb, T ab) const
+		{
+			return T(1) - ab * sa * sb;
+		}
+
+		DOLPHIN_ENSURE_INLINE
+		T finish(T v) const { return v; }
+	};
+
+	template<typename T>
+	class gemm_decomposition<dot_product<T> >
+	{
+	public:
+		static const bool transforms_a = false;
+		static const bool transforms_b = false;
+
+		DOLPHIN_ENSURE_INLINE
+		explicit gemm_decomposition(const dot_product<T>&) { }
+
+		template<class A>
+		DOLPHIN_ENSURE_INLINE
+		void stats_a(const A&, dense_col<T>& sa) const
+		{
+			sa << T(0);
+		}
+
+		template<class B>
+		DOLPHIN_ENSURE_INLINE
+		void stats_b(const B&, dense_col<T>& sb) const
+		{
+			sb << T(0);
+		}
+
+		DOLPHIN_ENSURE_INLINE
+		T combine(T, T, T ab) const { return ab; }
+
+		DOLPHIN_ENSURE_INLINE
+		T finish(T v) const { return v; }
+	};
+
+	namespace internal
+	{
+		// log b, with zeros mapped to the log of the smallest normal
+		// value, so that the terms with a_i = 0 vanish in the GEMM
+		// instead of becoming 0 * (-inf). The entries that do have a
+		// term with a_i > 0 = b_i (which are infinite) come out finite
+		// here, and are recomputed directly after the GEMM (see
+		// _patch_zero_support).
+
+		template<typename T>
+		struct log_rhs_decomposition
+		{
+			static const bool transforms_a = false;
+			static const bool transforms_b = true;
+
+			template<class B>
+			void transform_b(const B& b, dense_matrix<T>& gb) const
+			{
+				const T lb = std::numeric_limits<T>::min();
+				gb = log(max(b, lb));
+			}
+
+			template<class B>
+			DOLPHIN_ENSURE_INLINE
+			void stats_b(const B&, dense_col<T>& sb) const
+			{
+				sb << T(0);
+			}
+
+			DOLPHIN_ENSURE_INLINE
+			T finish(T v) const { return v; }
+		};
+	}
+
+	// KL(a || b) = sum a log a - <a, log b>
+
+	template<typename T>
+	class gemm_decomposition<kl_divergence<T> >
+	: public internal::log_rhs_decomposition<T>
+	{
+	public:
+		DOLPHIN_ENSURE_INLINE
+		explicit gemm_decomposition(const kl_divergence<T>&) { }
+
+		template<class A>
+		DOLPHIN_ENSURE_INLINE
+		void stats_a(const A& a, dense_col<T>& sa) const
+		{
+			colwise_sum(xlogx(a), sa);
+		}
+
+		DOLPHIN_ENSURE_INLINE
+		T combine(T sa, T, T ab) const
+		{
+			return sa - ab;
+		}
+	};
+
+	// H(a, b) = - <a, log b>
+
+	template<typename T>
+	class gemm_decomposition<cross_entropy<T> >
+	: public internal::log_rhs_decomposition<T>
+	{
+	public:
+		DOLPHIN_ENSURE_INLINE
+		explicit gemm_decomposition(const cross_entropy<T>&) { }
+
+		template<class A>
+		DOLPHIN_ENSURE_INLINE
+		void stats_a(const A&, dense_col<T>& sa) const
+		{
+			sa << T(0);
+		}
+
+		DOLPHIN_ENSURE_INLINE
+		T combine(T, T, T ab) const
+		{
+			return - ab;
+		}
+	};
+
+
+	/********************************************
+	 *
+	 *  small-dimension kernels
+	 *
+	 *  When the inputs have a small compile-time
+	 *  number of rows, pairwise evaluation keeps
+	 *  a block of L columns of a dimension-major
+	 *  (as a structure of arrays), and runs each
+	 *  dimension across the L columns at once,
+	 *  with the entry of b broadcast.
+	 *
+	 *  A kernel keeps nacc accumulators per
+	 *  column, the c-th one of lane l at
+	 *  s[c * L + l], and provides init, update
+	 *  (with dimension t) and finish on the lane
+	 *  at s, so that the loops over lanes are
+	 *  contiguous in every accumulator.
+	 *
+	 ********************************************/
+
+	namespace internal
+	{
+		template<class Metric>
+		struct small_dim_kernel
+		{
+			static const bool value = false;
+		};
+
+		template<typename T>
+		struct small_dim_kernel<sqeuclidean_distance<T> >
+		{
+			static const bool value = true;
+			static const int nacc = 1;
+
+			DOLPHIN_ENSURE_INLINE
+			small_dim_kernel(const sqeuclidean_distance<T>&, index_t) { }
+
+			template<index_t L>
+			DOLPHIN_ENSURE_INLINE void init(T *s) const { s[0] = T(0); }
+
+			template<index_t L>
+			DOLPHIN_ENSURE_INLINE void update(T *s, index_t, T x, T y) const
+			{
+				T u = x - y;
+				s[0] += u * u;
+			}
+
+			template<index_t L>
+			DOLPHIN_ENSURE_INLINE T finish(const T *s) const { return s[0]; }
+		};
+
+		template<typename T>
+		struct small_dim_kernel<euclidean_distance<T> >
+		: public small_dim_kernel<sqeuclidean_distance<T> >
+		{
+			DOLPHIN_ENSURE_INLINE
+			small_dim_kernel(const euclidean_distance<T>&, index_t d)
+			: small_dim_kernel<sqeuclidean_distance<T> >(sqeuclidean_distance<T>(), d) { }
+
+			template<index_t L>
+			DOLPHIN_ENSURE_INLINE T finish(const T *s) const { return math::sqrt(s[0]); }
+		};
+
+		template<typename T, typename W>
+		class small_dim_kernel<wsqeuclidean_distance<T, W> >
+		{
+		public:
+			static const bool value = true;
+			static const int nacc = 1;
+
+			DOLPHIN_ENSURE_INLINE
+			small_dim_kernel(const wsqeuclidean_distance<T, W>& metric, index_t)
+			: m_w(metric.weights()) { }
+
+			template<index_t L>
+			DOLPHIN_ENSURE_INLINE void init(T *s) const { s[0] = T(0); }
+
+			template<index_t L>
+			DOLPHIN_ENSURE_INLINE void update(T *s, index_t t, T x, T y) const
+			{
+				T u = x - y;
+				s[0] += m_w[t] * (u * u);
+			}
+
+			template<index_t L>
+			DOLPHIN_ENSURE_INLINE T finish(const T *s) const { return s[0]; }
+
+		private:
+			const W& m_w;
+		};
+
+		template<typename T, typename W>
+		struct small_dim_kernel<weuclidean_distance<T, W> >
+		: public small_dim_kernel<wsqeuclidean_distance<T, W> >
+		{
+			DOLPHIN_ENSURE_INLINE
+			small_dim_kernel(const weuclidean_distance<T, W>& metric, index_t d)
+			: small_dim_kernel<wsqeuclidean_distance<T, W> >(
+					wsqeuclidean_distance<T, W>(metric.weights()), d) { }
+
+			template<index_t L>
+			DOLPHIN_ENSURE_INLINE T finish(const T *s) const { return math::sqrt(s[0]); }
+		};
+
+		template<typename T>
+		struct small_dim_kernel<dot_product<T> >
+		{
+			static const bool value = true;
+			static const int nacc = 1;
+
+			DOLPHIN_ENSURE_INLINE
+			small_dim_kernel(const dot_product<T>&, index_t) { }
+
+			template<index_t L>
+			DOLPHIN_ENSURE_INLINE void init(T *s) const { s[0] = T(0); }
+
+			template<index_t L>
+			DOLPHIN_ENSURE_INLINE void update(T *s, index_t, T x, T y) const { s[0] += x * y; }
+
+			template<index_t L>
+			DOLPHIN_ENSURE_INLINE T finish(const T *s) const { return s[0]; }
+		};
+
+		template<typename T>
+		struct small_dim_kernel<cityblock_distance<T> >
+		{
+			static const bool value = true;
+			static const int nacc = 1;
+
+			DOLPHIN_ENSURE_INLINE
+			small_dim_kernel(const cityblock_distance<T>&, index_t) { }
+
+			template<index_t L>
+			DOLPHIN_ENSURE_INLINE void init(T *s) const { s[0] = T(0); }
+
+			template<index_t L>
+			DOLPHIN_ENSURE_INLINE void update(T *s, index_t, T x, T y) const { s[0] += math::abs(x - y); }
+
+			template<index_t L>
+			DOLPHIN_ENSURE_INLINE T finish(const T *s) const { return s[0]; }
+		};
+
+		template<typename T, typename W>
+		class small_dim_kernel<wcityblock_distance<T, W> >
+		{
+		public:
+			static const bool value = true;
+			static const int nacc = 1;
+
+			DOLPHIN_ENSURE_INLINE
+			small_dim_kernel(const wcityblock_distance<T, W>& metric, index_t)
+			: m_w(metric.weights()) { }
+
+			template<index_t L>
+			DOLPHIN_ENSURE_INLINE void init(T *s) const { s[0] = T(0); }
+
+			template<index_t L>
+			DOLPHIN_ENSURE_INLINE void update(T *s, index_t t, T x, T y) const
+			{
+				s[0] += m_w[t] * math::abs(x - y);
+			}
+
+			template<index_t L>
+			DOLPHIN_ENSURE_INLINE T finish(const T *s) const { return s[0]; }
+
+		private:
+			const W& m_w;
+		};
+
+		template<typename T>
+		struct small_dim_kernel<chebyshev_distance<T> >
+		{
+			static const bool value = true;
+			static const int nacc = 1;
+
+			DOLPHIN_ENSURE_INLINE
+			small_dim_kernel(const chebyshev_distance<T>&, index_t) { }
+
+			template<index_t L>
+			DOLPHIN_ENSURE_INLINE void init(T *s) const { s[0] = T(0); }
+
+			template<index_t L>
+			DOLPHIN_ENSURE_INLINE void update(T *s, index_t, T x, T y) const
+			{
+				T u = math::abs(x - y);
+				s[0] = u > s[0] ? u : s[0];
+			}
+
+			template<index_t L>
+			DOLPHIN_ENSURE_INLINE T finish(const T *s) const { return s[0]; }
+		};
+
+		template<typename T>
+		class small_dim_kernel<minkowski_distance<T> >
+		{
+		public:
+			static const bool value = true;
+			static const int nacc = 1;
+
+			DOLPHIN_ENSURE_INLINE
+			small_dim_kernel(const minkowski_distance<T>& metric, index_t)
+			: m_p(metric.p()), m_inv_p(math::rcp(metric.p())) { }
+
+			template<index_t L>
+			DOLPHIN_ENSURE_INLINE void init(T *s) const { s[0] = T(0); }
+
+			template<index_t L>
+			DOLPHIN_ENSURE_INLINE void update(T *s, index_t, T x, T y) const
+			{
+				s[0] += math::pow(math::abs(x - y), m_p);
+			}
+
+			template<index_t L>
+			DOLPHIN_ENSURE_INLINE T finish(const T *s) const { return math::pow(s[0], m_inv_p); }
+
+		private:
+			T m_p;
+			T m_inv_p;
+		};
+
+		template<typename T, typename W>
+		class small_dim_kernel<wminkowski_distance<T, W> >
+		{
+		public:
+			static const bool value = true;
+			static const int nacc = 1;
+
+			DOLPHIN_ENSURE_INLINE
+			small_dim_kernel(const wminkowski_distance<T, W>& metric, index_t)
+			: m_p(metric.p()), m_inv_p(math::rcp(metric.p())), m_w(metric.weights()) { }
+
+			template<index_t L>
+			DOLPHIN_ENSURE_INLINE void init(T *s) const { s[0] = T(0); }
+
+			template<index_t L>
+			DOLPHIN_ENSURE_INLINE void update(T *s, index_t t, T x, T y) const
+			{
+				s[0] += m_w[t] * math::pow(math::abs(x - y), m_p);
+			}
+
+			template<index_t L>
+			DOLPHIN_ENSURE_INLINE T finish(const T *s) const { return math::pow(s[0], m_inv_p); }
+
+		private:
+			T m_p;
+			T m_inv_p;
+			const W& m_w;
+		};
+
+		template<typename T>
+		struct small_dim_kernel<hamming_distance<T> >
+		{
+			static const bool value = true;
+			static const int nacc = 1;
+
+			DOLPHIN_ENSURE_INLINE
+			small_dim_kernel(const hamming_distance<T>&, index_t) { }
+
+			template<index_t L>
+			DOLPHIN_ENSURE_INLINE void init(uint32_t *s) const { s[0] = 0; }
+
+			template<index_t L>
+			DOLPHIN_ENSURE_INLINE void update(uint32_t *s, index_t, T x, T y) const
+			{
+				s[0] += uint32_t(x != y);
+			}
+
+			template<index_t L>
+			DOLPHIN_ENSURE_INLINE uint32_t finish(const uint32_t *s) const { return s[0]; }
+		};
+
+		template<typename T, typename W>
+		class small_dim_kernel<whamming_distance<T, W> >
+		{
+			typedef typename lmat::matrix_traits<W>::value_type RT;
+
+		public:
+			static const bool value = true;
+			static const int nacc = 1;
+
+			DOLPHIN_ENSURE_INLINE
+			small_dim_kernel(const whamming_distance<T, W>& metric, index_t)
+			: m_w(metric.weights()) { }
+
+			template<index_t L>
+			DOLPHIN_ENSURE_INLINE void init(RT *s) const { s[0] = RT(0); }
+
+			template<index_t L>
+			DOLPHIN_ENSURE_INLINE void update(RT *s, index_t t, T x, T y) const
+			{
+				s[0] += RT(x != y) * m_w[t];
+			}
+
+			template<index_t L>
+			DOLPHIN_ENSURE_INLINE RT finish(const RT *s) const { return s[0]; }
+
+		private:
+			const W& m_w;
+		};
+
+		template<typename T>
+		struct small_dim_kernel<cosine_distance<T> >
+		{
+			static const bool value = true;
+			static const int nacc = 3;
+
+			DOLPHIN_ENSURE_INLINE
+			small_dim_kernel(const cosine_distance<T>&, index_t) { }
+
+			template<index_t L>
+			DOLPHIN_ENSURE_INLINE void init(T *s) const
+			{
+				s[0] = T(0);
+				s[L] = T(0);
+				s[2 * L] = T(0);
+			}
+
+			template<index_t L>
+			DOLPHIN_ENSURE_INLINE void update(T *s, index_t, T x, T y) const
+			{
+				s[0] += x * x;
+				s[L] += x * y;
+				s[2 * L] += y * y;
+			}
+
+			template<index_t L>
+			DOLPHIN_ENSURE_INLINE T finish(const T *s) const
+			{
+				return T(1) - ( s[L] / math::sqrt(s[0] * s[2 * L]) );
+			}
+		};
+
+		// runs on columns centered beforehand (see the tiled
+		// evaluation of correlation_distance)
+
+		template<typename T>
+		struct small_dim_kernel<correlation_distance<T> >
+		{
+			static const bool value = true;
+			static const int nacc = 3;
+
+			DOLPHIN_ENSURE_INLINE
+			small_dim_kernel(const correlation_distance<T>&, index_t) { }
+
+			template<index_t L>
+			DOLPHIN_ENSURE_INLINE void init(T *s) const
+			{
+				s[0] = T(0);
+				s[L] = T(0);
+				s[2 * L] = T(0);
+			}
+
+			template<index_t L>
+			DOLPHIN_ENSURE_INLINE void update(T *s, index_t, T x, T y) const
+			{
+				s[0] += x * x;
+				s[L] += x * y;
+				s[2 * L] += y * y;
+			}
+
+			template<index_t L>
+			DOLPHIN_ENSURE_INLINE T finish(const T *s) const
+			{
+				return correlation_from_moments(s[0], s[L], s[2 * L]);
+			}
+		};
+
+		template<typename T>
+		struct small_dim_kernel<kl_divergence<T> >
+		{
+			static const bool value = true;
+			static const int nacc = 1;
+
+			DOLPHIN_ENSURE_INLINE
+			small_dim_kernel(const kl_divergence<T>&, index_t) { }
+
+			template<index_t L>
+			DOLPHIN_ENSURE_INLINE void init(T *s) const { s[0] = T(0); }
+
+			template<index_t L>
+			DOLPHIN_ENSURE_INLINE void update(T *s, index_t, T x, T y) const
+			{
+				s[0] += math::xlogx(x) - math::xlogy(x, y);
+			}
+
+			template<index_t L>
+			DOLPHIN_ENSURE_INLINE T finish(const T *s) const { return s[0]; }
+		};
+
+		template<typename T>
+		struct small_dim_kernel<cross_entropy<T> >
+		{
+			static const bool value = true;
+			static const int nacc = 1;
+
+			DOLPHIN_ENSURE_INLINE
+			small_dim_kernel(const cross_entropy<T>&, index_t) { }
+
+			template<index_t L>
+			DOLPHIN_ENSURE_INLINE void init(T *s) const { s[0] = T(0); }
+
+			template<index_t L>
+			DOLPHIN_ENSURE_INLINE void update(T *s, index_t, T x, T y) const
+			{
+				s[0] += math::xlogy(x, y);
+			}
+
+			template<index_t L>
+			DOLPHIN_ENSURE_INLINE T finish(const T *s) const { return - s[0]; }
+		};
+
+		template<typename T>
+		struct small_dim_kernel<js_divergence<T> >
+		{
+			static const bool value = true;
+			static const int nacc = 2;
+
+			DOLPHIN_ENSURE_INLINE
+			small_dim_kernel(const js_divergence<T>&, index_t) { }
+
+			template<index_t L>
+			DOLPHIN_ENSURE_INLINE void init(T *s) const
+			{
+				s[0] = T(0);
+				s[L] = T(0);
+			}
+
+			template<index_t L>
+			DOLPHIN_ENSURE_INLINE void update(T *s, index_t, T x, T y) const
+			{
+				T xy = x + y;
+				s[0] += math::xlogx(x) + math::xlogx(y) - math::xlogx(xy);
+				s[L] += xy;
+			}
+
+			template<index_t L>
+			DOLPHIN_ENSURE_INLINE T finish(const T *s) const
+			{
+				T v = T(0.5) * (s[0] + T(0.69314718055994530942) * s[L]);
+				return v > T(0) ? v : T(0);
+			}
+		};
+	}
+
+
+	/********************************************
+	 *
+	 *  8-bit integer metrics
+	 *
+	 *  sqeuclidean_distance, dot_product and
+	 *  cityblock_distance on int8_t / uint8_t
+	 *  columns return int32_t, accumulated in
+	 *  int32, which is exact for dimensions up
+	 *  to int8_max_dim (sums of at most 255^2 per
+	 *  entry); larger dimensions are rejected with
+	 *  std::invalid_argument. hamming_distance
+	 *  keeps its uint32_t counts.
+	 *
+	 *  Contiguous columns go through AVX2 kernels,
+	 *  which widen 16 entries to int16 and
+	 *  multiply-add pairs of them into int32 lanes.
+	 *  Pairwise evaluation takes the tiled kernels
+	 *  for small dimensions, the per-pair kernels
+	 *  otherwise (there is no integer GEMM).
+	 *
+	 ********************************************/
+
+	namespace internal
+	{
+		const index_t int8_max_dim = 33025;
+
+#if defined(__AVX2__)
+		DOLPHIN_ENSURE_INLINE
+		inline __m256i int8_load16(const std::int8_t *p)
+		{
+			return _mm256_cvtepi8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p)));
+		}
+
+		DOLPHIN_ENSURE_INLINE
+		inline __m256i int8_load16(const uint8_t *p)
+		{
+			return _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p)));
+		}
+
+		DOLPHIN_ENSURE_INLINE
+		inline int32_t int8_hsum(__m256i v)
+		{
+			__m128i s = _mm_add_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+			s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0x4e));
+			s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0xb1));
+			return _mm_cvtsi128_si32(s);
+		}
+#endif
+
+		// each op updates an int32 sum with a pair of entries, and,
+		// with AVX2, eight int32 sums with 16 pairs widened to int16
+
+		// max_dim: the largest dimension for which the int32 sums
+		// of an op are exact
+
+		struct int8_sqdist_op
+		{
+			static const index_t max_dim = int8_max_dim;
+
+			DOLPHIN_ENSURE_INLINE
+			static void update(int32_t& s, int32_t x, int32_t y)
+			{
+				int32_t u = x - y;
+				s += u * u;
+			}
+
+#if defined(__AVX2__)
+			DOLPHIN_ENSURE_INLINE
+			static __m256i update(__m256i s, __m256i x, __m256i y)
+			{
+				__m256i u = _mm256_sub_epi16(x, y);
+				return _mm256_add_epi32(s, _mm256_madd_epi16(u, u));
+			}
+#endif
+		};
+
+		struct int8_dot_op
+		{
+			static const index_t max_dim = int8_max_dim;
+
+			DOLPHIN_ENSURE_INLINE
+			static void update(int32_t& s, int32_t x, int32_t y)
+			{
+				s += x * y;
+			}
+
+#if defined(__AVX2__)
+			DOLPHIN_ENSURE_INLINE
+			static __m256i update(__m256i s, __m256i x, __m256i y)
+			{
+				return _mm256_add_epi32(s, _mm256_madd_epi16(x, y));
+			}
+#endif
+		};
+
+		struct int8_absdiff_op
+		{
+			static const index_t max_dim = int8_max_dim;
+
+			DOLPHIN_ENSURE_INLINE
+			static void update(int32_t& s, int32_t x, int32_t y)
+			{
+				s += x > y ? x - y : y - x;
+			}
+
+#if defined(__AVX2__)
+			DOLPHIN_ENSURE_INLINE
+			static __m256i update(__m256i s, __m256i x, __m256i y)
+			{
+				__m256i u = _mm256_abs_epi16(_mm256_sub_epi16(x, y));
+				return _mm256_add_epi32(s, _mm256_madd_epi16(u, _mm256_set1_epi16(1)));
+			}
+#endif
+		};
+
+		struct int8_neq_op
+		{
+			static const index_t max_dim = std::numeric_limits<int32_t>::max();
+
+			DOLPHIN_ENSURE_INLINE
+			static void update(int32_t& s, int32_t x, int32_t y)
+			{
+				s += int32_t(x != y);
+			}
+
+#if defined(__AVX2__)
+			DOLPHIN_ENSURE_INLINE
+			static __m256i update(__m256i s, __m256i x, __m256i y)
+			{
+				// e: minus the number of equal entries in each pair
+				__m256i e = _mm256_madd_epi16(_mm256_cmpeq_epi16(x, y), _mm256_set1_epi16(1));
+				return _mm256_add_epi32(s, _mm256_add_epi32(e, _mm256_set1_epi32(2)));
+			}
+#endif
+		};
+
+		template<class Op>
+		DOLPHIN_ENSURE_INLINE
+		inline void int8_check_dim(index_t d)
+		{
+			check_arg(d <= Op::max_dim,
+					"The dimension exceeds the range in which 8-bit integer metrics are exact.");
+		}
+
+		template<class Op, typename T>
+		inline int32_t int8_run(const T *x, const T *y, index_t n)
+		{
+			index_t i = 0;
+			int32_t s = 0;
+
+#if defined(__AVX2__)
+			__m256i a0 = _mm256_setzero_si256();
+			__m256i a1 = _mm256_setzero_si256();
+
+			for (; i + 32 <= n; i += 32)
+			{
+				a0 = Op::update(a0, int8_load16(x + i), int8_load16(y + i));
+				a1 = Op::update(a1, int8_load16(x + i + 16), int8_load16(y + i + 16));
+			}
+			for (; i + 16 <= n; i += 16)
+			{
+				a0 = Op::update(a0, int8_load16(x + i), int8_load16(y + i));
+			}
+			s = int8_hsum(_mm256_add_epi32(a0, a1));
+#endif
+			for (; i < n; ++i) Op::update(s, int32_t(x[i]), int32_t(y[i]));
+			return s;
+		}
+
+		template<class Op, class A, class B>
+		DOLPHIN_ENSURE_INLINE
+		inline int32_t int8_eval(const A& a, const B& b, std::true_type)
+		{
+			return int8_run<Op>(a.ptr_data(), b.ptr_data(), a.nelems());
+		}
+
+		template<class Op, class A, class B>
+		inline int32_t int8_eval(const A& a, const B& b, std::false_type)
+		{
+			auto rd_a = lmat::make_vec_accessor(lmat::scalar_(), in_(a));
+			auto rd_b = lmat::make_vec_accessor(lmat::scalar_(), in_(b));
+
+			const index_t n = a.nelems();
+			int32_t s = 0;
+			for (index_t i = 0; i < n; ++i)
+				Op::update(s, int32_t(rd_a.scalar(i)), int32_t(rd_b.scalar(i)));
+			return s;
+		}
+
+		template<class Op, class A, class B>
+		DOLPHIN_ENSURE_INLINE
+		inline int32_t int8_eval(const A& a, const B& b)
+		{
+			LMAT_CHECK_DIMS( a.nelems() == b.nelems() )
+			int8_check_dim<Op>(a.nelems());
+			return int8_eval<Op>(a, b, std::integral_constant<bool,
+					is_contiguous<A>::value && is_contiguous<B>::value>());
+		}
+
+		// tiled kernels, one int32 sum per lane
+
+		template<typename T, class Op>
+		struct int8_small_dim_kernel
+		{
+			static const bool value = true;
+			static const int nacc = 1;
+
+			template<index_t L>
+			DOLPHIN_ENSURE_INLINE void init(int32_t *s) const { s[0] = 0; }
+
+			template<index_t L>
+			DOLPHIN_ENSURE_INLINE void update(int32_t *s, index_t, T x, T y) const
+			{
+				Op::update(s[0], int32_t(x), int32_t(y));
+			}
+
+			template<index_t L>
+			DOLPHIN_ENSURE_INLINE int32_t finish(const int32_t *s) const { return s[0]; }
+		};
+	}
+
+	DOLPHIN_DEF_INT8_METRIC(sqeuclidean_distance, std::int8_t, int32_t, true, true, int8_sqdist_op)
+	DOLPHIN_DEF_INT8_METRIC(sqeuclidean_distance, uint8_t, int32_t, true, true, int8_sqdist_op)
+	DOLPHIN_DEF_INT8_METRIC(dot_product, std::int8_t, int32_t, false, true, int8_dot_op)
+	DOLPHIN_DEF_INT8_METRIC(dot_product, uint8_t, int32_t, false, true, int8_dot_op)
+	DOLPHIN_DEF_INT8_METRIC(cityblock_distance, std::int8_t, int32_t, true, true, int8_absdiff_op)
+	DOLPHIN_DEF_INT8_METRIC(cityblock_distance, uint8_t, int32_t, true, true, int8_absdiff_op)
+	DOLPHIN_DEF_INT8_METRIC(hamming_distance, std::int8_t, uint32_t, true, true, int8_neq_op)
+	DOLPHIN_DEF_INT8_METRIC(hamming_distance, uint8_t, uint32_t, true, true, int8_neq_op)
+
+	namespace internal
+	{
+		DOLPHIN_DEF_INT8_SMALL_DIM_KERNEL(sqeuclidean_distance, std::int8_t, int8_sqdist_op)
+		DOLPHIN_DEF_INT8_SMALL_DIM_KERNEL(sqeuclidean_distance, uint8_t, int8_sqdist_op)
+		DOLPHIN_DEF_INT8_SMALL_DIM_KERNEL(dot_product, std::int8_t, int8_dot_op)
+		DOLPHIN_DEF_INT8_SMALL_DIM_KERNEL(dot_product, uint8_t, int8_dot_op)
+		DOLPHIN_DEF_INT8_SMALL_DIM_KERNEL(cityblock_distance, std::int8_t, int8_absdiff_op)
+		DOLPHIN_DEF_INT8_SMALL_DIM_KERNEL(cityblock_distance, uint8_t, int8_absdiff_op)
+	}
+
+
+	/**
+	 * Pairwise scores of quantized columns, with a_i = sa[i] * qa_i
+	 * and b_j = sb[j] * qb_j, from the exact integer inner products
+	 * of qa and qb (by pairwise(dot_product<T>)):
+	 *
+	 *   dot_product:          sa[i] sb[j] <qa_i, qb_j>
+	 *   sqeuclidean_distance: |a_i|^2 + |b_j|^2 - 2 <a_i, b_j>,
+	 *                         clamped at zero.
+	 */
+	template<typename T, class A, class SA, class B, class SB, typename TD, class D>
+	void dequantized_pairwise(const dot_product<T>& metric,
+			const IRegularMatrix<A, T>& qa, const IRegularMatrix<SA, TD>& sa,
+			const IRegularMatrix<B, T>& qb, const IRegularMatrix<SB, TD>& sb,
+			IRegularMatrix<D, TD>& dst)
+	{
+		typedef typename metric_traits<dot_product<T> >::result_type RT;
+
+		const index_t m = qa.ncolumns();
+		const index_t n = qb.ncolumns();
+		check_arg(qa.nrows() == qb.nrows(), "The dimensions of qa and qb are inconsistent.");
+		internal::int8_check_dim<internal::int8_dot_op>(qa.nrows());
+		check_arg(sa.nelems() == m && sb.nelems() == n, "The sizes of the scales are inconsistent.");
+		check_arg(dst.nrows() == m && dst.ncolumns() == n, "The size of dst is invalid.");
+
+		const SA& sa_ = sa.derived();
+		const SB& sb_ = sb.derived();
+		D& dst_ = dst.derived();
+
+		dense_matrix<RT> g = pairwise(metric, qa, qb);
+
+		for (index_t j = 0; j < n; ++j)
+			for (index_t i = 0; i < m; ++i)
+				dst_(i, j) = sa_[i] * sb_[j] * TD(g(i, j));
+	}
+
+	template<typename T, class A, class SA, class B, class SB, typename TD, class D>
+	void dequantized_pairwise(const sqeuclidean_distance<T>&,
+			const IRegularMatrix<A, T>& qa, const IRegularMatrix<SA, TD>& sa,
+			const IRegularMatrix<B, T>& qb, const IRegularMatrix<SB, TD>& sb,
+			IRegularMatrix<D, TD>& dst)
+	{
+		typedef typename metric_traits<dot_product<T> >::result_type RT;
+
+		const index_t m = qa.ncolumns();
+		const index_t n = qb.ncolumns();
+		check_arg(qa.nrows() == qb.nrows(), "The dimensions of qa and qb are inconsistent.");
+		internal::int8_check_dim<internal::int8_dot_op>(qa.nrows());
+		check_arg(sa.nelems() == m && sb.nelems() == n, "The sizes of the scales are inconsistent.");
+		check_arg(dst.nrows() == m && dst.ncolumns() == n, "The size of dst is invalid.");
+
+		const SA& sa_ = sa.derived();
+		const SB& sb_ = sb.derived();
+		D& dst_ = dst.derived();
+
+		dot_product<T> dot;
+		const A& qa_ = qa.derived();
+		const B& qb_ = qb.derived();
+
+		dense_col<TD> na(m);
+		dense_col<TD> nb(n);
+		for (index_t i = 0; i < m; ++i)
+			na[i] = sa_[i] * sa_[i] * TD(dot(qa_.column(i), qa_.column(i)));
+		for (index_t j = 0; j < n; ++j)
+			nb[j] = sb_[j] * sb_[j] * TD(dot(qb_.column(j), qb_.column(j)));
+
+		dense_matrix<RT> g = pairwise(dot, qa_, qb_);
+
+		for (index_t j = 0; j < n; ++j)
+		{
+			for (index_t i = 0; i < m; ++i)
+			{
+				TD v = na[i] + nb[j] - TD(2) * sa_[i] * sb_[j] * TD(g(i, j));
+				dst_(i, j) = v > TD(0) ? v : TD(0);
+			}
+		}
+	}
+
+
+	/********************************************
+	 *
+	 *  pairwise planning
+	 *
+	 ********************************************/
+
+	namespace internal
+	{
+		// whether the metric has a GEMM-based pairwise evaluation,
+		// through a decomposition or a specialized evaluator
+
+		template<class Metric>
+		struct gemm_path_available
+		{
+			static const bool value = metric_traits<Metric>::is_gemm_decomposable;
+		};
+
+		template<typename T>
+		struct gemm_path_available<correlation_distance<T> >
+		{
+			static const bool value = true;
+		};
+
+		// the GEMM methods that support pairwise_options::refine_rtol,
+		// those of the form |a|^2 + |b|^2 - 2 <a, b>, whose statistics
+		// are the squared norms
+
+		template<class Metric>
+		struct gemm_refinable
+		{
+			static const bool value = false;
+		};
+
+		template<typename T>
+		struct gemm_refinable<sqeuclidean_distance<T> >
+		{
+			static const bool value = true;
+		};
+
+		template<typename T>
+		struct gemm_refinable<euclidean_distance<T> >
+		{
+			static const bool value = true;
+		};
+
+		template<typename T, typename W>
+		struct gemm_refinable<wsqeuclidean_distance<T, W> >
+		{
+			static const bool value = true;
+		};
+
+		template<typename T, typename W>
+		struct gemm_refinable<weuclidean_distance<T, W> >
+		{
+			static const bool value = true;
+		};
+
+		// the columns of a processed together by the tiled kernels
+
+		const index_t pairwise_tile_lanes = 16;
+
+		// plan_pairwise keeps GEMM for every metric that has a GEMM
+		// method, as pairwise evaluation did before the planner: no
+		// crossover below which the tiled or per-pair kernels beat it
+		// has been measured yet. Metrics without GEMM take the tiled
+		// kernels when a holds a full block of columns and the
+		// dimension is at most pairwise_tiled_max_dim, a value chosen
+		// from the register use of the kernels, not from timings.
+		//
+		// tests/common/bench_pairwise.cpp times the three methods
+		// over a grid of (m, n, d) for float and double. GEMM
+		// cut-offs are to be added here only from its measured
+		// crossovers, with the machine they were measured on.
+
+		const index_t pairwise_tiled_max_dim = 32;
+	}
+
+	/**
+	 * Chooses how pairwise(metric, a, b) is evaluated, for a with m
+	 * columns, b with n columns, and d rows.
+	 */
+	template<class Metric>
+	pairwise_method plan_pairwise(index_t m, index_t, index_t d)
+	{
+		using namespace internal;
+
+		if (gemm_path_available<Metric>::value)
+			return PAIRWISE_GEMM;
+
+		const bool has_tiled = small_dim_kernel<Metric>::value;
+		if (has_tiled && m >= pairwise_tile_lanes && d <= pairwise_tiled_max_dim)
+			return PAIRWISE_TILED;
+
+		return PAIRWISE_DIRECT;
+	}
+
+}
+
+
+namespace lmat
+{
+	// matrix traits for pairwise metrics
+
+	template<class Dist, class Arg1, class Arg2>
+	struct matrix_traits<dolphin::pairwise_metric_expr<Dist, Arg1, Arg2> >
+	: public lmat::matrix_xpr_traits_base<
+	  typename Dist::result_type,
+	  meta::ncols<Arg1>::value,
+	  meta::ncols<Arg2>::value,
+	  typename meta::common_domain<Arg1, Arg2>::type> { };
+
+	template<class Dist, class Arg>
+	struct matrix_traits<dolphin::self_pairwise_metric_expr<Dist, Arg> >
+	: public lmat::matrix_xpr_traits_base<
+	  typename Dist::result_type,
+	  meta::ncols<Arg>::value,
+	  meta::ncols<Arg>::value,
+	  typename meta::domain_of<Arg>::type> { };
+
+
+	// introduce SIMD support to the fold kernels
+
+	LMAT_DEF_SIMD_SUPPORT(dolphin::internal::cosine_dist_kernel)
+	LMAT_DEF_SIMD_SUPPORT(dolphin::internal::kl_div_kernel)
+	LMAT_DEF_SIMD_SUPPORT(dolphin::internal::cross_entropy_kernel)
+	LMAT_DEF_SIMD_SUPPORT(dolphin::internal::js_div_kernel)
+
+
+	/********************************************
+	 *
+	 *  generic pairwise evaluation
+	 *
+	 ********************************************/
+
+	template<typename Metric, class A, class B, class D>
+	void _evaluate(const dolphin::pairwise_metric_expr<Metric, A, B>& expr,
+			IRegularMatrix<D, typename dolphin::metric_traits<Metric>::result_type>& dst)
+	{
+		D& dst_ = dst.derived();
+		const index_t m = expr.nrows();
+		const index_t n = expr.ncolumns();
+
+		const A& a = expr.arg1();
+		const B& b = expr.arg2();
+
+		for (index_t j = 0; j < n; ++j)
+		{
+			auto bj = b.column(j);
+
+			for (index_t i = 0; i < m; ++i)
+			{
+				dst_(i, j) = expr.metric()(a.column(i), bj);
+			}
+		}
+	}
+
+	template<typename Metric, class A, class D>
+	void _evaluate(const dolphin::self_pairwise_metric_expr<Metric, A>& expr,
+			IRegularMatrix<D, typename dolphin::metric_traits<Metric>::result_type>& dst)
+	{
+		D& dst_ = dst.derived();
+		const index_t n = expr.ncolumns();
+
+		const A& a = expr.arg();
+
+		const bool is_pos_def = dolphin::metric_traits<Metric>::is_positive_definite;
+		const bool is_symmetric = dolphin::metric_traits<Metric>::is_symmetric;
+		typedef typename dolphin::metric_traits<Metric>::result_type RT;
+
+		if (is_symmetric)
+		{
+			if (is_pos_def)
+			{
+				for (index_t j = 0; j < n; ++j)
+				{
+					auto aj = a.column(j);
+
+					for (index_t i = 0; i < j; ++i)
+						dst_(i, j) = dst_(j, i);
+
+					dst_(j, j) = RT(0);
+
+					for (index_t i = j+1; i < n; ++i)
+						dst_(i, j) = expr.metric()(a.column(i), aj);
+				}
+			}
+			else
+			{
+				for (index_t j = 0; j < n; ++j)
+				{
+					auto aj = a.column(j);
+
+					for (index_t i = 0; i < j; ++i)
+						dst_(i, j) = dst_(j, i);
+
+					for (index_t i = j; i < n; ++i)
+						dst_(i, j) = expr.metric()(a.column(i), aj);
+				}
+			}
+		}
+		else
+		{
+			if (is_pos_def)
+			{
+				for (index_t j = 0; j < n; ++j)
+				{
+					auto aj = a.column(j);
+
+					for (index_t i = 0; i < j; ++i)
+						dst_(i, j) = expr.metric()(a.column(i), aj);
+
+					dst_(j, j) = RT(0);
+
+					for (index_t i = j+1; i < n; ++i)
+						dst_(i, j) = expr.metric()(a.column(i), aj);
+				}
+			}
+			else
+			{
+				for (index_t j = 0; j < n; ++j)
+				{
+					auto aj = a.column(j);
+
+					for (index_t i = 0; i < n; ++i)
+						dst_(i, j) = expr.metric()(a.column(i), aj);
+				}
+			}
+		}
+	}
+
+
+	/********************************************
+	 *
+	 *  GEMM-based pairwise evaluation
+	 *
+	 ********************************************/
+
+	// For decompositions on log b (KL divergence, cross entropy), the
+	// pairs with some a_i > 0 where b_i = 0 are recomputed directly,
+	// which gives the infinite value of the per-pair loops. They are
+	// found by a GEMM of indicators over the rows where b has zeros,
+	// so inputs without zeros in b only cost one scan of b.
+
+	template<typename Metric, class A, class B, class D>
+	void _patch_zero_support(const Metric& metric, const A& a, const B& b, D& dst, std::true_type)
+	{
+		typedef typename dolphin::metric_traits<Metric>::result_type T;
+
+		const index_t d = a.nrows();
+		const index_t m = a.ncolumns();
+		const index_t n = b.ncolumns();
+
+		std::vector<index_t> rows;
+		for (index_t t = 0; t < d; ++t)
+		{
+			for (index_t j = 0; j < n; ++j)
+			{
+				if (b(t, j) == T(0))
+				{
+					rows.push_back(t);
+					break;
+				}
+			}
+		}
+		if (rows.empty()) return;
+
+		const index_t nz = static_cast<index_t>(rows.size());
+		dense_matrix<T> pa(nz, m);
+		dense_matrix<T> zb(nz, n);
+
+		for (index_t i = 0; i < m; ++i)
+			for (index_t r = 0; r < nz; ++r) pa(r, i) = a(rows[r], i) > T(0) ? T(1) : T(0);
+
+		for (index_t j = 0; j < n; ++j)
+			for (index_t r = 0; r < nz; ++r) zb(r, j) = b(rows[r], j) == T(0) ? T(1) : T(0);
+
+		dense_matrix<T> cnt(m, n);
+		blas::gemm(pa, zb, cnt, 'T', 'N');
+
+		for (index_t j = 0; j < n; ++j)
 		{
-			auto dvs = dst_.diag();
-			dvs << T(0);
+			for (index_t i = 0; i < m; ++i)
+			{
+				if (cnt(i, j) > T(0.5)) dst(i, j) = metric(a.column(i), b.column(j));
+			}
 		}
 	}
 
-	template<typename T, class A, class B, class D>
-	void evaluate(const dolphin::pairwise_metric_expr<dolphin::sqeuclidean_distance<T>, A, B>& expr,
-			IRegularMatrix<D, T>& dst)
+	template<typename Metric, class A, class B, class D>
+	DOLPHIN_ENSURE_INLINE
+	inline void _patch_zero_support(const Metric&, const A&, const B&, D&, std::false_type) { }
+
+	template<typename Metric, class A, class B, class D>
+	void _evaluate_by_gemm(const Metric& metric, const A& a, const B& b,
+			IRegularMatrix<D, typename dolphin::metric_traits<Metric>::result_type>& dst, bool selfpw,
+			double refine_rtol)
 	{
+		typedef typename dolphin::metric_traits<Metric>::result_type T;
+		typedef dolphin::gemm_decomposition<Metric> dec_t;
+		typedef dolphin::internal::gemm_operand<dec_t, dec_t::transforms_a> lhs_t;
+		typedef dolphin::internal::gemm_operand<dec_t, dec_t::transforms_b> rhs_t;
+
+		const bool is_pos_def = dolphin::metric_traits<Metric>::is_positive_definite;
+
 		D& dst_ = dst.derived();
-		const A& a = expr.arg1();
-		const B& b = expr.arg2();
+		const dec_t dec(metric);
 
 		const index_t m = a.ncolumns();
 		const index_t n = b.ncolumns();
 
-		dense_col<T> sa2(m);
-		dense_row<T> sb2(n);
+		dense_col<T> sa(m);
+		dense_col<T> sb(n);
+		dec.stats_a(a, sa);
+		dec.stats_b(b, sb);
 
-		colwise_sqsum(a, sa2);
-		colwise_sqsum(b, sb2);
+		dense_matrix<T> fa;
+		dense_matrix<T> gb;
+		blas::gemm(lhs_t::lhs(dec, a, fa), rhs_t::rhs(dec, b, gb), dst_, 'T', 'N');
 
-		dst_ = repcol(sa2, n)  + reprow(sb2, m);
-		blas::gemm(T(-2), a, b, T(1), dst_, 'T', 'N');
+		// entries below the refinement bound are recomputed directly
 
-		_postprocess_posdef_metrics(dst_, false);
+		const T rtol = dolphin::internal::gemm_refinable<Metric>::value ? T(refine_rtol) : T(0);
+
+		for (index_t j = 0; j < n; ++j)
+		{
+			const T sbj = sb[j];
+			for (index_t i = 0; i < m; ++i)
+			{
+				T v = dec.combine(sa[i], sbj, dst_(i, j));
+				if (rtol > T(0) && v < rtol * (sa[i] + sbj))
+				{
+					dst_(i, j) = metric(a.column(i), b.column(j));
+				}
+				else
+				{
+					if (is_pos_def && v < T(0)) v = T(0);
+					dst_(i, j) = dec.finish(v);
+				}
+			}
+		}
+
+		typedef std::is_base_of<dolphin::internal::log_rhs_decomposition<T>, dec_t> has_log_rhs;
+		_patch_zero_support(metric, a, b, dst_, has_log_rhs());
+
+		if (is_pos_def && selfpw)
+		{
+			for (index_t i = 0; i < n; ++i) dst_(i, i) = T(0);
+		}
 	}
 
-	template<typename T, class A, class D>
-	void evaluate(const dolphin::self_pairwise_metric_expr<dolphin::sqeuclidean_distance<T>, A>& expr,
-			IRegularMatrix<D, T>& dst)
+	template<class Metric, class A, class B, class D>
+	DOLPHIN_ENSURE_INLINE
+	inline void _evaluate_gemm(const dolphin::pairwise_metric_expr<Metric, A, B>& expr,
+			IRegularMatrix<D, typename dolphin::metric_traits<Metric>::result_type>& dst, std::true_type)
+	{
+		_evaluate_by_gemm(expr.metric(), expr.arg1(), expr.arg2(), dst, false, expr.options().refine_rtol);
+	}
+
+	template<class Metric, class A, class D>
+	DOLPHIN_ENSURE_INLINE
+	inline void _evaluate_gemm(const dolphin::self_pairwise_metric_expr<Metric, A>& expr,
+			IRegularMatrix<D, typename dolphin::metric_traits<Metric>::result_type>& dst, std::true_type)
+	{
+		_evaluate_by_gemm(expr.metric(), expr.arg(), expr.arg(), dst, true, expr.options().refine_rtol);
+	}
+
+	template<class Expr, class D, typename T>
+	DOLPHIN_ENSURE_INLINE
+	inline void _evaluate_gemm(const Expr& expr, IRegularMatrix<D, T>& dst, std::false_type)
+	{
+		_evaluate(expr, dst);
+	}
+
+
+	/********************************************
+	 *
+	 *  tiled pairwise evaluation
+	 *
+	 ********************************************/
+
+	// the compile-time number of rows of the inputs (0 if dynamic)
+
+	template<class A, class B>
+	struct _static_nrows
+	{
+		static const int value = meta::nrows<A>::value > 0 ? meta::nrows<A>::value : meta::nrows<B>::value;
+	};
+
+	// with Dim > 0, the loops over dimensions are fully unrolled
+
+	template<int Dim, typename Metric, class A, class B, class D>
+	void _evaluate_tiled(const Metric& metric, const A& a, const B& b,
+			IRegularMatrix<D, typename dolphin::metric_traits<Metric>::result_type>& dst, bool selfpw)
 	{
+		typedef typename dolphin::metric_traits<Metric>::input_type T;
+		typedef typename dolphin::metric_traits<Metric>::result_type RT;
+		typedef dolphin::internal::small_dim_kernel<Metric> kernel_t;
+
+		const index_t L = dolphin::internal::pairwise_tile_lanes;
+		const int C = kernel_t::nacc;
+		const bool is_pos_def = dolphin::metric_traits<Metric>::is_positive_definite;
+
 		D& dst_ = dst.derived();
-		const A& a = expr.arg();
+		const index_t d = Dim > 0 ? index_t(Dim) : a.nrows();
+		const index_t m = a.ncolumns();
+		const index_t n = b.ncolumns();
+		LMAT_CHECK_DIMS( a.nrows() == d && b.nrows() == d )
+
+		// a, dimension-major, zero-padded to whole blocks
+
+		const index_t mp = (m + L - 1) / L * L;
+		dense_matrix<T> at(mp, d);
+		for (index_t t = 0; t < d; ++t)
+		{
+			T *c = at.ptr_col(t);
+			for (index_t i = 0; i < m; ++i) c[i] = a(t, i);
+			for (index_t i = m; i < mp; ++i) c[i] = T(0);
+		}
+
+		const kernel_t kernel(metric, d);
+		RT s[C * L];
+
+		for (index_t j = 0; j < n; ++j)
+		{
+			for (index_t i0 = 0; i0 < m; i0 += L)
+			{
+				for (index_t l = 0; l < L; ++l)
+					kernel.template init<L>(s + l);
 
-		const index_t n = a.ncolumns();
+				for (index_t t = 0; t < d; ++t)
+				{
+					const T *x = at.ptr_col(t) + i0;
+					const T yt = b(t, j);
+					for (index_t l = 0; l < L; ++l)
+						kernel.template update<L>(s + l, t, x[l], yt);
+				}
 
-		dense_col<T> sa2(n);
-		colwise_sqsum(a, sa2);
+				const index_t len = m - i0 < L ? m - i0 : L;
+				for (index_t l = 0; l < len; ++l)
+				{
+					RT v = kernel.template finish<L>(s + l);
+					if (is_pos_def && v < RT(0)) v = RT(0);
+					dst_(i0 + l, j) = v;
+				}
+			}
+		}
 
-		dst_ = repcol(sa2, n)  + reprow(as_row(sa2), n);
-		blas::gemm(T(-2), a, a, T(1), dst_, 'T', 'N');
+		if (is_pos_def && selfpw)
+		{
+			for (index_t i = 0; i < n; ++i) dst_(i, i) = RT(0);
+		}
+	}
 
-		_postprocess_posdef_metrics(dst_, true);
+	template<class Metric, class A, class B, class D>
+	DOLPHIN_ENSURE_INLINE
+	inline void _evaluate_tiled(const dolphin::pairwise_metric_expr<Metric, A, B>& expr,
+			IRegularMatrix<D, typename dolphin::metric_traits<Metric>::result_type>& dst, std::true_type)
+	{
+		_evaluate_tiled<_static_nrows<A, B>::value>(
+				expr.metric(), expr.arg1(), expr.arg2(), dst, false);
 	}
 
-	template<typename T, class W, class A, class B, class D>
-	void evaluate(const dolphin::pairwise_metric_expr<dolphin::wsqeuclidean_distance<T, W>, A, B>& expr,
-			IRegularMatrix<D, T>& dst)
+	template<class Metric, class A, class D>
+	DOLPHIN_ENSURE_INLINE
+	inline void _evaluate_tiled(const dolphin::self_pairwise_metric_expr<Metric, A>& expr,
+			IRegularMatrix<D, typename dolphin::metric_traits<Metric>::result_type>& dst, std::true_type)
 	{
-		D& dst_ = dst.derived();
-		const A& a = expr.arg1();
-		const B& b = expr.arg2();
-		const W& w = expr.metric().weights();
+		_evaluate_tiled<_static_nrows<A, A>::value>(
+				expr.metric(), expr.arg(), expr.arg(), dst, true);
+	}
+
+	template<class Expr, class D, typename T>
+	DOLPHIN_ENSURE_INLINE
+	inline void _evaluate_tiled(const Expr& expr, IRegularMatrix<D, T>& dst, std::false_type)
+	{
+		_evaluate(expr, dst);
+	}
+
+
+	/********************************************
+	 *
+	 *  panel pairwise evaluation
+	 *
+	 ********************************************/
+
+	// Mixed-precision metrics widen blocks of pairwise_panel_cols
+	// columns of each side into panels of the accumulation type, and
+	// evaluate their widened_metric over each pair of panels, with its
+	// own planning. No widened copy of a whole input is made.
+
+	template<class Policy, class A>
+	DOLPHIN_ENSURE_INLINE
+	inline void _widen_column(const A& a, index_t j, typename Policy::accum_type *p, std::true_type)
+	{
+		Policy::widen_n(a.ptr_col(j), p, a.nrows());
+	}
+
+	template<class Policy, class A>
+	inline void _widen_column(const A& a, index_t j, typename Policy::accum_type *p, std::false_type)
+	{
+		const index_t d = a.nrows();
+		for (index_t t = 0; t < d; ++t) p[t] = Policy::widen(a(t, j));
+	}
+
+	template<class Policy, class A>
+	inline void _widen_panel(const A& a, index_t j0, dense_matrix<typename Policy::accum_type>& p)
+	{
+		for (index_t j = 0; j < p.ncolumns(); ++j)
+			_widen_column<Policy>(a, j0 + j, p.ptr_col(j),
+					std::integral_constant<bool, meta::is_percol_contiguous<A>::value>());
+	}
+
+	template<class Metric, class A, class B, class D>
+	void _evaluate_panels(const Metric& metric, const A& a, const B& b,
+			IRegularMatrix<D, typename dolphin::metric_traits<Metric>::result_type>& dst, bool selfpw,
+			const dolphin::pairwise_options& opts)
+	{
+		typedef typename Metric::policy_type policy_t;
+		typedef typename policy_t::accum_type TAcc;
+		typedef typename dolphin::internal::widened_metric<Metric>::type base_t;
+
+		const index_t P = dolphin::internal::pairwise_panel_cols;
+		const bool mirror = selfpw && dolphin::metric_traits<Metric>::is_symmetric;
 
+		D& dst_ = dst.derived();
+		const index_t d = a.nrows();
 		const index_t m = a.ncolumns();
 		const index_t n = b.ncolumns();
+		LMAT_CHECK_DIMS( b.nrows() == d )
+
+		base_t base;
+
+		for (index_t j0 = 0; j0 < n; j0 += P)
+		{
+			const index_t nj = n - j0 < P ? n - j0 : P;
+			dense_matrix<TAcc> pb(d, nj);
+			_widen_panel<policy_t>(b, j0, pb);
+
+			// with mirror, the blocks above the diagonal are copies
+
+			for (index_t i0 = (mirror ? j0 : 0); i0 < m; i0 += P)
+			{
+				const index_t mi = m - i0 < P ? m - i0 : P;
+				dense_matrix<TAcc> r(mi, nj);
+
+				if (selfpw && i0 == j0)
+				{
+					evaluate(dolphin::pairwise(base, pb, opts), r);
+				}
+				else
+				{
+					dense_matrix<TAcc> pa(d, mi);
+					_widen_panel<policy_t>(a, i0, pa);
+					evaluate(dolphin::pairwise(base, pa, pb, opts), r);
+				}
+
+				for (index_t j = 0; j < nj; ++j)
+				{
+					for (index_t i = 0; i < mi; ++i)
+					{
+						dst_(i0 + i, j0 + j) = policy_t::narrow(r(i, j));
+						if (mirror && i0 > j0)
+							dst_(j0 + j, i0 + i) = dst_(i0 + i, j0 + j);
+					}
+				}
+			}
+		}
+	}
+
+
+	/********************************************
+	 *
+	 *  pairwise evaluation dispatch
+	 *
+	 ********************************************/
 
-		dense_col<T> sa2(m);
-		dense_row<T> sb2(n);
+	// The method of the expression is used, or, if PAIRWISE_AUTO,
+	// the one chosen by plan_pairwise at run time. A small
+	// compile-time number of rows (at most 8) takes the tiled
+	// kernels under PAIRWISE_AUTO, when the metric has them.
 
-		colwise_sum(sqr(a) * repcol(w, m), sa2);
-		colwise_sum(sqr(b) * repcol(w, n), sb2);
+	template<class Metric, class A, class B>
+	struct _small_dim_pairwise
+	{
+		static const int dim = _static_nrows<A, B>::value;
+		static const bool value = dolphin::internal::small_dim_kernel<Metric>::value && dim > 0 && dim <= 8;
+	};
 
-		dst_ = repcol(sa2, n)  + reprow(sb2, m);
+	template<class Metric, class Expr, class D>
+	void _evaluate_method(const Expr& expr, D& dst, dolphin::pairwise_method method)
+	{
+		switch (method)
+		{
+		case dolphin::PAIRWISE_GEMM:
+			_evaluate_gemm(expr, dst, std::integral_constant<bool,
+					dolphin::internal::gemm_path_available<Metric>::value>());
+			break;
+
+		case dolphin::PAIRWISE_TILED:
+			_evaluate_tiled(expr, dst, std::integral_constant<bool,
+					dolphin::internal::small_dim_kernel<Metric>::value>());
+			break;
+
+		default:
+			_evaluate(expr, dst);
+		}
+	}
 
-		dense_matrix<T> wa = a * repcol(w, m);
-		blas::gemm(T(-2), wa, b, T(1), dst_, 'T', 'N');
+	template<class Metric, class Expr, class D>
+	void _evaluate_planned(const Expr& expr, D& dst, index_t m, index_t n, index_t d, std::false_type)
+	{
+		dolphin::pairwise_method method = expr.options().method;
+		if (method == dolphin::PAIRWISE_AUTO)
+			method = dolphin::plan_pairwise<Metric>(m, n, d);
 
-		_postprocess_posdef_metrics(dst_, false);
+		_evaluate_method<Metric>(expr, dst, method);
 	}
 
-	template<typename T, class W, class A, class D>
-	void evaluate(const dolphin::self_pairwise_metric_expr<dolphin::wsqeuclidean_distance<T, W>, A>& expr,
-			IRegularMatrix<D, T>& dst)
+	template<class Metric, class Expr, class D>
+	DOLPHIN_ENSURE_INLINE
+	inline void _evaluate_planned(const Expr& expr, D& dst, index_t, index_t, index_t, std::true_type)
 	{
-		D& dst_ = dst.derived();
-		const A& a = expr.arg();
-		const W& w = expr.metric().weights();
+		dolphin::pairwise_method method = expr.options().method;
+		if (method == dolphin::PAIRWISE_AUTO)
+			method = dolphin::PAIRWISE_TILED;
+
+		_evaluate_method<Metric>(expr, dst, method);
+	}
+
+	template<class Metric, class A, class B, class D>
+	DOLPHIN_ENSURE_INLINE
+	inline void _evaluate_pairwise(const dolphin::pairwise_metric_expr<Metric, A, B>& expr,
+			IRegularMatrix<D, typename dolphin::metric_traits<Metric>::result_type>& dst, std::false_type)
+	{
+		_evaluate_planned<Metric>(expr, dst,
+				expr.arg1().ncolumns(), expr.arg2().ncolumns(), expr.arg1().nrows(),
+				std::integral_constant<bool, _small_dim_pairwise<Metric, A, B>::value>());
+	}
 
-		const index_t n = a.ncolumns();
+	template<class Metric, class A, class D>
+	DOLPHIN_ENSURE_INLINE
+	inline void _evaluate_pairwise(const dolphin::self_pairwise_metric_expr<Metric, A>& expr,
+			IRegularMatrix<D, typename dolphin::metric_traits<Metric>::result_type>& dst, std::false_type)
+	{
+		_evaluate_planned<Metric>(expr, dst,
+				expr.arg().ncolumns(), expr.arg().ncolumns(), expr.arg().nrows(),
+				std::integral_constant<bool, _small_dim_pairwise<Metric, A, A>::value>());
+	}
 
-		dense_col<T> sa2(n);
-		colwise_sum(sqr(a) * repcol(w, n), sa2);
+	template<class Metric, class A, class B, class D>
+	DOLPHIN_ENSURE_INLINE
+	inline void _evaluate_pairwise(const dolphin::pairwise_metric_expr<Metric, A, B>& expr,
+			IRegularMatrix<D, typename dolphin::metric_traits<Metric>::result_type>& dst, std::true_type)
+	{
+		_evaluate_panels(expr.metric(), expr.arg1(), expr.arg2(), dst, false, expr.options());
+	}
 
-		dst_ = repcol(sa2, n)  + reprow(as_row(sa2), n);
+	template<class Metric, class A, class D>
+	DOLPHIN_ENSURE_INLINE
+	inline void _evaluate_pairwise(const dolphin::self_pairwise_metric_expr<Metric, A>& expr,
+			IRegularMatrix<D, typename dolphin::metric_traits<Metric>::result_type>& dst, std::true_type)
+	{
+		_evaluate_panels(expr.metric(), expr.arg(), expr.arg(), dst, true, expr.options());
+	}
 
-		dense_matrix<T> wa = a * repcol(w, n);
-		blas::gemm(T(-2), wa, a, T(1), dst_, 'T', 'N');
+	template<class Metric, class A, class B, class D>
+	inline void evaluate(const dolphin::pairwise_metric_expr<Metric, A, B>& expr,
+			IRegularMatrix<D, typename dolphin::metric_traits<Metric>::result_type>& dst)
+	{
+		_evaluate_pairwise(expr, dst, std::integral_constant<bool,
+				dolphin::internal::widened_metric<Metric>::value>());
+	}
 
-		_postprocess_posdef_metrics(dst_, true);
+	template<class Metric, class A, class D>
+	inline void evaluate(const dolphin::self_pairwise_metric_expr<Metric, A>& expr,
+			IRegularMatrix<D, typename dolphin::metric_traits<Metric>::result_type>& dst)
+	{
+		_evaluate_pairwise(expr, dst, std::integral_constant<bool,
+				dolphin::internal::widened_metric<Metric>::value>());
 	}
 
-	// euclidean_distance
 
-	template<typename T, class A, class B, class D>
-	void evaluate(const dolphin::pairwise_metric_expr<dolphin::euclidean_distance<T>, A, B>& expr,
+	/********************************************
+	 *
+	 *  specialized pairwise evaluation
+	 *
+	 ********************************************/
+
+	// sqmahalanobis_distance: both sides are transformed by L' once,
+	// in O(n d^2), after which the sqeuclidean GEMM path takes over
+
+	template<typename T, class L, class A, class B, class D>
+	void evaluate(const dolphin::pairwise_metric_expr<dolphin::sqmahalanobis_distance<T, L>, A, B>& expr,
 			IRegularMatrix<D, T>& dst)
 	{
-		D& dst_ = dst.derived();
+		const L& l = expr.metric().chol_factor();
+		const A& a = expr.arg1();
+		const B& b = expr.arg2();
+
+		dense_matrix<T> ta(l.ncolumns(), a.ncolumns());
+		dense_matrix<T> tb(l.ncolumns(), b.ncolumns());
+		blas::gemm(l, a, ta, 'T', 'N');
+		blas::gemm(l, b, tb, 'T', 'N');
 
 		dolphin::sqeuclidean_distance<T> sqdist;
-		dst_ = dolphin::pairwise(sqdist, expr.arg1(), expr.arg2());
-		dst_ = sqrt(dst_);
+		dst.derived() = dolphin::pairwise(sqdist, ta, tb);
 	}
 
-	template<typename T, class A, class D>
-	void evaluate(const dolphin::self_pairwise_metric_expr<dolphin::euclidean_distance<T>, A>& expr,
+	template<typename T, class L, class A, class D>
+	void evaluate(const dolphin::self_pairwise_metric_expr<dolphin::sqmahalanobis_distance<T, L>, A>& expr,
 			IRegularMatrix<D, T>& dst)
 	{
-		D& dst_ = dst.derived();
+		const L& l = expr.metric().chol_factor();
+		const A& a = expr.arg();
+
+		dense_matrix<T> ta(l.ncolumns(), a.ncolumns());
+		blas::gemm(l, a, ta, 'T', 'N');
 
 		dolphin::sqeuclidean_distance<T> sqdist;
-		dst_ = dolphin::pairwise(sqdist, expr.arg());
-		dst_ = sqrt(dst_);
+		dst.derived() = dolphin::pairwise(sqdist, ta);
 	}
 
-	template<typename T, class W, class A, class B, class D>
-	void evaluate(const dolphin::pairwise_metric_expr<dolphin::weuclidean_distance<T, W>, A, B>& expr,
+	template<typename T, class L, class A, class B, class D>
+	void evaluate(const dolphin::pairwise_metric_expr<dolphin::mahalanobis_distance<T, L>, A, B>& expr,
 			IRegularMatrix<D, T>& dst)
 	{
 		D& dst_ = dst.derived();
 
-		dolphin::wsqeuclidean_distance<T, W> sqdist(expr.metric().weights());
+		dolphin::sqmahalanobis_distance<T, L> sqdist(expr.metric().chol_factor());
 		dst_ = dolphin::pairwise(sqdist, expr.arg1(), expr.arg2());
 		dst_ = sqrt(dst_);
 	}
 
-	template<typename T, class W, class A, class D>
-	void evaluate(const dolphin::self_pairwise_metric_expr<dolphin::weuclidean_distance<T, W>, A>& expr,
+	template<typename T, class L, class A, class D>
+	void evaluate(const dolphin::self_pairwise_metric_expr<dolphin::mahalanobis_distance<T, L>, A>& expr,
 			IRegularMatrix<D, T>& dst)
 	{
 		D& dst_ = dst.derived();
 
-		dolphin::wsqeuclidean_distance<T, W> sqdist(expr.metric().weights());
+		dolphin::sqmahalanobis_distance<T, L> sqdist(expr.metric().chol_factor());
 		dst_ = dolphin::pairwise(sqdist, expr.arg());
 		dst_ = sqrt(dst_);
 	}
 
 
-	// cosine_distance
+	// correlation_distance: the columns are centered into copies
+	// (constant columns to exact zeros) before the products are
+	// formed, by the tiled kernel or by one GEMM
+
+	template<typename T, class A>
+	void _center_columns(const A& a, dense_matrix<T>& ac)
+	{
+		const index_t d = a.nrows();
+		const T c = math::rcp(T(d));
+
+		for (index_t i = 0; i < a.ncolumns(); ++i)
+		{
+			T *p = ac.ptr_col(i);
+			const T x0 = d > 0 ? a(0, i) : T(0);
+
+			T s(0);
+			bool cst = true;
+			for (index_t t = 0; t < d; ++t)
+			{
+				const T x = a(t, i);
+				s += x;
+				cst &= (x == x0);
+			}
+
+			const T mu = cst ? x0 : s * c;
+			for (index_t t = 0; t < d; ++t) p[t] = a(t, i) - mu;
+		}
+	}
+
+	// reciprocal norms of centered columns, with 0 for zero columns,
+	// which puts them at distance 1
+
+	template<typename T>
+	void _rcp_colnorms(const dense_matrix<T>& ac, dense_col<T>& r)
+	{
+		for (index_t i = 0; i < ac.ncolumns(); ++i)
+		{
+			const T s = sqsum(ac.column(i));
+			r[i] = s > T(0) ? math::rcp(math::sqrt(s)) : T(0);
+		}
+	}
 
 	template<typename T, class A, class B, class D>
-	void evaluate(const dolphin::pairwise_metric_expr<dolphin::cosine_distance<T>, A, B>& expr,
-			IRegularMatrix<D, T>& dst)
+	void _evaluate_correlation(const A& a, const B& b, IRegularMatrix<D, T>& dst, bool selfpw)
 	{
 		D& dst_ = dst.derived();
-		const A& a = expr.arg1();
-		const B& b = expr.arg2();
 
+		const index_t d = a.nrows();
 		const index_t m = a.ncolumns();
 		const index_t n = b.ncolumns();
 
+		dense_matrix<T> ac(d, m);
 		dense_col<T> ra(m);
-		dense_row<T> rb(n);
+		_center_columns(a, ac);
+		_rcp_colnorms(ac, ra);
+
+		dense_matrix<T> bc(d, selfpw ? 0 : n);
+		dense_col<T> rb(selfpw ? 0 : n);
+		if (!selfpw)
+		{
+			_center_columns(b, bc);
+			_rcp_colnorms(bc, rb);
+		}
+
+		const dense_matrix<T>& bc_ = selfpw ? ac : bc;
+		const dense_col<T>& rb_ = selfpw ? ra : rb;
+
+		blas::gemm(ac, bc_, dst_, 'T', 'N');
+
+		for (index_t j = 0; j < n; ++j)
+		{
+			const T rbj = rb_[j];
+
+			for (index_t i = 0; i < m; ++i)
+			{
+				T v = T(1) - dst_(i, j) * ra[i] * rbj;
+				dst_(i, j) = v > T(0) ? v : T(0);
+			}
+		}
 
-		for (index_t i = 0; i < m; ++i) ra[i] = math::rcp(sqsum(a.column(i)));
-		for (index_t j = 0; j < n; ++j) rb[j] = math::rcp(sqsum(b.column(j)));
+		if (selfpw)
+		{
+			for (index_t i = 0; i < n; ++i) dst_(i, i) = T(0);
+		}
+	}
 
-		blas::gemm(a, b, dst_, 'T', 'N');
-		dst_ = T(1) - dst_ * sqrt(repcol(ra, n) * reprow(rb, m));
+	// the GEMM method of correlation_distance
 
-		_postprocess_posdef_metrics(dst_, false);
+	template<typename T, class A, class B, class D>
+	inline void _evaluate_gemm(const dolphin::pairwise_metric_expr<dolphin::correlation_distance<T>, A, B>& expr,
+			IRegularMatrix<D, T>& dst, std::true_type)
+	{
+		_evaluate_correlation(expr.arg1(), expr.arg2(), dst, false);
 	}
 
 	template<typename T, class A, class D>
-	void evaluate(const dolphin::self_pairwise_metric_expr<dolphin::cosine_distance<T>, A>& expr,
-			IRegularMatrix<D, T>& dst)
+	inline void _evaluate_gemm(const dolphin::self_pairwise_metric_expr<dolphin::correlation_distance<T>, A>& expr,
+			IRegularMatrix<D, T>& dst, std::true_type)
 	{
-		D& dst_ = dst.derived();
-		const A& a = expr.arg();
+		_evaluate_correlation(expr.arg(), expr.arg(), dst, true);
+	}
+
+	// the tiled method of correlation_distance
+
+	template<typename T, class A, class B, class D>
+	inline void _evaluate_tiled(const dolphin::pairwise_metric_expr<dolphin::correlation_distance<T>, A, B>& expr,
+			IRegularMatrix<D, T>& dst, std::true_type)
+	{
+		const A& a = expr.arg1();
+		const B& b = expr.arg2();
 
-		const index_t n = a.ncolumns();
+		dense_matrix<T> ac(a.nrows(), a.ncolumns());
+		dense_matrix<T> bc(b.nrows(), b.ncolumns());
+		_center_columns(a, ac);
+		_center_columns(b, bc);
 
-		dense_col<T> ra(n);
+		_evaluate_tiled<_static_nrows<A, B>::value>(expr.metric(), ac, bc, dst, false);
+	}
 
-		for (index_t i = 0; i < n; ++i) ra[i] = math::rcp(sqsum(a.column(i)));
+	template<typename T, class A, class D>
+	inline void _evaluate_tiled(const dolphin::self_pairwise_metric_expr<dolphin::correlation_distance<T>, A>& expr,
+			IRegularMatrix<D, T>& dst, std::true_type)
+	{
+		const A& a = expr.arg();
 
-		blas::gemm(a, a, dst_, 'T', 'N');
-		dst_ = T(1) - dst_ * sqrt(repcol(ra, n) * reprow(as_row(ra), n));
+		dense_matrix<T> ac(a.nrows(), a.ncolumns());
+		_center_columns(a, ac);
 
-		_postprocess_posdef_metrics(dst_, true);
+		_evaluate_tiled<_static_nrows<A, A>::value>(expr.metric(), ac, ac, dst, true);
 	}
 }
 
@@ -0,0 +1,118 @@
+/**
+ * @file mixed_precision.h
+ *
+ * @brief Precision policies for reductions over stored values
+ *
+ * @author Dahua Lin
+ */
+
+#ifdef _MSC_VER
+#pragma once
+#endif
+
+#ifndef DOLPHIN_MIXED_PRECISION_H_
+#define DOLPHIN_MIXED_PRECISION_H_
+
+#include <dolphin/common/common_base.h>
+#include <type_traits>
+
+#if defined(__AVX__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+namespace dolphin
+{
+	/**
+	 * Widens n stored values. Overloads for specific storage types
+	 * (e.g. in half.h) are found by argument-dependent lookup.
+	 */
+	template<typename TIn, typename TAcc>
+	inline void widen_values(const TIn *src, TAcc *dst, index_t n)
+	{
+		for (index_t i = 0; i < n; ++i) dst[i] = static_cast<TAcc>(src[i]);
+	}
+
+	/**
+	 * Widens n floats to double, with packed conversions under SSE2
+	 * or AVX.
+	 */
+	inline void widen_values(const float *src, double *dst, index_t n)
+	{
+		index_t i = 0;
+
+#if defined(__AVX__)
+		for (; i + 8 <= n; i += 8)
+		{
+			__m256 f = _mm256_loadu_ps(src + i);
+			_mm256_storeu_pd(dst + i, _mm256_cvtps_pd(_mm256_castps256_ps128(f)));
+			_mm256_storeu_pd(dst + i + 4, _mm256_cvtps_pd(_mm256_extractf128_ps(f, 1)));
+		}
+#elif defined(__SSE2__)
+		for (; i + 4 <= n; i += 4)
+		{
+			__m128 f = _mm_loadu_ps(src + i);
+			_mm_storeu_pd(dst + i, _mm_cvtps_pd(f));
+			_mm_storeu_pd(dst + i + 2, _mm_cvtps_pd(_mm_movehl_ps(f, f)));
+		}
+#endif
+		for (; i < n; ++i) dst[i] = double(src[i]);
+	}
+
+
+	/********************************************
+	 *
+	 *  mixed_precision
+	 *
+	 *  Values are stored as TIn, widened to TAcc
+	 *  when loaded, accumulated as TAcc, and the
+	 *  results are written as TOut. For float to
+	 *  double, single-pair metrics widen packs of
+	 *  floats in SIMD registers and keep several
+	 *  packs of double partial sums (see mp_fold
+	 *  in metrics.h), and widen_n converts four or
+	 *  eight floats per instruction. Pairwise
+	 *  evaluation widens whole columns with
+	 *  widen_n, and runs the kernels of TAcc on
+	 *  the widened panels.
+	 *
+	 ********************************************/
+
+	template<typename TIn, typename TAcc=TIn, typename TOut=TAcc>
+	struct mixed_precision
+	{
+		static_assert(std::is_floating_point<TAcc>::value,
+				"TAcc must be a floating-point type.");
+		static_assert(sizeof(TAcc) >= sizeof(TIn),
+				"TAcc must be at least as wide as TIn.");
+
+		typedef TIn input_type;
+		typedef TAcc accum_type;
+		typedef TOut output_type;
+
+		DOLPHIN_ENSURE_INLINE
+		static TAcc widen(const TIn& x)
+		{
+			return static_cast<TAcc>(x);
+		}
+
+		DOLPHIN_ENSURE_INLINE
+		static TOut narrow(const TAcc& x)
+		{
+			return static_cast<TOut>(x);
+		}
+
+		DOLPHIN_ENSURE_INLINE
+		static void widen_n(const TIn *src, TAcc *dst, index_t n)
+		{
+			widen_values(src, dst, n);
+		}
+	};
+
+	// float storage, double accumulation, float or double results
+
+	typedef mixed_precision<float, double, float> float_acc_double;
+	typedef mixed_precision<float, double, double> float_to_double;
+
+}
+
+#endif
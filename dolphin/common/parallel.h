@@ -0,0 +1,118 @@
+/**
+ * @file parallel.h
+ *
+ * @brief Simple loop-level parallelism
+ *
+ * Loops are run by OpenMP threads when the library is compiled
+ * with OpenMP enabled, and serially otherwise. The loop body of
+ * parallel_for and parallel_for_chunks must not throw, as exceptions
+ * cannot propagate out of a parallel region; bodies that may throw
+ * go through parallel_for_checked.
+ *
+ * @author Dahua Lin
+ */
+
+#ifdef _MSC_VER
+#pragma once
+#endif
+
+#ifndef DOLPHIN_PARALLEL_H_
+#define DOLPHIN_PARALLEL_H_
+
+#include <dolphin/common/common_base.h>
+
+#include <vector>
+#include <exception>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace dolphin
+{
+
+	DOLPHIN_ENSURE_INLINE
+	inline index_t max_num_threads()
+	{
+#ifdef _OPENMP
+		return static_cast<index_t>(omp_get_max_threads());
+#else
+		return 1;
+#endif
+	}
+
+	DOLPHIN_ENSURE_INLINE
+	inline index_t thread_rank()
+	{
+#ifdef _OPENMP
+		return static_cast<index_t>(omp_get_thread_num());
+#else
+		return 0;
+#endif
+	}
+
+	/**
+	 * Calls fun(i) for each i in [0, n), distributing the iterations
+	 * dynamically over threads (suitable for uneven workloads).
+	 */
+	template<class Fun>
+	inline void parallel_for(index_t n, const Fun& fun)
+	{
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+		for (index_t i = 0; i < n; ++i)
+		{
+			fun(i);
+		}
+	}
+
+	/**
+	 * Calls fun(i0, i1) over consecutive chunks [i0, i1) of [0, n),
+	 * each with at most chunk_size iterations.
+	 */
+	template<class Fun>
+	inline void parallel_for_chunks(index_t n, index_t chunk_size, const Fun& fun)
+	{
+		const index_t nchunks = (n + chunk_size - 1) / chunk_size;
+
+		parallel_for(nchunks, [&](index_t c)
+		{
+			const index_t i0 = c * chunk_size;
+			const index_t i1 = i0 + chunk_size < n ? i0 + chunk_size : n;
+			fun(i0, i1);
+		});
+	}
+
+	/**
+	 * Calls fun(i) for each i in [0, n) like parallel_for, for loop
+	 * bodies that may throw. Exceptions are caught within the parallel
+	 * region, and that of the lowest failing iteration is rethrown
+	 * once all iterations have finished.
+	 */
+	template<class Fun>
+	inline void parallel_for_checked(index_t n, const Fun& fun)
+	{
+		std::vector<std::exception_ptr> errs(static_cast<size_t>(n));
+
+		parallel_for(n, [&](index_t i)
+		{
+			try
+			{
+				fun(i);
+			}
+			catch (...)
+			{
+				errs[i] = std::current_exception();
+			}
+		});
+
+		for (index_t i = 0; i < n; ++i)
+		{
+			if (errs[i]) std::rethrow_exception(errs[i]);
+		}
+	}
+
+}
+
+#endif
@@ -0,0 +1,385 @@
+/**
+ * @file pd_chol_cache.h
+ *
+ * @brief Cached Cholesky factors and log-determinants of PD matrices
+ *
+ * @author Dahua Lin
+ */
+
+#ifdef _MSC_VER
+#pragma once
+#endif
+
+#ifndef DOLPHIN_PD_CHOL_CACHE_H_
+#define DOLPHIN_PD_CHOL_CACHE_H_
+
+#include <dolphin/common/import_lmat.h>
+#include <dolphin/common/parallel.h>
+#include <cmath>
+#include <vector>
+
+namespace dolphin
+{
+	namespace internal
+	{
+		/**
+		 * Factors the d x d positive definite matrix a as L L', writing
+		 * the lower triangular L (with zero upper part) to l. Returns
+		 * false if a is not (numerically) positive definite.
+		 */
+		template<typename T>
+		bool chol_lower(index_t d, const T *a, T *l)
+		{
+			for (index_t j = 0; j < d; ++j)
+			{
+				const T *aj = a + j * d;
+				T *lj = l + j * d;
+				for (index_t i = 0; i < j; ++i) lj[i] = T(0);
+				for (index_t i = j; i < d; ++i) lj[i] = aj[i];
+			}
+
+			for (index_t j = 0; j < d; ++j)
+			{
+				T *lj = l + j * d;
+
+				const T v = lj[j];
+				if (!(v > T(0))) return false;
+
+				const T r = std::sqrt(v);
+				const T c = T(1) / r;
+				lj[j] = r;
+				for (index_t i = j + 1; i < d; ++i) lj[i] *= c;
+
+				for (index_t k = j + 1; k < d; ++k)
+				{
+					T *lk = l + k * d;
+					const T u = lj[k];
+					for (index_t i = k; i < d; ++i) lk[i] -= lj[i] * u;
+				}
+			}
+
+			return true;
+		}
+
+		template<typename T>
+		inline T chol_logdet(index_t d, const T *l)
+		{
+			T s(0);
+			for (index_t i = 0; i < d; ++i) s += std::log(l[i * (d + 1)]);
+			return s * T(2);
+		}
+
+		/**
+		 * Updates L to the factor of L L' + sgn * x x', where sgn
+		 * is +1 or -1, in O(d^2). x is overwritten. Returns false
+		 * if a downdate would lose positive definiteness, in which
+		 * case L is left partially modified.
+		 */
+		template<typename T>
+		bool chol_rank1(index_t d, T *l, T *x, bool downdate)
+		{
+			for (index_t i = 0; i < d; ++i)
+			{
+				T *li = l + i * d;
+				const T lii = li[i];
+				const T xi = x[i];
+
+				T r;
+				if (downdate)
+				{
+					const T r2 = (lii - xi) * (lii + xi);
+					if (!(r2 > T(0))) return false;
+					r = std::sqrt(r2);
+				}
+				else
+				{
+					r = std::hypot(lii, xi);
+				}
+
+				const T c = r / lii;
+				const T s = xi / lii;
+				const T rc = T(1) / c;
+				li[i] = r;
+
+				if (downdate)
+				{
+					for (index_t j = i + 1; j < d; ++j)
+					{
+						const T v = (li[j] - s * x[j]) * rc;
+						x[j] = c * x[j] - s * v;
+						li[j] = v;
+					}
+				}
+				else
+				{
+					for (index_t j = i + 1; j < d; ++j)
+					{
+						const T v = (li[j] + s * x[j]) * rc;
+						x[j] = c * x[j] - s * v;
+						li[j] = v;
+					}
+				}
+			}
+			return true;
+		}
+
+		// solves L y = b in place
+		template<typename T>
+		inline void chol_solve_lower(index_t d, const T *l, T *b)
+		{
+			for (index_t j = 0; j < d; ++j)
+			{
+				const T *lj = l + j * d;
+				const T v = b[j] / lj[j];
+				b[j] = v;
+				for (index_t i = j + 1; i < d; ++i) b[i] -= lj[i] * v;
+			}
+		}
+
+		// solves L' y = b in place
+		template<typename T>
+		inline void chol_solve_upper(index_t d, const T *l, T *b)
+		{
+			for (index_t j = d - 1; j >= 0; --j)
+			{
+				const T *lj = l + j * d;
+				T s = b[j];
+				for (index_t i = j + 1; i < d; ++i) s -= lj[i] * b[i];
+				b[j] = s / lj[j];
+			}
+		}
+	}
+
+
+	/********************************************
+	 *
+	 *  pd_chol_cache
+	 *
+	 *  Keeps the Cholesky factors (A = L L') and
+	 *  log-determinants of K positive definite
+	 *  d x d matrices, so that they are computed
+	 *  once per change of the matrices and then
+	 *  reused by everything that needs them.
+	 *
+	 *  Matrices are passed stacked as the columns
+	 *  of a (d * d) x K matrix.
+	 *
+	 ********************************************/
+
+	template<typename T=double>
+	class pd_chol_cache
+	{
+		static_assert(std::is_floating_point<T>::value,
+				"T must be floating-point types.");
+
+	public:
+		typedef T value_type;
+
+	public:
+		pd_chol_cache(index_t d, index_t K)
+		: m_dim(d)
+		, m_K(K)
+		, m_factors(d * d, K)
+		, m_logdets(K)
+		{
+			check_arg(d > 0 && K >= 0, "pd_chol_cache: invalid dimensions.");
+			m_factors << T(0);
+			m_logdets << T(0);
+		}
+
+		DOLPHIN_ENSURE_INLINE index_t dim() const { return m_dim; }
+		DOLPHIN_ENSURE_INLINE index_t count() const { return m_K; }
+
+		/**
+		 * Factors all matrices in a ((d * d) x K), in parallel.
+		 */
+		template<class A>
+		void factorize(const IRegularMatrix<A, T>& a)
+		{
+			static_assert(is_percol_contiguous<A>::value, "a must be percol-contiguous");
+			check_arg(a.nrows() == m_dim * m_dim && a.ncolumns() == m_K,
+					"pd_chol_cache: the size of a is invalid.");
+
+			const A& a_ = a.derived();
+			const index_t d = m_dim;
+
+			// no exception can leave a parallel region, so failures
+			// are collected and reported afterwards
+
+			std::vector<char> ok(static_cast<size_t>(m_K));
+
+			parallel_for(m_K, [&](index_t k)
+			{
+				T *l = m_factors.ptr_col(k);
+				ok[k] = internal::chol_lower(d, a_.ptr_col(k), l);
+				if (ok[k]) m_logdets[k] = internal::chol_logdet(d, l);
+			});
+
+			for (index_t k = 0; k < m_K; ++k)
+				check_arg(ok[k] != 0, "pd_chol_cache: a matrix is not positive definite.");
+		}
+
+		/**
+		 * Factors a single d x d matrix into the k-th slot.
+		 */
+		template<class A>
+		void factorize(index_t k, const IRegularMatrix<A, T>& a)
+		{
+			static_assert(is_contiguous<A>::value, "a must be contiguous");
+			check_arg(a.nrows() == m_dim && a.ncolumns() == m_dim,
+					"pd_chol_cache: the size of a is invalid.");
+
+			T *l = m_factors.ptr_col(k);
+			check_arg(internal::chol_lower(m_dim, a.derived().ptr_data(), l),
+					"pd_chol_cache: the matrix is not positive definite.");
+			m_logdets[k] = internal::chol_logdet(m_dim, l);
+		}
+
+		DOLPHIN_ENSURE_INLINE
+		cref_matrix<T> factor(index_t k) const
+		{
+			return cref_matrix<T>(m_factors.ptr_col(k), m_dim, m_dim);
+		}
+
+		DOLPHIN_ENSURE_INLINE
+		const dense_matrix<T>& factors() const
+		{
+			return m_factors;
+		}
+
+		DOLPHIN_ENSURE_INLINE
+		T logdet(index_t k) const
+		{
+			return m_logdets[k];
+		}
+
+		DOLPHIN_ENSURE_INLINE
+		const dense_col<T>& logdets() const
+		{
+			return m_logdets;
+		}
+
+		/**
+		 * Changes the k-th matrix A to A + x x' (or A - x x' for
+		 * rank1_downdate) by updating its factor in O(d^2).
+		 */
+		template<class X>
+		void rank1_update(index_t k, const IRegularMatrix<X, T>& x)
+		{
+			rank1_(k, x, false);
+		}
+
+		template<class X>
+		void rank1_downdate(index_t k, const IRegularMatrix<X, T>& x)
+		{
+			rank1_(k, x, true);
+		}
+
+		/**
+		 * Solves L y = b for each column of b, in place.
+		 */
+		template<class B>
+		void solve_lower(index_t k, IRegularMatrix<B, T>& b) const
+		{
+			static_assert(is_percol_contiguous<B>::value, "b must be percol-contiguous");
+			check_arg(b.nrows() == m_dim, "pd_chol_cache: the size of b is invalid.");
+
+			B& b_ = b.derived();
+			const T *l = m_factors.ptr_col(k);
+			for (index_t j = 0; j < b.ncolumns(); ++j)
+				internal::chol_solve_lower(m_dim, l, b_.ptr_col(j));
+		}
+
+		/**
+		 * Solves L' y = b for each column of b, in place.
+		 */
+		template<class B>
+		void solve_upper(index_t k, IRegularMatrix<B, T>& b) const
+		{
+			static_assert(is_percol_contiguous<B>::value, "b must be percol-contiguous");
+			check_arg(b.nrows() == m_dim, "pd_chol_cache: the size of b is invalid.");
+
+			B& b_ = b.derived();
+			const T *l = m_factors.ptr_col(k);
+			for (index_t j = 0; j < b.ncolumns(); ++j)
+				internal::chol_solve_upper(m_dim, l, b_.ptr_col(j));
+		}
+
+		/**
+		 * Solves A y = b for each column of b, in place.
+		 */
+		template<class B>
+		void solve(index_t k, IRegularMatrix<B, T>& b) const
+		{
+			static_assert(is_percol_contiguous<B>::value, "b must be percol-contiguous");
+			check_arg(b.nrows() == m_dim, "pd_chol_cache: the size of b is invalid.");
+
+			B& b_ = b.derived();
+			const T *l = m_factors.ptr_col(k);
+			for (index_t j = 0; j < b.ncolumns(); ++j)
+			{
+				internal::chol_solve_lower(m_dim, l, b_.ptr_col(j));
+				internal::chol_solve_upper(m_dim, l, b_.ptr_col(j));
+			}
+		}
+
+		/**
+		 * Writes x' A^{-1} x = |L^{-1} x|^2 for each column x of xs
+		 * to r, with xs overwritten by L^{-1} xs.
+		 */
+		template<class X, class R>
+		void sqmahal_inplace(index_t k, IRegularMatrix<X, T>& xs, IRegularMatrix<R, T>& r) const
+		{
+			static_assert(supports_linear_index<R>::value, "r must support linear indexing");
+			check_arg(r.nelems() == xs.ncolumns(), "pd_chol_cache: the size of r is invalid.");
+
+			solve_lower(k, xs);
+
+			const X& xs_ = xs.derived();
+			R& r_ = r.derived();
+			for (index_t j = 0; j < xs.ncolumns(); ++j)
+			{
+				const T *v = xs_.ptr_col(j);
+				T s(0);
+				for (index_t i = 0; i < m_dim; ++i) s += v[i] * v[i];
+				r_[j] = s;
+			}
+		}
+
+	private:
+		template<class X>
+		void rank1_(index_t k, const IRegularMatrix<X, T>& x, bool downdate)
+		{
+			static_assert(supports_linear_index<X>::value, "x must support linear indexing");
+			check_arg(x.nelems() == m_dim, "pd_chol_cache: the size of x is invalid.");
+
+			const X& x_ = x.derived();
+			dense_col<T> w(m_dim);
+			for (index_t i = 0; i < m_dim; ++i) w[i] = x_[i];
+
+			// a failed downdate leaves the factor unchanged
+
+			T *l = m_factors.ptr_col(k);
+			const index_t dd = m_dim * m_dim;
+			dense_col<T> backup(downdate ? dd : 0);
+			if (downdate) for (index_t i = 0; i < dd; ++i) backup[i] = l[i];
+
+			if (!internal::chol_rank1(m_dim, l, w.ptr_data(), downdate))
+			{
+				for (index_t i = 0; i < dd; ++i) l[i] = backup[i];
+				throw invalid_argument("pd_chol_cache: the downdated matrix is not positive definite.");
+			}
+
+			m_logdets[k] = internal::chol_logdet(m_dim, l);
+		}
+
+	private:
+		index_t m_dim;
+		index_t m_K;
+		dense_matrix<T> m_factors;	// (d * d) x K, lower triangular factors
+		dense_col<T> m_logdets;		// K
+	};
+
+}
+
+#endif
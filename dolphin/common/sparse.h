@@ -0,0 +1,522 @@
+/**
+ * @file sparse.h
+ *
+ * @brief Compressed sparse column matrices and metrics on them
+ *
+ * @author Dahua Lin
+ */
+
+#ifdef _MSC_VER
+#pragma once
+#endif
+
+#ifndef DOLPHIN_SPARSE_H_
+#define DOLPHIN_SPARSE_H_
+
+#include <dolphin/common/metrics.h>
+#include <dolphin/common/parallel.h>
+#include <vector>
+
+namespace dolphin
+{
+
+	/********************************************
+	 *
+	 *  csc_matrix
+	 *
+	 *  A sparse matrix in compressed sparse
+	 *  column form: the entries of column j are
+	 *  at [colptr[j], colptr[j+1]) of rowinds
+	 *  and values, with strictly increasing row
+	 *  indices.
+	 *
+	 ********************************************/
+
+	template<typename T>
+	class csc_matrix
+	{
+	public:
+		typedef T value_type;
+
+	public:
+		csc_matrix()
+		: m_nrows(0), m_ncols(0), m_colptr(1, 0) { }
+
+		csc_matrix(index_t m, index_t n,
+				const std::vector<index_t>& colptr,
+				const std::vector<index_t>& rowinds,
+				const std::vector<T>& values)
+		: m_nrows(m), m_ncols(n)
+		, m_colptr(colptr), m_rowinds(rowinds), m_values(values)
+		{
+			validate_();
+		}
+
+		DOLPHIN_ENSURE_INLINE index_t nrows() const { return m_nrows; }
+		DOLPHIN_ENSURE_INLINE index_t ncolumns() const { return m_ncols; }
+		DOLPHIN_ENSURE_INLINE index_t nnz() const { return static_cast<index_t>(m_values.size()); }
+
+		DOLPHIN_ENSURE_INLINE const index_t *colptr() const { return m_colptr.data(); }
+		DOLPHIN_ENSURE_INLINE const index_t *rowinds() const { return m_rowinds.data(); }
+		DOLPHIN_ENSURE_INLINE const T *values() const { return m_values.data(); }
+
+		DOLPHIN_ENSURE_INLINE
+		index_t col_nnz(index_t j) const
+		{
+			return m_colptr[j + 1] - m_colptr[j];
+		}
+
+		DOLPHIN_ENSURE_INLINE
+		const index_t *col_rowinds(index_t j) const
+		{
+			return m_rowinds.data() + m_colptr[j];
+		}
+
+		DOLPHIN_ENSURE_INLINE
+		const T *col_values(index_t j) const
+		{
+			return m_values.data() + m_colptr[j];
+		}
+
+	private:
+		void validate_() const
+		{
+			check_arg(m_nrows >= 0 && m_ncols >= 0, "csc_matrix: invalid dimensions.");
+			check_arg(m_colptr.size() == static_cast<size_t>(m_ncols + 1) && m_colptr[0] == 0,
+					"csc_matrix: the size of colptr is invalid.");
+			check_arg(m_rowinds.size() == m_values.size() &&
+					m_values.size() == static_cast<size_t>(m_colptr[m_ncols]),
+					"csc_matrix: the sizes of rowinds and values are inconsistent with colptr.");
+
+			for (index_t j = 0; j < m_ncols; ++j)
+			{
+				const index_t k0 = m_colptr[j];
+				const index_t k1 = m_colptr[j + 1];
+				check_arg(k0 <= k1, "csc_matrix: colptr must be non-decreasing.");
+
+				for (index_t k = k0; k < k1; ++k)
+				{
+					const index_t i = m_rowinds[k];
+					check_arg(i >= 0 && i < m_nrows, "csc_matrix: row index out of range.");
+					check_arg(k == k0 || m_rowinds[k - 1] < i,
+							"csc_matrix: row indices must be strictly increasing within each column.");
+				}
+			}
+		}
+
+	private:
+		index_t m_nrows;
+		index_t m_ncols;
+		std::vector<index_t> m_colptr;
+		std::vector<index_t> m_rowinds;
+		std::vector<T> m_values;
+	};
+
+
+	/**
+	 * Converts a dense matrix to CSC form, keeping the non-zeros.
+	 */
+	template<typename T, class A>
+	csc_matrix<T> to_csc(const IRegularMatrix<A, T>& a)
+	{
+		const index_t m = a.nrows();
+		const index_t n = a.ncolumns();
+		const A& a_ = a.derived();
+
+		std::vector<index_t> colptr(static_cast<size_t>(n + 1));
+		std::vector<index_t> rowinds;
+		std::vector<T> values;
+
+		colptr[0] = 0;
+		for (index_t j = 0; j < n; ++j)
+		{
+			for (index_t i = 0; i < m; ++i)
+			{
+				const T v = a_(i, j);
+				if (v != T(0))
+				{
+					rowinds.push_back(i);
+					values.push_back(v);
+				}
+			}
+			colptr[j + 1] = static_cast<index_t>(values.size());
+		}
+
+		return csc_matrix<T>(m, n, colptr, rowinds, values);
+	}
+
+	/**
+	 * Returns the transpose of a, in CSC form (i.e. a in CSR form).
+	 */
+	template<typename T>
+	csc_matrix<T> transpose(const csc_matrix<T>& a)
+	{
+		const index_t m = a.nrows();
+		const index_t n = a.ncolumns();
+		const index_t nz = a.nnz();
+
+		std::vector<index_t> colptr(static_cast<size_t>(m + 1), 0);
+		std::vector<index_t> rowinds(static_cast<size_t>(nz));
+		std::vector<T> values(static_cast<size_t>(nz));
+
+		const index_t *ri = a.rowinds();
+		for (index_t k = 0; k < nz; ++k) ++ colptr[ri[k] + 1];
+		for (index_t i = 0; i < m; ++i) colptr[i + 1] += colptr[i];
+
+		// visiting the columns in order keeps the new row indices sorted
+
+		std::vector<index_t> pos(colptr.begin(), colptr.end() - 1);
+		for (index_t j = 0; j < n; ++j)
+		{
+			const index_t *rj = a.col_rowinds(j);
+			const T *vj = a.col_values(j);
+			for (index_t k = 0; k < a.col_nnz(j); ++k)
+			{
+				const index_t p = pos[rj[k]]++;
+				rowinds[p] = j;
+				values[p] = vj[k];
+			}
+		}
+
+		return csc_matrix<T>(n, m, colptr, rowinds, values);
+	}
+
+	template<typename T, class R>
+	void colwise_sqsum(const csc_matrix<T>& a, IRegularMatrix<R, T>& r)
+	{
+		static_assert(supports_linear_index<R>::value, "r must support linear indexing");
+		LMAT_CHECK_DIMS( r.nelems() == a.ncolumns() )
+
+		R& r_ = r.derived();
+		for (index_t j = 0; j < a.ncolumns(); ++j)
+		{
+			const T *v = a.col_values(j);
+			T s(0);
+			for (index_t k = 0; k < a.col_nnz(j); ++k) s += v[k] * v[k];
+			r_[j] = s;
+		}
+	}
+
+
+	/********************************************
+	 *
+	 *  metrics on sparse columns
+	 *
+	 *  Supported are the metrics whose GEMM
+	 *  decompositions need only inner products
+	 *  and per-column functions of the squared
+	 *  norms: (squared) Euclidean, cosine, and
+	 *  dot product. Their combine and finish
+	 *  steps are taken from gemm_decomposition.
+	 *
+	 ********************************************/
+
+	namespace internal
+	{
+		template<class Metric>
+		struct sparse_metric_support
+		{
+			static const bool value = false;
+		};
+
+		template<typename T>
+		struct sparse_metric_support<sqeuclidean_distance<T> >
+		{
+			static const bool value = true;
+			DOLPHIN_ENSURE_INLINE static T stat(T sqs) { return sqs; }
+		};
+
+		template<typename T>
+		struct sparse_metric_support<euclidean_distance<T> >
+		{
+			static const bool value = true;
+			DOLPHIN_ENSURE_INLINE static T stat(T sqs) { return sqs; }
+		};
+
+		template<typename T>
+		struct sparse_metric_support<cosine_distance<T> >
+		{
+			static const bool value = true;
+			DOLPHIN_ENSURE_INLINE static T stat(T sqs) { return math::rcp(math::sqrt(sqs)); }
+		};
+
+		template<typename T>
+		struct sparse_metric_support<dot_product<T> >
+		{
+			static const bool value = true;
+			DOLPHIN_ENSURE_INLINE static T stat(T) { return T(0); }
+		};
+
+		template<class Metric, typename T, class A>
+		inline void sparse_colstats(const A& a, dense_col<T>& s)
+		{
+			colwise_sqsum(a, s);
+			for (index_t i = 0; i < s.nelems(); ++i)
+				s[i] = sparse_metric_support<Metric>::stat(s[i]);
+		}
+
+		// inner products between columns
+
+		template<typename T>
+		inline T csc_coldot(const csc_matrix<T>& a, index_t i, const csc_matrix<T>& b, index_t j)
+		{
+			const index_t *ra = a.col_rowinds(i);
+			const index_t *rb = b.col_rowinds(j);
+			const T *va = a.col_values(i);
+			const T *vb = b.col_values(j);
+			const index_t na = a.col_nnz(i);
+			const index_t nb = b.col_nnz(j);
+
+			T s(0);
+			index_t p = 0, q = 0;
+			while (p < na && q < nb)
+			{
+				if (ra[p] < rb[q]) ++p;
+				else if (rb[q] < ra[p]) ++q;
+				else s += va[p++] * vb[q++];
+			}
+			return s;
+		}
+
+		template<typename T, class B>
+		inline T csc_coldot(const csc_matrix<T>& a, index_t i, const B& b, index_t j)
+		{
+			const index_t *ra = a.col_rowinds(i);
+			const T *va = a.col_values(i);
+
+			T s(0);
+			for (index_t k = 0; k < a.col_nnz(i); ++k) s += va[k] * b(ra[k], j);
+			return s;
+		}
+
+		/**
+		 * Runs over the output in tiles of columns, in parallel. For
+		 * each column j, colprod(j) writes the inner products of all
+		 * left columns with the right column j to r(:, j), which are
+		 * then turned into metric values in place.
+		 */
+		template<class Metric, typename T, class D, class ColProd>
+		void sparse_pairwise_run(const Metric& metric,
+				const dense_col<T>& sa, const dense_col<T>& sb,
+				D& r, bool selfpw, const ColProd& colprod)
+		{
+			typedef gemm_decomposition<Metric> dec_t;
+			const dec_t dec(metric);
+			const bool is_pos_def = metric_traits<Metric>::is_positive_definite;
+
+			const index_t m = sa.nelems();
+			const index_t n = sb.nelems();
+
+			parallel_for_chunks(n, 16, [&](index_t j0, index_t j1)
+			{
+				for (index_t j = j0; j < j1; ++j)
+				{
+					colprod(j);
+
+					const T sbj = sb[j];
+					for (index_t i = 0; i < m; ++i)
+					{
+						T v = dec.combine(sa[i], sbj, r(i, j));
+						if (is_pos_def && v < T(0)) v = T(0);
+						r(i, j) = dec.finish(v);
+					}
+
+					if (is_pos_def && selfpw) r(j, j) = T(0);
+				}
+			});
+		}
+
+		template<class Metric, typename T, class D>
+		void sparse_pairwise_ss(const Metric& metric,
+				const csc_matrix<T>& a, const csc_matrix<T>& b, D& r, bool selfpw)
+		{
+			const index_t m = a.ncolumns();
+			const index_t n = b.ncolumns();
+			LMAT_CHECK_DIMS( a.nrows() == b.nrows() && r.nrows() == m && r.ncolumns() == n )
+
+			dense_col<T> sa(m), sb(n);
+			sparse_colstats<Metric>(a, sa);
+			sparse_colstats<Metric>(b, sb);
+
+			// Gustavson-style product: with a' stored by columns, each
+			// non-zero b(k, j) is spread over the non-zeros of row k of
+			// a, so only matching index pairs are ever visited
+
+			const csc_matrix<T> at = transpose(a);
+
+			sparse_pairwise_run(metric, sa, sb, r, selfpw, [&](index_t j)
+			{
+				for (index_t i = 0; i < m; ++i) r(i, j) = T(0);
+
+				const index_t *rb = b.col_rowinds(j);
+				const T *vb = b.col_values(j);
+
+				for (index_t q = 0; q < b.col_nnz(j); ++q)
+				{
+					const index_t k = rb[q];
+					const T v = vb[q];
+
+					const index_t *ri = at.col_rowinds(k);
+					const T *vi = at.col_values(k);
+					for (index_t p = 0; p < at.col_nnz(k); ++p)
+						r(ri[p], j) += vi[p] * v;
+				}
+			});
+		}
+
+		template<class Metric, typename T, class B, class D>
+		void sparse_pairwise_sd(const Metric& metric,
+				const csc_matrix<T>& a, const B& b, D& r)
+		{
+			const index_t m = a.ncolumns();
+			const index_t n = b.ncolumns();
+			LMAT_CHECK_DIMS( a.nrows() == b.nrows() && r.nrows() == m && r.ncolumns() == n )
+
+			dense_col<T> sa(m), sb(n);
+			sparse_colstats<Metric>(a, sa);
+			sparse_colstats<Metric>(b, sb);
+
+			sparse_pairwise_run(metric, sa, sb, r, false, [&](index_t j)
+			{
+				for (index_t i = 0; i < m; ++i) r(i, j) = csc_coldot(a, i, b, j);
+			});
+		}
+
+		template<class Metric, typename T, class A, class D>
+		void sparse_pairwise_ds(const Metric& metric,
+				const A& a, const csc_matrix<T>& b, D& r)
+		{
+			const index_t m = a.ncolumns();
+			const index_t n = b.ncolumns();
+			LMAT_CHECK_DIMS( a.nrows() == b.nrows() && r.nrows() == m && r.ncolumns() == n )
+
+			dense_col<T> sa(m), sb(n);
+			sparse_colstats<Metric>(a, sa);
+			sparse_colstats<Metric>(b, sb);
+
+			sparse_pairwise_run(metric, sa, sb, r, false, [&](index_t j)
+			{
+				const index_t *rb = b.col_rowinds(j);
+				const T *vb = b.col_values(j);
+				const index_t nb = b.col_nnz(j);
+
+				for (index_t i = 0; i < m; ++i)
+				{
+					T s(0);
+					for (index_t q = 0; q < nb; ++q) s += vb[q] * a(rb[q], i);
+					r(i, j) = s;
+				}
+			});
+		}
+
+		template<class Metric, typename T, class B, class R>
+		void sparse_colwise(const Metric& metric, const csc_matrix<T>& a, const B& b, R& r)
+		{
+			typedef gemm_decomposition<Metric> dec_t;
+			typedef sparse_metric_support<Metric> sup_t;
+			const dec_t dec(metric);
+			const bool is_pos_def = metric_traits<Metric>::is_positive_definite;
+
+			const index_t na = a.ncolumns();
+			const index_t nb = b.ncolumns();
+			LMAT_CHECK_DIMS( a.nrows() == b.nrows() )
+			LMAT_CHECK_DIMS( na == 1 || nb == 1 || na == nb )
+
+			const index_t n = na > nb ? na : nb;
+			LMAT_CHECK_DIMS( r.nelems() == n )
+
+			dense_col<T> sa(na), sb(nb);
+			colwise_sqsum(a, sa);
+			colwise_sqsum(b, sb);
+
+			for (index_t j = 0; j < n; ++j)
+			{
+				const index_t ia = na == 1 ? 0 : j;
+				const index_t ib = nb == 1 ? 0 : j;
+
+				T v = dec.combine(sup_t::stat(sa[ia]), sup_t::stat(sb[ib]), csc_coldot(a, ia, b, ib));
+				if (is_pos_def && v < T(0)) v = T(0);
+				r[j] = dec.finish(v);
+			}
+		}
+	}
+
+
+	/**
+	 * Writes metric(a_i, b_j) to r(i, j), for sparse a and b.
+	 */
+	template<class Metric, typename T, class D>
+	void pairwise(const IMetric<Metric>& metric,
+			const csc_matrix<T>& a, const csc_matrix<T>& b, IRegularMatrix<D, T>& r)
+	{
+		static_assert(internal::sparse_metric_support<Metric>::value,
+				"The metric is not supported on sparse inputs.");
+		internal::sparse_pairwise_ss(metric.derived(), a, b, r.derived(), false);
+	}
+
+	/**
+	 * Writes metric(a_i, a_j) to r(i, j), for sparse a.
+	 */
+	template<class Metric, typename T, class D>
+	void pairwise(const IMetric<Metric>& metric,
+			const csc_matrix<T>& a, IRegularMatrix<D, T>& r)
+	{
+		static_assert(internal::sparse_metric_support<Metric>::value,
+				"The metric is not supported on sparse inputs.");
+		internal::sparse_pairwise_ss(metric.derived(), a, a, r.derived(), true);
+	}
+
+	template<class Metric, typename T, class B, class D>
+	void pairwise(const IMetric<Metric>& metric,
+			const csc_matrix<T>& a, const IRegularMatrix<B, T>& b, IRegularMatrix<D, T>& r)
+	{
+		static_assert(internal::sparse_metric_support<Metric>::value,
+				"The metric is not supported on sparse inputs.");
+		internal::sparse_pairwise_sd(metric.derived(), a, b.derived(), r.derived());
+	}
+
+	template<class Metric, typename T, class A, class D>
+	void pairwise(const IMetric<Metric>& metric,
+			const IRegularMatrix<A, T>& a, const csc_matrix<T>& b, IRegularMatrix<D, T>& r)
+	{
+		static_assert(internal::sparse_metric_support<Metric>::value,
+				"The metric is not supported on sparse inputs.");
+		internal::sparse_pairwise_ds(metric.derived(), a.derived(), b, r.derived());
+	}
+
+	/**
+	 * Column-wise metric values, with the same broadcasting rules
+	 * as colwise on dense inputs.
+	 */
+	template<class Metric, typename T, class R>
+	void colwise(const IMetric<Metric>& metric,
+			const csc_matrix<T>& a, const csc_matrix<T>& b, IRegularMatrix<R, T>& r)
+	{
+		static_assert(internal::sparse_metric_support<Metric>::value,
+				"The metric is not supported on sparse inputs.");
+		internal::sparse_colwise(metric.derived(), a, b, r.derived());
+	}
+
+	template<class Metric, typename T, class B, class R>
+	void colwise(const IMetric<Metric>& metric,
+			const csc_matrix<T>& a, const IRegularMatrix<B, T>& b, IRegularMatrix<R, T>& r)
+	{
+		static_assert(internal::sparse_metric_support<Metric>::value,
+				"The metric is not supported on sparse inputs.");
+		internal::sparse_colwise(metric.derived(), a, b.derived(), r.derived());
+	}
+
+	// all supported metrics are symmetric
+
+	template<class Metric, typename T, class A, class R>
+	void colwise(const IMetric<Metric>& metric,
+			const IRegularMatrix<A, T>& a, const csc_matrix<T>& b, IRegularMatrix<R, T>& r)
+	{
+		static_assert(internal::sparse_metric_support<Metric>::value,
+				"The metric is not supported on sparse inputs.");
+		internal::sparse_colwise(metric.derived(), b, a.derived(), r.derived());
+	}
+
+}
+
+#endif
@@ -0,0 +1,310 @@
+/**
+ * @file topk_symeig.h
+ *
+ * @brief Leading eigenpairs of large symmetric operators
+ *
+ * @author Dahua Lin
+ */
+
+#ifdef _MSC_VER
+#pragma once
+#endif
+
+#ifndef DOLPHIN_TOPK_SYMEIG_H_
+#define DOLPHIN_TOPK_SYMEIG_H_
+
+#include <dolphin/common/common_base.h>
+#include <dolphin/common/properties.h>
+#include <dolphin/common/import_lmat.h>
+#include <light_mat/linalg/blas_l3.h>
+#include <light_mat/linalg/lapack_syev.h>
+
+#include <cmath>
+#include <limits>
+#include <random>
+
+namespace dolphin
+{
+	/********************************************
+	 *
+	 *  symmetric operators
+	 *
+	 *  An operator for topk_symeig provides
+	 *
+	 *    index_t dim() const;
+	 *    void apply(const cref_matrix<T>& x,
+	 *               ref_matrix<T>& y) const;
+	 *
+	 *  where apply computes y = A x for a block x
+	 *  of dim() x b. A never needs to be formed,
+	 *  so sparse or implicit operators work as
+	 *  well as dense matrices.
+	 *
+	 ********************************************/
+
+	template<typename T, class Mat>
+	class dense_symop
+	{
+	public:
+		DOLPHIN_ENSURE_INLINE
+		explicit dense_symop(const Mat& a)
+		: m_a(a) { }
+
+		DOLPHIN_ENSURE_INLINE
+		index_t dim() const
+		{
+			return m_a.nrows();
+		}
+
+		void apply(const cref_matrix<T>& x, ref_matrix<T>& y) const
+		{
+			blas::gemm(m_a, x, y, 'N', 'N');
+		}
+
+	private:
+		const Mat& m_a;
+	};
+
+	template<typename T, class Mat>
+	DOLPHIN_ENSURE_INLINE
+	inline dense_symop<T, Mat> make_dense_symop(const IRegularMatrix<Mat, T>& a)
+	{
+		check_arg(a.nrows() == a.ncolumns(), "make_dense_symop: a must be square.");
+		return dense_symop<T, Mat>(a.derived());
+	}
+
+
+	namespace internal
+	{
+		/**
+		 * Orthonormalizes the columns of q in place by classical
+		 * Gram-Schmidt with one re-orthogonalization pass. Columns
+		 * that turn out linearly dependent are replaced by random
+		 * directions.
+		 */
+		template<typename T, class RNG>
+		void orthonormalize_columns(ref_matrix<T>& q, RNG& rng)
+		{
+			const index_t n = q.nrows();
+			const index_t b = q.ncolumns();
+			const T eps = std::numeric_limits<T>::epsilon();
+
+			std::normal_distribution<T> nrm;
+			dense_col<T> h(b);
+
+			for (index_t j = 0; j < b; ++j)
+			{
+				T *qj = q.ptr_col(j);
+				ref_col<T> vj(qj, n);
+
+				for (int attempt = 0; ; ++attempt)
+				{
+					T s0(0);
+					for (index_t i = 0; i < n; ++i) s0 += qj[i] * qj[i];
+
+					if (j > 0)
+					{
+						cref_matrix<T> qp(q.ptr_data(), n, j);
+						ref_col<T> hj(h.ptr_data(), j);
+
+						for (int pass = 0; pass < 2; ++pass)
+						{
+							blas::gemm(qp, vj, hj, 'T', 'N');
+							blas::gemm(T(-1), qp, hj, T(1), vj, 'N', 'N');
+						}
+					}
+
+					T s(0);
+					for (index_t i = 0; i < n; ++i) s += qj[i] * qj[i];
+
+					if (s > T(100) * eps * eps * s0 && s > T(0))
+					{
+						const T c = T(1) / std::sqrt(s);
+						for (index_t i = 0; i < n; ++i) qj[i] *= c;
+						break;
+					}
+
+					check_arg(attempt < 10, "orthonormalize_columns: failed to find a new direction.");
+					for (index_t i = 0; i < n; ++i) qj[i] = nrm(rng);
+				}
+			}
+		}
+	}
+
+
+	/********************************************
+	 *
+	 *  topk_symeig
+	 *
+	 *  Randomized subspace iteration with
+	 *  Rayleigh-Ritz projection. Each iteration
+	 *  applies the operator once to a block of
+	 *  k + oversampling vectors, and solves the
+	 *  projected problem of that size by LAPACK.
+	 *
+	 *  The iteration converges towards the
+	 *  eigenvalues of largest magnitude. To get
+	 *  the largest (algebraic) ones of an
+	 *  operator with a negative spectrum part,
+	 *  set shift so that A + shift * I is
+	 *  positive semi-definite.
+	 *
+	 ********************************************/
+
+	template<typename T=double>
+	class topk_symeig
+	{
+		static_assert(std::is_floating_point<T>::value,
+				"T must be floating-point types.");
+
+	public:
+		simple_property<index_t> oversampling;
+		simple_property<size_t> max_iters;
+		simple_property<T> tol;
+		simple_property<T> shift;
+		simple_property<unsigned int> seed;
+
+	public:
+		explicit topk_symeig(index_t k)
+		: oversampling(10,        require_ge_<index_t>(0), "oversampling must be non-negative")
+		, max_iters   (300,       require_gt_<size_t>(0),  "maxiters must be positive")
+		, tol         (T(1.0e-6), require_gt_<T>(0),       "tol must be positive")
+		, shift       (T(0))
+		, seed        (0)
+		, m_k(k)
+		{
+			check_arg(k > 0, "k must be positive.");
+		}
+
+		DOLPHIN_ENSURE_INLINE
+		index_t k() const
+		{
+			return m_k;
+		}
+
+		/**
+		 * Computes the k leading eigenpairs of op, writing the
+		 * eigenvalues to evs (in descending order) and the
+		 * eigenvectors to the columns of evecs (n x k).
+		 *
+		 * Stops when the residual norm |A v - lambda v| of every
+		 * pair is below tol times the largest |lambda|, and returns
+		 * the number of iterations. A return value of max_iters
+		 * indicates that this was not reached.
+		 */
+		template<class Op, class E, class U>
+		size_t run(const Op& op, IRegularMatrix<E, T>& evs, IRegularMatrix<U, T>& evecs) const
+		{
+			static_assert(supports_linear_index<E>::value, "evs must support linear indexing");
+			static_assert(is_percol_contiguous<U>::value, "evecs must be percol-contiguous");
+
+			const index_t n = op.dim();
+			const index_t k = m_k;
+			check_arg(k <= n, "k must not exceed the dimension of the operator.");
+			check_arg(is_vector(evs) && evs.nelems() == k, "The size of evs is invalid.");
+			check_arg(evecs.nrows() == n && evecs.ncolumns() == k, "The size of evecs is invalid.");
+
+			const index_t b = k + oversampling.get() < n ? k + oversampling.get() : n;
+			const T sh = shift.get();
+
+			dense_matrix<T> Q(n, b);
+			dense_matrix<T> Y(n, b);
+			dense_matrix<T> X(n, b);
+			dense_matrix<T> H(b, b);
+			dense_matrix<T> V(b, b);
+			dense_col<T> lam(b);
+
+			ref_matrix<T> rQ(Q.ptr_data(), n, b);
+			ref_matrix<T> rY(Y.ptr_data(), n, b);
+
+			std::mt19937 rng(seed.get());
+			std::normal_distribution<T> nrm;
+			for (index_t i = 0; i < n * b; ++i) Q[i] = nrm(rng);
+			internal::orthonormalize_columns(rQ, rng);
+
+			size_t it = 0;
+			for (;;)
+			{
+				++it;
+
+				// Y = (A + shift I) Q
+
+				op.apply(cref_matrix<T>(Q.ptr_data(), n, b), rY);
+				if (sh != T(0))
+				{
+					for (index_t i = 0; i < n * b; ++i) Y[i] += sh * Q[i];
+				}
+
+				// Rayleigh-Ritz: H = Q' Y = V diag(lam) V'
+
+				blas::gemm(Q, Y, H, 'T', 'N');
+				for (index_t j = 0; j < b; ++j)
+					for (index_t i = 0; i < j; ++i)
+						H(i, j) = H(j, i) = (H(i, j) + H(j, i)) * T(0.5);
+
+				lapack::syev(H, lam, V);	// ascending
+
+				// Ritz vectors X = Q V and A X = Y V, with the
+				// latter kept in Q as the next basis
+
+				blas::gemm(Q, V, X, 'N', 'N');
+				blas::gemm(Y, V, Q, 'N', 'N');
+
+				// residuals of the top k pairs (the last k columns)
+
+				T lmax(0);
+				for (index_t j = b - k; j < b; ++j)
+					if (std::abs(lam[j]) > lmax) lmax = std::abs(lam[j]);
+
+				bool conv = true;
+				for (index_t j = b - k; j < b && conv; ++j)
+				{
+					const T *x = X.ptr_col(j);
+					const T *ax = Q.ptr_col(j);
+					T r(0);
+					for (index_t i = 0; i < n; ++i)
+					{
+						T v = ax[i] - lam[j] * x[i];
+						r += v * v;
+					}
+					conv = std::sqrt(r) <= tol.get() * lmax;
+				}
+
+				if (conv || it >= max_iters.get()) break;
+
+				internal::orthonormalize_columns(rQ, rng);
+			}
+
+			// output in descending order
+
+			E& evs_ = evs.derived();
+			U& evecs_ = evecs.derived();
+
+			for (index_t i = 0; i < k; ++i)
+			{
+				const index_t j = b - 1 - i;
+				evs_[i] = lam[j] - sh;
+
+				const T *x = X.ptr_col(j);
+				T *u = evecs_.ptr_col(i);
+				for (index_t l = 0; l < n; ++l) u[l] = x[l];
+			}
+
+			return it;
+		}
+
+		template<class Mat, class E, class U>
+		DOLPHIN_ENSURE_INLINE
+		size_t run_dense(const IRegularMatrix<Mat, T>& a, IRegularMatrix<E, T>& evs,
+				IRegularMatrix<U, T>& evecs) const
+		{
+			return run(make_dense_symop(a), evs, evecs);
+		}
+
+	private:
+		index_t m_k;
+	};
+
+}
+
+#endif
@@ -0,0 +1,379 @@
+/**
+ * @file gauss_logpdf.h
+ *
+ * @brief Batched evaluation of Gaussian log-densities
+ *
+ * @author Dahua Lin
+ */
+
+#ifdef _MSC_VER
+#pragma once
+#endif
+
+#ifndef DOLPHIN_GAUSS_LOGPDF_H_
+#define DOLPHIN_GAUSS_LOGPDF_H_
+
+#include <dolphin/common/common_base.h>
+#include <dolphin/common/properties.h>
+#include <dolphin/common/import_lmat.h>
+#include <dolphin/common/common_calc.h>
+#include <dolphin/common/pd_chol_cache.h>
+#include <dolphin/common/parallel.h>
+#include <light_mat/linalg/blas_l3.h>
+
+namespace dolphin
+{
+	enum gauss_cov_form
+	{
+		GAUSS_COV_SPHERICAL,
+		GAUSS_COV_DIAGONAL,
+		GAUSS_COV_FULL
+	};
+
+
+	/********************************************
+	 *
+	 *  gauss_logpdf_batch
+	 *
+	 *  Evaluates log N(x_j | mu_k, Sigma_k) for
+	 *  all samples j and components k into a
+	 *  K x n matrix, in blocks of samples that
+	 *  are processed in parallel. The component
+	 *  parameters are preprocessed once when they
+	 *  are set, so that each block costs one or
+	 *  two GEMMs against the data:
+	 *
+	 *  - spherical: mu' x, with the squared norms
+	 *    added back;
+	 *  - diagonal: (1 ./ v)' x.^2 - 2 (mu ./ v)' x;
+	 *  - full: W_k x, with W_k = C_k^{-1} for the
+	 *    Cholesky factor C_k of Sigma_k.
+	 *
+	 ********************************************/
+
+	template<typename T=double>
+	class gauss_logpdf_batch
+	{
+		static_assert(std::is_floating_point<T>::value,
+				"T must be floating-point types.");
+
+	public:
+		simple_property<index_t> block_size;
+
+	public:
+		gauss_logpdf_batch()
+		: block_size(256, require_gt_<index_t>(0), "block_size must be positive")
+		, m_form(GAUSS_COV_SPHERICAL), m_dim(0), m_K(0) { }
+
+		DOLPHIN_ENSURE_INLINE gauss_cov_form cov_form() const { return m_form; }
+		DOLPHIN_ENSURE_INLINE index_t dim() const { return m_dim; }
+		DOLPHIN_ENSURE_INLINE index_t ncomponents() const { return m_K; }
+
+		/**
+		 * Sets components with means mu (d x K) and covariances
+		 * sigma2[k] * I.
+		 */
+		template<class Mu, class S>
+		void set_spherical(const IRegularMatrix<Mu, T>& mu, const IRegularMatrix<S, T>& sigma2)
+		{
+			const index_t d = mu.nrows();
+			const index_t K = mu.ncolumns();
+			check_arg(sigma2.nelems() == K, "gauss_logpdf_batch: the size of sigma2 is invalid.");
+
+			reset_(GAUSS_COV_SPHERICAL, d, K);
+
+			m_A.resize(d, K);
+			copy(mu.derived(), m_A);
+
+			for (index_t k = 0; k < K; ++k)
+			{
+				const T s2 = sigma2.derived()[k];
+				check_arg(s2 > T(0), "gauss_logpdf_batch: sigma2 must be positive.");
+
+				m_icoef[k] = math::rcp(s2);
+				m_cterm[k] = sqsum(m_A.column(k)) * m_icoef[k] + T(d) * (log2pi() + math::log(s2));
+			}
+		}
+
+		/**
+		 * Sets components with means mu (d x K) and diagonal
+		 * covariances, whose variances are the columns of vars (d x K).
+		 */
+		template<class Mu, class V>
+		void set_diagonal(const IRegularMatrix<Mu, T>& mu, const IRegularMatrix<V, T>& vars)
+		{
+			const index_t d = mu.nrows();
+			const index_t K = mu.ncolumns();
+			check_arg(vars.nrows() == d && vars.ncolumns() == K,
+					"gauss_logpdf_batch: the size of vars is invalid.");
+
+			reset_(GAUSS_COV_DIAGONAL, d, K);
+
+			m_A.resize(d, K);	// 1 ./ v
+			m_B.resize(d, K);	// -2 mu ./ v
+
+			const Mu& mu_ = mu.derived();
+			const V& vars_ = vars.derived();
+
+			for (index_t k = 0; k < K; ++k)
+			{
+				T c = T(d) * log2pi();
+				for (index_t i = 0; i < d; ++i)
+				{
+					const T v = vars_(i, k);
+					check_arg(v > T(0), "gauss_logpdf_batch: vars must be positive.");
+
+					const T u = mu_(i, k);
+					const T iv = math::rcp(v);
+					m_A(i, k) = iv;
+					m_B(i, k) = T(-2) * u * iv;
+					c += u * u * iv + math::log(v);
+				}
+				m_cterm[k] = c;
+			}
+		}
+
+		/**
+		 * Sets components with means mu (d x K) and full covariances,
+		 * given by their Cholesky factors in covs.
+		 */
+		template<class Mu>
+		void set_full(const IRegularMatrix<Mu, T>& mu, const pd_chol_cache<T>& covs)
+		{
+			const index_t d = mu.nrows();
+			const index_t K = mu.ncolumns();
+			check_arg(covs.dim() == d && covs.count() == K,
+					"gauss_logpdf_batch: the size of covs is invalid.");
+
+			reset_(GAUSS_COV_FULL, d, K);
+
+			m_A.resize(d * d, K);	// W_k = C_k^{-1}, column-major
+			m_B.resize(d, K);		// W_k mu_k
+
+			m_A << T(0);
+			const Mu& mu_ = mu.derived();
+
+			for (index_t k = 0; k < K; ++k)
+			{
+				const T *c = covs.factor(k).ptr_data();
+				T *w = m_A.ptr_col(k);
+
+				for (index_t j = 0; j < d; ++j)
+				{
+					T *wj = w + j * d;
+					wj[j] = T(1);
+					internal::chol_solve_lower(d, c, wj);
+				}
+
+				T *b = m_B.ptr_col(k);
+				for (index_t i = 0; i < d; ++i) b[i] = T(0);
+				for (index_t j = 0; j < d; ++j)
+				{
+					const T *wj = w + j * d;
+					const T u = mu_(j, k);
+					for (index_t i = j; i < d; ++i) b[i] += wj[i] * u;
+				}
+
+				m_cterm[k] = covs.logdet(k) + T(d) * log2pi();
+			}
+		}
+
+		/**
+		 * Writes log N(x_j | mu_k, Sigma_k) to out(k, j), for the
+		 * samples given as the columns of x (d x n).
+		 */
+		template<class X, class Out>
+		void logpdf(const IRegularMatrix<X, T>& x, IRegularMatrix<Out, T>& out) const
+		{
+			eval_(x, out, (const T*)(0), (T*)(0));
+		}
+
+		/**
+		 * Fused E-step: writes the posterior probabilities of the
+		 * components, with prior log-weights logw (K), to out (K x n),
+		 * and the log-likelihood of each sample to loglik (n).
+		 */
+		template<class X, class LW, class Out, class LL>
+		void posterior(const IRegularMatrix<X, T>& x, const IRegularMatrix<LW, T>& logw,
+				IRegularMatrix<Out, T>& out, IRegularMatrix<LL, T>& loglik) const
+		{
+			static_assert(is_contiguous<LW>::value, "logw must be contiguous");
+			static_assert(is_contiguous<LL>::value, "loglik must be contiguous");
+			check_arg(logw.nelems() == m_K, "gauss_logpdf_batch: the size of logw is invalid.");
+			check_arg(loglik.nelems() == x.ncolumns(), "gauss_logpdf_batch: the size of loglik is invalid.");
+
+			eval_(x, out, logw.derived().ptr_data(), loglik.derived().ptr_data());
+		}
+
+		/**
+		 * Evaluates one block of samples xb (d x b) into ob (K x b),
+		 * as logpdf does, or as posterior does when logw is given
+		 * (in which case b log-likelihoods go to loglik). work must
+		 * hold d * b values.
+		 *
+		 * This is the entry for callers that run their own blocked
+		 * passes over the data.
+		 */
+		void eval_block(const cref_matrix<T>& xb, ref_matrix<T>& ob,
+				const T *logw, T *loglik, T *work) const
+		{
+			const index_t K = m_K;
+			const index_t b = xb.ncolumns();
+
+			switch (m_form)
+			{
+			case GAUSS_COV_SPHERICAL: eval_spherical_(xb, ob); break;
+			case GAUSS_COV_DIAGONAL:  eval_diagonal_(xb, ob, work); break;
+			case GAUSS_COV_FULL:      eval_full_(xb, ob, work); break;
+			}
+
+			if (logw)
+			{
+				for (index_t j = 0; j < b; ++j)
+				{
+					T *oj = ob.ptr_col(j);
+					for (index_t k = 0; k < K; ++k) oj[k] += logw[k];
+				}
+
+				ref_row<T> llb(loglik, b);
+				colwise_nrmexp_inplace(ob, llb);
+			}
+		}
+
+	private:
+		static T log2pi()
+		{
+			return T(1.83787706640934548356);
+		}
+
+		void reset_(gauss_cov_form form, index_t d, index_t K)
+		{
+			check_arg(d > 0 && K > 0, "gauss_logpdf_batch: the components must be non-empty.");
+			m_form = form;
+			m_dim = d;
+			m_K = K;
+			m_icoef.resize(K, 1);
+			m_cterm.resize(K, 1);
+		}
+
+		template<class X, class Out>
+		void eval_(const IRegularMatrix<X, T>& x, IRegularMatrix<Out, T>& out,
+				const T *logw, T *loglik) const
+		{
+			static_assert(is_contiguous<X>::value, "x must be contiguous");
+			static_assert(is_contiguous<Out>::value, "out must be contiguous");
+
+			const index_t d = m_dim;
+			const index_t K = m_K;
+			const index_t n = x.ncolumns();
+			check_arg(K > 0, "gauss_logpdf_batch: the components have not been set.");
+			check_arg(x.nrows() == d, "gauss_logpdf_batch: the dimension of x is invalid.");
+			check_arg(out.nrows() == K && out.ncolumns() == n, "gauss_logpdf_batch: the size of out is invalid.");
+
+			const T *px = x.derived().ptr_data();
+			T *po = out.derived().ptr_data();
+			const index_t bs = block_size.get();
+			const index_t nblocks = (n + bs - 1) / bs;
+
+			// one work area per thread, allocated once per call
+			dense_matrix<T> work(d * bs, max_num_threads());
+
+			parallel_for(nblocks, [&](index_t blk)
+			{
+				const index_t j0 = blk * bs;
+				const index_t b = (n - j0 < bs) ? n - j0 : bs;
+
+				cref_matrix<T> xb(px + j0 * d, d, b);
+				ref_matrix<T> ob(po + j0 * K, K, b);
+
+				eval_block(xb, ob, logw, loglik ? loglik + j0 : (T*)(0),
+						work.ptr_col(thread_rank()));
+			});
+		}
+
+		void eval_spherical_(const cref_matrix<T>& xb, ref_matrix<T>& ob) const
+		{
+			const index_t d = m_dim;
+			const index_t K = m_K;
+			const index_t b = xb.ncolumns();
+
+			blas::gemm(m_A, xb, ob, 'T', 'N');
+
+			for (index_t j = 0; j < b; ++j)
+			{
+				const T *xj = xb.ptr_col(j);
+				T xx(0);
+				for (index_t i = 0; i < d; ++i) xx += xj[i] * xj[i];
+
+				T *oj = ob.ptr_col(j);
+				for (index_t k = 0; k < K; ++k)
+				{
+					T q = (xx - T(2) * oj[k]) * m_icoef[k] + m_cterm[k];
+					oj[k] = T(-0.5) * q;
+				}
+			}
+		}
+
+		void eval_diagonal_(const cref_matrix<T>& xb, ref_matrix<T>& ob, T *work) const
+		{
+			const index_t d = m_dim;
+			const index_t K = m_K;
+			const index_t b = xb.ncolumns();
+
+			const T *px = xb.ptr_data();
+			for (index_t i = 0; i < d * b; ++i) work[i] = px[i] * px[i];
+
+			cref_matrix<T> xsq(work, d, b);
+			blas::gemm(m_A, xsq, ob, 'T', 'N');
+			blas::gemm(T(1), m_B, xb, T(1), ob, 'T', 'N');
+
+			for (index_t j = 0; j < b; ++j)
+			{
+				T *oj = ob.ptr_col(j);
+				for (index_t k = 0; k < K; ++k)
+					oj[k] = T(-0.5) * (oj[k] + m_cterm[k]);
+			}
+		}
+
+		void eval_full_(const cref_matrix<T>& xb, ref_matrix<T>& ob, T *work) const
+		{
+			const index_t d = m_dim;
+			const index_t K = m_K;
+			const index_t b = xb.ncolumns();
+
+			ref_matrix<T> z(work, d, b);
+
+			for (index_t k = 0; k < K; ++k)
+			{
+				cref_matrix<T> w(m_A.ptr_col(k), d, d);
+				blas::gemm(w, xb, z, 'N', 'N');
+
+				const T *bk = m_B.ptr_col(k);
+				for (index_t j = 0; j < b; ++j)
+				{
+					const T *zj = z.ptr_col(j);
+					T s(0);
+					for (index_t i = 0; i < d; ++i)
+					{
+						T v = zj[i] - bk[i];
+						s += v * v;
+					}
+					ob(k, j) = T(-0.5) * (s + m_cterm[k]);
+				}
+			}
+		}
+
+	private:
+		gauss_cov_form m_form;
+		index_t m_dim;
+		index_t m_K;
+
+		dense_matrix<T> m_A;	// spherical: mu; diagonal: 1 ./ v; full: stacked W_k
+		dense_matrix<T> m_B;	// diagonal: -2 mu ./ v; full: W_k mu_k
+		dense_col<T> m_icoef;	// spherical: 1 / sigma2
+		dense_col<T> m_cterm;	// per-component constants of -2 log N
+	};
+
+}
+
+#endif
@@ -0,0 +1,433 @@
+/**
+ * @file gmm.h
+ *
+ * @brief Gaussian mixture models estimated by EM
+ *
+ * @author Dahua Lin
+ */
+
+#ifdef _MSC_VER
+#pragma once
+#endif
+
+#ifndef DOLPHIN_GMM_H_
+#define DOLPHIN_GMM_H_
+
+#include <dolphin/mixture/gauss_logpdf.h>
+#include <cmath>
+
+namespace dolphin
+{
+
+	struct gmm_silent_monitor
+	{
+		template<typename T>
+		DOLPHIN_ENSURE_INLINE
+		void on_iteration(size_t iter, T avg_loglik) { }
+	};
+
+
+	/********************************************
+	 *
+	 *  gmm
+	 *
+	 *  Fits a mixture of K Gaussians by EM, with
+	 *  spherical, diagonal or full covariances.
+	 *
+	 *  Each iteration reads the data once: every
+	 *  block of samples gets its posteriors from
+	 *  gauss_logpdf_batch (fused with the column
+	 *  softmax), which are immediately dispatched
+	 *  into weighted sufficient statistics with
+	 *  GEMMs. Blocks are processed in parallel,
+	 *  each thread accumulating into its own
+	 *  statistics, which are reduced at the end
+	 *  of the pass. All working storage is
+	 *  allocated once per call to run.
+	 *
+	 *  Covariances are passed stacked as columns:
+	 *  1 x K (spherical variances), d x K
+	 *  (diagonal variances), or (d * d) x K
+	 *  (full matrices).
+	 *
+	 ********************************************/
+
+	template<typename T=double>
+	class gmm
+	{
+		static_assert(std::is_floating_point<T>::value,
+				"T must be floating-point types.");
+
+	public:
+		simple_property<size_t> max_iters;
+		simple_property<T> tol;
+		simple_property<index_t> block_size;
+		simple_property<T> reg;
+
+	public:
+		gmm(size_t K_, gauss_cov_form form)
+		: max_iters (100,        require_gt_<size_t>(0),  "max_iters must be positive")
+		, tol       (T(1.0e-6),  require_gt_<T>(0),       "tol must be positive")
+		, block_size(1024,       require_gt_<index_t>(0), "block_size must be positive")
+		, reg       (T(1.0e-6),  require_ge_<T>(0),       "reg must be non-negative")
+		, m_K(static_cast<index_t>(K_))
+		, m_form(form)
+		, m_dim(0)
+		{
+			check_arg(m_K > 0, "gmm: K must be positive.");
+		}
+
+		DOLPHIN_ENSURE_INLINE index_t K() const { return m_K; }
+		DOLPHIN_ENSURE_INLINE gauss_cov_form cov_form() const { return m_form; }
+
+		/**
+		 * The component densities at the current parameters, which
+		 * are those written back by the last call to run.
+		 */
+		DOLPHIN_ENSURE_INLINE
+		const gauss_logpdf_batch<T>& components() const
+		{
+			return m_comps;
+		}
+
+		DOLPHIN_ENSURE_INLINE
+		const dense_col<T>& log_weights() const
+		{
+			return m_logw;
+		}
+
+		/**
+		 * Runs EM from the parameters given in weights (K), means
+		 * (d x K) and covs, and updates them in place. Returns the
+		 * average log-likelihood per sample at the last E-step.
+		 *
+		 * A component whose total posterior mass falls below one
+		 * sample keeps its previous parameters. reg is added to all
+		 * variances to keep them away from zero.
+		 */
+		template<class Data, class Weights, class Means, class Covs, class Mon>
+		T run(const IRegularMatrix<Data, T>& data,
+				IRegularMatrix<Weights, T>& weights,
+				IRegularMatrix<Means, T>& means,
+				IRegularMatrix<Covs, T>& covs,
+				Mon& monitor)
+		{
+			static_assert(is_contiguous<Data>::value, "data must be contiguous");
+			static_assert(supports_linear_index<Weights>::value, "weights must support linear indexing");
+
+			const index_t d = data.nrows();
+			const index_t n = data.ncolumns();
+			const index_t K = m_K;
+			const index_t cr = cov_rows_(d);
+
+			check_arg(n > 0, "gmm: the data must be non-empty.");
+			check_arg(is_vector(weights) && weights.nelems() == K, "gmm: the size of weights is invalid.");
+			check_arg(means.nrows() == d && means.ncolumns() == K, "gmm: the size of means is invalid.");
+			check_arg(covs.nrows() == cr && covs.ncolumns() == K, "gmm: the size of covs is invalid.");
+
+			m_dim = d;
+
+			// parameters
+
+			m_w.resize(K, 1);
+			m_mu.resize(d, K);
+			m_cov.resize(cr, K);
+			m_logw.resize(K, 1);
+			m_delta.resize(d, 1);
+
+			const Weights& weights_ = weights.derived();
+			for (index_t k = 0; k < K; ++k) m_w[k] = weights_[k];
+			copy(means.derived(), m_mu);
+			copy(covs.derived(), m_cov);
+
+			pd_chol_cache<T> chol(m_form == GAUSS_COV_FULL ? d : 1, m_form == GAUSS_COV_FULL ? K : 0);
+
+			// working storage: per-thread statistics and block buffers
+
+			const index_t bs = block_size.get();
+			const index_t nt = max_num_threads();
+			const index_t s2r = m_form == GAUSS_COV_FULL ? d * d : d;
+
+			dense_matrix<T> cnts(K, nt);
+			dense_matrix<T> sum1(d * K, nt);
+			dense_matrix<T> sum2(s2r * K, nt);
+			dense_col<T> lls(nt);
+
+			dense_matrix<T> post(K * bs, nt);
+			dense_matrix<T> llbuf(bs, nt);
+			dense_matrix<T> work(d * bs, nt);
+
+			dense_col<T> nk(K);
+			dense_matrix<T> s1(d, K);
+			dense_matrix<T> s2(s2r, K);
+
+			const T *px = data.derived().ptr_data();
+			const index_t nblocks = (n + bs - 1) / bs;
+
+			T prev = T(0);
+			T avg = T(0);
+
+			for (size_t t = 0; t < max_iters.get(); ++t)
+			{
+				set_components_(chol);
+
+				cnts << T(0);
+				sum1 << T(0);
+				sum2 << T(0);
+				lls << T(0);
+
+				// fused E-step and statistics (one pass over data)
+
+				parallel_for(nblocks, [&](index_t blk)
+				{
+					const index_t r = thread_rank();
+					const index_t j0 = blk * bs;
+					const index_t b = (n - j0 < bs) ? n - j0 : bs;
+
+					cref_matrix<T> xb(px + j0 * d, d, b);
+					ref_matrix<T> pb(post.ptr_col(r), K, b);
+					T *ll = llbuf.ptr_col(r);
+					T *wk = work.ptr_col(r);
+
+					m_comps.eval_block(xb, pb, m_logw.ptr_data(), ll, wk);
+					accum_block_(xb, pb, ll, wk, cnts.ptr_col(r), sum1.ptr_col(r), sum2.ptr_col(r), lls[r]);
+				});
+
+				// reduce over threads
+
+				nk << T(0);
+				s1 << T(0);
+				s2 << T(0);
+				T ltotal(0);
+
+				for (index_t r = 0; r < nt; ++r)
+				{
+					const T *c = cnts.ptr_col(r);
+					for (index_t k = 0; k < K; ++k) nk[k] += c[k];
+
+					const T *a1 = sum1.ptr_col(r);
+					T *p1 = s1.ptr_data();
+					for (index_t i = 0; i < d * K; ++i) p1[i] += a1[i];
+
+					const T *a2 = sum2.ptr_col(r);
+					T *p2 = s2.ptr_data();
+					for (index_t i = 0; i < s2r * K; ++i) p2[i] += a2[i];
+
+					ltotal += lls[r];
+				}
+
+				avg = ltotal / T(n);
+				monitor.on_iteration(t + 1, avg);
+
+				// M-step
+
+				update_params_(n, nk, s1, s2);
+
+				if (t > 0 && std::abs(avg - prev) <= tol.get() * std::abs(avg)) break;
+				prev = avg;
+			}
+
+			// write back, with the components matching the results
+
+			set_components_(chol);
+
+			Weights& wout = weights.derived();
+			for (index_t k = 0; k < K; ++k) wout[k] = m_w[k];
+			copy(m_mu, means.derived());
+			copy(m_cov, covs.derived());
+
+			return avg;
+		}
+
+		/**
+		 * Writes the posteriors (K x n) of the samples in x under the
+		 * parameters from the last run, and their log-likelihoods (n).
+		 */
+		template<class X, class Out, class LL>
+		void posterior(const IRegularMatrix<X, T>& x,
+				IRegularMatrix<Out, T>& out, IRegularMatrix<LL, T>& loglik) const
+		{
+			check_arg(m_dim > 0, "gmm: the model has not been estimated.");
+			m_comps.posterior(x, m_logw, out, loglik);
+		}
+
+	private:
+		index_t cov_rows_(index_t d) const
+		{
+			switch (m_form)
+			{
+			case GAUSS_COV_SPHERICAL: return 1;
+			case GAUSS_COV_DIAGONAL: return d;
+			default: return d * d;
+			}
+		}
+
+		void set_components_(pd_chol_cache<T>& chol)
+		{
+			m_comps.block_size.set(block_size.get());
+
+			for (index_t k = 0; k < m_K; ++k)
+			{
+				check_arg(m_w[k] > T(0), "gmm: the weights must be positive.");
+				m_logw[k] = std::log(m_w[k]);
+			}
+
+			switch (m_form)
+			{
+			case GAUSS_COV_SPHERICAL:
+				m_comps.set_spherical(m_mu, m_cov);
+				break;
+			case GAUSS_COV_DIAGONAL:
+				m_comps.set_diagonal(m_mu, m_cov);
+				break;
+			case GAUSS_COV_FULL:
+				chol.factorize(m_cov);
+				m_comps.set_full(m_mu, chol);
+				break;
+			}
+		}
+
+		/**
+		 * Adds the statistics of a block, given its posteriors pb:
+		 * cnt += sum_j p_j, s1 += x p', and s2 += x.^2 p' (spherical,
+		 * diagonal) or, per component, the scatter of x around the
+		 * current mean weighted by p (full).
+		 */
+		void accum_block_(const cref_matrix<T>& xb, const ref_matrix<T>& pb,
+				const T *ll, T *wk, T *cnt, T *a1, T *a2, T& lsum) const
+		{
+			const index_t d = m_dim;
+			const index_t K = m_K;
+			const index_t b = xb.ncolumns();
+
+			for (index_t j = 0; j < b; ++j)
+			{
+				const T *pj = pb.ptr_col(j);
+				for (index_t k = 0; k < K; ++k) cnt[k] += pj[k];
+				lsum += ll[j];
+			}
+
+			ref_matrix<T> s1(a1, d, K);
+			blas::gemm(T(1), xb, pb, T(1), s1, 'N', 'T');
+
+			if (m_form != GAUSS_COV_FULL)
+			{
+				const T *px = xb.ptr_data();
+				for (index_t i = 0; i < d * b; ++i) wk[i] = px[i] * px[i];
+
+				cref_matrix<T> xsq(wk, d, b);
+				ref_matrix<T> s2(a2, d, K);
+				blas::gemm(T(1), xsq, pb, T(1), s2, 'N', 'T');
+			}
+			else
+			{
+				// centering at the current means avoids the cancellation
+				// of E[x x'] - mu mu' when the data is far from the origin
+
+				for (index_t k = 0; k < K; ++k)
+				{
+					const T *mu = m_mu.ptr_col(k);
+					for (index_t j = 0; j < b; ++j)
+					{
+						const T *xj = xb.ptr_col(j);
+						T *yj = wk + j * d;
+						const T c = std::sqrt(pb(k, j));
+						for (index_t i = 0; i < d; ++i) yj[i] = c * (xj[i] - mu[i]);
+					}
+
+					cref_matrix<T> y(wk, d, b);
+					ref_matrix<T> s2(a2 + k * d * d, d, d);
+					blas::gemm(T(1), y, y, T(1), s2, 'N', 'T');
+				}
+			}
+		}
+
+		void update_params_(index_t n, const dense_col<T>& nk,
+				const dense_matrix<T>& s1, const dense_matrix<T>& s2)
+		{
+			const index_t d = m_dim;
+			const index_t K = m_K;
+			const T r = reg.get();
+
+			// a component left with less than one sample keeps all its
+			// parameters, including its weight (up to renormalization)
+
+			T wsum(0);
+			for (index_t k = 0; k < K; ++k)
+			{
+				if (nk[k] >= T(1)) m_w[k] = nk[k] / T(n);
+				wsum += m_w[k];
+			}
+			for (index_t k = 0; k < K; ++k) m_w[k] /= wsum;
+
+			for (index_t k = 0; k < K; ++k)
+			{
+				if (nk[k] < T(1)) continue;
+
+				const T c = T(1) / nk[k];
+				const T *a1 = s1.ptr_col(k);
+				const T *a2 = s2.ptr_col(k);
+				T *mu = m_mu.ptr_col(k);
+				T *cv = m_cov.ptr_col(k);
+
+				if (m_form == GAUSS_COV_FULL)
+				{
+					// s2 is centered at the previous mean mu0, thus
+					// cov = s2 / n_k - (mu - mu0)(mu - mu0)'
+
+					T *delta = m_delta.ptr_data();
+					for (index_t i = 0; i < d; ++i)
+					{
+						const T m = a1[i] * c;
+						delta[i] = m - mu[i];
+						mu[i] = m;
+					}
+
+					for (index_t j = 0; j < d; ++j)
+					{
+						for (index_t i = 0; i < d; ++i)
+						{
+							cv[i + j * d] = a2[i + j * d] * c - delta[i] * delta[j];
+						}
+						cv[j + j * d] += r;
+					}
+				}
+				else
+				{
+					T vs(0);
+					for (index_t i = 0; i < d; ++i)
+					{
+						const T m = a1[i] * c;
+						mu[i] = m;
+						T v = a2[i] * c - m * m;
+						if (v < T(0)) v = T(0);
+
+						if (m_form == GAUSS_COV_DIAGONAL)
+							cv[i] = v + r;
+						else
+							vs += v;
+					}
+
+					if (m_form == GAUSS_COV_SPHERICAL)
+						cv[0] = vs / T(d) + r;
+				}
+			}
+		}
+
+	private:
+		index_t m_K;
+		gauss_cov_form m_form;
+		index_t m_dim;
+
+		dense_col<T> m_w;		// K
+		dense_matrix<T> m_mu;	// d x K
+		dense_matrix<T> m_cov;	// (1, d or d * d) x K
+		dense_col<T> m_logw;	// K
+		dense_col<T> m_delta;	// d
+
+		gauss_logpdf_batch<T> m_comps;
+	};
+
+}
+
+#endif
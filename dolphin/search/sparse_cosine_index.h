@@ -0,0 +1,329 @@
+/**
+ * @file sparse_cosine_index.h
+ *
+ * @brief Inverted index for top-k cosine search over sparse vectors
+ *
+ * @author Dahua Lin
+ */
+
+#ifdef _MSC_VER
+#pragma once
+#endif
+
+#ifndef DOLPHIN_SPARSE_COSINE_INDEX_H_
+#define DOLPHIN_SPARSE_COSINE_INDEX_H_
+
+#include <dolphin/common/sparse.h>
+#include <dolphin/common/parallel.h>
+
+#include <vector>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include <functional>
+
+namespace dolphin
+{
+
+	/********************************************
+	 *
+	 *  sparse_cosine_index
+	 *
+	 *  Keeps one posting list per dimension, with
+	 *  the entries of each document already scaled
+	 *  by its reciprocal norm, so that the cosine
+	 *  similarity to a normalized query is a sum
+	 *  of products over the shared dimensions.
+	 *
+	 *  Queries are answered document-at-a-time
+	 *  with MaxScore pruning: the query terms are
+	 *  sorted by their score upper bounds, and the
+	 *  lists whose bounds sum to at most the k-th
+	 *  best score so far are only probed for the
+	 *  documents found in the other lists, and
+	 *  only while they can still make a
+	 *  difference.
+	 *
+	 *  Distances agree with cosine_distance, i.e.
+	 *  1 - cos(q, x), clamped at zero.
+	 *
+	 ********************************************/
+
+	template<typename T>
+	class sparse_cosine_index
+	{
+	public:
+		/**
+		 * Builds the index over the columns of docs, whose labels
+		 * are their column indices.
+		 */
+		explicit sparse_cosine_index(const csc_matrix<T>& docs)
+		: m_dim(docs.nrows()), m_size(docs.ncolumns())
+		, m_rnorms(static_cast<size_t>(docs.ncolumns()))
+		{
+			for (index_t j = 0; j < m_size; ++j)
+			{
+				const T *v = docs.col_values(j);
+				T s(0);
+				for (index_t k = 0; k < docs.col_nnz(j); ++k) s += v[k] * v[k];
+				m_rnorms[j] = s > 0 ? math::rcp(math::sqrt(s)) : T(0);
+			}
+
+			// the rows of docs, with sorted document indices
+
+			const csc_matrix<T> rows = transpose(docs);
+			const index_t nz = rows.nnz();
+
+			m_offsets.assign(rows.colptr(), rows.colptr() + (m_dim + 1));
+			m_docs.assign(rows.rowinds(), rows.rowinds() + nz);
+			m_weights.resize(static_cast<size_t>(nz));
+			m_maxw.assign(static_cast<size_t>(m_dim), T(0));
+
+			for (index_t t = 0; t < m_dim; ++t)
+			{
+				T mw(0);
+				for (index_t p = m_offsets[t]; p < m_offsets[t + 1]; ++p)
+				{
+					const T w = rows.values()[p] * m_rnorms[m_docs[p]];
+					m_weights[p] = w;
+					if (std::abs(w) > mw) mw = std::abs(w);
+				}
+				m_maxw[t] = mw;
+			}
+		}
+
+		DOLPHIN_ENSURE_INLINE index_t dim() const { return m_dim; }
+		DOLPHIN_ENSURE_INLINE index_t size() const { return m_size; }
+
+		DOLPHIN_ENSURE_INLINE
+		index_t list_size(index_t t) const
+		{
+			return m_offsets[t + 1] - m_offsets[t];
+		}
+
+		DOLPHIN_ENSURE_INLINE
+		T rnorm(index_t j) const
+		{
+			return m_rnorms[j];
+		}
+
+		/**
+		 * Finds the k documents nearest to each query in cosine
+		 * distance, among those sharing a non-zero dimension with
+		 * it. Queries are processed in parallel.
+		 *
+		 * dists and labels are k x nq, sorted by increasing distance.
+		 * Unfilled slots (also all slots of zero queries) get an
+		 * infinite distance and label -1.
+		 */
+		template<class Dists, class Labels>
+		void search(const csc_matrix<T>& queries, index_t k,
+				IRegularMatrix<Dists, T>& dists, IRegularMatrix<Labels, index_t>& labels) const
+		{
+			const index_t nq = queries.ncolumns();
+			check_arg(queries.nrows() == m_dim, "The dimension of queries is invalid.");
+			check_arg(k > 0, "k must be positive.");
+			check_arg(dists.nrows() == k && dists.ncolumns() == nq, "The size of dists is invalid.");
+			check_arg(labels.nrows() == k && labels.ncolumns() == nq, "The size of labels is invalid.");
+
+			Dists& dists_ = dists.derived();
+			Labels& labels_ = labels.derived();
+
+			index_t maxnz = 0;
+			for (index_t j = 0; j < nq; ++j)
+				if (queries.col_nnz(j) > maxnz) maxnz = queries.col_nnz(j);
+
+			// per-thread scratch, allocated before the parallel region
+
+			const index_t nw = max_num_threads();
+			std::vector<search_workspace> wss(static_cast<size_t>(nw));
+			for (index_t w = 0; w < nw; ++w) wss[w].init(maxnz, k);
+
+			parallel_for_chunks(nq, 16, [&](index_t j0, index_t j1)
+			{
+				search_workspace& ws = wss[thread_rank()];
+				for (index_t j = j0; j < j1; ++j)
+				{
+					search_one_(queries, j, k, ws);
+
+					// heap is sorted by decreasing similarity
+
+					const std::vector<entry_t>& heap = ws.heap;
+					const index_t h = static_cast<index_t>(heap.size());
+					for (index_t i = 0; i < k; ++i)
+					{
+						if (i < h)
+						{
+							T v = T(1) - heap[i].first;
+							if (v < T(0)) v = T(0);
+							dists_(i, j) = v;
+							labels_(i, j) = heap[i].second;
+						}
+						else
+						{
+							dists_(i, j) = std::numeric_limits<T>::infinity();
+							labels_(i, j) = -1;
+						}
+					}
+				}
+			});
+		}
+
+		template<class Q, class Dists, class Labels>
+		void search(const IRegularMatrix<Q, T>& queries, index_t k,
+				IRegularMatrix<Dists, T>& dists, IRegularMatrix<Labels, index_t>& labels) const
+		{
+			search(to_csc(queries), k, dists, labels);
+		}
+
+	private:
+		typedef std::pair<T, index_t> entry_t;	// (similarity, document)
+
+		struct qterm
+		{
+			T w;			// normalized query weight
+			T ub;			// upper bound of the contribution
+			index_t pos;	// cursor into the posting list
+			index_t end;
+		};
+
+		struct search_workspace
+		{
+			std::vector<entry_t> heap;		// capacity k
+			std::vector<qterm> terms;		// capacity max query nnz
+			std::vector<T> cub;				// capacity max query nnz
+
+			void init(index_t maxnz, index_t k)
+			{
+				heap.reserve(static_cast<size_t>(k));
+				terms.reserve(static_cast<size_t>(maxnz));
+				cub.reserve(static_cast<size_t>(maxnz));
+			}
+		};
+
+		/**
+		 * Leaves in ws.heap the best k entries for the j-th query,
+		 * sorted by decreasing similarity. Works entirely within
+		 * the storage of ws.
+		 */
+		void search_one_(const csc_matrix<T>& queries, index_t j, index_t k,
+				search_workspace& ws) const
+		{
+			std::vector<entry_t>& heap = ws.heap;
+			std::vector<qterm>& terms = ws.terms;
+			std::vector<T>& cub = ws.cub;
+			heap.clear();
+			terms.clear();
+
+			const index_t *qi = queries.col_rowinds(j);
+			const T *qv = queries.col_values(j);
+			const index_t qn = queries.col_nnz(j);
+
+			T qs(0);
+			for (index_t p = 0; p < qn; ++p) qs += qv[p] * qv[p];
+			if (!(qs > T(0))) return;
+			const T rq = math::rcp(math::sqrt(qs));
+
+			for (index_t p = 0; p < qn; ++p)
+			{
+				const index_t t = qi[p];
+				if (list_size(t) == 0) continue;
+
+				qterm e;
+				e.w = qv[p] * rq;
+				e.ub = std::abs(e.w) * m_maxw[t];
+				e.pos = m_offsets[t];
+				e.end = m_offsets[t + 1];
+				terms.push_back(e);
+			}
+
+			const index_t nt = static_cast<index_t>(terms.size());
+			if (nt == 0) return;
+
+			std::sort(terms.begin(), terms.end(),
+					[](const qterm& a, const qterm& b) { return a.ub < b.ub; });
+
+			// cub[i]: the sum of the bounds of terms [0, i]
+
+			cub.resize(static_cast<size_t>(nt));
+			T acc(0);
+			for (index_t i = 0; i < nt; ++i) cub[i] = (acc += terms[i].ub);
+
+			const std::greater<entry_t> comp;	// the root is the worst kept entry
+
+			T theta = -std::numeric_limits<T>::infinity();
+			index_t ne = 0;		// terms [0, ne) are non-essential
+
+			for(;;)
+			{
+				// next candidate: the smallest document in the essential lists
+
+				index_t doc = m_size;
+				for (index_t i = ne; i < nt; ++i)
+				{
+					if (terms[i].pos < terms[i].end && m_docs[terms[i].pos] < doc)
+						doc = m_docs[terms[i].pos];
+				}
+				if (doc == m_size) break;
+
+				T s(0);
+				for (index_t i = ne; i < nt; ++i)
+				{
+					qterm& e = terms[i];
+					if (e.pos < e.end && m_docs[e.pos] == doc)
+						s += e.w * m_weights[e.pos++];
+				}
+
+				// complete the score from the non-essential lists,
+				// as long as the document can still enter the heap
+
+				bool alive = true;
+				for (index_t i = ne - 1; i >= 0; --i)
+				{
+					if (s + cub[i] <= theta) { alive = false; break; }
+
+					qterm& e = terms[i];
+					e.pos = static_cast<index_t>(
+							std::lower_bound(m_docs.data() + e.pos, m_docs.data() + e.end, doc) - m_docs.data());
+
+					if (e.pos < e.end && m_docs[e.pos] == doc)
+						s += e.w * m_weights[e.pos];
+				}
+				if (!alive) continue;
+
+				if (index_t(heap.size()) < k)
+				{
+					heap.push_back(entry_t(s, doc));
+					std::push_heap(heap.begin(), heap.end(), comp);
+				}
+				else if (s > theta)
+				{
+					std::pop_heap(heap.begin(), heap.end(), comp);
+					heap.back() = entry_t(s, doc);
+					std::push_heap(heap.begin(), heap.end(), comp);
+				}
+				else continue;
+
+				if (index_t(heap.size()) == k)
+				{
+					theta = heap.front().first;
+					while (ne < nt && cub[ne] <= theta) ++ne;
+				}
+			}
+
+			std::sort_heap(heap.begin(), heap.end(), comp);
+		}
+
+	private:
+		index_t m_dim;
+		index_t m_size;
+		std::vector<index_t> m_offsets;		// dim + 1
+		std::vector<index_t> m_docs;		// nnz, sorted within each list
+		std::vector<T> m_weights;			// nnz, scaled by the document norms
+		std::vector<T> m_maxw;				// dim, max |weight| of each list
+		std::vector<T> m_rnorms;			// size, reciprocal document norms
+	};
+
+}
+
+#endif
@@ -0,0 +1,451 @@
+/**
+ * @file hkmeans.h
+ *
+ * @brief Hierarchical K-means (vocabulary tree)
+ *
+ * @author Dahua Lin
+ */
+
+#ifdef _MSC_VER
+#pragma once
+#endif
+
+#ifndef DOLPHIN_HKMEANS_H_
+#define DOLPHIN_HKMEANS_H_
+
+#include <dolphin/vq/kmeans.h>
+#include <dolphin/common/parallel.h>
+
+#include <vector>
+#include <ostream>
+#include <cstring>
+#include <algorithm>
+
+namespace dolphin
+{
+
+	/********************************************
+	 *
+	 *  tree storage
+	 *
+	 *  Nodes are kept in a flat array in breadth-
+	 *  first order, with the children of a node
+	 *  placed consecutively. The center of node i
+	 *  is the i-th column of a d x nnodes matrix,
+	 *  so the children centers visited at each
+	 *  step of encoding are contiguous in memory.
+	 *
+	 *  Both arrays are plain data, and a tree can
+	 *  be used in place from a memory-mapped file
+	 *  written by hkmeans_tree::save.
+	 *
+	 ********************************************/
+
+	struct hkm_node
+	{
+		index_t first_child;	// -1 for leaves
+		index_t nchildren;		// 0 for leaves
+		index_t leaf_id;		// -1 for internal nodes
+		index_t count;			// number of training samples
+	};
+
+	struct hkm_file_header
+	{
+		char magic[8];			// "DOLPHKM"
+		index_t value_size;		// sizeof(T)
+		index_t dim;
+		index_t nnodes;
+		index_t nleaves;
+	};
+
+
+	template<typename T>
+	class hkmeans_tree_view
+	{
+	public:
+		hkmeans_tree_view(index_t dim, index_t nnodes, index_t nleaves,
+				const hkm_node *nodes, const T *centers)
+		: m_dim(dim), m_nnodes(nnodes), m_nleaves(nleaves)
+		, m_nodes(nodes), m_centers(centers) { }
+
+		/**
+		 * Makes a view over a buffer with the layout written by
+		 * hkmeans_tree::save (e.g. a memory-mapped file).
+		 */
+		static hkmeans_tree_view from_buffer(const void *buf)
+		{
+			const hkm_file_header *h = static_cast<const hkm_file_header*>(buf);
+
+			check_arg(std::memcmp(h->magic, "DOLPHKM", 8) == 0, "Invalid hkmeans tree buffer.");
+			check_arg(h->value_size == index_t(sizeof(T)), "Unmatched value type of hkmeans tree.");
+
+			const hkm_node *nodes = reinterpret_cast<const hkm_node*>(h + 1);
+			const T *centers = reinterpret_cast<const T*>(nodes + h->nnodes);
+
+			return hkmeans_tree_view(h->dim, h->nnodes, h->nleaves, nodes, centers);
+		}
+
+		DOLPHIN_ENSURE_INLINE index_t dim() const { return m_dim; }
+		DOLPHIN_ENSURE_INLINE index_t nnodes() const { return m_nnodes; }
+		DOLPHIN_ENSURE_INLINE index_t nleaves() const { return m_nleaves; }
+
+		DOLPHIN_ENSURE_INLINE const hkm_node& node(index_t i) const
+		{
+			return m_nodes[i];
+		}
+
+		DOLPHIN_ENSURE_INLINE const T *center(index_t i) const
+		{
+			return m_centers + i * m_dim;
+		}
+
+		/**
+		 * Returns the leaf id of x, by descending from the root to
+		 * the nearest child at each level (O(b log_b K) distances).
+		 */
+		index_t encode(const T *x) const
+		{
+			index_t c = 0;
+
+			while (m_nodes[c].nchildren > 0)
+			{
+				const index_t f = m_nodes[c].first_child;
+				const index_t nc = m_nodes[c].nchildren;
+
+				const T *pc = center(f);
+				index_t best = f;
+				T dmin = sqdist(x, pc);
+
+				for (index_t k = 1; k < nc; ++k)
+				{
+					pc += m_dim;
+					T v = sqdist(x, pc);
+					if (v < dmin)
+					{
+						dmin = v;
+						best = f + k;
+					}
+				}
+
+				c = best;
+			}
+
+			return m_nodes[c].leaf_id;
+		}
+
+		template<class X, typename TL, class Labels>
+		void encode(const IRegularMatrix<X, T>& xs, IRegularMatrix<Labels, TL>& labels) const
+		{
+			static_assert(is_percol_contiguous<X>::value, "xs must be percol-contiguous");
+
+			check_arg(xs.nrows() == m_dim, "The dimension of xs is invalid.");
+			check_arg(labels.nelems() == xs.ncolumns(), "The size of labels is invalid.");
+
+			const X& xs_ = xs.derived();
+			Labels& labels_ = labels.derived();
+
+			parallel_for_chunks(xs.ncolumns(), 256, [&](index_t j0, index_t j1)
+			{
+				for (index_t j = j0; j < j1; ++j)
+					labels_[j] = static_cast<TL>(encode(xs_.ptr_col(j)));
+			});
+		}
+
+	private:
+		DOLPHIN_ENSURE_INLINE
+		T sqdist(const T *x, const T *c) const
+		{
+			T s(0);
+			for (index_t i = 0; i < m_dim; ++i)
+			{
+				T v = x[i] - c[i];
+				s += v * v;
+			}
+			return s;
+		}
+
+	private:
+		index_t m_dim;
+		index_t m_nnodes;
+		index_t m_nleaves;
+		const hkm_node *m_nodes;
+		const T *m_centers;
+	};
+
+
+	template<typename T>
+	class hkmeans_tree
+	{
+	public:
+		hkmeans_tree(index_t dim, std::vector<hkm_node>&& nodes, std::vector<T>&& centers)
+		: m_dim(dim), m_nleaves(0)
+		, m_nodes(std::move(nodes)), m_centers(std::move(centers))
+		{
+			for (size_t i = 0; i < m_nodes.size(); ++i)
+			{
+				if (m_nodes[i].nchildren == 0)
+					m_nodes[i].leaf_id = m_nleaves ++;
+				else
+					m_nodes[i].leaf_id = -1;
+			}
+		}
+
+		DOLPHIN_ENSURE_INLINE
+		hkmeans_tree_view<T> view() const
+		{
+			return hkmeans_tree_view<T>(m_dim, nnodes(), m_nleaves,
+					m_nodes.data(), m_centers.data());
+		}
+
+		DOLPHIN_ENSURE_INLINE index_t dim() const { return m_dim; }
+		DOLPHIN_ENSURE_INLINE index_t nnodes() const { return static_cast<index_t>(m_nodes.size()); }
+		DOLPHIN_ENSURE_INLINE index_t nleaves() const { return m_nleaves; }
+
+		DOLPHIN_ENSURE_INLINE
+		index_t encode(const T *x) const
+		{
+			return view().encode(x);
+		}
+
+		template<class X, typename TL, class Labels>
+		void encode(const IRegularMatrix<X, T>& xs, IRegularMatrix<Labels, TL>& labels) const
+		{
+			view().encode(xs, labels);
+		}
+
+		void save(std::ostream& out) const
+		{
+			hkm_file_header h;
+			std::memcpy(h.magic, "DOLPHKM", 8);
+			h.value_size = static_cast<index_t>(sizeof(T));
+			h.dim = m_dim;
+			h.nnodes = nnodes();
+			h.nleaves = m_nleaves;
+
+			out.write(reinterpret_cast<const char*>(&h), sizeof(h));
+			out.write(reinterpret_cast<const char*>(m_nodes.data()),
+					static_cast<std::streamsize>(m_nodes.size() * sizeof(hkm_node)));
+			out.write(reinterpret_cast<const char*>(m_centers.data()),
+					static_cast<std::streamsize>(m_centers.size() * sizeof(T)));
+		}
+
+	private:
+		index_t m_dim;
+		index_t m_nleaves;
+		std::vector<hkm_node> m_nodes;
+		std::vector<T> m_centers;
+	};
+
+
+	/********************************************
+	 *
+	 *  tree construction
+	 *
+	 *  The tree is grown level by level. All nodes
+	 *  of a level are split concurrently, each by
+	 *  running the kmeans engine with K = branch
+	 *  on the samples that reach it. The samples of
+	 *  each node occupy a contiguous range of a
+	 *  shared permutation, so splits of sibling
+	 *  nodes touch disjoint memory.
+	 *
+	 ********************************************/
+
+	template<typename T=double>
+	class hkmeans
+	{
+	public:
+		simple_property<index_t> branch;
+		simple_property<index_t> max_depth;
+		simple_property<size_t> max_iters;
+		simple_property<T> tol;
+		simple_property<unsigned int> seed;
+
+	public:
+		hkmeans(index_t b, index_t depth)
+		: branch    (b,         require_gt_<index_t>(1), "branch must be greater than 1")
+		, max_depth (depth,     require_gt_<index_t>(0), "max_depth must be positive")
+		, max_iters (100,       require_gt_<size_t>(0),  "maxiters must be positive")
+		, tol       (T(1.0e-6), require_gt_<T>(0),       "tol must be positive")
+		, seed      (0)
+		{ }
+
+		template<class Data>
+		hkmeans_tree<T> run(const IRegularMatrix<Data, T>& data) const
+		{
+			static_assert(is_percol_contiguous<Data>::value, "data must be percol-contiguous");
+
+			const Data& data_ = data.derived();
+			const index_t d = data.nrows();
+			const index_t n = data.ncolumns();
+			const index_t b = branch.get();
+
+			check_arg(n > 0, "data must be non-empty.");
+
+			std::vector<index_t> perm(static_cast<size_t>(n));
+			for (index_t j = 0; j < n; ++j) perm[j] = j;
+
+			// root
+
+			std::vector<hkm_node> nodes(1);
+			std::vector<T> centers(static_cast<size_t>(d), T(0));
+			std::vector<index_t> begins(1, 0);
+
+			nodes[0].first_child = -1;
+			nodes[0].nchildren = 0;
+			nodes[0].count = n;
+
+			for (index_t j = 0; j < n; ++j)
+			{
+				const T *x = data_.ptr_col(j);
+				for (index_t i = 0; i < d; ++i) centers[i] += x[i];
+			}
+			for (index_t i = 0; i < d; ++i) centers[i] /= T(n);
+
+			// grow level by level
+
+			index_t lv_begin = 0;
+			index_t lv_end = 1;
+
+			for (index_t depth = 0; depth < max_depth.get() && lv_begin < lv_end; ++depth)
+			{
+				const index_t nl = lv_end - lv_begin;
+
+				// the working storage of all splits is allocated up front;
+				// the kmeans engine may still throw, which is propagated
+				// once the level is done
+
+				std::vector<split_workspace> ws(static_cast<size_t>(nl));
+				for (index_t t = 0; t < nl; ++t)
+				{
+					const index_t m = nodes[lv_begin + t].count;
+					if (m > b) ws[t].init(d, m, b);
+				}
+
+				parallel_for_checked(nl, [&](index_t t)
+				{
+					const index_t c = lv_begin + t;
+					split_node(data_, c, begins[c], nodes[c].count, b,
+							perm, ws[t]);
+				});
+
+				// allocate the children of each node consecutively
+
+				for (index_t t = 0; t < nl; ++t)
+				{
+					const index_t c = lv_begin + t;
+					if (!ws[t].split) continue;
+					const dense_col<index_t>& cnts = ws[t].counts;
+
+					nodes[c].first_child = static_cast<index_t>(nodes.size());
+
+					index_t pos = begins[c];
+					for (index_t k = 0; k < b; ++k)
+					{
+						if (cnts[k] == 0) continue;
+
+						hkm_node nd;
+						nd.first_child = -1;
+						nd.nchildren = 0;
+						nd.leaf_id = -1;
+						nd.count = cnts[k];
+						nodes.push_back(nd);
+						begins.push_back(pos);
+						pos += cnts[k];
+
+						const T *pc = ws[t].ctrs.ptr_col(k);
+						centers.insert(centers.end(), pc, pc + d);
+
+						++ nodes[c].nchildren;
+					}
+				}
+
+				lv_begin = lv_end;
+				lv_end = static_cast<index_t>(nodes.size());
+			}
+
+			return hkmeans_tree<T>(d, std::move(nodes), std::move(centers));
+		}
+
+	private:
+		struct split_workspace
+		{
+			dense_matrix<T> sub;		// d x m, the samples of the node
+			dense_matrix<T> ctrs;		// d x b
+			dense_col<index_t> labels;	// m
+			dense_col<index_t> counts;	// b
+			std::vector<index_t> offsets;	// b
+			std::vector<index_t> tmp;	// m
+			bool split;
+
+			split_workspace() : split(false) { }
+
+			void init(index_t d, index_t m, index_t b)
+			{
+				sub.resize(d, m);
+				ctrs.resize(d, b);
+				labels.resize(m, 1);
+				counts.resize(b, 1);
+				offsets.resize(static_cast<size_t>(b));
+				tmp.resize(static_cast<size_t>(m));
+			}
+		};
+
+		/**
+		 * Splits the samples perm[i0, i0 + m) into (at most) b groups,
+		 * reordering that range by group, with the group centers and
+		 * sizes left in ws. Leaves ws.split false if the node should
+		 * not be split.
+		 */
+		template<class Data>
+		void split_node(const Data& data, index_t c, index_t i0, index_t m, index_t b,
+				std::vector<index_t>& perm, split_workspace& ws) const
+		{
+			if (m <= b) return;
+
+			const index_t d = data.nrows();
+
+			dense_matrix<T>& sub = ws.sub;
+			for (index_t j = 0; j < m; ++j)
+			{
+				const T *x = data.ptr_col(perm[i0 + j]);
+				T *y = sub.ptr_col(j);
+				for (index_t i = 0; i < d; ++i) y[i] = x[i];
+			}
+
+			std::mt19937 rng(seed.get() + static_cast<unsigned int>(c));
+			kmeans_random_seeds(sub, b, ws.ctrs, rng);
+
+			kmeans<T> km(static_cast<size_t>(b));
+			km.max_iters.set(max_iters.get());
+			km.tol.set(tol.get());
+
+			dense_col<index_t>& labels = ws.labels;
+			dense_col<index_t>& counts = ws.counts;
+			kmeans_silent_monitor mon;
+			km.run(sub, ws.ctrs, labels, counts, mon);
+
+			index_t nnz = 0;
+			for (index_t k = 0; k < b; ++k) if (counts[k] > 0) ++ nnz;
+			if (nnz < 2) return;
+
+			// reorder the range by group (counting sort)
+
+			std::vector<index_t>& offsets = ws.offsets;
+			offsets[0] = 0;
+			for (index_t k = 1; k < b; ++k) offsets[k] = offsets[k-1] + counts[k-1];
+
+			std::vector<index_t>& tmp = ws.tmp;
+			std::copy(perm.begin() + i0, perm.begin() + (i0 + m), tmp.begin());
+			for (index_t j = 0; j < m; ++j)
+			{
+				perm[i0 + (offsets[labels[j]] ++)] = tmp[j];
+			}
+
+			ws.split = true;
+		}
+	};
+
+}
+
+#endif
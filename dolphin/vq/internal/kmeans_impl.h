@@ -17,24 +17,193 @@
 #include <dolphin/common/properties.h>
 
 #include <dolphin/common/import_lmat.h>
+#include <light_mat/linalg/blas_l3.h>
+
+#include <vector>
+#include <limits>
+#include <algorithm>
 
 namespace dolphin { namespace internal {
 
+	/********************************************
+	 *
+	 *  Lloyd iterations over a stack of restarts
+	 *
+	 *  All R restarts keep their centers side by
+	 *  side in a d x (K * R) matrix, so that one
+	 *  GEMM per data block scores every restart,
+	 *  and each data block is read only once per
+	 *  iteration regardless of R.
+	 *
+	 *  On return, objvs holds the objective of
+	 *  the final centers and labels of each
+	 *  restart.
+	 *
+	 ********************************************/
 
-	template<typename T, typename TI, typename TL,
-		class Data, class Centers, class Labels, class Counts, class Monitor>
-	void kmeans_impl(
+	template<typename T, class Data, class Monitor>
+	index_t kmeans_impl(
 			const Data& data,
-			Centers& centers,
-			Labels& labels,
-			Counts& counts,
+			const index_t K,
+			const index_t bsize,
+			dense_matrix<T>& centers,	// d x (K * R), initialized by caller
+			dense_matrix<index_t>& labels,	// n x R
+			std::vector<T>& objvs,		// R
 			Monitor& monitor,
 			const size_t max_iter,
 			const T tol)
 	{
+		const index_t d = data.nrows();
 		const index_t n = data.ncolumns();
-		const index_t K = centers.ncolumns();
+		const index_t KR = centers.ncolumns();
+		const index_t R = KR / K;
+
+		// working storage (allocated once)
+
+		dense_col<T> xn(n);
+		colwise_sqsum(data, xn);
+
+		dense_col<T> cn(KR);
+		colwise_sqsum(centers, cn);
+
+		dense_matrix<T> scores(KR, bsize);
+		dense_matrix<T> sums(d, KR);
+		dense_col<index_t> cnts(KR);
+
+		labels << index_t(-1);
+
+		std::vector<T> cur(static_cast<size_t>(R));
+		std::vector<index_t> nchanged(static_cast<size_t>(R));
+		std::vector<char> active(static_cast<size_t>(R), 1);
+
+		objvs.assign(static_cast<size_t>(R), std::numeric_limits<T>::infinity());
+		index_t nactive = R;
+
+		for (size_t t = 0; t < max_iter && nactive > 0; ++t)
+		{
+			sums << T(0);
+			cnts << index_t(0);
+			std::fill(cur.begin(), cur.end(), T(0));
+			std::fill(nchanged.begin(), nchanged.end(), index_t(0));
+
+			// assignment (one pass over data)
+
+			for (index_t j0 = 0; j0 < n; j0 += bsize)
+			{
+				const index_t nb = std::min(bsize, n - j0);
+
+				cref_matrix<T> X(data.ptr_col(j0), d, nb);
+				ref_matrix<T> S(scores.ptr_data(), KR, nb);
+
+				blas::gemm(centers, X, S, 'T', 'N');
+
+				for (index_t jj = 0; jj < nb; ++jj)
+				{
+					const index_t j = j0 + jj;
+					const T *x = X.ptr_col(jj);
+					const T *s = S.ptr_col(jj);
+
+					for (index_t r = 0; r < R; ++r)
+					{
+						if (!active[r]) continue;
+
+						const index_t o = r * K;
+
+						index_t kmin = 0;
+						T vmin = cn[o] - T(2) * s[o];
+
+						for (index_t k = 1; k < K; ++k)
+						{
+							T v = cn[o + k] - T(2) * s[o + k];
+							if (v < vmin)
+							{
+								vmin = v;
+								kmin = k;
+							}
+						}
+
+						index_t& l = labels(j, r);
+						if (l != kmin)
+						{
+							l = kmin;
+							++ nchanged[r];
+						}
+
+						T dv = xn[j] + vmin;
+						if (dv > T(0)) cur[r] += dv;
+
+						T *sc = sums.ptr_col(o + kmin);
+						for (index_t i = 0; i < d; ++i) sc[i] += x[i];
+						++ cnts[o + kmin];
+					}
+				}
+			}
+
+			// update (empty clusters keep their previous centers)
+
+			for (index_t r = 0; r < R; ++r)
+			{
+				if (!active[r]) continue;
+
+				for (index_t k = r * K; k < (r + 1) * K; ++k)
+				{
+					if (cnts[k] > 0)
+					{
+						const T c = T(1) / T(cnts[k]);
+						const T *sc = sums.ptr_col(k);
+						T *pc = centers.ptr_col(k);
+
+						for (index_t i = 0; i < d; ++i) pc[i] = sc[i] * c;
+					}
+				}
+			}
+
+			colwise_sqsum(centers, cn);
+
+			// convergence test (per restart)
+
+			for (index_t r = 0; r < R; ++r)
+			{
+				if (!active[r]) continue;
+
+				monitor.on_iteration(r, t + 1, cur[r], nchanged[r]);
+
+				T prev = objvs[r];
+				objvs[r] = cur[r];
+
+				if (nchanged[r] == 0 || prev - cur[r] <= tol * cur[r])
+				{
+					active[r] = 0;
+					-- nactive;
+				}
+			}
+		}
+
+		// the objective of the final centers (the one above was measured
+		// against the centers before the last update)
+
+		std::fill(objvs.begin(), objvs.end(), T(0));
+
+		for (index_t j = 0; j < n; ++j)
+		{
+			const T *x = data.ptr_col(j);
+
+			for (index_t r = 0; r < R; ++r)
+			{
+				const T *c = centers.ptr_col(r * K + labels(j, r));
+
+				T s(0);
+				for (index_t i = 0; i < d; ++i)
+				{
+					T v = x[i] - c[i];
+					s += v * v;
+				}
+				objvs[r] += s;
+			}
+		}
 
+		return static_cast<index_t>(
+				std::min_element(objvs.begin(), objvs.end()) - objvs.begin());
 	}
 
 
@@ -0,0 +1,526 @@
+/**
+ * @file ivf_index.h
+ *
+ * @brief Inverted-file index over a K-means coarse quantizer
+ *
+ * @author Dahua Lin
+ */
+
+#ifdef _MSC_VER
+#pragma once
+#endif
+
+#ifndef DOLPHIN_IVF_INDEX_H_
+#define DOLPHIN_IVF_INDEX_H_
+
+#include <dolphin/vq/kmeans.h>
+#include <dolphin/common/metrics.h>
+#include <dolphin/common/parallel.h>
+
+#include <vector>
+#include <ostream>
+#include <cstring>
+#include <limits>
+#include <algorithm>
+
+namespace dolphin
+{
+
+	/********************************************
+	 *
+	 *  storage
+	 *
+	 *  The buffer written by ivf_index::save keeps
+	 *  the vectors of all inverted lists in one
+	 *  d x N matrix, grouped by list, with list l
+	 *  occupying columns [offsets[l], offsets[l+1]),
+	 *  and the external ids in a parallel array,
+	 *  with the layout
+	 *
+	 *    header | offsets | ids | centers | vectors
+	 *
+	 *  and ivf_index_view::from_buffer searches it
+	 *  in place (e.g. from a memory-mapped file).
+	 *
+	 ********************************************/
+
+	struct ivf_file_header
+	{
+		char magic[8];			// "DOLPIVF"
+		index_t value_size;		// sizeof(T)
+		index_t dim;
+		index_t nlists;
+		index_t size;
+	};
+
+
+	namespace internal
+	{
+		/**
+		 * Batched search over the inverted lists of Derived, which
+		 * provides dim(), nlists(), centers(), list_size(l),
+		 * list_ids(l) and list_vectors(l), each list being stored
+		 * contiguously.
+		 */
+		template<class Derived, typename T, class Metric>
+		class ivf_search_base
+		{
+		public:
+			LMAT_CRTP_REF
+
+			/**
+			 * Finds the k nearest stored vectors of each query, probing
+			 * the nprobe lists whose centers are nearest to the query.
+			 *
+			 * dists and labels are k x nq, sorted by increasing distance.
+			 * Unfilled slots get an infinite distance and label -1.
+			 */
+			template<class Q, class Dists, class Labels>
+			void search(const IRegularMatrix<Q, T>& queries, index_t k, index_t nprobe,
+					IRegularMatrix<Dists, T>& dists, IRegularMatrix<Labels, index_t>& labels) const
+			{
+				static_assert(is_percol_contiguous<Q>::value, "queries must be percol-contiguous");
+
+				const Derived& s = derived();
+				const index_t d = s.dim();
+				const index_t L = s.nlists();
+				const index_t nq = queries.ncolumns();
+				check_arg(queries.nrows() == d, "The dimension of queries is invalid.");
+				check_arg(k > 0 && nprobe > 0, "k and nprobe must be positive.");
+				check_arg(dists.nrows() == k && dists.ncolumns() == nq, "The size of dists is invalid.");
+				check_arg(labels.nrows() == k && labels.ncolumns() == nq, "The size of labels is invalid.");
+
+				if (nprobe > L) nprobe = L;
+
+				const Q& q_ = queries.derived();
+				Dists& dists_ = dists.derived();
+				Labels& labels_ = labels.derived();
+
+				// coarse distances of all queries (one GEMM-backed pairwise call)
+
+				Metric metric;
+				dense_matrix<T> cdists(L, nq);
+				cdists = pairwise(metric, s.centers(), q_);
+
+				index_t maxlen = 0;
+				for (index_t l = 0; l < L; ++l)
+					if (s.list_size(l) > maxlen) maxlen = s.list_size(l);
+
+				// per-thread scratch, allocated before the parallel region
+
+				const index_t nw = max_num_threads();
+				std::vector<search_workspace> wss(static_cast<size_t>(nw));
+				for (index_t w = 0; w < nw; ++w) wss[w].init(L, maxlen, k);
+
+				parallel_for_chunks(nq, 16, [&](index_t j0, index_t j1)
+				{
+					search_workspace& ws = wss[thread_rank()];
+					for (index_t j = j0; j < j1; ++j)
+					{
+						search_one(q_.ptr_col(j), cdists.ptr_col(j), k, nprobe, ws);
+
+						const std::vector<entry_t>& heap = ws.heap;
+						const index_t h = static_cast<index_t>(heap.size());
+						for (index_t i = 0; i < k; ++i)
+						{
+							if (i < h)
+							{
+								dists_(i, j) = heap[i].first;
+								labels_(i, j) = heap[i].second;
+							}
+							else
+							{
+								dists_(i, j) = std::numeric_limits<T>::infinity();
+								labels_(i, j) = -1;
+							}
+						}
+					}
+				});
+			}
+
+		private:
+			typedef std::pair<T, index_t> entry_t;
+
+			struct search_workspace
+			{
+				std::vector<entry_t> probes;	// nlists
+				dense_col<T> buf;				// longest list
+				std::vector<entry_t> heap;		// capacity k
+
+				void init(index_t nlists, index_t maxlen, index_t k)
+				{
+					probes.resize(static_cast<size_t>(nlists));
+					buf.resize(maxlen > 0 ? maxlen : 1, 1);
+					heap.reserve(static_cast<size_t>(k));
+				}
+			};
+
+			/**
+			 * Leaves in ws.heap the best k entries for the query q (with
+			 * coarse distances cd), sorted by increasing distance. Works
+			 * entirely within the storage of ws.
+			 */
+			void search_one(const T *q, const T *cd, index_t k, index_t nprobe,
+					search_workspace& ws) const
+			{
+				const Derived& s = derived();
+				const index_t L = s.nlists();
+				Metric metric;
+
+				// probed lists
+
+				std::vector<entry_t>& probes = ws.probes;
+				for (index_t l = 0; l < L; ++l)
+					probes[l] = entry_t(cd[l], l);
+
+				std::partial_sort(probes.begin(), probes.begin() + nprobe, probes.end());
+
+				// scan lists, keeping a max-heap of the best k
+
+				cref_col<T> qj(q, s.dim());
+				std::vector<entry_t>& heap = ws.heap;
+				heap.clear();
+
+				for (index_t p = 0; p < nprobe; ++p)
+				{
+					const index_t l = probes[p].second;
+					const index_t len = s.list_size(l);
+					if (len == 0) continue;
+
+					ref_col<T> dl(ws.buf.ptr_data(), len);
+					colwise(metric, s.list_vectors(l), qj, dl);
+
+					const index_t *ids = s.list_ids(l);
+					for (index_t i = 0; i < len; ++i)
+					{
+						const T v = dl[i];
+						if (index_t(heap.size()) < k)
+						{
+							heap.push_back(entry_t(v, ids[i]));
+							std::push_heap(heap.begin(), heap.end());
+						}
+						else if (v < heap.front().first)
+						{
+							std::pop_heap(heap.begin(), heap.end());
+							heap.back() = entry_t(v, ids[i]);
+							std::push_heap(heap.begin(), heap.end());
+						}
+					}
+				}
+
+				std::sort_heap(heap.begin(), heap.end());
+			}
+		};
+	}
+
+
+	template<typename T, class Metric=sqeuclidean_distance<T> >
+	class ivf_index_view
+	: public internal::ivf_search_base<ivf_index_view<T, Metric>, T, Metric>
+	{
+	public:
+		ivf_index_view(index_t dim, index_t nlists,
+				const T *centers, const index_t *offsets,
+				const index_t *ids, const T *vectors)
+		: m_dim(dim), m_nlists(nlists)
+		, m_centers(centers), m_offsets(offsets)
+		, m_ids(ids), m_vectors(vectors) { }
+
+		static ivf_index_view from_buffer(const void *buf)
+		{
+			const ivf_file_header *h = static_cast<const ivf_file_header*>(buf);
+
+			check_arg(std::memcmp(h->magic, "DOLPIVF", 8) == 0, "Invalid IVF index buffer.");
+			check_arg(h->value_size == index_t(sizeof(T)), "Unmatched value type of IVF index.");
+
+			const index_t *offsets = reinterpret_cast<const index_t*>(h + 1);
+			const index_t *ids = offsets + (h->nlists + 1);
+			const T *centers = reinterpret_cast<const T*>(ids + h->size);
+			const T *vectors = centers + h->dim * h->nlists;
+
+			return ivf_index_view(h->dim, h->nlists, centers, offsets, ids, vectors);
+		}
+
+		DOLPHIN_ENSURE_INLINE index_t dim() const { return m_dim; }
+		DOLPHIN_ENSURE_INLINE index_t nlists() const { return m_nlists; }
+		DOLPHIN_ENSURE_INLINE index_t size() const { return m_offsets[m_nlists]; }
+
+		DOLPHIN_ENSURE_INLINE
+		index_t list_size(index_t l) const
+		{
+			return m_offsets[l+1] - m_offsets[l];
+		}
+
+		DOLPHIN_ENSURE_INLINE
+		const index_t *list_ids(index_t l) const
+		{
+			return m_ids + m_offsets[l];
+		}
+
+		DOLPHIN_ENSURE_INLINE
+		cref_matrix<T> list_vectors(index_t l) const
+		{
+			return cref_matrix<T>(m_vectors + m_offsets[l] * m_dim, m_dim, list_size(l));
+		}
+
+		DOLPHIN_ENSURE_INLINE
+		cref_matrix<T> centers() const
+		{
+			return cref_matrix<T>(m_centers, m_dim, m_nlists);
+		}
+
+	private:
+		index_t m_dim;
+		index_t m_nlists;
+		const T *m_centers;
+		const index_t *m_offsets;
+		const index_t *m_ids;
+		const T *m_vectors;
+	};
+
+
+	/********************************************
+	 *
+	 *  ivf_index
+	 *
+	 *  Each inverted list owns its vectors and
+	 *  ids, and grows geometrically, so that add
+	 *  costs O(n d) amortized, regardless of the
+	 *  size of the index. save() writes the lists
+	 *  one after another, in the packed layout
+	 *  read by ivf_index_view.
+	 *
+	 ********************************************/
+
+	template<typename T, class Metric=sqeuclidean_distance<T> >
+	class ivf_index
+	: public internal::ivf_search_base<ivf_index<T, Metric>, T, Metric>
+	{
+	public:
+		template<class Centers>
+		explicit ivf_index(const IRegularMatrix<Centers, T>& centers)
+		: m_centers(centers.nrows(), centers.ncolumns())
+		, m_lists(static_cast<size_t>(centers.ncolumns()))
+		, m_size(0)
+		{
+			check_arg(centers.ncolumns() > 0, "The coarse quantizer must be non-empty.");
+			copy(centers.derived(), m_centers);
+		}
+
+		DOLPHIN_ENSURE_INLINE index_t dim() const { return m_centers.nrows(); }
+		DOLPHIN_ENSURE_INLINE index_t nlists() const { return m_centers.ncolumns(); }
+		DOLPHIN_ENSURE_INLINE index_t size() const { return m_size; }
+
+		DOLPHIN_ENSURE_INLINE
+		index_t list_size(index_t l) const
+		{
+			return static_cast<index_t>(m_lists[l].ids.size());
+		}
+
+		DOLPHIN_ENSURE_INLINE
+		const index_t *list_ids(index_t l) const
+		{
+			return m_lists[l].ids.data();
+		}
+
+		DOLPHIN_ENSURE_INLINE
+		cref_matrix<T> list_vectors(index_t l) const
+		{
+			return cref_matrix<T>(m_lists[l].vectors.data(), dim(), list_size(l));
+		}
+
+		DOLPHIN_ENSURE_INLINE
+		cref_matrix<T> centers() const
+		{
+			return cref_matrix<T>(m_centers.ptr_data(), dim(), nlists());
+		}
+
+		/**
+		 * Assigns the columns of data to their nearest lists and
+		 * appends them, with external ids given by ids.
+		 */
+		template<class Data, class Ids>
+		void add(const IRegularMatrix<Data, T>& data, const IRegularMatrix<Ids, index_t>& ids)
+		{
+			static_assert(is_percol_contiguous<Data>::value, "data must be percol-contiguous");
+
+			const index_t d = dim();
+			const index_t L = nlists();
+			const index_t n = data.ncolumns();
+
+			check_arg(data.nrows() == d, "The dimension of data is invalid.");
+			check_arg(ids.nelems() == n, "The size of ids is invalid.");
+
+			const Data& data_ = data.derived();
+			const Ids& ids_ = ids.derived();
+
+			// assign: the distances of each block go into one reused
+			// buffer, and the per-column minima are found in parallel
+
+			std::vector<index_t> labels(static_cast<size_t>(n));
+			const index_t bsize = 1024;
+			dense_matrix<T> D(L, std::min(n, bsize));
+
+			for (index_t j0 = 0; j0 < n; j0 += bsize)
+			{
+				const index_t nb = std::min(bsize, n - j0);
+				cref_matrix<T> X(data_.ptr_col(j0), d, nb);
+				ref_matrix<T> Db(D.ptr_data(), L, nb);
+				Db = pairwise(Metric(), m_centers, X);
+
+				parallel_for_chunks(nb, 64, [&](index_t b0, index_t b1)
+				{
+					for (index_t jj = b0; jj < b1; ++jj)
+					{
+						const T *dj = Db.ptr_col(jj);
+						index_t lmin = 0;
+						for (index_t l = 1; l < L; ++l)
+							if (dj[l] < dj[lmin]) lmin = l;
+						labels[j0 + jj] = lmin;
+					}
+				});
+			}
+
+			// the new columns grouped by list: members [starts[l], starts[l+1])
+
+			std::vector<index_t> starts(static_cast<size_t>(L + 1), 0);
+			for (index_t j = 0; j < n; ++j) ++ starts[labels[j] + 1];
+			for (index_t l = 0; l < L; ++l) starts[l + 1] += starts[l];
+
+			std::vector<index_t> members(static_cast<size_t>(n));
+			std::vector<index_t> cursor(starts.begin(), starts.end() - 1);
+			for (index_t j = 0; j < n; ++j) members[cursor[labels[j]] ++] = j;
+
+			// append to each list in parallel (growth may throw)
+
+			parallel_for_checked(L, [&](index_t l)
+			{
+				const index_t c = starts[l + 1] - starts[l];
+				if (c == 0) return;
+
+				list_store& s = m_lists[l];
+				const index_t len = static_cast<index_t>(s.ids.size());
+				s.grow(len + c, d);
+
+				for (index_t p = 0; p < c; ++p)
+				{
+					const index_t j = members[starts[l] + p];
+					std::memcpy(s.vectors.data() + (len + p) * d, data_.ptr_col(j),
+							static_cast<size_t>(d) * sizeof(T));
+					s.ids[len + p] = static_cast<index_t>(ids_[j]);
+				}
+			});
+
+			m_size += n;
+		}
+
+		void save(std::ostream& out) const
+		{
+			const index_t L = nlists();
+
+			ivf_file_header h;
+			std::memcpy(h.magic, "DOLPIVF", 8);
+			h.value_size = static_cast<index_t>(sizeof(T));
+			h.dim = dim();
+			h.nlists = L;
+			h.size = size();
+
+			std::vector<index_t> offsets(static_cast<size_t>(L + 1), 0);
+			for (index_t l = 0; l < L; ++l) offsets[l + 1] = offsets[l] + list_size(l);
+
+			out.write(reinterpret_cast<const char*>(&h), sizeof(h));
+			out.write(reinterpret_cast<const char*>(offsets.data()),
+					static_cast<std::streamsize>(offsets.size() * sizeof(index_t)));
+			for (index_t l = 0; l < L; ++l)
+				out.write(reinterpret_cast<const char*>(list_ids(l)),
+						static_cast<std::streamsize>(list_size(l) * index_t(sizeof(index_t))));
+			out.write(reinterpret_cast<const char*>(m_centers.ptr_data()),
+					static_cast<std::streamsize>(m_centers.nelems() * index_t(sizeof(T))));
+			for (index_t l = 0; l < L; ++l)
+				out.write(reinterpret_cast<const char*>(m_lists[l].vectors.data()),
+						static_cast<std::streamsize>(list_size(l) * dim() * index_t(sizeof(T))));
+		}
+
+	private:
+		struct list_store
+		{
+			std::vector<T> vectors;		// d x len, column-major
+			std::vector<index_t> ids;	// len
+
+			// resizes to len columns, at least doubling the capacity
+			// whenever it is exceeded
+
+			void grow(index_t len, index_t d)
+			{
+				const size_t cap = ids.capacity();
+				if (size_t(len) > cap)
+				{
+					const size_t c = std::max(size_t(len), 2 * cap);
+					vectors.reserve(c * size_t(d));
+					ids.reserve(c);
+				}
+				vectors.resize(size_t(len) * size_t(d));
+				ids.resize(size_t(len));
+			}
+		};
+
+		dense_matrix<T> m_centers;			// d x nlists
+		std::vector<list_store> m_lists;	// nlists
+		index_t m_size;
+	};
+
+
+	/********************************************
+	 *
+	 *  ivf_trainer
+	 *
+	 *  Trains the coarse quantizer with kmeans.
+	 *
+	 ********************************************/
+
+	template<typename T=float, class Metric=sqeuclidean_distance<T> >
+	class ivf_trainer
+	{
+	public:
+		simple_property<size_t> max_iters;
+		simple_property<T> tol;
+		simple_property<unsigned int> seed;
+
+	public:
+		explicit ivf_trainer(index_t nlists)
+		: max_iters (25,        require_gt_<size_t>(0),  "maxiters must be positive")
+		, tol       (T(1.0e-4), require_gt_<T>(0),       "tol must be positive")
+		, seed      (0)
+		, m_nlists(nlists)
+		{
+			check_arg(nlists > 0, "nlists must be positive.");
+		}
+
+		template<class Data>
+		ivf_index<T, Metric> run(const IRegularMatrix<Data, T>& data) const
+		{
+			const index_t K = m_nlists;
+
+			dense_matrix<T> centers(data.nrows(), K);
+			std::mt19937 rng(seed.get());
+			kmeans_random_seeds(data, K, centers, rng);
+
+			kmeans<T> km(static_cast<size_t>(K));
+			km.max_iters.set(max_iters.get());
+			km.tol.set(tol.get());
+
+			dense_col<index_t> labels(data.ncolumns());
+			dense_col<index_t> counts(K);
+			kmeans_silent_monitor mon;
+			km.run(data, centers, labels, counts, mon);
+
+			return ivf_index<T, Metric>(centers);
+		}
+
+	private:
+		index_t m_nlists;
+	};
+
+}
+
+#endif
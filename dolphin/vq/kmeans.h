@@ -14,55 +14,171 @@
 #define DOLPHIN_KMEANS_H_
 
 #include "internal/kmeans_impl.h"
+#include <random>
 
 namespace dolphin
 {
 
+	struct kmeans_silent_monitor
+	{
+		template<typename T>
+		DOLPHIN_ENSURE_INLINE
+		void on_iteration(index_t restart, size_t iter, T objv, index_t nchanged) { }
+	};
+
+
 	template<typename T=double>
 	class kmeans
 	{
 	public:
 		simple_property<size_t> max_iters;
 		simple_property<T> tol;
+		simple_property<index_t> block_size;
 
 	public:
 		kmeans(size_t K_)
 		: max_iters (100,       require_gt_<size_t>(0), "maxiters must be positive")
 		, tol       (T(1.0e-6), require_gt_<T>(0),      "tol must be positive")
+		, block_size(1024,      require_gt_<index_t>(0), "block_size must be positive")
+		, m_K(static_cast<index_t>(K_))
 		{ }
 
+		DOLPHIN_ENSURE_INLINE
+		index_t K() const
+		{
+			return m_K;
+		}
+
+		/**
+		 * Runs K-means from the initial centers given in centers,
+		 * and returns the final objective (sum of squared distances).
+		 */
 		template<typename TL, typename TI,
 			class Data, class Centers, class Labels, class Counts, class Mon>
-		void run(const IRegularMatrix<Data, T>& data,
+		T run(const IRegularMatrix<Data, T>& data,
+				IRegularMatrix<Centers, T>& centers,
+				IRegularMatrix<Labels, TL>& labels,
+				IRegularMatrix<Counts, TI>& counts,
+				Mon& monitor)
+		{
+			return run_restarts(data, centers, centers, labels, counts, monitor);
+		}
+
+		/**
+		 * Runs R restarts concurrently, with the initial centers of
+		 * all restarts stacked in seeds (of size d x (K * R)).
+		 *
+		 * Each iteration scores all restarts against a data block with
+		 * a single GEMM, so the data is read once per iteration no
+		 * matter how many restarts there are. The solution with the
+		 * lowest objective is written to centers, labels and counts,
+		 * and its objective (that of the returned centers and labels)
+		 * is returned.
+		 */
+		template<typename TL, typename TI,
+			class Data, class Seeds, class Centers, class Labels, class Counts, class Mon>
+		T run_restarts(const IRegularMatrix<Data, T>& data,
+				const IRegularMatrix<Seeds, T>& seeds,
 				IRegularMatrix<Centers, T>& centers,
 				IRegularMatrix<Labels, TL>& labels,
 				IRegularMatrix<Counts, TI>& counts,
 				Mon& monitor)
 		{
-			static_assert(is_percol_contiguous<Data>::value, "data must be percol-contiguous");
+			static_assert(is_contiguous<Data>::value, "data must be contiguous");
 			static_assert(is_percol_contiguous<Centers>::value, "centers must be percol-contiguous");
 			static_assert(supports_linear_index<Labels>::value, "labels must support linear indexing");
 			static_assert(supports_linear_index<Counts>::value, "counts must support linear indexing");
 
-			check_arg(data.nrows() == centers.nrows(),
-					"The sample dimensions in data and centers are inconsistent.");
-
+			const index_t d = data.nrows();
 			const index_t n = data.ncolumns();
-			const index_t K = centers.ncolumns();
+			const index_t K = m_K;
+
+			check_arg(d == seeds.nrows() && d == centers.nrows(),
+					"The sample dimensions in data and centers are inconsistent.");
+			check_arg(K > 0, "K must be positive.");
+			check_arg(centers.ncolumns() == K, "The number of centers is invalid.");
+			check_arg(seeds.ncolumns() >= K && seeds.ncolumns() % K == 0,
+					"The number of seeds must be a positive multiple of K.");
+			check_arg(n >= K, "The number of samples must be no less than K.");
 
 			check_arg(is_vector(labels) && labels.nelems() == n, "The size of labels is invalid.");
 			check_arg(is_vector(counts) && counts.nelems() == K, "The size of counts is invalid.");
 
-			internal::kmeans_impl(
-					data.derived(),
-					centers.derived(),
-					labels.derived(),
-					counts.derived(),
-					monitor, max_iters, tol);
+			dense_matrix<T> C(d, seeds.ncolumns());
+			copy(seeds.derived(), C);
+
+			const index_t R = seeds.ncolumns() / K;
+			dense_matrix<index_t> L(n, R);
+			std::vector<T> objvs;
+
+			const index_t r = internal::kmeans_impl(
+					data.derived(), K, block_size.get(), C, L, objvs,
+					monitor, max_iters.get(), tol.get());
+
+			// extract the best restart
+
+			Centers& centers_ = centers.derived();
+			Labels& labels_ = labels.derived();
+			Counts& counts_ = counts.derived();
+
+			for (index_t k = 0; k < K; ++k)
+			{
+				const T *pc = C.ptr_col(r * K + k);
+				for (index_t i = 0; i < d; ++i) centers_(i, k) = pc[i];
+				counts_[k] = TI(0);
+			}
+
+			for (index_t j = 0; j < n; ++j)
+			{
+				index_t l = L(j, r);
+				labels_[j] = static_cast<TL>(l);
+				++ counts_[l];
+			}
+
+			return objvs[r];
 		}
+
+	private:
+		index_t m_K;
 	};
 
 
+	/**
+	 * Fills seeds (of size d x (K * R)) with R sets of K distinct
+	 * samples chosen uniformly at random from data.
+	 */
+	template<typename T, class Data, class Seeds, class RNG>
+	void kmeans_random_seeds(const IRegularMatrix<Data, T>& data, index_t K,
+			IRegularMatrix<Seeds, T>& seeds, RNG& rng)
+	{
+		const index_t d = data.nrows();
+		const index_t n = data.ncolumns();
+
+		check_arg(seeds.nrows() == d, "The sample dimensions in data and seeds are inconsistent.");
+		check_arg(K > 0 && K <= n && seeds.ncolumns() % K == 0, "The size of seeds is invalid.");
+
+		const Data& data_ = data.derived();
+		Seeds& seeds_ = seeds.derived();
+		const index_t R = seeds.ncolumns() / K;
+
+		std::vector<index_t> perm(static_cast<size_t>(n));
+		for (index_t i = 0; i < n; ++i) perm[i] = i;
+
+		for (index_t r = 0; r < R; ++r)
+		{
+			// partial Fisher-Yates: the first K entries form a random subset
+			for (index_t k = 0; k < K; ++k)
+			{
+				std::uniform_int_distribution<index_t> u(k, n - 1);
+				std::swap(perm[k], perm[u(rng)]);
+
+				const index_t j = perm[k];
+				for (index_t i = 0; i < d; ++i)
+					seeds_(i, r * K + k) = data_(i, j);
+			}
+		}
+	}
+
 }
 
 #endif
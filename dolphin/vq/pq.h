@@ -0,0 +1,351 @@
+/**
+ * @file pq.h
+ *
+ * @brief Product quantization with asymmetric distance computation
+ *
+ * @author Dahua Lin
+ */
+
+#ifdef _MSC_VER
+#pragma once
+#endif
+
+#ifndef DOLPHIN_PQ_H_
+#define DOLPHIN_PQ_H_
+
+#include <dolphin/vq/kmeans.h>
+#include <dolphin/vq/vq_encoder.h>
+#include <dolphin/common/metrics.h>
+#include <dolphin/common/parallel.h>
+
+#include <vector>
+#include <memory>
+#include <algorithm>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+namespace dolphin
+{
+	namespace internal
+	{
+		/********************************************
+		 *
+		 *  ADC scan
+		 *
+		 *  dists[j] = sum_m lut[m * ksub + codes[j * M + m]]
+		 *
+		 ********************************************/
+
+		template<typename T>
+		inline void pq_adc_scan_scalar(index_t M, index_t ksub, const T *lut,
+				const uint8_t *codes, index_t j0, index_t n, T *dists)
+		{
+			for (index_t j = j0; j < n; ++j)
+			{
+				const uint8_t *c = codes + j * M;
+				const T *t = lut;
+
+				T s(0);
+				for (index_t m = 0; m < M; ++m, t += ksub) s += t[c[m]];
+				dists[j] = s;
+			}
+		}
+
+		template<typename T>
+		inline void pq_adc_scan(index_t M, index_t ksub, const T *lut,
+				const uint8_t *codes, index_t n, T *dists)
+		{
+			pq_adc_scan_scalar(M, ksub, lut, codes, 0, n, dists);
+		}
+
+		inline void pq_adc_scan(index_t M, index_t ksub, const float *lut,
+				const uint8_t *codes, index_t n, float *dists)
+		{
+			index_t j = 0;
+
+#if defined(__AVX2__)
+			// 8 codes at a time: one gather fetches 4 code bytes of each
+			// of the 8 vectors, followed by 4 table gathers
+
+			if (M % 4 == 0)
+			{
+				const int iM = static_cast<int>(M);
+				const __m256i offs = _mm256_setr_epi32(0, iM, 2*iM, 3*iM, 4*iM, 5*iM, 6*iM, 7*iM);
+				const __m256i bmask = _mm256_set1_epi32(0xff);
+
+				for (; j + 8 <= n; j += 8)
+				{
+					const uint8_t *c = codes + j * M;
+					__m256 a0 = _mm256_setzero_ps();
+					__m256 a1 = _mm256_setzero_ps();
+
+					for (index_t m = 0; m < M; m += 4)
+					{
+						__m256i w = _mm256_i32gather_epi32(reinterpret_cast<const int*>(c + m), offs, 1);
+						const float *t = lut + m * ksub;
+
+						__m256i i0 = _mm256_and_si256(w, bmask);
+						__m256i i1 = _mm256_and_si256(_mm256_srli_epi32(w, 8), bmask);
+						__m256i i2 = _mm256_and_si256(_mm256_srli_epi32(w, 16), bmask);
+						__m256i i3 = _mm256_srli_epi32(w, 24);
+
+						a0 = _mm256_add_ps(a0, _mm256_i32gather_ps(t, i0, 4));
+						a1 = _mm256_add_ps(a1, _mm256_i32gather_ps(t + ksub, i1, 4));
+						a0 = _mm256_add_ps(a0, _mm256_i32gather_ps(t + 2 * ksub, i2, 4));
+						a1 = _mm256_add_ps(a1, _mm256_i32gather_ps(t + 3 * ksub, i3, 4));
+					}
+
+					_mm256_storeu_ps(dists + j, _mm256_add_ps(a0, a1));
+				}
+			}
+#endif
+			pq_adc_scan_scalar(M, ksub, lut, codes, j, n, dists);
+		}
+	}
+
+
+	/********************************************
+	 *
+	 *  product_quantizer
+	 *
+	 *  The d dimensions are split into M subspaces
+	 *  of d / M consecutive dimensions, each with
+	 *  its own codebook of ksub (<= 256) centers.
+	 *  A vector is encoded as M uint8 codes.
+	 *
+	 ********************************************/
+
+	template<typename T=float>
+	class product_quantizer
+	{
+	public:
+		typedef T value_type;
+
+		/**
+		 * Constructs from the sub-codebooks stacked in centers, of size
+		 * (d / M) x (M * ksub), where columns [m * ksub, (m+1) * ksub)
+		 * hold the centers of the m-th subspace.
+		 */
+		template<class Centers>
+		product_quantizer(index_t M, const IRegularMatrix<Centers, T>& centers)
+		: m_M(M)
+		, m_dsub(centers.nrows())
+		, m_ksub(centers.ncolumns() / M)
+		, m_centers(centers.nrows(), centers.ncolumns())
+		{
+			check_arg(M > 0 && centers.ncolumns() % M == 0,
+					"The number of centers must be a multiple of M.");
+			check_arg(m_ksub > 0 && m_ksub <= 256, "ksub must be in [1, 256].");
+
+			copy(centers.derived(), m_centers);
+
+			m_encoders.reserve(static_cast<size_t>(M));
+			for (index_t m = 0; m < M; ++m)
+			{
+				cref_matrix<T> cm(m_centers.ptr_col(m * m_ksub), m_dsub, m_ksub);
+				m_encoders.emplace_back(new vq_encoder<T>(cm));
+			}
+		}
+
+		DOLPHIN_ENSURE_INLINE index_t dim() const { return m_M * m_dsub; }
+		DOLPHIN_ENSURE_INLINE index_t nsubspaces() const { return m_M; }
+		DOLPHIN_ENSURE_INLINE index_t subdim() const { return m_dsub; }
+		DOLPHIN_ENSURE_INLINE index_t ksub() const { return m_ksub; }
+
+		DOLPHIN_ENSURE_INLINE
+		const dense_matrix<T>& centers() const
+		{
+			return m_centers;
+		}
+
+		DOLPHIN_ENSURE_INLINE
+		void encode(const T *x, uint8_t *code) const
+		{
+			for (index_t m = 0; m < m_M; ++m)
+				code[m] = static_cast<uint8_t>(m_encoders[m]->encode(x + m * m_dsub));
+		}
+
+		/**
+		 * Encodes the columns of data into codes (of size M x n).
+		 */
+		template<class Data, class Codes>
+		void encode(const IRegularMatrix<Data, T>& data, IRegularMatrix<Codes, uint8_t>& codes) const
+		{
+			static_assert(is_percol_contiguous<Data>::value, "data must be percol-contiguous");
+			static_assert(is_percol_contiguous<Codes>::value, "codes must be percol-contiguous");
+
+			const index_t n = data.ncolumns();
+			check_arg(data.nrows() == dim(), "The dimension of data is invalid.");
+			check_arg(codes.nrows() == m_M && codes.ncolumns() == n, "The size of codes is invalid.");
+
+			const Data& data_ = data.derived();
+			Codes& codes_ = codes.derived();
+
+			parallel_for_chunks(n, 256, [&](index_t j0, index_t j1)
+			{
+				for (index_t j = j0; j < j1; ++j)
+					encode(data_.ptr_col(j), codes_.ptr_col(j));
+			});
+		}
+
+		/**
+		 * Computes the lookup table of a query (of length M * ksub),
+		 * with lut[m * ksub + k] being the squared Euclidean distance
+		 * between the m-th sub-vector of q and the k-th center of the
+		 * m-th subspace.
+		 */
+		void compute_lut(const T *q, T *lut) const
+		{
+			sqeuclidean_distance<T> dist;
+
+			for (index_t m = 0; m < m_M; ++m)
+			{
+				cref_col<T> qm(q + m * m_dsub, m_dsub);
+				cref_matrix<T> cm(m_centers.ptr_col(m * m_ksub), m_dsub, m_ksub);
+				ref_row<T> r(lut + m * m_ksub, m_ksub);
+
+				colwise(dist, qm, cm, r);
+			}
+		}
+
+		/**
+		 * Asymmetric distances (approximate squared Euclidean distances)
+		 * between a query, given by its lookup table, and n encoded vectors.
+		 */
+		DOLPHIN_ENSURE_INLINE
+		void adc_scan(const T *lut, const uint8_t *codes, index_t n, T *dists) const
+		{
+			internal::pq_adc_scan(m_M, m_ksub, lut, codes, n, dists);
+		}
+
+		template<class Codes, class Dists>
+		void adc_distances(const T *q,
+				const IRegularMatrix<Codes, uint8_t>& codes,
+				IRegularMatrix<Dists, T>& dists) const
+		{
+			static_assert(is_contiguous<Codes>::value, "codes must be contiguous");
+			static_assert(is_contiguous<Dists>::value, "dists must be contiguous");
+
+			const index_t n = codes.ncolumns();
+			check_arg(codes.nrows() == m_M, "The size of codes is invalid.");
+			check_arg(dists.nelems() == n, "The size of dists is invalid.");
+
+			dense_col<T> lut(m_M * m_ksub);
+			compute_lut(q, lut.ptr_data());
+			adc_scan(lut.ptr_data(), codes.derived().ptr_data(), n, dists.derived().ptr_data());
+		}
+
+	private:
+		index_t m_M;
+		index_t m_dsub;
+		index_t m_ksub;
+		dense_matrix<T> m_centers;
+		std::vector<std::shared_ptr<vq_encoder<T> > > m_encoders;
+	};
+
+
+	/********************************************
+	 *
+	 *  pq_trainer
+	 *
+	 *  Runs the kmeans engine independently (and
+	 *  concurrently) on each subspace.
+	 *
+	 ********************************************/
+
+	template<typename T=float>
+	class pq_trainer
+	{
+	public:
+		simple_property<index_t> ksub;
+		simple_property<size_t> max_iters;
+		simple_property<T> tol;
+		simple_property<unsigned int> seed;
+
+	public:
+		explicit pq_trainer(index_t M)
+		: ksub      (256,       require_within_<index_t>(1, 256), "ksub must be in [1, 256]")
+		, max_iters (25,        require_gt_<size_t>(0),  "maxiters must be positive")
+		, tol       (T(1.0e-4), require_gt_<T>(0),       "tol must be positive")
+		, seed      (0)
+		, m_M(M)
+		{
+			check_arg(M > 0, "M must be positive.");
+		}
+
+		template<class Data>
+		product_quantizer<T> run(const IRegularMatrix<Data, T>& data) const
+		{
+			static_assert(is_percol_contiguous<Data>::value, "data must be percol-contiguous");
+
+			const Data& data_ = data.derived();
+			const index_t d = data.nrows();
+			const index_t n = data.ncolumns();
+			const index_t M = m_M;
+			const index_t K = ksub.get();
+
+			check_arg(d > 0 && d % M == 0, "The dimension must be a positive multiple of M.");
+			check_arg(n >= K, "The number of samples must be no less than ksub.");
+
+			const index_t ds = d / M;
+			dense_matrix<T> centers(ds, M * K);
+
+			// working storage, allocated before the parallel region: one
+			// per subspace, or one per thread when there are more subspaces
+			// than threads. The kmeans engine may still throw, which is
+			// propagated after the join.
+
+			const index_t nw = std::min(M, max_num_threads());
+			std::vector<subspace_workspace> wss(static_cast<size_t>(nw));
+			for (index_t w = 0; w < nw; ++w) wss[w].init(ds, n, K);
+
+			parallel_for_checked(M, [&](index_t m)
+			{
+				subspace_workspace& ws = wss[nw == M ? m : thread_rank()];
+
+				dense_matrix<T>& sub = ws.sub;
+				for (index_t j = 0; j < n; ++j)
+				{
+					const T *x = data_.ptr_col(j) + m * ds;
+					T *y = sub.ptr_col(j);
+					for (index_t i = 0; i < ds; ++i) y[i] = x[i];
+				}
+
+				ref_matrix<T> cm(centers.ptr_col(m * K), ds, K);
+				std::mt19937 rng(seed.get() + static_cast<unsigned int>(m));
+				kmeans_random_seeds(sub, K, cm, rng);
+
+				kmeans<T> km(static_cast<size_t>(K));
+				km.max_iters.set(max_iters.get());
+				km.tol.set(tol.get());
+
+				kmeans_silent_monitor mon;
+				km.run(sub, cm, ws.labels, ws.counts, mon);
+			});
+
+			return product_quantizer<T>(M, centers);
+		}
+
+	private:
+		struct subspace_workspace
+		{
+			dense_matrix<T> sub;		// ds x n
+			dense_col<index_t> labels;	// n
+			dense_col<index_t> counts;	// K
+
+			void init(index_t ds, index_t n, index_t K)
+			{
+				sub.resize(ds, n);
+				labels.resize(n, 1);
+				counts.resize(K, 1);
+			}
+		};
+
+		index_t m_M;
+	};
+
+}
+
+#endif
@@ -0,0 +1,357 @@
+/**
+ * @file vq_encoder.h
+ *
+ * @brief Low-latency encoder for a fixed codebook
+ *
+ * @author Dahua Lin
+ */
+
+#ifdef _MSC_VER
+#pragma once
+#endif
+
+#ifndef DOLPHIN_VQ_ENCODER_H_
+#define DOLPHIN_VQ_ENCODER_H_
+
+#include <dolphin/common/import_lmat.h>
+#include <limits>
+
+#if defined(__AVX__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+namespace dolphin
+{
+	namespace internal
+	{
+		/********************************************
+		 *
+		 *  lane packs
+		 *
+		 *  The only place where vector intrinsics
+		 *  appear: vq_pack<T> wraps the register type
+		 *  of the widest instruction set enabled at
+		 *  compile time, with the few operations the
+		 *  panel kernel needs. DOLPHIN_VQ_SIMD is
+		 *  defined when such a pack is available.
+		 *
+		 ********************************************/
+
+		template<typename T> struct vq_pack;
+
+#if defined(__AVX__)
+#define DOLPHIN_VQ_SIMD
+
+		template<>
+		struct vq_pack<float>
+		{
+			typedef __m256 type;
+			static const index_t width = 8;
+
+			DOLPHIN_ENSURE_INLINE static type zero() { return _mm256_setzero_ps(); }
+			DOLPHIN_ENSURE_INLINE static type set1(float x) { return _mm256_set1_ps(x); }
+			DOLPHIN_ENSURE_INLINE static type load(const float *p) { return _mm256_loadu_ps(p); }
+			DOLPHIN_ENSURE_INLINE static void store(float *p, type a) { _mm256_storeu_ps(p, a); }
+			DOLPHIN_ENSURE_INLINE static type add(type a, type b) { return _mm256_add_ps(a, b); }
+			DOLPHIN_ENSURE_INLINE static type sub_mul(type a, type x, type y) { return _mm256_sub_ps(a, _mm256_mul_ps(x, y)); }
+		};
+
+		template<>
+		struct vq_pack<double>
+		{
+			typedef __m256d type;
+			static const index_t width = 4;
+
+			DOLPHIN_ENSURE_INLINE static type zero() { return _mm256_setzero_pd(); }
+			DOLPHIN_ENSURE_INLINE static type set1(double x) { return _mm256_set1_pd(x); }
+			DOLPHIN_ENSURE_INLINE static type load(const double *p) { return _mm256_loadu_pd(p); }
+			DOLPHIN_ENSURE_INLINE static void store(double *p, type a) { _mm256_storeu_pd(p, a); }
+			DOLPHIN_ENSURE_INLINE static type add(type a, type b) { return _mm256_add_pd(a, b); }
+			DOLPHIN_ENSURE_INLINE static type sub_mul(type a, type x, type y) { return _mm256_sub_pd(a, _mm256_mul_pd(x, y)); }
+		};
+
+#elif defined(__SSE2__)
+#define DOLPHIN_VQ_SIMD
+
+		template<>
+		struct vq_pack<float>
+		{
+			typedef __m128 type;
+			static const index_t width = 4;
+
+			DOLPHIN_ENSURE_INLINE static type zero() { return _mm_setzero_ps(); }
+			DOLPHIN_ENSURE_INLINE static type set1(float x) { return _mm_set1_ps(x); }
+			DOLPHIN_ENSURE_INLINE static type load(const float *p) { return _mm_loadu_ps(p); }
+			DOLPHIN_ENSURE_INLINE static void store(float *p, type a) { _mm_storeu_ps(p, a); }
+			DOLPHIN_ENSURE_INLINE static type add(type a, type b) { return _mm_add_ps(a, b); }
+			DOLPHIN_ENSURE_INLINE static type sub_mul(type a, type x, type y) { return _mm_sub_ps(a, _mm_mul_ps(x, y)); }
+		};
+
+		template<>
+		struct vq_pack<double>
+		{
+			typedef __m128d type;
+			static const index_t width = 2;
+
+			DOLPHIN_ENSURE_INLINE static type zero() { return _mm_setzero_pd(); }
+			DOLPHIN_ENSURE_INLINE static type set1(double x) { return _mm_set1_pd(x); }
+			DOLPHIN_ENSURE_INLINE static type load(const double *p) { return _mm_loadu_pd(p); }
+			DOLPHIN_ENSURE_INLINE static void store(double *p, type a) { _mm_storeu_pd(p, a); }
+			DOLPHIN_ENSURE_INLINE static type add(type a, type b) { return _mm_add_pd(a, b); }
+			DOLPHIN_ENSURE_INLINE static type sub_mul(type a, type x, type y) { return _mm_sub_pd(a, _mm_mul_pd(x, y)); }
+		};
+
+#endif
+
+
+		/********************************************
+		 *
+		 *  panel kernels
+		 *
+		 *  A panel holds W consecutive centers in
+		 *  transposed layout, i.e. panel[i * W + l]
+		 *  is the i-th coordinate of the l-th center.
+		 *  The kernel computes, for each lane l,
+		 *
+		 *    out[l] = hn[l] - <x, c_l>
+		 *
+		 *  where hn[l] = |c_l|^2 / 2, which ranks the
+		 *  centers in the same order as |x - c_l|^2.
+		 *
+		 *  W is fixed per type (so the panel layout
+		 *  does not depend on the instruction set),
+		 *  and spans W / vq_pack<T>::width packs.
+		 *
+		 ********************************************/
+
+		template<typename T> struct vq_panel_width;
+		template<> struct vq_panel_width<float>  { static const index_t value = 8; };
+		template<> struct vq_panel_width<double> { static const index_t value = 4; };
+
+		template<typename T>
+		struct vq_panel_kernel
+		{
+			static const index_t width = vq_panel_width<T>::value;
+
+#ifdef DOLPHIN_VQ_SIMD
+			typedef vq_pack<T> pack_t;
+			typedef typename pack_t::type vec_t;
+			static const index_t npacks = width / pack_t::width;
+
+			DOLPHIN_ENSURE_INLINE
+			static void eval(index_t d, const T *x, const T *panel, const T *hn, T *out)
+			{
+				const index_t P = pack_t::width;
+
+				// two accumulators per pack, over even and odd coordinates
+
+				vec_t a0[npacks], a1[npacks];
+				for (index_t q = 0; q < npacks; ++q)
+				{
+					a0[q] = pack_t::load(hn + q * P);
+					a1[q] = pack_t::zero();
+				}
+
+				index_t i = 0;
+				for (; i + 1 < d; i += 2, panel += 2 * width)
+				{
+					vec_t x0 = pack_t::set1(x[i]);
+					vec_t x1 = pack_t::set1(x[i+1]);
+					for (index_t q = 0; q < npacks; ++q)
+					{
+						a0[q] = pack_t::sub_mul(a0[q], x0, pack_t::load(panel + q * P));
+						a1[q] = pack_t::sub_mul(a1[q], x1, pack_t::load(panel + width + q * P));
+					}
+				}
+				if (i < d)
+				{
+					vec_t x0 = pack_t::set1(x[i]);
+					for (index_t q = 0; q < npacks; ++q)
+						a0[q] = pack_t::sub_mul(a0[q], x0, pack_t::load(panel + q * P));
+				}
+
+				for (index_t q = 0; q < npacks; ++q)
+					pack_t::store(out + q * P, pack_t::add(a0[q], a1[q]));
+			}
+#else
+			DOLPHIN_ENSURE_INLINE
+			static void eval(index_t d, const T *x, const T *panel, const T *hn, T *out)
+			{
+				for (index_t l = 0; l < width; ++l) out[l] = hn[l];
+				for (index_t i = 0; i < d; ++i, panel += width)
+				{
+					const T xi = x[i];
+					for (index_t l = 0; l < width; ++l) out[l] -= xi * panel[l];
+				}
+			}
+#endif
+		};
+	}
+
+
+	/********************************************
+	 *
+	 *  vq_encoder
+	 *
+	 *  Finds the nearest code of a fixed codebook
+	 *  for single vectors or tiny batches, without
+	 *  going through GEMM and without any heap
+	 *  allocation per call.
+	 *
+	 ********************************************/
+
+	template<typename T>
+	class vq_encoder
+	{
+		static_assert(std::is_floating_point<T>::value,
+				"T must be floating-point types.");
+
+		typedef internal::vq_panel_kernel<T> kernel_t;
+
+	public:
+		typedef T value_type;
+		static const index_t lane_width = kernel_t::width;
+
+	public:
+		template<class Centers>
+		explicit vq_encoder(const IRegularMatrix<Centers, T>& centers)
+		: m_dim(centers.nrows())
+		, m_K(centers.ncolumns())
+		, m_npanels((m_K + lane_width - 1) / lane_width)
+		, m_panels(m_npanels * m_dim * lane_width)
+		, m_hnorms(m_npanels * lane_width)
+		{
+			check_arg(m_K > 0, "The codebook must be non-empty.");
+
+			const Centers& c = centers.derived();
+			const index_t W = lane_width;
+
+			m_panels << T(0);
+			m_hnorms << std::numeric_limits<T>::infinity();
+
+			for (index_t k = 0; k < m_K; ++k)
+			{
+				T *panel = m_panels.ptr_data() + (k / W) * m_dim * W + (k % W);
+
+				T s(0);
+				for (index_t i = 0; i < m_dim; ++i)
+				{
+					T v = c(i, k);
+					panel[i * W] = v;
+					s += v * v;
+				}
+				m_hnorms[k] = s * T(0.5);
+			}
+		}
+
+		DOLPHIN_ENSURE_INLINE
+		index_t dim() const
+		{
+			return m_dim;
+		}
+
+		DOLPHIN_ENSURE_INLINE
+		index_t ncenters() const
+		{
+			return m_K;
+		}
+
+		/**
+		 * Returns the index of the code nearest to x, and writes
+		 * the squared Euclidean distance to that code to sqdist.
+		 */
+		index_t encode(const T *x, T& sqdist) const
+		{
+			const index_t W = lane_width;
+			const T *panel = m_panels.ptr_data();
+			const T *hn = m_hnorms.ptr_data();
+
+			T buf[lane_width];
+			index_t kmin = 0;
+			T vmin = std::numeric_limits<T>::infinity();
+
+			for (index_t p = 0; p < m_npanels; ++p, panel += m_dim * W, hn += W)
+			{
+				kernel_t::eval(m_dim, x, panel, hn, buf);
+
+				for (index_t l = 0; l < W; ++l)
+				{
+					if (buf[l] < vmin)
+					{
+						vmin = buf[l];
+						kmin = p * W + l;
+					}
+				}
+			}
+
+			T xx(0);
+			for (index_t i = 0; i < m_dim; ++i) xx += x[i] * x[i];
+
+			T v = xx + T(2) * vmin;
+			sqdist = v > T(0) ? v : T(0);
+			return kmin;
+		}
+
+		DOLPHIN_ENSURE_INLINE
+		index_t encode(const T *x) const
+		{
+			T sqdist;
+			return encode(x, sqdist);
+		}
+
+		template<class X, typename TL, class Labels>
+		void encode(const IRegularMatrix<X, T>& xs, IRegularMatrix<Labels, TL>& labels) const
+		{
+			static_assert(is_percol_contiguous<X>::value, "xs must be percol-contiguous");
+			static_assert(supports_linear_index<Labels>::value, "labels must support linear indexing");
+
+			const index_t n = xs.ncolumns();
+			check_arg(xs.nrows() == m_dim, "The dimension of xs is invalid.");
+			check_arg(is_vector(labels) && labels.nelems() == n, "The size of labels is invalid.");
+
+			const X& xs_ = xs.derived();
+			Labels& labels_ = labels.derived();
+
+			for (index_t j = 0; j < n; ++j)
+			{
+				labels_[j] = static_cast<TL>(encode(xs_.ptr_col(j)));
+			}
+		}
+
+		template<class X, typename TL, class Labels, class Dists>
+		void encode(const IRegularMatrix<X, T>& xs, IRegularMatrix<Labels, TL>& labels,
+				IRegularMatrix<Dists, T>& sqdists) const
+		{
+			static_assert(is_percol_contiguous<X>::value, "xs must be percol-contiguous");
+			static_assert(supports_linear_index<Labels>::value, "labels must support linear indexing");
+			static_assert(supports_linear_index<Dists>::value, "sqdists must support linear indexing");
+
+			const index_t n = xs.ncolumns();
+			check_arg(xs.nrows() == m_dim, "The dimension of xs is invalid.");
+			check_arg(is_vector(labels) && labels.nelems() == n &&
+					is_vector(sqdists) && sqdists.nelems() == n,
+					"The size of labels or sqdists is invalid.");
+
+			const X& xs_ = xs.derived();
+			Labels& labels_ = labels.derived();
+			Dists& sqdists_ = sqdists.derived();
+
+			for (index_t j = 0; j < n; ++j)
+			{
+				T v;
+				labels_[j] = static_cast<TL>(encode(xs_.ptr_col(j), v));
+				sqdists_[j] = v;
+			}
+		}
+
+	private:
+		index_t m_dim;
+		index_t m_K;
+		index_t m_npanels;
+		dense_col<T> m_panels;	// npanels x (dim x W), transposed centers
+		dense_col<T> m_hnorms;	// npanels x W, half squared norms (+inf for padding)
+	};
+
+}
+
+#endif
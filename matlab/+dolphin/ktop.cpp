@@ -7,39 +7,29 @@
  **********************************************************/
 
 #include <light_mat/matlab/matlab_port.h>
-#include <light_mat/mateval/matrix_sort.h>
+#include <dolphin/common/ktop.h>
+#include <functional>
 
 using namespace lmat;
 using namespace lmat::matlab;
 
-template<typename T, typename Ord>
-inline void find_ktop(index_t n, index_t k, Ord ord,
-        const T *pa, T *ptmp, T *pr)
+template<typename T, typename Comp>
+inline void find_ktop(index_t n, index_t k, Comp comp,
+        const T *pa, T *pr)
 {
-    cref_col<T> a(pa, n);
-    ref_col<T> tmp(ptmp, n);
-    ref_col<T> r(pr, k);
-    
-    copy(a, tmp);    
-    gsort(tmp, lmat::partial_sort(k), ord);
-    copy(tmp(range(0, k)), r);
+    dolphin::find_ktop(pa, n, k, comp, pr);
 }
 
 
-template<typename T, typename Ord>
-inline void find_ktop_x(index_t n, index_t k, Ord ord,
-        const T *pa, std::pair<T, index_t> *ptmp, T *px, double *pi)
+template<typename T, typename Comp>
+inline void find_ktop_x(index_t n, index_t k, Comp comp,
+        const T *pa, index_t *ptmp, T *px, double *pi)
 {
-    cref_col<T> a(pa, n);
-    ref_col<std::pair<T, index_t> > tmp(ptmp, n);
-
-    tmp = gsorted_ex(a, lmat::partial_sort(k), ord);
+    dolphin::find_ktop(pa, n, k, comp, px, ptmp);
     
     for (index_t i = 0; i < k; ++i)
     {
-        const std::pair<T, index_t>& t = tmp[i];
-        px[i] = std::get<0>(t);
-        pi[i] = static_cast<double>(std::get<1>(t) + 1);
+        pi[i] = static_cast<double>(ptmp[i] + 1);
     }    
 }
 
@@ -47,8 +37,6 @@ inline void find_ktop_x(index_t n, index_t k, Ord ord,
 
 LMAT_NUM_MEX(ktop, 0)
 {
-    typedef std::pair<T, index_t> sxv_t;
-    
     LMAT_MX_NARGINCHK(2, 2)
     LMAT_MX_NARGOUTCHK(0, 2)
     
@@ -71,34 +59,33 @@ LMAT_NUM_MEX(ktop, 0)
         if (nlhs <= 1)
         {
             LMAT_MX_OUT(0, r, marray::numeric_matrix<T>(om, on), col_, T)
-            dense_col<T> tmp(n);
             
             if (k >= 0)
             {
-                find_ktop(n, ak, asc_(),
-                        a.ptr_data(), tmp.ptr_data(), r.ptr_data());
+                find_ktop(n, ak, std::less<T>(),
+                        a.ptr_data(), r.ptr_data());
             }
             else
             {
-                find_ktop(n, ak, desc_(),
-                        a.ptr_data(), tmp.ptr_data(), r.ptr_data());
+                find_ktop(n, ak, std::greater<T>(),
+                        a.ptr_data(), r.ptr_data());
             }
         }
         else
         {                        
             LMAT_MX_OUT(0, rx, marray::numeric_matrix<T>(om, on), col_, T)
             LMAT_MX_OUT(1, ri, marray::numeric_matrix<double>(om, on), col_, double)
-            dense_col<sxv_t> tmp(n);
+            dense_col<index_t> tmp(ak);
             
             if (k >= 0)
             {
-                find_ktop_x(n, ak, asc_(),
+                find_ktop_x(n, ak, std::less<T>(),
                         a.ptr_data(), tmp.ptr_data(), 
                         rx.ptr_data(), ri.ptr_data());
             }
             else
             {
-                find_ktop_x(n, ak, desc_(),
+                find_ktop_x(n, ak, std::greater<T>(),
                         a.ptr_data(), tmp.ptr_data(), 
                         rx.ptr_data(), ri.ptr_data());
             }
@@ -114,51 +101,21 @@ LMAT_NUM_MEX(ktop, 0)
         if (nlhs <= 1)
         {
             LMAT_MX_OUT(0, r, marray::numeric_matrix<T>(ak, n), mat_, T)
-            dense_col<T> tmp(m);
             
             if (k >= 0)
-            {
-                for (index_t j = 0; j < n; ++j)
-                {
-                    find_ktop(m, ak, asc_(),
-                            a.ptr_col(j), tmp.ptr_data(), r.ptr_col(j));
-                }
-            }
+                dolphin::colwise_ktop(a, ak, std::less<T>(), r);
             else
-            {
-                mexPrintf("desc\n");
-                for (index_t j = 0; j < n; ++j)
-                {
-                    find_ktop(m, ak, desc_(),
-                            a.ptr_col(j), tmp.ptr_data(), r.ptr_col(j));
-                }
-            }
+                dolphin::colwise_ktop(a, ak, std::greater<T>(), r);
         }
         else
         {
             LMAT_MX_OUT(0, rx, marray::numeric_matrix<T>(ak, n), mat_, T)
             LMAT_MX_OUT(1, ri, marray::numeric_matrix<double>(ak, n), mat_, double)
-            dense_col<sxv_t> tmp(m);
             
             if (k >= 0)
-            {
-                for (index_t j = 0; j < n; ++j)
-                {
-                    find_ktop_x(m, ak, asc_(),
-                            a.ptr_col(j), tmp.ptr_data(), 
-                            rx.ptr_col(j), ri.ptr_col(j));
-                }
-            }
+                dolphin::colwise_ktop(a, ak, std::less<T>(), rx, ri, 1);
             else
-            {
-                mexPrintf("desc\n");
-                for (index_t j = 0; j < n; ++j)
-                {
-                    find_ktop_x(m, ak, desc_(),
-                            a.ptr_col(j), tmp.ptr_data(), 
-                            rx.ptr_col(j), ri.ptr_col(j));
-                }
-            }
+                dolphin::colwise_ktop(a, ak, std::greater<T>(), rx, ri, 1);
         }
     }
     
@@ -32,10 +32,6 @@ LMAT_FP_MEX(logsumexp, 0)
         const index_t n = a.ncolumns();
         LMAT_MX_OUT(0, r, marray::numeric_matrix<T>(1, n), row_, T);
         
-        for (index_t j = 0; j < n; ++j)
-        {
-            et.set_logvalues(a.column(j));
-            r[j] = et.logsum();
-        }
+        colwise_logsumexp(a, r);
     }
 }
@@ -0,0 +1,107 @@
+/**
+ * @file bench_pairwise.cpp
+ *
+ * @brief Timing of the pairwise evaluation methods
+ *
+ * Times PAIRWISE_GEMM, PAIRWISE_TILED and PAIRWISE_DIRECT over a
+ * grid of (m, n, d) for float and double, and prints one line per
+ * configuration, with the fastest method last. The thresholds next
+ * to plan_pairwise in metrics.h are set from the crossovers seen in
+ * this output.
+ *
+ * @author Dahua Lin
+ */
+
+#include "../test_base.h"
+#include <dolphin/common/metrics.h>
+#include <chrono>
+#include <cstdio>
+
+using namespace dolphin;
+using namespace dolphin::test;
+
+
+// seconds per evaluation, repeated for at least min_secs
+
+template<class Metric, typename T>
+double time_method(const Metric& dist, const dense_matrix<T>& a, const dense_matrix<T>& b,
+		pairwise_method method, dense_matrix<T>& r)
+{
+	typedef std::chrono::steady_clock bclock;
+	const double min_secs = 0.05;
+
+	r = pairwise(dist, a, b, method);	// warm-up
+
+	index_t reps = 0;
+	double secs = 0;
+	const bclock::time_point t0 = bclock::now();
+	do
+	{
+		r = pairwise(dist, a, b, method);
+		++reps;
+		secs = std::chrono::duration<double>(bclock::now() - t0).count();
+	}
+	while (secs < min_secs);
+
+	return secs / double(reps);
+}
+
+template<class Metric>
+void bench_metric(const char *name)
+{
+	typedef typename metric_traits<Metric>::input_type T;
+
+	const index_t ms[] = {1, 4, 16, 64, 256, 1024};
+	const index_t ds[] = {2, 4, 8, 16, 32, 64, 128, 512};
+	const pairwise_method methods[3] = {PAIRWISE_GEMM, PAIRWISE_TILED, PAIRWISE_DIRECT};
+	const char *mnames[3] = {"gemm", "tiled", "direct"};
+
+	Metric dist;
+
+	for (index_t mi = 0; mi < index_t(sizeof(ms) / sizeof(index_t)); ++mi)
+	{
+		for (index_t ni = 0; ni < index_t(sizeof(ms) / sizeof(index_t)); ++ni)
+		{
+			for (index_t di = 0; di < index_t(sizeof(ds) / sizeof(index_t)); ++di)
+			{
+				const index_t m = ms[mi];
+				const index_t n = ms[ni];
+				const index_t d = ds[di];
+
+				dense_matrix<T> a(d, m);
+				dense_matrix<T> b(d, n);
+				dense_matrix<T> r(m, n);
+				fill_randr(a, T(-1), T(1));
+				fill_randr(b, T(-1), T(1));
+
+				double t[3];
+				int best = 0;
+				for (int k = 0; k < 3; ++k)
+				{
+					t[k] = time_method(dist, a, b, methods[k], r);
+					if (t[k] < t[best]) best = k;
+				}
+
+				std::printf("%-12s %-6s m=%5ld n=%5ld d=%4ld  gemm %10.3e  tiled %10.3e  direct %10.3e  best %s (auto %s)\n",
+						name, sizeof(T) == 4 ? "float" : "double",
+						long(m), long(n), long(d), t[0], t[1], t[2], mnames[best],
+						mnames[plan_pairwise<Metric>(m, n, d) - PAIRWISE_GEMM]);
+			}
+		}
+	}
+}
+
+
+int main()
+{
+	bench_metric<sqeuclidean_distance<float> >("sqeuclidean");
+	bench_metric<sqeuclidean_distance<double> >("sqeuclidean");
+	bench_metric<cosine_distance<float> >("cosine");
+	bench_metric<cosine_distance<double> >("cosine");
+	bench_metric<dot_product<float> >("dot");
+	bench_metric<dot_product<double> >("dot");
+	bench_metric<chebyshev_distance<float> >("chebyshev");
+	bench_metric<chebyshev_distance<double> >("chebyshev");
+
+	return 0;
+}
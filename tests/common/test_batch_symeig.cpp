@@ -0,0 +1,104 @@
+/**
+ * @file test_batch_symeig.cpp
+ *
+ * @brief Unit testing of batched symmetric eigen-decomposition
+ *
+ * @author Dahua Lin
+ */
+
+#include "../test_base.h"
+#include <dolphin/common/batch_symeig.h>
+
+using namespace dolphin;
+using namespace dolphin::test;
+
+
+template<typename T>
+void verify_batch_symeig(index_t n, index_t nb)
+{
+	const index_t nn = n * n;
+
+	dense_matrix<T> a(nn, nb);
+	fill_randr(a, T(-1), T(1));
+
+	for (index_t b = 0; b < nb; ++b)
+	{
+		T *m = a.ptr_col(b);
+		for (index_t j = 0; j < n; ++j)
+			for (index_t i = 0; i < j; ++i) m[j + i * n] = m[i + j * n];
+	}
+
+	// some degenerate matrices: zero, scaled identity, repeated eigenvalues
+
+	if (nb > 2)
+	{
+		T *m0 = a.ptr_col(0);
+		T *m1 = a.ptr_col(1);
+		T *m2 = a.ptr_col(2);
+		for (index_t k = 0; k < nn; ++k) m0[k] = m1[k] = m2[k] = T(0);
+		for (index_t i = 0; i < n; ++i)
+		{
+			m1[i + i * n] = T(3);
+			m2[i + i * n] = i == 0 ? T(1) : T(2);
+		}
+	}
+
+	dense_matrix<T> evs(n, nb);
+	dense_matrix<T> evs2(n, nb);
+	dense_matrix<T> U(nn, nb);
+
+	batch_symeig(n, a, evs, U);
+	batch_symeig(n, a, evs2);
+
+	T tol = T(sizeof(T) == 4 ? 1.0e-5 : 1.0e-12);
+	ASSERT_MAT_APPROX(n, nb, evs2, evs, tol);
+
+	for (index_t b = 0; b < nb; ++b)
+	{
+		cref_matrix<T> m(a.ptr_col(b), n, n);
+		cref_matrix<T> u(U.ptr_col(b), n, n);
+		const T *e = evs.ptr_col(b);
+
+		for (index_t i = 0; i + 1 < n; ++i) ASSERT_TRUE( e[i] >= e[i+1] );
+
+		for (index_t j = 0; j < n; ++j)
+		{
+			for (index_t i = 0; i < n; ++i)
+			{
+				T s(0);
+				for (index_t k = 0; k < n; ++k) s += m(i, k) * u(k, j);
+				ASSERT_APPROX( s, e[j] * u(i, j), tol );
+			}
+
+			for (index_t j2 = 0; j2 < n; ++j2)
+			{
+				T s(0);
+				for (index_t k = 0; k < n; ++k) s += u(k, j) * u(k, j2);
+				ASSERT_APPROX( s, T(j == j2 ? 1 : 0), tol );
+			}
+		}
+	}
+}
+
+
+T_CASE( test_batch_symeig_closed )
+{
+	verify_batch_symeig<T>(1, 5);
+	verify_batch_symeig<T>(2, 50);
+	verify_batch_symeig<T>(3, 50);
+}
+
+T_CASE( test_batch_symeig_jacobi )
+{
+	verify_batch_symeig<T>(4, 3);
+	verify_batch_symeig<T>(4, 21);		// not a multiple of the group width
+	verify_batch_symeig<T>(6, 40);
+	verify_batch_symeig<T>(9, 10);
+}
+
+
+AUTO_TPACK( test_batch_symeig )
+{
+	ADD_T_CASE_FP( test_batch_symeig_closed )
+	ADD_T_CASE_FP( test_batch_symeig_jacobi )
+}
@@ -8,6 +8,7 @@
 
 #include "../test_base.h"
 #include <dolphin/common/common_calc.h>
+#include <limits>
 
 using namespace dolphin;
 using namespace dolphin::test;
@@ -54,6 +55,60 @@ T_CASE( test_normalize_exp)
 	ASSERT_VEC_APPROX(n, p, p0, tol);
 }
 
+T_CASE( test_colwise_logsumexp )
+{
+	const index_t m = 6;
+	const index_t n = 9;
+	dense_matrix<T> a(m, n);
+	fill_randr(a, T(-20), T(5));
+
+	dense_row<T> r(n);
+	colwise_logsumexp(a, r);
+
+	dense_row<T> r0(n);
+	exp_terms<T> et;
+	for (index_t j = 0; j < n; ++j)
+	{
+		et.set_logvalues(a.column(j));
+		r0[j] = et.logsum();
+	}
+
+	T tol = T(sizeof(T) == 4 ? 1.0e-5 : 1.0e-12);
+	ASSERT_VEC_APPROX(n, r, r0, tol);
+
+	dense_matrix<T> p(m, n);
+	copy(a, p);
+	dense_row<T> r2(n);
+	colwise_nrmexp_inplace(p, r2);
+	ASSERT_VEC_APPROX(n, r2, r0, tol);
+
+	for (index_t j = 0; j < n; ++j)
+	{
+		dense_col<T> p0(m);
+		et.set_logvalues(a.column(j));
+		et.normalize_to(p0);
+
+		for (index_t i = 0; i < m; ++i) ASSERT_APPROX( p(i, j), p0[i], tol );
+	}
+}
+
+T_CASE( test_colwise_logsumexp_empty )
+{
+	const index_t n = 4;
+	dense_matrix<T> a(0, n);
+	dense_row<T> r(n);
+
+	const T ninf = -std::numeric_limits<T>::infinity();
+
+	r << T(1);
+	colwise_logsumexp(a, r);
+	for (index_t j = 0; j < n; ++j) ASSERT_TRUE( r[j] == ninf );
+
+	r << T(1);
+	colwise_nrmexp_inplace(a, r);
+	for (index_t j = 0; j < n; ++j) ASSERT_TRUE( r[j] == ninf );
+}
+
 T_CASE( test_full_entropy )
 {
 	const index_t n = 10;
@@ -110,12 +165,53 @@ T_CASE( test_rowwise_entropy )
 }
 
 
+SIMPLE_CASE( test_mp_entropy )
+{
+	const index_t m = 5000;
+	const index_t n = 4;
+	dense_matrix<float> p(m, n);
+	fill_randr(p, -0.2f, 1.0f);
+
+	dense_row<double> r0(n);
+	dense_col<double> rr0(m, zero());
+	for (index_t j = 0; j < n; ++j)
+	{
+		double v0(0);
+		for (index_t i = 0; i < m; ++i)
+		{
+			double x = double(p(i, j));
+			if (x > 0)
+			{
+				v0 -= x * math::log(x);
+				rr0[i] -= x * math::log(x);
+			}
+		}
+		r0[j] = v0;
+	}
+
+	ASSERT_APPROX( entropy(p.column(0), float_to_double()), r0[0], 1.0e-12 );
+
+	dense_row<double> r(n);
+	colwise_entropy(p, r, float_to_double());
+	ASSERT_VEC_APPROX(n, r, r0, 1.0e-12);
+
+	dense_col<float> rr(m);
+	rowwise_entropy(p, rr, float_acc_double());
+	for (index_t i = 0; i < m; ++i)
+		ASSERT_EQ( rr[i], float(rr0[i]) );
+}
+
+
 AUTO_TPACK( test_exp_terms )
 {
 	ADD_T_CASE( test_logsumexp, float )
 	ADD_T_CASE( test_logsumexp, double )
 	ADD_T_CASE( test_normalize_exp, float )
 	ADD_T_CASE( test_normalize_exp, double )
+	ADD_T_CASE( test_colwise_logsumexp, float )
+	ADD_T_CASE( test_colwise_logsumexp, double )
+	ADD_T_CASE( test_colwise_logsumexp_empty, float )
+	ADD_T_CASE( test_colwise_logsumexp_empty, double )
 }
 
 
@@ -127,6 +223,7 @@ AUTO_TPACK( test_entropy )
 	ADD_T_CASE( test_colwise_entropy, double )
 	ADD_T_CASE( test_rowwise_entropy, float )
 	ADD_T_CASE( test_rowwise_entropy, double )
+	ADD_SIMPLE_CASE( test_mp_entropy )
 }
 
 
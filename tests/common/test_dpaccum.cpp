@@ -415,6 +415,61 @@ SIMPLE_CASE( test_dispatch_min_rows )
 
 
 
+SIMPLE_CASE( test_dispatch_sum_mp_1d )
+{
+	const index_t K = 12;
+	const index_t len = 20000;
+
+	dense_col<index_t> I(len);
+	dense_col<float> v(len);
+	dense_col<float> a(K, zero());
+	dense_col<double> a0(K, zero());
+
+	fill_randi(I, (index_t)0, K+2);
+	fill_randr(v, 0.f, 1.f);
+
+	for (index_t i = 0; i < len; ++i)
+	{
+		index_t k = I[i];
+		if (k >= 0 && k < K) a0[k] += double(v[i]);
+	}
+
+	dispatch_sum(v, I, a, float_acc_double());
+
+	for (index_t k = 0; k < K; ++k)
+		ASSERT_EQ( a[k], float(a0[k]) );
+}
+
+SIMPLE_CASE( test_dispatch_sum_mp_cols )
+{
+	const index_t m = 15;
+	const index_t n = 600;
+	const index_t K = 5;
+
+	dense_col<index_t> J(n);
+	dense_matrix<float> v(m, n);
+	dense_matrix<double> a(m, K, zero());
+	dense_matrix<double> a0(m, K, zero());
+
+	fill_randi(J, (index_t)0, K+1);
+	fill_randr(v, 0.f, 1.f);
+
+	for (index_t j = 0; j < n; ++j)
+	{
+		index_t cj = J[j];
+
+		if (cj >= 0 && cj < K)
+		{
+			for (index_t i = 0; i < m; ++i) a0(i, cj) += double(v(i, j));
+		}
+	}
+
+	dispatch_sum_cols(v, J, a, float_to_double());
+
+	ASSERT_MAT_APPROX(m, K, a, a0, 1.0e-12);
+}
+
+
 AUTO_TPACK( test_counts )
 {
 	ADD_SIMPLE_CASE( test_add_counts_1d )
@@ -426,6 +481,7 @@ AUTO_TPACK( test_dpaccum_1d )
 	ADD_SIMPLE_CASE( test_dispatch_sum_1d )
 	ADD_SIMPLE_CASE( test_dispatch_max_1d )
 	ADD_SIMPLE_CASE( test_dispatch_min_1d )
+	ADD_SIMPLE_CASE( test_dispatch_sum_mp_1d )
 }
 
 AUTO_TPACK( test_dpaccum_2d )
@@ -440,6 +496,7 @@ AUTO_TPACK( test_dpaccum_cols )
 	ADD_SIMPLE_CASE( test_dispatch_sum_cols )
 	ADD_SIMPLE_CASE( test_dispatch_max_cols )
 	ADD_SIMPLE_CASE( test_dispatch_min_cols )
+	ADD_SIMPLE_CASE( test_dispatch_sum_mp_cols )
 }
 
 
@@ -0,0 +1,182 @@
+/**
+ * @file test_half.cpp
+ *
+ * @brief Unit testing of 16-bit storage types and metrics on them
+ *
+ * @author Dahua Lin
+ */
+
+#include "../test_base.h"
+#include <dolphin/common/metrics.h>
+#include <cmath>
+
+using namespace dolphin;
+using namespace dolphin::test;
+
+typedef dense_matrix<float> fmat_t;
+
+const index_t vdim = 40;
+const index_t M = 300;	// spans two panels
+const index_t N = 21;
+
+
+// the value of a finite half, by its fields
+
+double half_value(uint16_t h)
+{
+	const int e = (h >> 10) & 0x1f;
+	const int m = h & 0x3ff;
+	double v = e == 0 ? std::ldexp(double(m), -24) : std::ldexp(double(0x400 + m), e - 25);
+	return (h & 0x8000) ? -v : v;
+}
+
+SIMPLE_CASE( test_half_conversion )
+{
+	for (uint32_t h = 0; h < 0x10000; ++h)
+	{
+		if ((h & 0x7c00) == 0x7c00) continue;	// inf and nan
+
+		half_t x;
+		x.bits = static_cast<uint16_t>(h);
+		const float v = float(x);
+		ASSERT_TRUE( double(v) == half_value(x.bits) );
+		ASSERT_EQ( half_t(v).bits, x.bits );
+	}
+
+	// rounding to nearest even, overflow and underflow
+
+	ASSERT_EQ( half_t(1.0f + 1.0f / 2048).bits, 0x3c00 );
+	ASSERT_EQ( half_t(1.0f + 3.0f / 2048).bits, 0x3c02 );
+	ASSERT_EQ( half_t(65519.0f).bits, 0x7bff );
+	ASSERT_EQ( half_t(65520.0f).bits, 0x7c00 );
+	ASSERT_EQ( half_t(-1.0e-8f).bits, 0x8000 );
+	ASSERT_EQ( half_t(std::ldexp(3.0f, -25)).bits, 0x0002 );
+	ASSERT_TRUE( std::isnan(float(half_t(std::nanf("")))) );
+}
+
+SIMPLE_CASE( test_bf16_conversion )
+{
+	for (uint32_t h = 0; h < 0x10000; ++h)
+	{
+		bfloat16_t x;
+		x.bits = static_cast<uint16_t>(h);
+		const float v = float(x);
+		if (std::isnan(v)) continue;
+		ASSERT_EQ( bfloat16_t(v).bits, x.bits );
+	}
+
+	ASSERT_EQ( bfloat16_t(1.0f + 1.0f / 256).bits, 0x3f80 );
+	ASSERT_EQ( bfloat16_t(1.0f + 3.0f / 256).bits, 0x3f82 );
+	ASSERT_TRUE( std::isnan(float(bfloat16_t(std::nanf("")))) );
+}
+
+SIMPLE_CASE( test_bulk_conversion )
+{
+	const index_t n = 37;	// a partial block at the end
+	float f[n], g[n];
+	half_t h[n];
+	bfloat16_t b[n];
+
+	for (index_t i = 0; i < n; ++i) f[i] = 0.37f * float(i) - 5.0f;
+
+	narrow_values(f, h, n);
+	narrow_values(f, b, n);
+	for (index_t i = 0; i < n; ++i)
+	{
+		ASSERT_EQ( h[i].bits, half_t(f[i]).bits );
+		ASSERT_EQ( b[i].bits, bfloat16_t(f[i]).bits );
+	}
+
+	widen_values(h, g, n);
+	for (index_t i = 0; i < n; ++i) ASSERT_TRUE( g[i] == float(h[i]) );
+
+	widen_values(b, g, n);
+	for (index_t i = 0; i < n; ++i) ASSERT_TRUE( g[i] == float(b[i]) );
+}
+
+
+// metrics on 16-bit storage agree with the float metrics on the
+// widened values
+
+template<typename H>
+void make_stored(dense_matrix<H>& a, fmat_t& af)
+{
+	fmat_t x(a.nrows(), a.ncolumns());
+	fill_randr(x, 0.1f, 1.0f);
+
+	for (index_t i = 0; i < a.nelems(); ++i)
+	{
+		a[i] = H(x[i]);
+		af[i] = float(a[i]);
+	}
+}
+
+template<class Policy, template<typename> class Base, template<class> class Mp>
+void verify_stored_metric()
+{
+	typedef typename Policy::input_type H;
+
+	dense_matrix<H> a(vdim, M), b(vdim, N);
+	fmat_t af(vdim, M), bf(vdim, N);
+	make_stored(a, af);
+	make_stored(b, bf);
+
+	const float tol = 1.0e-4f;
+	Base<float> dist;
+	Mp<Policy> mpdist;
+
+	fmat_t D0 = pairwise(dist, af, bf);
+	fmat_t D = pairwise(mpdist, a, b);
+	ASSERT_MAT_APPROX(M, N, D, D0, tol);
+
+	fmat_t S0 = pairwise(dist, af);
+	fmat_t S = pairwise(mpdist, a);
+	ASSERT_MAT_APPROX(M, M, S, S0, tol);
+
+	dense_row<float> r0(M), r(M);
+	colwise(dist, af, bf.column(0), r0);
+	colwise(mpdist, a, b.column(0), r);
+	ASSERT_VEC_APPROX(M, r, r0, tol);
+}
+
+SIMPLE_CASE( test_half_sqeuclidean )
+{
+	verify_stored_metric<half_acc_float, sqeuclidean_distance, mp_sqeuclidean_distance>();
+}
+
+SIMPLE_CASE( test_half_cosine )
+{
+	verify_stored_metric<half_acc_float, cosine_distance, mp_cosine_distance>();
+}
+
+SIMPLE_CASE( test_half_cityblock )
+{
+	verify_stored_metric<half_acc_float, cityblock_distance, mp_cityblock_distance>();
+}
+
+SIMPLE_CASE( test_bf16_sqeuclidean )
+{
+	verify_stored_metric<bf16_acc_float, sqeuclidean_distance, mp_sqeuclidean_distance>();
+}
+
+SIMPLE_CASE( test_bf16_dot_product )
+{
+	verify_stored_metric<bf16_acc_float, dot_product, mp_dot_product>();
+}
+
+
+AUTO_TPACK( half_conversion )
+{
+	ADD_SIMPLE_CASE( test_half_conversion )
+	ADD_SIMPLE_CASE( test_bf16_conversion )
+	ADD_SIMPLE_CASE( test_bulk_conversion )
+}
+
+AUTO_TPACK( half_dists )
+{
+	ADD_SIMPLE_CASE( test_half_sqeuclidean )
+	ADD_SIMPLE_CASE( test_half_cosine )
+	ADD_SIMPLE_CASE( test_half_cityblock )
+	ADD_SIMPLE_CASE( test_bf16_sqeuclidean )
+	ADD_SIMPLE_CASE( test_bf16_dot_product )
+}
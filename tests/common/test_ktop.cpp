@@ -0,0 +1,308 @@
+/**
+ * @file test_ktop.cpp
+ *
+ * @brief Unit testing of k-top selection
+ *
+ * @author Dahua Lin
+ */
+
+#include "../test_base.h"
+#include <dolphin/common/ktop.h>
+#include <algorithm>
+#include <vector>
+#include <limits>
+#include <cmath>
+
+using namespace dolphin;
+using namespace dolphin::test;
+
+
+template<typename T, class Comp>
+void verify_ktop_on(const dense_col<T>& x, index_t k, Comp comp)
+{
+	const index_t n = x.nelems();
+
+	dense_col<T> r0(n);
+	copy(x, r0);
+	std::sort(r0.ptr_data(), r0.ptr_data() + n, comp);
+
+	dense_col<T> r(k);
+	dense_col<index_t> ri(k);
+
+	find_ktop(x, k, comp, r);
+	ASSERT_VEC_EQ(k, r, r0);
+
+	find_ktop(x, k, comp, r, ri);
+	ASSERT_VEC_EQ(k, r, r0);
+
+	for (index_t i = 0; i < k; ++i)
+	{
+		ASSERT_TRUE( ri[i] >= 0 && ri[i] < n );
+		ASSERT_EQ( x[ri[i]], r[i] );
+
+		for (index_t i2 = 0; i2 < i; ++i2) ASSERT_TRUE( ri[i2] != ri[i] );
+	}
+}
+
+template<typename T, class Comp>
+void verify_ktop(index_t n, index_t k, Comp comp)
+{
+	dense_col<T> x(n);
+	fill_randi(x, T(0), T(1000));
+	verify_ktop_on(x, k, comp);
+}
+
+
+T_CASE( test_ktop_asc )
+{
+	verify_ktop<T>(1, 1, std::less<T>());
+	verify_ktop<T>(10, 0, std::less<T>());
+	verify_ktop<T>(10, 3, std::less<T>());
+	verify_ktop<T>(10, 10, std::less<T>());
+	verify_ktop<T>(1000, 1, std::less<T>());
+	verify_ktop<T>(1000, 20, std::less<T>());
+}
+
+T_CASE( test_ktop_desc )
+{
+	verify_ktop<T>(1, 1, std::greater<T>());
+	verify_ktop<T>(10, 0, std::greater<T>());
+	verify_ktop<T>(10, 3, std::greater<T>());
+	verify_ktop<T>(10, 10, std::greater<T>());
+	verify_ktop<T>(1000, 1, std::greater<T>());
+	verify_ktop<T>(1000, 20, std::greater<T>());
+}
+
+
+template<typename T, class Comp>
+void verify_radix_ktop(index_t n, index_t k, Comp comp)
+{
+	dense_col<T> x(n);
+	fill_randi(x, T(-500), T(500));
+
+	dense_col<T> r0(n);
+	copy(x, r0);
+	std::sort(r0.ptr_data(), r0.ptr_data() + n, comp);
+
+	dense_col<T> r(k);
+	dense_col<index_t> ri(k);
+
+	radix_ktop(x.ptr_data(), n, k, comp, r.ptr_data(), ri.ptr_data());
+	ASSERT_VEC_EQ(k, r, r0);
+
+	for (index_t i = 0; i < k; ++i)
+	{
+		ASSERT_TRUE( ri[i] >= 0 && ri[i] < n );
+		ASSERT_EQ( x[ri[i]], r[i] );
+
+		for (index_t i2 = 0; i2 < i; ++i2) ASSERT_TRUE( ri[i2] != ri[i] );
+	}
+
+	if (k > 0)
+	{
+		ASSERT_EQ( find_kth(x.ptr_data(), n, k, comp), r0[k-1] );
+	}
+}
+
+T_CASE( test_ktop_radix )
+{
+	verify_radix_ktop<T>(1, 1, std::less<T>());
+	verify_radix_ktop<T>(10, 0, std::less<T>());
+	verify_radix_ktop<T>(10, 3, std::less<T>());
+	verify_radix_ktop<T>(1000, 1, std::less<T>());
+	verify_radix_ktop<T>(1000, 20, std::less<T>());
+	verify_radix_ktop<T>(1000, 1000, std::less<T>());
+
+	verify_radix_ktop<T>(1, 1, std::greater<T>());
+	verify_radix_ktop<T>(10, 3, std::greater<T>());
+	verify_radix_ktop<T>(1000, 20, std::greater<T>());
+	verify_radix_ktop<T>(1000, 1000, std::greater<T>());
+
+	// large enough for find_ktop to take the radix path
+	verify_ktop<T>(100000, 5000, std::less<T>());
+	verify_ktop<T>(100000, 5000, std::greater<T>());
+}
+
+template<typename T, class Comp>
+void verify_ktop_real(index_t n, index_t k, Comp comp)
+{
+	dense_col<T> x(n);
+	fill_randr(x, T(-1), T(1));
+	verify_ktop_on(x, k, comp);
+}
+
+T_CASE( test_ktop_real )
+{
+	verify_ktop_real<T>(1000, 20, std::less<T>());
+	verify_ktop_real<T>(1000, 20, std::greater<T>());
+
+	// through radix select
+	verify_ktop_real<T>(100000, 5000, std::less<T>());
+	verify_ktop_real<T>(100000, 5000, std::greater<T>());
+}
+
+
+// NaNs (of either sign) rank after all numbers, under either order
+
+template<typename T, class Comp>
+void verify_ktop_nan(const dense_col<T>& x, index_t k, Comp comp,
+		const T *r, const index_t *ri)
+{
+	const index_t n = x.nelems();
+
+	std::vector<T> r0;
+	for (index_t i = 0; i < n; ++i)
+		if (!std::isnan(x[i])) r0.push_back(x[i]);
+	std::sort(r0.begin(), r0.end(), comp);
+	const index_t nnum = static_cast<index_t>(r0.size());
+
+	for (index_t i = 0; i < k; ++i)
+	{
+		if (i < nnum)
+			ASSERT_EQ( r[i], r0[i] );
+		else
+			ASSERT_TRUE( std::isnan(r[i]) );
+
+		ASSERT_TRUE( ri[i] >= 0 && ri[i] < n );
+		const T v = x[ri[i]];
+		ASSERT_TRUE( v == r[i] || (std::isnan(v) && std::isnan(r[i])) );
+
+		for (index_t i2 = 0; i2 < i; ++i2) ASSERT_TRUE( ri[i2] != ri[i] );
+	}
+}
+
+template<typename T, class Comp>
+void verify_ktop_nan(index_t n, index_t k, index_t nnan, Comp comp)
+{
+	dense_col<T> x(n);
+	fill_randr(x, T(-1), T(1));
+
+	const T nan = std::numeric_limits<T>::quiet_NaN();
+	for (index_t i = 0; i < nnan; ++i)
+		x[i * n / nnan] = i % 2 == 0 ? nan : std::copysign(nan, T(-1));
+
+	dense_col<T> r(k);
+	dense_col<index_t> ri(k);
+
+	find_ktop(x, k, comp, r, ri);
+	verify_ktop_nan(x, k, comp, r.ptr_data(), ri.ptr_data());
+
+	radix_ktop(x.ptr_data(), n, k, comp, r.ptr_data(), ri.ptr_data());
+	verify_ktop_nan(x, k, comp, r.ptr_data(), ri.ptr_data());
+
+	const T v = find_kth(x.ptr_data(), n, k, comp);
+	if (k <= n - nnan)
+		ASSERT_EQ( v, r[k-1] );
+	else
+		ASSERT_TRUE( std::isnan(v) );
+}
+
+T_CASE( test_ktop_nan )
+{
+	// heap path: a few NaNs, and more NaNs than the unselected numbers
+	verify_ktop_nan<T>(1000, 20, 50, std::less<T>());
+	verify_ktop_nan<T>(1000, 20, 50, std::greater<T>());
+	verify_ktop_nan<T>(100, 60, 50, std::less<T>());
+	verify_ktop_nan<T>(100, 60, 50, std::greater<T>());
+
+	// radix path
+	verify_ktop_nan<T>(100000, 5000, 1000, std::less<T>());
+	verify_ktop_nan<T>(100000, 5000, 1000, std::greater<T>());
+	verify_ktop_nan<T>(100000, 5000, 96000, std::less<T>());
+	verify_ktop_nan<T>(100000, 5000, 96000, std::greater<T>());
+}
+
+T_CASE( test_colwise_ktop )
+{
+	const index_t m = 50;
+	const index_t n = 37;
+	const index_t k = 6;
+
+	dense_matrix<T> a(m, n);
+	fill_randi(a, T(0), T(1000));
+
+	dense_matrix<T> r(k, n);
+	dense_matrix<T> r2(k, n);
+	dense_matrix<index_t> ri(k, n);
+
+	colwise_ktop(a, k, std::greater<T>(), r);
+	colwise_ktop(a, k, std::greater<T>(), r2, ri);
+
+	for (index_t j = 0; j < n; ++j)
+	{
+		dense_col<T> c0(m);
+		copy(a.column(j), c0);
+		std::sort(c0.ptr_data(), c0.ptr_data() + m, std::greater<T>());
+
+		ASSERT_VEC_EQ(k, r.ptr_col(j), c0);
+		ASSERT_VEC_EQ(k, r2.ptr_col(j), c0);
+
+		for (index_t i = 0; i < k; ++i)
+		{
+			ASSERT_TRUE( ri(i, j) >= 0 && ri(i, j) < m );
+			ASSERT_EQ( a(ri(i, j), j), r2(i, j) );
+		}
+	}
+
+	dense_matrix<double> rd(k, n);
+	colwise_ktop(a, k, std::less<T>(), r, rd, 1);
+
+	for (index_t j = 0; j < n; ++j)
+	{
+		for (index_t i = 0; i < k; ++i)
+		{
+			index_t ii = static_cast<index_t>(rd(i, j)) - 1;
+			ASSERT_TRUE( ii >= 0 && ii < m );
+			ASSERT_EQ( a(ii, j), r(i, j) );
+		}
+	}
+}
+
+T_CASE( test_colwise_ktop_invalid_k )
+{
+	const index_t m = 10;
+	const index_t n = 40;
+	const index_t k = m + 1;
+
+	dense_matrix<T> a(m, n);
+	fill_randi(a, T(0), T(1000));
+
+	dense_matrix<T> r(k, n);
+	dense_matrix<index_t> ri(k, n);
+
+	bool thrown = false;
+	try
+	{
+		colwise_ktop(a, k, std::greater<T>(), r);
+	}
+	catch (invalid_argument&)
+	{
+		thrown = true;
+	}
+	ASSERT_TRUE( thrown );
+
+	thrown = false;
+	try
+	{
+		colwise_ktop(a, k, std::greater<T>(), r, ri);
+	}
+	catch (invalid_argument&)
+	{
+		thrown = true;
+	}
+	ASSERT_TRUE( thrown );
+}
+
+AUTO_TPACK( test_ktop )
+{
+	ADD_T_CASE_FP( test_ktop_asc )
+	ADD_T_CASE_FP( test_ktop_desc )
+	ADD_T_CASE( test_ktop_asc, int32_t )
+	ADD_T_CASE( test_ktop_desc, int32_t )
+	ADD_T_CASE_FP( test_ktop_radix )
+	ADD_T_CASE( test_ktop_radix, int32_t )
+	ADD_T_CASE_FP( test_ktop_real )
+	ADD_T_CASE_FP( test_ktop_nan )
+	ADD_T_CASE_FP( test_colwise_ktop )
+	ADD_T_CASE_FP( test_colwise_ktop_invalid_k )
+}
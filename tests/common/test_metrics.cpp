@@ -10,6 +10,7 @@
 #include "../test_base.h"
 #include <dolphin/common/metrics.h>
 #include <functional>
+#include <cmath>
 
 using namespace dolphin;
 using namespace dolphin::test;
@@ -199,6 +200,72 @@ DEF_MY_DIST( my_cosine_distance )
 	return T(1) - xy / math::sqrt(xx * yy);
 }
 
+DEF_MY_DIST( my_correlation_distance )
+{
+	const index_t d = a.nelems();
+	T ma(0), mb(0);
+	for (index_t i = 0; i < d; ++i)
+	{
+		ma += a[i];
+		mb += b[i];
+	}
+	ma /= d;
+	mb /= d;
+
+	T xx(0), yy(0), xy(0);
+	for (index_t i = 0; i < d; ++i)
+	{
+		T u = a[i] - ma;
+		T v = b[i] - mb;
+		xx += u * u;
+		xy += u * v;
+		yy += v * v;
+	}
+	return T(1) - xy / math::sqrt(xx * yy);
+}
+
+DEF_MY_DIST( my_dot_product )
+{
+	T s(0);
+	for (index_t i = 0; i < a.nelems(); ++i)
+	{
+		s += a[i] * b[i];
+	}
+	return s;
+}
+
+
+DEF_MY_DIST( my_kl_divergence )
+{
+	T s(0);
+	for (index_t i = 0; i < a.nelems(); ++i)
+	{
+		if (a[i] > 0) s += a[i] * math::log(a[i] / b[i]);
+	}
+	return s;
+}
+
+DEF_MY_DIST( my_cross_entropy )
+{
+	T s(0);
+	for (index_t i = 0; i < a.nelems(); ++i)
+	{
+		if (a[i] > 0) s -= a[i] * math::log(b[i]);
+	}
+	return s;
+}
+
+DEF_MY_DIST( my_js_divergence )
+{
+	T s(0);
+	for (index_t i = 0; i < a.nelems(); ++i)
+	{
+		T m = T(0.5) * (a[i] + b[i]);
+		if (a[i] > 0) s += T(0.5) * a[i] * math::log(a[i] / m);
+		if (b[i] > 0) s += T(0.5) * b[i] * math::log(b[i] / m);
+	}
+	return s;
+}
 
 #define DEF_DIST_TEST_(Name, Construct) \
 		SIMPLE_CASE( test_##Name ) { \
@@ -258,6 +325,102 @@ DEF_DIST_TEST( chebyshev_distance )
 DEF_DIST_TEST_( minkowski_distance, minkowski_distance<double> dist(3.2) )
 
 DEF_DIST_TEST( cosine_distance )
+DEF_DIST_TEST( correlation_distance )
+DEF_DIST_TEST( dot_product )
+
+// columns of a are distributions with some zero entries,
+// those of b are strictly positive distributions
+
+void make_distributions(mat_t& a, bool with_zeros, index_t shift=0)
+{
+	fill_randr(a, 0.1, 1.0);
+	for (index_t j = 0; j < a.ncolumns(); ++j)
+	{
+		if (with_zeros)
+		{
+			a((j + shift) % vdim, j) = 0.0;
+			a((j + shift + 5) % vdim, j) = 0.0;
+		}
+
+		double s = 0;
+		for (index_t i = 0; i < vdim; ++i) s += a(i, j);
+		for (index_t i = 0; i < vdim; ++i) a(i, j) /= s;
+	}
+}
+
+// infinite entries must match exactly, the others approximately
+
+void verify_dists_inf(const mat_t& D, const mat_t& D0, double tol)
+{
+	ASSERT_EQ( D.nrows(), D0.nrows() );
+	ASSERT_EQ( D.ncolumns(), D0.ncolumns() );
+
+	for (index_t j = 0; j < D0.ncolumns(); ++j)
+	{
+		for (index_t i = 0; i < D0.nrows(); ++i)
+		{
+			if (std::isinf(D0(i, j)))
+				ASSERT_TRUE( D(i, j) == D0(i, j) );
+			else
+				ASSERT_APPROX( D(i, j), D0(i, j), tol );
+		}
+	}
+}
+
+#define DEF_PDIST_TEST(Name) \
+		SIMPLE_CASE( test_##Name ) { \
+			mat_t a(vdim, M); \
+			mat_t b(vdim, N); \
+			make_distributions(a, true); \
+			make_distributions(b, false); \
+			Name<double> dist; \
+			mat_t D0 = my_pairwise(a, b, my_##Name()); \
+			mat_t D1 = my_pairwise(a, b, dist); \
+			mat_t D2 = pairwise(dist, a, b); \
+			ASSERT_EQ( D2.nrows(), M ); \
+			ASSERT_EQ( D2.ncolumns(), N ); \
+			double tol = 1.0e-12; \
+			ASSERT_MAT_APPROX(M, N, D1, D0, tol); \
+			ASSERT_MAT_APPROX(M, N, D2, D0, tol); \
+			mat_t S0 = my_pairwise(a, a, my_##Name()); \
+			mat_t S2 = pairwise(dist, a); \
+			verify_dists_inf(S2, S0, tol); }
+
+DEF_PDIST_TEST( kl_divergence )
+DEF_PDIST_TEST( cross_entropy )
+DEF_PDIST_TEST( js_divergence )
+
+// zeros in b where a is positive give infinite values, with every
+// evaluation method
+
+template<class Metric, class MyMetric>
+void verify_zero_support(const Metric& dist, const MyMetric& mydist)
+{
+	mat_t a(vdim, M);
+	mat_t b(vdim, N);
+	make_distributions(a, true);
+	make_distributions(b, true, 2);
+
+	mat_t D0 = my_pairwise(a, b, mydist);
+	mat_t S0 = my_pairwise(a, a, mydist);
+
+	const pairwise_method methods[3] = {PAIRWISE_GEMM, PAIRWISE_TILED, PAIRWISE_DIRECT};
+	for (int k = 0; k < 3; ++k)
+	{
+		mat_t D = pairwise(dist, a, b, methods[k]);
+		verify_dists_inf(D, D0, 1.0e-12);
+
+		mat_t S = pairwise(dist, a, methods[k]);
+		verify_dists_inf(S, S0, 1.0e-12);
+	}
+}
+
+SIMPLE_CASE( test_pdist_zero_support )
+{
+	verify_zero_support(kl_divergence<double>(), my_kl_divergence());
+	verify_zero_support(cross_entropy<double>(), my_cross_entropy());
+}
+
 
 SIMPLE_CASE( test_hamming_distance )
 {
@@ -342,9 +505,653 @@ SIMPLE_CASE( test_weighted_hamming )
 }
 
 
+// small compile-time dimensions (structure-of-arrays kernels)
+
+const int sdim = 3;
+const index_t sM = 37;		// spans several blocks of columns
+const index_t sN = 11;
+
+typedef cref_matrix<double, sdim, 0> smat_t;
+
+#define DEF_SMALL_DIST_TEST_(Name, Construct) \
+		SIMPLE_CASE( test_small_##Name ) { \
+			mat_t a(sdim, sM); \
+			mat_t b(sdim, sN); \
+			fill_randr(a, -1.0, 1.0); \
+			fill_randr(b, -1.0, 1.0); \
+			smat_t sa(a.ptr_data(), sdim, sM); \
+			smat_t sb(b.ptr_data(), sdim, sN); \
+			Construct; \
+			mat_t D0 = my_pairwise(a, b, my_##Name()); \
+			mat_t D2 = pairwise(dist, sa, sb); \
+			ASSERT_EQ( D2.nrows(), sM ); \
+			ASSERT_EQ( D2.ncolumns(), sN ); \
+			double tol = 1.0e-13; \
+			ASSERT_MAT_APPROX(sM, sN, D2, D0, tol); \
+			mat_t S0 = my_pairwise(a, a, my_##Name()); \
+			mat_t S2 = pairwise(dist, sa); \
+			ASSERT_MAT_APPROX(sM, sM, S2, S0, tol); }
+
+#define DEF_SMALL_DIST_TEST(Name) DEF_SMALL_DIST_TEST_( Name, Name<double> dist )
+
+DEF_SMALL_DIST_TEST( euclidean_distance )
+DEF_SMALL_DIST_TEST( sqeuclidean_distance )
+DEF_SMALL_DIST_TEST( cityblock_distance )
+DEF_SMALL_DIST_TEST( chebyshev_distance )
+DEF_SMALL_DIST_TEST_( minkowski_distance, minkowski_distance<double> dist(3.2) )
+DEF_SMALL_DIST_TEST( cosine_distance )
+DEF_SMALL_DIST_TEST( correlation_distance )
+DEF_SMALL_DIST_TEST( dot_product )
+
+SIMPLE_CASE( test_small_weighted_sqeuclidean )
+{
+	mat_t a(sdim, sM);
+	mat_t b(sdim, sN);
+	dense_col<double> w(sdim);
+	fill_randr(a, -1.0, 1.0);
+	fill_randr(b, -1.0, 1.0);
+	fill_randr(w, 0.0, 2.0);
+
+	smat_t sa(a.ptr_data(), sdim, sM);
+	smat_t sb(b.ptr_data(), sdim, sN);
+	auto dist = weighted_sqeuclidean(w);
+
+	mat_t D0 = my_wpairwise(a, b, w, my_weighted_sqeuclidean());
+	mat_t D2 = pairwise(dist, sa, sb);
+	ASSERT_MAT_APPROX(sM, sN, D2, D0, 1.0e-13);
+}
+
+// an explicit method is honored for small compile-time dimensions
+
+SIMPLE_CASE( test_small_pairwise_methods )
+{
+	mat_t a(sdim, sM);
+	mat_t b(sdim, sN);
+	fill_randr(a, -1.0, 1.0);
+	fill_randr(b, -1.0, 1.0);
+
+	smat_t sa(a.ptr_data(), sdim, sM);
+	smat_t sb(b.ptr_data(), sdim, sN);
+	sqeuclidean_distance<double> dist;
+
+	mat_t D0 = my_pairwise(a, b, my_sqeuclidean_distance());
+	mat_t S0 = my_pairwise(a, a, my_sqeuclidean_distance());
+	for (index_t i = 0; i < sM; ++i) S0(i, i) = 0.0;
+
+	const pairwise_method methods[3] = {PAIRWISE_GEMM, PAIRWISE_TILED, PAIRWISE_DIRECT};
+	for (int k = 0; k < 3; ++k)
+	{
+		mat_t D = pairwise(dist, sa, sb, methods[k]);
+		ASSERT_MAT_APPROX(sM, sN, D, D0, 1.0e-13);
+
+		mat_t S = pairwise(dist, sa, methods[k]);
+		for (index_t i = 0; i < sM; ++i) S(i, i) = 0.0;
+		ASSERT_MAT_APPROX(sM, sM, S, S0, 1.0e-13);
+	}
+}
+
+
+// evaluation methods
+
+template<class Metric, class MyMetric>
+void verify_pairwise_methods(const Metric& dist, const MyMetric& mydist)
+{
+	mat_t a(vdim, M);
+	mat_t b(vdim, N);
+	fill_randr(a, -1.0, 1.0);
+	fill_randr(b, -1.0, 1.0);
+
+	mat_t D0 = my_pairwise(a, b, mydist);
+	mat_t S0 = my_pairwise(a, a, mydist);
+	for (index_t i = 0; i < M; ++i) S0(i, i) = 0.0;
+
+	const pairwise_method methods[3] = {PAIRWISE_GEMM, PAIRWISE_TILED, PAIRWISE_DIRECT};
+	for (int k = 0; k < 3; ++k)
+	{
+		mat_t D = pairwise(dist, a, b, methods[k]);
+		ASSERT_MAT_APPROX(M, N, D, D0, 1.0e-13);
+
+		mat_t S = pairwise(dist, a, methods[k]);
+		for (index_t i = 0; i < M; ++i) S(i, i) = 0.0;
+		ASSERT_MAT_APPROX(M, M, S, S0, 1.0e-13);
+	}
+}
+
+SIMPLE_CASE( test_pairwise_methods )
+{
+	verify_pairwise_methods(sqeuclidean_distance<double>(), my_sqeuclidean_distance());
+	verify_pairwise_methods(cosine_distance<double>(), my_cosine_distance());
+	verify_pairwise_methods(correlation_distance<double>(), my_correlation_distance());
+	verify_pairwise_methods(chebyshev_distance<double>(), my_chebyshev_distance());	// no GEMM method
+}
+
+// correlation distance on data with a large offset, and with a
+// constant column (at distance 1 from all others)
+
+SIMPLE_CASE( test_correlation_offset )
+{
+	mat_t a(vdim, M);
+	mat_t b(vdim, N);
+	fill_randr(a, -1.0, 1.0);
+	fill_randr(b, -1.0, 1.0);
+	for (index_t i = 0; i < a.nelems(); ++i) a[i] += 1.0e4;
+	for (index_t i = 0; i < b.nelems(); ++i) b[i] += 1.0e4;
+	for (index_t i = 0; i < vdim; ++i) a(i, 0) = 0.3;
+
+	mat_t D0 = my_pairwise(a, b, my_correlation_distance());
+	for (index_t j = 0; j < N; ++j) D0(0, j) = 1.0;
+
+	mat_t S0 = my_pairwise(a, a, my_correlation_distance());
+	for (index_t j = 0; j < M; ++j) S0(0, j) = S0(j, 0) = 1.0;
+	for (index_t i = 0; i < M; ++i) S0(i, i) = 0.0;
+
+	correlation_distance<double> dist;
+	const double tol = 1.0e-9;
+
+	mat_t D1 = my_pairwise(a, b, dist);
+	ASSERT_MAT_APPROX(M, N, D1, D0, tol);
+
+	const pairwise_method methods[3] = {PAIRWISE_GEMM, PAIRWISE_TILED, PAIRWISE_DIRECT};
+	for (int k = 0; k < 3; ++k)
+	{
+		mat_t D = pairwise(dist, a, b, methods[k]);
+		ASSERT_MAT_APPROX(M, N, D, D0, tol);
+
+		mat_t S = pairwise(dist, a, methods[k]);
+		ASSERT_MAT_APPROX(M, M, S, S0, tol);
+	}
+}
+
+SIMPLE_CASE( test_pairwise_plan )
+{
+	typedef sqeuclidean_distance<double> sqe_t;
+	typedef sqeuclidean_distance<float> sqe_f;
+	typedef chebyshev_distance<double> cheb_t;
+	typedef js_divergence<double> js_t;
+
+	// metrics with a GEMM method keep it for all shapes
+
+	ASSERT_EQ( plan_pairwise<sqe_t>(1, 10000, 128), PAIRWISE_GEMM );
+	ASSERT_EQ( plan_pairwise<sqe_t>(1000, 1, 4), PAIRWISE_GEMM );
+	ASSERT_EQ( plan_pairwise<sqe_t>(1000, 1000, 4), PAIRWISE_GEMM );
+	ASSERT_EQ( plan_pairwise<sqe_t>(1000, 1000, 128), PAIRWISE_GEMM );
+	ASSERT_EQ( plan_pairwise<sqe_t>(20, 20, 128), PAIRWISE_GEMM );
+	ASSERT_EQ( plan_pairwise<sqe_f>(1000, 1000, 20), PAIRWISE_GEMM );
+	ASSERT_EQ( plan_pairwise<correlation_distance<double> >(3, 3, 2), PAIRWISE_GEMM );
+
+	// the others take the tiled kernels for small dimensions
+
+	ASSERT_EQ( plan_pairwise<cheb_t>(1000, 1000, 128), PAIRWISE_DIRECT );
+	ASSERT_EQ( plan_pairwise<cheb_t>(1000, 1000, 8), PAIRWISE_TILED );
+	ASSERT_EQ( plan_pairwise<js_t>(10, 1000, 8), PAIRWISE_DIRECT );
+}
+
+
+// refinement of GEMM-based squared Euclidean distances, on a
+// shape for which plan_pairwise takes the GEMM method
+
+const index_t rdim = 64;
+const index_t rM = 64;
+
+SIMPLE_CASE( test_refined_sqeuclidean )
+{
+	// b_j is a near-duplicate of a_j, far from the origin
+
+	mat_t a0(rdim, rM);
+	mat_t e0(rdim, rM);
+	fill_randr(a0, 10.0, 11.0);
+	fill_randr(e0, -1.0e-3, 1.0e-3);
+
+	dense_matrix<float> a(rdim, rM);
+	dense_matrix<float> b(rdim, rM);
+	for (index_t j = 0; j < rM; ++j)
+	{
+		for (index_t i = 0; i < rdim; ++i)
+		{
+			a(i, j) = float(a0(i, j));
+			b(i, j) = float(a0(i, j) + e0(i, j));
+		}
+	}
+
+	mat_t D0(rM, rM);
+	for (index_t j = 0; j < rM; ++j)
+	{
+		for (index_t i = 0; i < rM; ++i)
+		{
+			double s = 0;
+			for (index_t k = 0; k < rdim; ++k)
+			{
+				double u = double(a(k, i)) - double(b(k, j));
+				s += u * u;
+			}
+			D0(i, j) = s;
+		}
+	}
+
+	sqeuclidean_distance<float> dist;
+	dense_matrix<float> D = pairwise(dist, a, b, pairwise_options(PAIRWISE_GEMM, 1.0e-3));
+
+	for (index_t j = 0; j < rM; ++j)
+	{
+		for (index_t i = 0; i < rM; ++i)
+		{
+			double tol = (i == j ? 1.0e-5 : 1.0e-3) * D0(i, j);
+			ASSERT_TRUE( math::abs(double(D(i, j)) - D0(i, j)) <= tol );
+		}
+	}
+
+	// refinement is also applied through the default method
+
+	ASSERT_EQ( plan_pairwise<sqeuclidean_distance<float> >(rM, rM, rdim), PAIRWISE_GEMM );
+	dense_matrix<float> D2 = pairwise(dist, a, b, pairwise_refined());
+	for (index_t j = 0; j < rM; ++j)
+		ASSERT_TRUE( math::abs(double(D2(j, j)) - D0(j, j)) <= 1.0e-5 * D0(j, j) );
+}
+
+
+// mixed-precision metrics: float inputs agree with the double metrics
+// on the widened inputs, regardless of the dimension
+
+const index_t mpdim = 4096;
+
+void normalize_columns(dense_matrix<float>& a)
+{
+	for (index_t j = 0; j < a.ncolumns(); ++j)
+	{
+		double s = 0;
+		for (index_t i = 0; i < a.nrows(); ++i) s += a(i, j);
+		for (index_t i = 0; i < a.nrows(); ++i) a(i, j) = float(a(i, j) / s);
+	}
+}
+
+template<class MpMetric, class Metric>
+void verify_mp_metric(const MpMetric& mpdist, const Metric& dist, bool distrs)
+{
+	dense_matrix<float> a(mpdim, M);
+	dense_matrix<float> b(mpdim, N);
+	fill_randr(a, 0.1f, 1.0f);
+	fill_randr(b, 0.1f, 1.0f);
+
+	if (distrs)
+	{
+		for (index_t j = 0; j < M; ++j) a(j, j) = 0.f;
+		normalize_columns(a);
+		normalize_columns(b);
+	}
+
+	mat_t ad(mpdim, M);
+	mat_t bd(mpdim, N);
+	for (index_t i = 0; i < a.nelems(); ++i) ad[i] = double(a[i]);
+	for (index_t i = 0; i < b.nelems(); ++i) bd[i] = double(b[i]);
+
+	mat_t D0 = pairwise(dist, ad, bd);
+	mat_t D = pairwise(mpdist, a, b);
+	ASSERT_MAT_APPROX(M, N, D, D0, 1.0e-10);
+
+	dense_row<double> r0(M), r(M);
+	colwise(dist, ad, bd.column(0), r0);
+	colwise(mpdist, a, b.column(0), r);
+	ASSERT_VEC_APPROX(M, r, r0, 1.0e-10);
+}
+
+#define DEF_MP_DIST_TEST(Name, Distrs) \
+		SIMPLE_CASE( test_mp_##Name ) { \
+			verify_mp_metric(mp_##Name<float_to_double>(), Name<double>(), Distrs); }
+
+DEF_MP_DIST_TEST( sqeuclidean_distance, false )
+DEF_MP_DIST_TEST( euclidean_distance, false )
+DEF_MP_DIST_TEST( cityblock_distance, false )
+DEF_MP_DIST_TEST( dot_product, false )
+DEF_MP_DIST_TEST( cosine_distance, false )
+DEF_MP_DIST_TEST( correlation_distance, false )
+DEF_MP_DIST_TEST( kl_divergence, true )
+DEF_MP_DIST_TEST( cross_entropy, true )
+DEF_MP_DIST_TEST( js_divergence, true )
+
+SIMPLE_CASE( test_mp_float_output )
+{
+	dense_matrix<float> a(mpdim, M);
+	fill_randr(a, -1.0f, 1.0f);
+
+	mat_t ad(mpdim, M);
+	for (index_t i = 0; i < a.nelems(); ++i) ad[i] = double(a[i]);
+
+	mat_t S0 = pairwise(cosine_distance<double>(), ad);
+	dense_matrix<float> S = pairwise(mp_cosine_distance<float_acc_double>(), a);
+
+	for (index_t j = 0; j < M; ++j)
+		for (index_t i = 0; i < M; ++i)
+			ASSERT_TRUE( math::abs(double(S(i, j)) - S0(i, j)) <= 1.0e-6 );
+}
+
+// the packed fold of float inputs, over lengths with every tail
+
+template<class MpMetric, class Metric>
+void verify_mp_tails(const MpMetric& mpdist, const Metric& dist)
+{
+	for (index_t n = 1; n <= 40; ++n)
+	{
+		dense_col<float> x(n), y(n);
+		fill_randr(x, -1.0f, 1.0f);
+		fill_randr(y, -1.0f, 1.0f);
+
+		dense_col<double> xd(n), yd(n);
+		for (index_t i = 0; i < n; ++i)
+		{
+			xd[i] = double(x[i]);
+			yd[i] = double(y[i]);
+		}
+
+		ASSERT_APPROX( mpdist(x, y), dist(xd, yd), 1.0e-12 );
+	}
+}
+
+SIMPLE_CASE( test_mp_tails )
+{
+	verify_mp_tails(mp_sqeuclidean_distance<float_to_double>(), sqeuclidean_distance<double>());
+	verify_mp_tails(mp_cityblock_distance<float_to_double>(), cityblock_distance<double>());
+	verify_mp_tails(mp_dot_product<float_to_double>(), dot_product<double>());
+	verify_mp_tails(mp_cosine_distance<float_to_double>(), cosine_distance<double>());
+}
+
+// a long sum in float drifts by many units in the last place, while
+// the double accumulation of the policy is exact here: each term is
+// 1.1f, with 24 significant bits, and the sum is below 2^53
+
+SIMPLE_CASE( test_mp_long_sum )
+{
+	const index_t n = index_t(1) << 21;
+	dense_col<float> x(n), y(n);
+	for (index_t i = 0; i < n; ++i)
+	{
+		x[i] = 1.0f;
+		y[i] = 1.1f;
+	}
+
+	const double r0 = double(n) * double(1.1f);
+
+	const double rf = double(dot_product<float>()(x, y));
+	const double rd = mp_dot_product<float_to_double>()(x, y);
+
+	ASSERT_TRUE( math::abs(rf - r0) > 1.0e-5 * r0 );
+	ASSERT_TRUE( rd == r0 );
+}
+
+
+// 8-bit integer metrics, against 64-bit references; the small
+// dimension takes the tiled kernels, the large one the per-pair
+// kernels (with full SIMD blocks and a tail)
+
+struct my_int_sqeuclidean
+{
+	template<typename T>
+	int64_t operator() (const T& x, const T& y) const { int64_t u = int64_t(x) - int64_t(y); return u * u; }
+};
+
+struct my_int_dot
+{
+	template<typename T>
+	int64_t operator() (const T& x, const T& y) const { return int64_t(x) * int64_t(y); }
+};
+
+struct my_int_cityblock
+{
+	template<typename T>
+	int64_t operator() (const T& x, const T& y) const { int64_t u = int64_t(x) - int64_t(y); return u < 0 ? -u : u; }
+};
+
+struct my_int_hamming
+{
+	template<typename T>
+	int64_t operator() (const T& x, const T& y) const { return int64_t(x != y); }
+};
+
+template<typename T, class Metric, class Ref>
+void verify_int8_metric(const Metric& dist, const Ref& ref, index_t d, T lb, T ub)
+{
+	typedef typename metric_traits<Metric>::result_type RT;
+
+	const index_t m = 37;
+	const index_t n = 11;
+	dense_matrix<T> a(d, m);
+	dense_matrix<T> b(d, n);
+	fill_randi(a, lb, ub);
+	fill_randi(b, lb, ub);
+	for (index_t i = 0; i < d; i += 3) b(i, 0) = a(i, 0);
+
+	dense_matrix<RT> D0(m, n);
+	for (index_t j = 0; j < n; ++j)
+	{
+		for (index_t i = 0; i < m; ++i)
+		{
+			int64_t v = 0;
+			for (index_t t = 0; t < d; ++t) v += ref(a(t, i), b(t, j));
+			D0(i, j) = RT(v);
+		}
+	}
+
+	dense_matrix<RT> D = pairwise(dist, a, b);
+	ASSERT_MAT_EQ(m, n, D, D0);
+
+	dense_matrix<RT> D2 = pairwise(dist, a, b, PAIRWISE_DIRECT);
+	ASSERT_MAT_EQ(m, n, D2, D0);
+
+	dense_row<RT> r0(m), r(m);
+	for (index_t i = 0; i < m; ++i) r0[i] = D0(i, 0);
+	colwise(dist, a, b.column(0), r);
+	ASSERT_VEC_EQ(m, r, r0);
+}
+
+template<typename T>
+void verify_int8_metrics(T lb, T ub)
+{
+	const index_t ds[2] = {7, 75};
+	for (int k = 0; k < 2; ++k)
+	{
+		verify_int8_metric(sqeuclidean_distance<T>(), my_int_sqeuclidean(), ds[k], lb, ub);
+		verify_int8_metric(dot_product<T>(), my_int_dot(), ds[k], lb, ub);
+		verify_int8_metric(cityblock_distance<T>(), my_int_cityblock(), ds[k], lb, ub);
+		verify_int8_metric(hamming_distance<T>(), my_int_hamming(), ds[k], lb, ub);
+	}
+}
+
+SIMPLE_CASE( test_uint8_metrics )
+{
+	verify_int8_metrics<uint8_t>(0, 255);
+}
+
+SIMPLE_CASE( test_int8_metrics )
+{
+	verify_int8_metrics<std::int8_t>(-128, 127);
+}
+
+SIMPLE_CASE( test_dequantized_pairwise )
+{
+	const index_t d = 50;
+	dense_matrix<std::int8_t> qa(d, M);
+	dense_matrix<std::int8_t> qb(d, N);
+	fill_randi(qa, std::int8_t(-127), std::int8_t(127));
+	fill_randi(qb, std::int8_t(-127), std::int8_t(127));
+
+	dense_col<double> sa(M);
+	dense_col<double> sb(N);
+	fill_randr(sa, 0.5, 2.0);
+	fill_randr(sb, 0.5, 2.0);
+
+	mat_t a(d, M);
+	mat_t b(d, N);
+	for (index_t j = 0; j < M; ++j)
+		for (index_t i = 0; i < d; ++i) a(i, j) = sa[j] * double(qa(i, j));
+	for (index_t j = 0; j < N; ++j)
+		for (index_t i = 0; i < d; ++i) b(i, j) = sb[j] * double(qb(i, j));
+
+	mat_t D(M, N);
+
+	dequantized_pairwise(dot_product<std::int8_t>(), qa, sa, qb, sb, D);
+	mat_t D0 = my_pairwise(a, b, dot_product<double>());
+	ASSERT_MAT_APPROX(M, N, D, D0, 1.0e-8);
+
+	dequantized_pairwise(sqeuclidean_distance<std::int8_t>(), qa, sa, qb, sb, D);
+	D0 = my_pairwise(a, b, sqeuclidean_distance<double>());
+	ASSERT_MAT_APPROX(M, N, D, D0, 1.0e-8);
+}
+
+// dimensions beyond the exact range of the int32 sums are rejected
+
+SIMPLE_CASE( test_int8_max_dim )
+{
+	const index_t d = 33026;
+	dense_matrix<uint8_t> qa(d, 3);
+	dense_matrix<uint8_t> qb(d, 2);
+	fill_randi(qa, uint8_t(0), uint8_t(255));
+	fill_randi(qb, uint8_t(0), uint8_t(255));
+
+	dense_col<double> sa(3);
+	dense_col<double> sb(2);
+	fill_randr(sa, 0.5, 2.0);
+	fill_randr(sb, 0.5, 2.0);
+
+	sqeuclidean_distance<uint8_t> dist;
+	bool thrown;
+
+	thrown = false;
+	try { dist(qa.column(0), qb.column(0)); } catch (invalid_argument&) { thrown = true; }
+	ASSERT_TRUE( thrown );
+
+	thrown = false;
+	try
+	{
+		dense_row<int32_t> r(3);
+		colwise(dist, qa, qb.column(0), r);
+	}
+	catch (invalid_argument&) { thrown = true; }
+	ASSERT_TRUE( thrown );
+
+	const pairwise_method methods[3] = {PAIRWISE_AUTO, PAIRWISE_TILED, PAIRWISE_DIRECT};
+	for (int k = 0; k < 3; ++k)
+	{
+		thrown = false;
+		try
+		{
+			dense_matrix<int32_t> G = pairwise(dist, qa, qb, methods[k]);
+		}
+		catch (invalid_argument&) { thrown = true; }
+		ASSERT_TRUE( thrown );
+	}
+
+	thrown = false;
+	try
+	{
+		mat_t D(3, 2);
+		dequantized_pairwise(dot_product<uint8_t>(), qa, sa, qb, sb, D);
+	}
+	catch (invalid_argument&) { thrown = true; }
+	ASSERT_TRUE( thrown );
+
+	// the largest exact dimension is accepted
+
+	dense_col<uint8_t> x(d - 1), y(d - 1);
+	fill_randi(x, uint8_t(0), uint8_t(255));
+	fill_randi(y, uint8_t(0), uint8_t(255));
+	ASSERT_TRUE( dist(x, y) >= 0 );
+}
+
+
 
 // colwise evaluation
 
+// Mahalanobis distances
+
+inline void make_chol_factor(mat_t& L)
+{
+	fill_randr(L, -1.0, 1.0);
+	for (index_t j = 0; j < vdim; ++j)
+	{
+		for (index_t i = 0; i < j; ++i) L(i, j) = 0.0;
+		L(j, j) = 1.0 + math::abs(L(j, j));
+	}
+}
+
+inline double my_sqmahal(const mat_t& L, const mat_t& a, index_t i, const mat_t& b, index_t j)
+{
+	// (a - b)' (L L') (a - b), through the explicit precision matrix
+
+	double s = 0;
+	for (index_t p = 0; p < vdim; ++p)
+	{
+		for (index_t q = 0; q < vdim; ++q)
+		{
+			double w = 0;
+			for (index_t k = 0; k < vdim; ++k) w += L(p, k) * L(q, k);
+			s += (a(p, i) - b(p, j)) * w * (a(q, i) - b(q, j));
+		}
+	}
+	return s;
+}
+
+SIMPLE_CASE( test_sqmahalanobis )
+{
+	mat_t a(vdim, M);
+	mat_t b(vdim, N);
+	mat_t L(vdim, vdim);
+
+	fill_randr(a, -1.0, 1.0);
+	fill_randr(b, -1.0, 1.0);
+	make_chol_factor(L);
+
+	auto dist = sqmahalanobis(L);
+
+	mat_t D0(M, N);
+	for (index_t j = 0; j < N; ++j)
+		for (index_t i = 0; i < M; ++i) D0(i, j) = my_sqmahal(L, a, i, b, j);
+
+	mat_t S0(M, M);
+	for (index_t j = 0; j < M; ++j)
+		for (index_t i = 0; i < M; ++i) S0(i, j) = my_sqmahal(L, a, i, a, j);
+
+	double tol = 1.0e-11;
+
+	mat_t D1 = my_pairwise(a, b, dist);
+	mat_t D2 = pairwise(dist, a, b);
+	mat_t S2 = pairwise(dist, a);
+
+	ASSERT_MAT_APPROX(M, N, D1, D0, tol);
+	ASSERT_MAT_APPROX(M, N, D2, D0, tol);
+	ASSERT_MAT_APPROX(M, M, S2, S0, tol);
+}
+
+SIMPLE_CASE( test_mahalanobis )
+{
+	mat_t a(vdim, M);
+	mat_t b(vdim, N);
+	mat_t L(vdim, vdim);
+
+	fill_randr(a, -1.0, 1.0);
+	fill_randr(b, -1.0, 1.0);
+	make_chol_factor(L);
+
+	auto dist = mahalanobis(L);
+
+	mat_t D0(M, N);
+	for (index_t j = 0; j < N; ++j)
+		for (index_t i = 0; i < M; ++i) D0(i, j) = math::sqrt(my_sqmahal(L, a, i, b, j));
+
+	mat_t S0(M, M);
+	for (index_t j = 0; j < M; ++j)
+		for (index_t i = 0; i < M; ++i) S0(i, j) = math::sqrt(my_sqmahal(L, a, i, a, j));
+
+	double tol = 1.0e-10;
+
+	mat_t D1 = my_pairwise(a, b, dist);
+	mat_t D2 = pairwise(dist, a, b);
+	mat_t S2 = pairwise(dist, a);
+
+	ASSERT_MAT_APPROX(M, N, D1, D0, tol);
+	ASSERT_MAT_APPROX(M, N, D2, D0, tol);
+	ASSERT_MAT_APPROX(M, M, S2, S0, tol);
+}
+
+
 SIMPLE_CASE( colwise_metric_00 )
 {
 	mat_t a(vdim, M);
@@ -425,9 +1232,19 @@ AUTO_TPACK( basic_dists )
 	ADD_SIMPLE_CASE( test_minkowski_distance )
 
 	ADD_SIMPLE_CASE( test_cosine_distance )
+	ADD_SIMPLE_CASE( test_correlation_distance )
+	ADD_SIMPLE_CASE( test_dot_product )
 	ADD_SIMPLE_CASE( test_hamming_distance )
 }
 
+AUTO_TPACK( prob_dists )
+{
+	ADD_SIMPLE_CASE( test_kl_divergence )
+	ADD_SIMPLE_CASE( test_cross_entropy )
+	ADD_SIMPLE_CASE( test_js_divergence )
+	ADD_SIMPLE_CASE( test_pdist_zero_support )
+}
+
 AUTO_TPACK( weighted_dists )
 {
 	ADD_SIMPLE_CASE( test_weighted_euclidean )
@@ -436,6 +1253,55 @@ AUTO_TPACK( weighted_dists )
 	ADD_SIMPLE_CASE( test_weighted_minkowski )
 
 	ADD_SIMPLE_CASE( test_weighted_hamming )
+
+	ADD_SIMPLE_CASE( test_sqmahalanobis )
+	ADD_SIMPLE_CASE( test_mahalanobis )
+}
+
+AUTO_TPACK( small_dim_dists )
+{
+	ADD_SIMPLE_CASE( test_small_euclidean_distance )
+	ADD_SIMPLE_CASE( test_small_sqeuclidean_distance )
+	ADD_SIMPLE_CASE( test_small_cityblock_distance )
+	ADD_SIMPLE_CASE( test_small_chebyshev_distance )
+	ADD_SIMPLE_CASE( test_small_minkowski_distance )
+	ADD_SIMPLE_CASE( test_small_cosine_distance )
+	ADD_SIMPLE_CASE( test_small_correlation_distance )
+	ADD_SIMPLE_CASE( test_small_dot_product )
+	ADD_SIMPLE_CASE( test_small_weighted_sqeuclidean )
+	ADD_SIMPLE_CASE( test_small_pairwise_methods )
+}
+
+AUTO_TPACK( pairwise_methods )
+{
+	ADD_SIMPLE_CASE( test_pairwise_methods )
+	ADD_SIMPLE_CASE( test_correlation_offset )
+	ADD_SIMPLE_CASE( test_pairwise_plan )
+	ADD_SIMPLE_CASE( test_refined_sqeuclidean )
+}
+
+AUTO_TPACK( mixed_precision_dists )
+{
+	ADD_SIMPLE_CASE( test_mp_sqeuclidean_distance )
+	ADD_SIMPLE_CASE( test_mp_euclidean_distance )
+	ADD_SIMPLE_CASE( test_mp_cityblock_distance )
+	ADD_SIMPLE_CASE( test_mp_dot_product )
+	ADD_SIMPLE_CASE( test_mp_cosine_distance )
+	ADD_SIMPLE_CASE( test_mp_correlation_distance )
+	ADD_SIMPLE_CASE( test_mp_kl_divergence )
+	ADD_SIMPLE_CASE( test_mp_cross_entropy )
+	ADD_SIMPLE_CASE( test_mp_js_divergence )
+	ADD_SIMPLE_CASE( test_mp_float_output )
+	ADD_SIMPLE_CASE( test_mp_tails )
+	ADD_SIMPLE_CASE( test_mp_long_sum )
+}
+
+AUTO_TPACK( int8_dists )
+{
+	ADD_SIMPLE_CASE( test_uint8_metrics )
+	ADD_SIMPLE_CASE( test_int8_metrics )
+	ADD_SIMPLE_CASE( test_dequantized_pairwise )
+	ADD_SIMPLE_CASE( test_int8_max_dim )
 }
 
 AUTO_TPACK( colwise_dists )
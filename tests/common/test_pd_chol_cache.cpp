@@ -0,0 +1,165 @@
+/**
+ * @file test_pd_chol_cache.cpp
+ *
+ * @brief Unit testing of pd_chol_cache
+ *
+ * @author Dahua Lin
+ */
+
+#include "../test_base.h"
+#include <dolphin/common/pd_chol_cache.h>
+#include <cmath>
+
+using namespace dolphin;
+using namespace dolphin::test;
+
+
+// a = b b' + I, for a random b
+template<typename T>
+void make_pdmat(index_t d, T *a)
+{
+	dense_matrix<T> b(d, d);
+	fill_randr(b, T(-1), T(1));
+
+	for (index_t j = 0; j < d; ++j)
+	{
+		for (index_t i = 0; i < d; ++i)
+		{
+			T s(i == j ? 1 : 0);
+			for (index_t k = 0; k < d; ++k) s += b(i, k) * b(j, k);
+			a[i + j * d] = s;
+		}
+	}
+}
+
+template<typename T>
+void verify_factor(index_t d, const cref_matrix<T>& L, const T *a, T tol)
+{
+	for (index_t j = 0; j < d; ++j)
+	{
+		for (index_t i = 0; i < j; ++i) ASSERT_EQ( L(i, j), T(0) );
+
+		for (index_t i = 0; i < d; ++i)
+		{
+			T s(0);
+			for (index_t k = 0; k < d; ++k) s += L(i, k) * L(j, k);
+			ASSERT_APPROX( s, a[i + j * d], tol );
+		}
+	}
+}
+
+
+T_CASE( test_pd_chol_factorize )
+{
+	const index_t d = 5;
+	const index_t K = 7;
+	T tol = T(sizeof(T) == 4 ? 1.0e-4 : 1.0e-12);
+
+	dense_matrix<T> a(d * d, K);
+	for (index_t k = 0; k < K; ++k) make_pdmat(d, a.ptr_col(k));
+
+	pd_chol_cache<T> cache(d, K);
+	ASSERT_EQ( cache.dim(), d );
+	ASSERT_EQ( cache.count(), K );
+
+	cache.factorize(a);
+
+	for (index_t k = 0; k < K; ++k)
+	{
+		cref_matrix<T> L = cache.factor(k);
+		verify_factor(d, L, a.ptr_col(k), tol);
+
+		T ld(0);
+		for (index_t i = 0; i < d; ++i) ld += std::log(L(i, i));
+		ASSERT_APPROX( cache.logdet(k), T(2) * ld, tol );
+	}
+
+	// solve and Mahalanobis terms
+
+	const index_t n = 4;
+	dense_matrix<T> x(d, n);
+	fill_randr(x, T(-1), T(1));
+
+	dense_matrix<T> y(d, n);
+	copy(x, y);
+	cache.solve(2, y);
+
+	cref_matrix<T> a2(a.ptr_col(2), d, d);
+	for (index_t j = 0; j < n; ++j)
+	{
+		for (index_t i = 0; i < d; ++i)
+		{
+			T s(0);
+			for (index_t k = 0; k < d; ++k) s += a2(i, k) * y(k, j);
+			ASSERT_APPROX( s, x(i, j), tol );
+		}
+	}
+
+	dense_matrix<T> z(d, n);
+	copy(x, z);
+	dense_col<T> r(n);
+	cache.sqmahal_inplace(2, z, r);
+
+	for (index_t j = 0; j < n; ++j)
+	{
+		T s(0);
+		for (index_t i = 0; i < d; ++i) s += x(i, j) * y(i, j);
+		ASSERT_APPROX( r[j], s, tol );
+	}
+}
+
+
+T_CASE( test_pd_chol_rank1 )
+{
+	const index_t d = 6;
+	T tol = T(sizeof(T) == 4 ? 1.0e-4 : 1.0e-11);
+
+	dense_matrix<T> a(d, d);
+	make_pdmat(d, a.ptr_data());
+
+	dense_col<T> x(d);
+	fill_randr(x, T(-1), T(1));
+
+	dense_matrix<T> a1(d, d);
+	for (index_t j = 0; j < d; ++j)
+		for (index_t i = 0; i < d; ++i) a1(i, j) = a(i, j) + x[i] * x[j];
+
+	pd_chol_cache<T> cache(d, 1);
+	cache.factorize(0, a);
+
+	pd_chol_cache<T> ref1(d, 1);
+	ref1.factorize(0, a1);
+
+	cache.rank1_update(0, x);
+	verify_factor(d, cache.factor(0), a1.ptr_data(), tol);
+	ASSERT_APPROX( cache.logdet(0), ref1.logdet(0), tol );
+
+	cache.rank1_downdate(0, x);
+	verify_factor(d, cache.factor(0), a.ptr_data(), tol);
+
+	// a downdate that breaks positive definiteness is rejected,
+	// and the factor is kept intact
+
+	dense_col<T> big(d);
+	big << T(0);
+	big[0] = T(2) * std::sqrt(a(0, 0));
+
+	bool thrown = false;
+	try
+	{
+		cache.rank1_downdate(0, big);
+	}
+	catch (invalid_argument&)
+	{
+		thrown = true;
+	}
+	ASSERT_TRUE( thrown );
+	verify_factor(d, cache.factor(0), a.ptr_data(), tol);
+}
+
+
+AUTO_TPACK( test_pd_chol_cache )
+{
+	ADD_T_CASE_FP( test_pd_chol_factorize )
+	ADD_T_CASE_FP( test_pd_chol_rank1 )
+}
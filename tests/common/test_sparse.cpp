@@ -0,0 +1,160 @@
+/**
+ * @file test_sparse.cpp
+ *
+ * @brief Unit testing of sparse matrices and metrics on them
+ *
+ * @author Dahua Lin
+ */
+
+#include "../test_base.h"
+#include <dolphin/common/sparse.h>
+
+using namespace dolphin;
+using namespace dolphin::test;
+
+typedef dense_matrix<double> mat_t;
+
+const index_t vdim = 50;
+const index_t M = 23;
+const index_t N = 37;	// spans several output tiles
+
+
+// keeps about a fifth of the entries, plus an all-zero column
+void make_sparse_data(mat_t& a)
+{
+	mat_t u(a.nrows(), a.ncolumns());
+	fill_randr(a, -1.0, 1.0);
+	fill_randr(u, 0.0, 1.0);
+
+	for (index_t j = 0; j < a.ncolumns(); ++j)
+		for (index_t i = 0; i < a.nrows(); ++i)
+			if (u(i, j) > 0.2) a(i, j) = 0.0;
+
+	for (index_t i = 0; i < a.nrows(); ++i) a(i, 1) = 0.0;
+}
+
+
+SIMPLE_CASE( test_csc_basics )
+{
+	mat_t a(vdim, M);
+	make_sparse_data(a);
+
+	csc_matrix<double> s = to_csc(a);
+	ASSERT_EQ( s.nrows(), vdim );
+	ASSERT_EQ( s.ncolumns(), M );
+	ASSERT_EQ( s.col_nnz(1), 0 );
+
+	index_t nz = 0;
+	mat_t a2(vdim, M);
+	a2 << 0.0;
+	for (index_t j = 0; j < M; ++j)
+	{
+		for (index_t k = 0; k < s.col_nnz(j); ++k)
+			a2(s.col_rowinds(j)[k], j) = s.col_values(j)[k];
+		nz += s.col_nnz(j);
+	}
+	ASSERT_EQ( s.nnz(), nz );
+	ASSERT_MAT_EQ( vdim, M, a2, a );
+
+	csc_matrix<double> t = transpose(s);
+	ASSERT_EQ( t.nrows(), M );
+	ASSERT_EQ( t.ncolumns(), vdim );
+	ASSERT_EQ( t.nnz(), nz );
+
+	for (index_t i = 0; i < vdim; ++i)
+		for (index_t k = 0; k < t.col_nnz(i); ++k)
+			ASSERT_EQ( t.col_values(i)[k], a(i, t.col_rowinds(i)[k]) );
+}
+
+
+template<class Metric>
+void verify_sparse_metric(const Metric& dist)
+{
+	mat_t a(vdim, M);
+	mat_t b(vdim, N);
+	make_sparse_data(a);
+	make_sparse_data(b);
+
+	// cosine is undefined for the all-zero columns
+	if (std::is_same<Metric, cosine_distance<double> >::value)
+	{
+		a(0, 1) = 0.5;
+		b(3, 1) = -0.5;
+	}
+
+	csc_matrix<double> sa = to_csc(a);
+	csc_matrix<double> sb = to_csc(b);
+	const double tol = 1.0e-12;
+
+	mat_t D0 = pairwise(dist, a, b);
+	mat_t D(M, N);
+
+	pairwise(dist, sa, sb, D);
+	ASSERT_MAT_APPROX(M, N, D, D0, tol);
+
+	pairwise(dist, sa, b, D);
+	ASSERT_MAT_APPROX(M, N, D, D0, tol);
+
+	pairwise(dist, a, sb, D);
+	ASSERT_MAT_APPROX(M, N, D, D0, tol);
+
+	mat_t S0 = pairwise(dist, a);
+	mat_t S(M, M);
+	pairwise(dist, sa, S);
+	ASSERT_MAT_APPROX(M, M, S, S0, tol);
+
+	// colwise, including broadcasting of a single column
+
+	mat_t b2(vdim, M);
+	make_sparse_data(b2);
+	b2(2, 1) = 1.0;
+	csc_matrix<double> sb2 = to_csc(b2);
+
+	dense_row<double> r0(M), r(M);
+	colwise(dist, a, b2, r0);
+
+	colwise(dist, sa, sb2, r);
+	ASSERT_VEC_APPROX(M, r, r0, tol);
+
+	colwise(dist, sa, b2, r);
+	ASSERT_VEC_APPROX(M, r, r0, tol);
+
+	colwise(dist, a, sb2, r);
+	ASSERT_VEC_APPROX(M, r, r0, tol);
+
+	csc_matrix<double> sb1 = to_csc(b2.column(0));
+	colwise(dist, a, b2.column(0), r0);
+	colwise(dist, sa, sb1, r);
+	ASSERT_VEC_APPROX(M, r, r0, tol);
+}
+
+
+SIMPLE_CASE( test_sparse_sqeuclidean )
+{
+	verify_sparse_metric(sqeuclidean_distance<double>());
+}
+
+SIMPLE_CASE( test_sparse_euclidean )
+{
+	verify_sparse_metric(euclidean_distance<double>());
+}
+
+SIMPLE_CASE( test_sparse_cosine )
+{
+	verify_sparse_metric(cosine_distance<double>());
+}
+
+SIMPLE_CASE( test_sparse_dot_product )
+{
+	verify_sparse_metric(dot_product<double>());
+}
+
+
+AUTO_TPACK( test_sparse )
+{
+	ADD_SIMPLE_CASE( test_csc_basics )
+	ADD_SIMPLE_CASE( test_sparse_sqeuclidean )
+	ADD_SIMPLE_CASE( test_sparse_euclidean )
+	ADD_SIMPLE_CASE( test_sparse_cosine )
+	ADD_SIMPLE_CASE( test_sparse_dot_product )
+}
@@ -0,0 +1,132 @@
+/**
+ * @file test_topk_symeig.cpp
+ *
+ * @brief Unit testing of topk_symeig
+ *
+ * @author Dahua Lin
+ */
+
+#include "../test_base.h"
+#include <dolphin/common/topk_symeig.h>
+
+using namespace dolphin;
+using namespace dolphin::test;
+
+
+// A = Q diag(lam) Q', with Q a random orthonormal basis
+
+template<typename T>
+void make_symmat(const dense_col<T>& lam, dense_matrix<T>& A)
+{
+	const index_t n = lam.nelems();
+
+	dense_matrix<T> Q(n, n);
+	fill_randr(Q, T(-1), T(1));
+
+	std::mt19937 rng(1);
+	ref_matrix<T> rQ(Q.ptr_data(), n, n);
+	internal::orthonormalize_columns(rQ, rng);
+
+	for (index_t j = 0; j < n; ++j)
+	{
+		for (index_t i = 0; i < n; ++i)
+		{
+			T s(0);
+			for (index_t l = 0; l < n; ++l) s += Q(i, l) * lam[l] * Q(j, l);
+			A(i, j) = s;
+		}
+	}
+}
+
+template<typename T>
+class diag_symop
+{
+public:
+	explicit diag_symop(const dense_col<T>& d) : m_d(d) { }
+
+	index_t dim() const { return m_d.nelems(); }
+
+	void apply(const cref_matrix<T>& x, ref_matrix<T>& y) const
+	{
+		for (index_t j = 0; j < x.ncolumns(); ++j)
+			for (index_t i = 0; i < x.nrows(); ++i)
+				y(i, j) = m_d[i] * x(i, j);
+	}
+
+private:
+	const dense_col<T>& m_d;
+};
+
+
+SIMPLE_CASE( test_topk_symeig_dense )
+{
+	const index_t n = 80;
+	const index_t k = 4;
+
+	dense_col<double> lam(n);
+	lam[0] = 10.0; lam[1] = 8.0; lam[2] = 7.0; lam[3] = 6.0;
+	for (index_t i = k; i < n; ++i) lam[i] = 3.0 * double(i - k) / double(n - k);
+
+	dense_matrix<double> A(n, n);
+	make_symmat(lam, A);
+
+	topk_symeig<double> solver(k);
+	solver.tol.set(1.0e-10);
+
+	dense_col<double> evs(k);
+	dense_matrix<double> U(n, k);
+
+	size_t it = solver.run_dense(A, evs, U);
+	ASSERT_TRUE( it < solver.max_iters.get() );
+
+	for (index_t j = 0; j < k; ++j)
+	{
+		ASSERT_APPROX( evs[j], lam[j], 1.0e-8 );
+
+		for (index_t i = 0; i < n; ++i)
+		{
+			double s = 0;
+			for (index_t l = 0; l < n; ++l) s += A(i, l) * U(l, j);
+			ASSERT_APPROX( s, evs[j] * U(i, j), 1.0e-8 );
+		}
+	}
+}
+
+
+SIMPLE_CASE( test_topk_symeig_op )
+{
+	// an implicit operator whose spectrum has a negative part
+
+	const index_t n = 200;
+	const index_t k = 3;
+
+	dense_col<double> d(n);
+	for (index_t i = 0; i < n; ++i) d[i] = -5.0 + 10.0 * double(i) / double(n - 1);
+	d[17] = 9.0;
+	d[60] = 8.5;
+
+	topk_symeig<double> solver(k);
+	solver.tol.set(1.0e-10);
+	solver.shift.set(5.0);
+
+	dense_col<double> evs(k);
+	dense_matrix<double> U(n, k);
+
+	size_t it = solver.run(diag_symop<double>(d), evs, U);
+	ASSERT_TRUE( it < solver.max_iters.get() );
+
+	ASSERT_APPROX( evs[0], 9.0, 1.0e-8 );
+	ASSERT_APPROX( evs[1], 8.5, 1.0e-8 );
+	ASSERT_APPROX( evs[2], 5.0, 1.0e-8 );
+
+	ASSERT_APPROX( std::abs(U(17, 0)), 1.0, 1.0e-6 );
+	ASSERT_APPROX( std::abs(U(60, 1)), 1.0, 1.0e-6 );
+	ASSERT_APPROX( std::abs(U(n-1, 2)), 1.0, 1.0e-6 );
+}
+
+
+AUTO_TPACK( test_topk_symeig )
+{
+	ADD_SIMPLE_CASE( test_topk_symeig_dense )
+	ADD_SIMPLE_CASE( test_topk_symeig_op )
+}
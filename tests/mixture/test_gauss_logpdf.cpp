@@ -0,0 +1,192 @@
+/**
+ * @file test_gauss_logpdf.cpp
+ *
+ * @brief Unit testing of gauss_logpdf_batch
+ *
+ * @author Dahua Lin
+ */
+
+#include "../test_base.h"
+#include <dolphin/mixture/gauss_logpdf.h>
+#include <cmath>
+#include <vector>
+
+using namespace dolphin;
+using namespace dolphin::test;
+
+const index_t d = 4;
+const index_t K = 3;
+const index_t n = 37;	// spans several blocks of size 16
+
+
+// log N(x | mu, C C'), through explicit triangular solves
+double my_gauss_logpdf(const double *x, const double *mu, const dense_matrix<double>& C)
+{
+	double z[d];
+	for (index_t i = 0; i < d; ++i) z[i] = x[i] - mu[i];
+
+	double ld = 0;
+	for (index_t i = 0; i < d; ++i)
+	{
+		double s = z[i];
+		for (index_t l = 0; l < i; ++l) s -= C(i, l) * z[l];
+		z[i] = s / C(i, i);
+		ld += std::log(C(i, i));
+	}
+
+	double q = 0;
+	for (index_t i = 0; i < d; ++i) q += z[i] * z[i];
+
+	return -0.5 * (q + d * std::log(2 * 3.14159265358979323846)) - ld;
+}
+
+void verify_logpdf(const gauss_logpdf_batch<double>& g, const dense_matrix<double>& X,
+		const dense_matrix<double>& mu, const std::vector<dense_matrix<double> >& Cs)
+{
+	dense_matrix<double> L(K, n);
+	g.logpdf(X, L);
+
+	dense_matrix<double> L0(K, n);
+	for (index_t j = 0; j < n; ++j)
+		for (index_t k = 0; k < K; ++k)
+			L0(k, j) = my_gauss_logpdf(X.ptr_col(j), mu.ptr_col(k), Cs[k]);
+
+	ASSERT_MAT_APPROX(K, n, L, L0, 1.0e-10);
+
+	// fused posterior
+
+	dense_col<double> logw(K);
+	logw[0] = std::log(0.2);
+	logw[1] = std::log(0.5);
+	logw[2] = std::log(0.3);
+
+	dense_matrix<double> P(K, n);
+	dense_row<double> ll(n);
+	g.posterior(X, logw, P, ll);
+
+	for (index_t j = 0; j < n; ++j)
+	{
+		double mx = L0(0, j) + logw[0];
+		for (index_t k = 1; k < K; ++k) mx = std::max(mx, L0(k, j) + logw[k]);
+
+		double s = 0;
+		for (index_t k = 0; k < K; ++k) s += std::exp(L0(k, j) + logw[k] - mx);
+		double lse = mx + std::log(s);
+
+		ASSERT_APPROX( ll[j], lse, 1.0e-10 );
+		for (index_t k = 0; k < K; ++k)
+			ASSERT_APPROX( P(k, j), std::exp(L0(k, j) + logw[k] - lse), 1.0e-10 );
+	}
+}
+
+
+SIMPLE_CASE( test_gauss_logpdf_spherical )
+{
+	dense_matrix<double> X(d, n);
+	dense_matrix<double> mu(d, K);
+	fill_randr(X, -2.0, 2.0);
+	fill_randr(mu, -1.0, 1.0);
+
+	dense_col<double> s2(K);
+	s2[0] = 0.5; s2[1] = 1.0; s2[2] = 2.5;
+
+	std::vector<dense_matrix<double> > Cs;
+	for (index_t k = 0; k < K; ++k)
+	{
+		dense_matrix<double> C(d, d);
+		C << 0.0;
+		for (index_t i = 0; i < d; ++i) C(i, i) = std::sqrt(s2[k]);
+		Cs.push_back(C);
+	}
+
+	gauss_logpdf_batch<double> g;
+	g.block_size.set(16);
+	g.set_spherical(mu, s2);
+
+	ASSERT_EQ( g.cov_form(), GAUSS_COV_SPHERICAL );
+	ASSERT_EQ( g.dim(), d );
+	ASSERT_EQ( g.ncomponents(), K );
+
+	verify_logpdf(g, X, mu, Cs);
+}
+
+
+SIMPLE_CASE( test_gauss_logpdf_diagonal )
+{
+	dense_matrix<double> X(d, n);
+	dense_matrix<double> mu(d, K);
+	dense_matrix<double> V(d, K);
+	fill_randr(X, -2.0, 2.0);
+	fill_randr(mu, -1.0, 1.0);
+	fill_randr(V, 0.5, 2.0);
+
+	std::vector<dense_matrix<double> > Cs;
+	for (index_t k = 0; k < K; ++k)
+	{
+		dense_matrix<double> C(d, d);
+		C << 0.0;
+		for (index_t i = 0; i < d; ++i) C(i, i) = std::sqrt(V(i, k));
+		Cs.push_back(C);
+	}
+
+	gauss_logpdf_batch<double> g;
+	g.block_size.set(16);
+	g.set_diagonal(mu, V);
+
+	ASSERT_EQ( g.cov_form(), GAUSS_COV_DIAGONAL );
+	verify_logpdf(g, X, mu, Cs);
+}
+
+
+SIMPLE_CASE( test_gauss_logpdf_full )
+{
+	dense_matrix<double> X(d, n);
+	dense_matrix<double> mu(d, K);
+	fill_randr(X, -2.0, 2.0);
+	fill_randr(mu, -1.0, 1.0);
+
+	// covariances C C' from random lower-triangular factors
+
+	std::vector<dense_matrix<double> > Cs;
+	dense_matrix<double> covs(d * d, K);
+
+	for (index_t k = 0; k < K; ++k)
+	{
+		dense_matrix<double> C(d, d);
+		fill_randr(C, -0.5, 0.5);
+		for (index_t j = 0; j < d; ++j)
+		{
+			for (index_t i = 0; i < j; ++i) C(i, j) = 0.0;
+			C(j, j) = 0.5 + std::abs(C(j, j));
+		}
+		Cs.push_back(C);
+
+		cref_matrix<double> cc(C.ptr_data(), d, d);
+		ref_matrix<double> S(covs.ptr_col(k), d, d);
+		for (index_t j = 0; j < d; ++j)
+			for (index_t i = 0; i < d; ++i)
+			{
+				double s = 0;
+				for (index_t l = 0; l < d; ++l) s += cc(i, l) * cc(j, l);
+				S(i, j) = s;
+			}
+	}
+
+	pd_chol_cache<double> chol(d, K);
+	chol.factorize(covs);
+
+	gauss_logpdf_batch<double> g;
+	g.block_size.set(16);
+	g.set_full(mu, chol);
+
+	ASSERT_EQ( g.cov_form(), GAUSS_COV_FULL );
+	verify_logpdf(g, X, mu, Cs);
+}
+
+
+AUTO_TPACK( test_gauss_logpdf )
+{
+	ADD_SIMPLE_CASE( test_gauss_logpdf_spherical )
+	ADD_SIMPLE_CASE( test_gauss_logpdf_diagonal )
+	ADD_SIMPLE_CASE( test_gauss_logpdf_full )
+}
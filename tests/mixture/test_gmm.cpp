@@ -0,0 +1,212 @@
+/**
+ * @file test_gmm.cpp
+ *
+ * @brief Unit testing of GMM estimation
+ *
+ * @author Dahua Lin
+ */
+
+#include "../test_base.h"
+#include <dolphin/mixture/gmm.h>
+#include <cmath>
+#include <random>
+#include <vector>
+
+using namespace dolphin;
+using namespace dolphin::test;
+
+const index_t d = 2;
+const index_t K = 3;
+const index_t n = 3000;
+
+struct gmm_recording_monitor
+{
+	std::vector<double> objvs;
+
+	void on_iteration(size_t iter, double avg_loglik)
+	{
+		objvs.push_back(avg_loglik);
+	}
+};
+
+// samples x = mu_k + A_k z, with k drawn by the weights w
+void gen_mixture_data(const double *w, const dense_matrix<double>& mu,
+		const std::vector<dense_matrix<double> >& A, dense_matrix<double>& X)
+{
+	std::mt19937 rng(123);
+	std::uniform_real_distribution<double> u(0.0, 1.0);
+	std::normal_distribution<double> nrm;
+
+	for (index_t j = 0; j < n; ++j)
+	{
+		double v = u(rng);
+		index_t k = 0;
+		while (k < K - 1 && v >= w[k]) v -= w[k++];
+
+		double z[d];
+		for (index_t i = 0; i < d; ++i) z[i] = nrm(rng);
+
+		for (index_t i = 0; i < d; ++i)
+		{
+			double s = mu(i, k);
+			for (index_t l = 0; l < d; ++l) s += A[k](i, l) * z[l];
+			X(i, j) = s;
+		}
+	}
+}
+
+void verify_monotone(const gmm_recording_monitor& mon)
+{
+	ASSERT_TRUE( mon.objvs.size() > 1 );
+	for (size_t t = 1; t < mon.objvs.size(); ++t)
+		ASSERT_TRUE( mon.objvs[t] >= mon.objvs[t-1] - 1.0e-8 );
+}
+
+
+SIMPLE_CASE( test_gmm_diagonal )
+{
+	const double w0[K] = {0.5, 0.3, 0.2};
+	const double m0[d * K] = {-5.0, 0.0,  5.0, 1.0,  0.0, 6.0};
+	const double s0[d * K] = {1.0, 0.5,  0.4, 1.5,  2.0, 0.8};	// std. deviations
+
+	dense_matrix<double> mu(d, K);
+	std::vector<dense_matrix<double> > A;
+	for (index_t k = 0; k < K; ++k)
+	{
+		dense_matrix<double> a(d, d);
+		a << 0.0;
+		for (index_t i = 0; i < d; ++i)
+		{
+			mu(i, k) = m0[i + k * d];
+			a(i, i) = s0[i + k * d];
+		}
+		A.push_back(a);
+	}
+
+	dense_matrix<double> X(d, n);
+	gen_mixture_data(w0, mu, A, X);
+
+	// initialize from perturbed means, unit variances, equal weights
+
+	dense_col<double> w(K);
+	dense_matrix<double> means(d, K);
+	dense_matrix<double> vars(d, K);
+	w << 1.0 / K;
+	vars << 1.0;
+	for (index_t k = 0; k < K; ++k)
+		for (index_t i = 0; i < d; ++i) means(i, k) = mu(i, k) + 0.5;
+
+	gmm<double> em(K, GAUSS_COV_DIAGONAL);
+	em.block_size.set(256);
+	em.tol.set(1.0e-10);
+	em.reg.set(0.0);	// keeps the EM objective exactly non-decreasing
+
+	gmm_recording_monitor mon;
+	double avg = em.run(X, w, means, vars, mon);
+
+	verify_monotone(mon);
+	ASSERT_APPROX( avg, mon.objvs.back(), 1.0e-12 );
+
+	for (index_t k = 0; k < K; ++k)
+	{
+		ASSERT_APPROX( w[k], w0[k], 0.05 );
+		for (index_t i = 0; i < d; ++i)
+		{
+			double s = s0[i + k * d];
+			ASSERT_APPROX( means(i, k), mu(i, k), 0.2 );
+			ASSERT_APPROX( vars(i, k), s * s, 0.25 * s * s );
+		}
+	}
+
+	// posteriors under the fitted model
+
+	dense_matrix<double> P(K, n);
+	dense_row<double> ll(n);
+	em.posterior(X, P, ll);
+
+	double lsum = 0;
+	for (index_t j = 0; j < n; ++j)
+	{
+		double s = 0;
+		for (index_t k = 0; k < K; ++k) s += P(k, j);
+		ASSERT_APPROX( s, 1.0, 1.0e-12 );
+		lsum += ll[j];
+	}
+	ASSERT_TRUE( lsum / n >= avg - 1.0e-8 );
+}
+
+
+SIMPLE_CASE( test_gmm_full )
+{
+	const double w0[K] = {0.4, 0.4, 0.2};
+	const double m0[d * K] = {-5.0, -5.0,  5.0, -5.0,  0.0, 5.0};
+
+	// lower-triangular factors of the covariances
+	const double a0[d * d * K] = {
+		1.0, 0.8, 0.0, 0.6,
+		1.5, -0.5, 0.0, 0.5,
+		0.7, 0.0, 0.0, 0.7 };
+
+	dense_matrix<double> mu(d, K);
+	std::vector<dense_matrix<double> > A;
+	for (index_t k = 0; k < K; ++k)
+	{
+		dense_matrix<double> a(d, d);
+		for (index_t j = 0; j < d; ++j)
+			for (index_t i = 0; i < d; ++i) a(i, j) = a0[i + j * d + k * d * d];
+		A.push_back(a);
+
+		for (index_t i = 0; i < d; ++i) mu(i, k) = m0[i + k * d];
+	}
+
+	dense_matrix<double> X(d, n);
+	gen_mixture_data(w0, mu, A, X);
+
+	dense_col<double> w(K);
+	dense_matrix<double> means(d, K);
+	dense_matrix<double> covs(d * d, K);
+	w << 1.0 / K;
+	covs << 0.0;
+	for (index_t k = 0; k < K; ++k)
+	{
+		for (index_t i = 0; i < d; ++i)
+		{
+			means(i, k) = mu(i, k) - 0.5;
+			covs(i * (d + 1), k) = 1.0;
+		}
+	}
+
+	gmm<double> em(K, GAUSS_COV_FULL);
+	em.block_size.set(256);
+	em.tol.set(1.0e-10);
+	em.reg.set(0.0);	// keeps the EM objective exactly non-decreasing
+
+	gmm_recording_monitor mon;
+	em.run(X, w, means, covs, mon);
+
+	verify_monotone(mon);
+
+	for (index_t k = 0; k < K; ++k)
+	{
+		ASSERT_APPROX( w[k], w0[k], 0.05 );
+		for (index_t i = 0; i < d; ++i)
+			ASSERT_APPROX( means(i, k), mu(i, k), 0.2 );
+
+		for (index_t j = 0; j < d; ++j)
+		{
+			for (index_t i = 0; i < d; ++i)
+			{
+				double c = 0;
+				for (index_t l = 0; l < d; ++l) c += A[k](i, l) * A[k](j, l);
+				ASSERT_APPROX( covs(i + j * d, k), c, 0.25 );
+			}
+		}
+	}
+}
+
+
+AUTO_TPACK( test_gmm )
+{
+	ADD_SIMPLE_CASE( test_gmm_diagonal )
+	ADD_SIMPLE_CASE( test_gmm_full )
+}
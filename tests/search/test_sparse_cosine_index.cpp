@@ -0,0 +1,120 @@
+/**
+ * @file test_sparse_cosine_index.cpp
+ *
+ * @brief Unit testing of sparse_cosine_index
+ *
+ * @author Dahua Lin
+ */
+
+#include "../test_base.h"
+#include <dolphin/search/sparse_cosine_index.h>
+#include <vector>
+#include <limits>
+#include <algorithm>
+
+using namespace dolphin;
+using namespace dolphin::test;
+
+typedef dense_matrix<double> mat_t;
+
+const index_t d = 40;
+const index_t n = 300;
+const index_t nq = 9;
+
+
+// non-negative, about a tenth of the entries kept
+void make_sparse_data(mat_t& a)
+{
+	mat_t u(a.nrows(), a.ncolumns());
+	fill_randr(a, 0.0, 1.0);
+	fill_randr(u, 0.0, 1.0);
+
+	for (index_t j = 0; j < a.ncolumns(); ++j)
+		for (index_t i = 0; i < a.nrows(); ++i)
+			if (u(i, j) > 0.1) a(i, j) = 0.0;
+}
+
+// top-k of pairwise(cosine_distance), among documents sharing a dimension
+// with the query (for non-negative data, those with distance below one)
+void verify_search(const mat_t& X, const mat_t& Q, index_t k)
+{
+	sparse_cosine_index<double> index(to_csc(X));
+	ASSERT_EQ( index.dim(), d );
+	ASSERT_EQ( index.size(), n );
+
+	dense_matrix<double> D(k, nq);
+	dense_matrix<index_t> L(k, nq);
+	index.search(to_csc(Q), k, D, L);
+
+	mat_t P = pairwise(cosine_distance<double>(), X, Q);
+
+	for (index_t j = 0; j < nq; ++j)
+	{
+		std::vector<std::pair<double, index_t> > v;
+		for (index_t i = 0; i < n; ++i)
+			if (P(i, j) < 1.0) v.push_back(std::make_pair(P(i, j), i));
+		std::sort(v.begin(), v.end());
+
+		const index_t h = std::min(k, static_cast<index_t>(v.size()));
+		for (index_t i = 0; i < h; ++i)
+		{
+			ASSERT_APPROX( D(i, j), v[i].first, 1.0e-12 );
+			ASSERT_EQ( L(i, j), v[i].second );
+		}
+		for (index_t i = h; i < k; ++i)
+		{
+			ASSERT_TRUE( D(i, j) == std::numeric_limits<double>::infinity() );
+			ASSERT_EQ( L(i, j), -1 );
+		}
+	}
+}
+
+
+SIMPLE_CASE( test_sparse_cosine_search )
+{
+	mat_t X(d, n);
+	mat_t Q(d, nq);
+	make_sparse_data(X);
+	fill_randr(Q, 0.0, 1.0);
+
+	// queries of various sparsity, including a single-term one
+
+	for (index_t j = 0; j < nq; ++j)
+		for (index_t i = 0; i < d; ++i)
+			if ((i + j) % (j + 1) != 0) Q(i, j) = 0.0;
+
+	for (index_t i = 1; i < d; ++i) Q(i, nq - 1) = 0.0;
+	Q(0, nq - 1) = 1.0;
+
+	verify_search(X, Q, 1);
+	verify_search(X, Q, 10);
+	verify_search(X, Q, n);		// no pruning, partially unfilled
+}
+
+
+SIMPLE_CASE( test_sparse_cosine_search_zero_query )
+{
+	mat_t X(d, n);
+	make_sparse_data(X);
+	sparse_cosine_index<double> index(to_csc(X));
+
+	mat_t Q(d, 1);
+	Q << 0.0;
+
+	dense_matrix<double> D(3, 1);
+	dense_matrix<index_t> L(3, 1);
+	index.search(Q, 3, D, L);
+
+	for (index_t i = 0; i < 3; ++i)
+	{
+		ASSERT_TRUE( D(i, 0) == std::numeric_limits<double>::infinity() );
+		ASSERT_EQ( L(i, 0), -1 );
+	}
+}
+
+
+AUTO_TPACK( test_sparse_cosine_index )
+{
+	ADD_SIMPLE_CASE( test_sparse_cosine_search )
+	ADD_SIMPLE_CASE( test_sparse_cosine_search_zero_query )
+}
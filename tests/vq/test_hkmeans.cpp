@@ -0,0 +1,81 @@
+/**
+ * @file test_hkmeans.cpp
+ *
+ * @brief Unit testing of hierarchical K-means
+ *
+ * @author Dahua Lin
+ */
+
+#include "../test_base.h"
+#include <dolphin/vq/hkmeans.h>
+#include <sstream>
+
+using namespace dolphin;
+using namespace dolphin::test;
+
+const index_t ng = 4;		// number of groups
+const index_t npg = 25;		// number of samples per group
+
+
+SIMPLE_CASE( test_hkmeans_tree )
+{
+	const double gx[ng] = {0.0, 0.0, 10.0, 10.0};
+	const double gy[ng] = {0.0, 3.0, 0.0, 3.0};
+
+	const index_t n = ng * npg;
+	dense_matrix<double> X(2, n);
+	fill_randr(X, -0.1, 0.1);
+
+	for (index_t g = 0; g < ng; ++g)
+	{
+		for (index_t i = 0; i < npg; ++i)
+		{
+			X(0, g * npg + i) += gx[g];
+			X(1, g * npg + i) += gy[g];
+		}
+	}
+
+	hkmeans<double> hkm(2, 2);
+	hkmeans_tree<double> tree = hkm.run(X);
+
+	ASSERT_EQ( tree.dim(), 2 );
+	ASSERT_EQ( tree.nnodes(), 7 );
+	ASSERT_EQ( tree.nleaves(), 4 );
+
+	dense_col<index_t> L(n);
+	tree.encode(X, L);
+
+	// each group goes to its own leaf
+
+	for (index_t g = 0; g < ng; ++g)
+	{
+		index_t l = L[g * npg];
+		ASSERT_TRUE( l >= 0 && l < 4 );
+
+		for (index_t i = 1; i < npg; ++i)
+			ASSERT_EQ( L[g * npg + i], l );
+
+		for (index_t g2 = 0; g2 < g; ++g2)
+			ASSERT_TRUE( L[g2 * npg] != l );
+	}
+
+	// encoding from a serialized buffer
+
+	std::stringstream ss;
+	tree.save(ss);
+	std::string buf = ss.str();
+
+	hkmeans_tree_view<double> v = hkmeans_tree_view<double>::from_buffer(buf.data());
+
+	ASSERT_EQ( v.nnodes(), tree.nnodes() );
+	ASSERT_EQ( v.nleaves(), tree.nleaves() );
+
+	for (index_t j = 0; j < n; ++j)
+		ASSERT_EQ( v.encode(X.ptr_col(j)), L[j] );
+}
+
+
+AUTO_TPACK( test_hkmeans )
+{
+	ADD_SIMPLE_CASE( test_hkmeans_tree )
+}
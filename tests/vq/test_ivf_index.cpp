@@ -0,0 +1,150 @@
+/**
+ * @file test_ivf_index.cpp
+ *
+ * @brief Unit testing of the IVF index
+ *
+ * @author Dahua Lin
+ */
+
+#include "../test_base.h"
+#include <dolphin/vq/ivf_index.h>
+#include <sstream>
+
+using namespace dolphin;
+using namespace dolphin::test;
+
+const index_t d = 3;
+const index_t nlists = 4;
+const index_t n = 60;
+const index_t nq = 5;
+const index_t k = 6;
+
+
+void my_knn(const dense_matrix<double>& X, const dense_matrix<double>& Q,
+		dense_matrix<double>& D0, dense_matrix<index_t>& L0)
+{
+	for (index_t j = 0; j < Q.ncolumns(); ++j)
+	{
+		std::vector<std::pair<double, index_t> > v;
+		for (index_t i = 0; i < X.ncolumns(); ++i)
+		{
+			double s = 0;
+			for (index_t t = 0; t < d; ++t)
+			{
+				double u = X(t, i) - Q(t, j);
+				s += u * u;
+			}
+			v.push_back(std::make_pair(s, i + 100));
+		}
+		std::sort(v.begin(), v.end());
+
+		for (index_t i = 0; i < k; ++i)
+		{
+			D0(i, j) = v[i].first;
+			L0(i, j) = v[i].second;
+		}
+	}
+}
+
+
+SIMPLE_CASE( test_ivf_add_and_search )
+{
+	dense_matrix<double> C(d, nlists);
+	dense_matrix<double> X(d, n);
+	dense_matrix<double> Q(d, nq);
+	fill_randr(C, -1.0, 1.0);
+	fill_randr(X, -1.0, 1.0);
+	fill_randr(Q, -1.0, 1.0);
+
+	dense_col<index_t> ids(n);
+	for (index_t j = 0; j < n; ++j) ids[j] = j + 100;
+
+	ivf_index<double> index(C);
+
+	// add in two batches
+
+	const index_t n1 = 25;
+	cref_matrix<double> X1(X.ptr_data(), d, n1);
+	cref_matrix<double> X2(X.ptr_col(n1), d, n - n1);
+	cref_col<index_t> ids1(ids.ptr_data(), n1);
+	cref_col<index_t> ids2(ids.ptr_data() + n1, n - n1);
+
+	index.add(X1, ids1);
+	index.add(X2, ids2);
+
+	ASSERT_EQ( index.nlists(), nlists );
+	ASSERT_EQ( index.size(), n );
+
+	index_t tsize = 0;
+	for (index_t l = 0; l < nlists; ++l) tsize += index.list_size(l);
+	ASSERT_EQ( tsize, n );
+
+	// probing all lists gives exact results
+
+	dense_matrix<double> D0(k, nq);
+	dense_matrix<index_t> L0(k, nq);
+	my_knn(X, Q, D0, L0);
+
+	dense_matrix<double> D(k, nq);
+	dense_matrix<index_t> L(k, nq);
+	index.search(Q, k, nlists, D, L);
+
+	ASSERT_MAT_APPROX(k, nq, D, D0, 1.0e-12);
+	ASSERT_MAT_EQ(k, nq, L, L0);
+
+	// the same from a serialized buffer
+
+	std::stringstream ss;
+	index.save(ss);
+	std::string buf = ss.str();
+
+	ivf_index_view<double> v = ivf_index_view<double>::from_buffer(buf.data());
+	ASSERT_EQ( v.size(), n );
+
+	dense_matrix<double> Dv(k, nq);
+	dense_matrix<index_t> Lv(k, nq);
+	v.search(Q, k, nlists, Dv, Lv);
+
+	ASSERT_MAT_APPROX(k, nq, Dv, D0, 1.0e-12);
+	ASSERT_MAT_EQ(k, nq, Lv, L0);
+}
+
+// adding one vector at a time yields the same lists as one batch
+
+SIMPLE_CASE( test_ivf_incremental_add )
+{
+	dense_matrix<double> C(d, nlists);
+	dense_matrix<double> X(d, n);
+	fill_randr(C, -1.0, 1.0);
+	fill_randr(X, -1.0, 1.0);
+
+	dense_col<index_t> ids(n);
+	for (index_t j = 0; j < n; ++j) ids[j] = j + 100;
+
+	ivf_index<double> a(C);
+	a.add(X, ids);
+
+	ivf_index<double> b(C);
+	for (index_t j = 0; j < n; ++j)
+		b.add(cref_matrix<double>(X.ptr_col(j), d, 1), cref_col<index_t>(ids.ptr_data() + j, 1));
+
+	ASSERT_EQ( b.size(), n );
+	for (index_t l = 0; l < nlists; ++l)
+	{
+		const index_t len = a.list_size(l);
+		ASSERT_EQ( b.list_size(l), len );
+		ASSERT_VEC_EQ( len, b.list_ids(l), a.list_ids(l) );
+	}
+
+	std::stringstream sa, sb;
+	a.save(sa);
+	b.save(sb);
+	ASSERT_TRUE( sa.str() == sb.str() );
+}
+
+
+AUTO_TPACK( test_ivf_index )
+{
+	ADD_SIMPLE_CASE( test_ivf_add_and_search )
+	ADD_SIMPLE_CASE( test_ivf_incremental_add )
+}
@@ -0,0 +1,268 @@
+/**
+ * @file test_kmeans.cpp
+ *
+ * @brief Unit testing of K-means
+ *
+ * @author Dahua Lin
+ */
+
+#include "../test_base.h"
+#include <dolphin/vq/kmeans.h>
+
+using namespace dolphin;
+using namespace dolphin::test;
+
+const index_t K = 3;
+const index_t npc = 30;		// number of samples per cluster
+
+
+template<typename T>
+void make_clustered_data(dense_matrix<T>& X, dense_col<index_t>& L0)
+{
+	const T cx[K] = {T(0), T(10), T(0)};
+	const T cy[K] = {T(0), T(0), T(10)};
+
+	fill_randr(X, T(-1), T(1));
+
+	for (index_t k = 0; k < K; ++k)
+	{
+		for (index_t i = 0; i < npc; ++i)
+		{
+			index_t j = k * npc + i;
+			X(0, j) += cx[k];
+			X(1, j) += cy[k];
+			L0[j] = k;
+		}
+	}
+}
+
+template<typename T>
+T my_objective(const dense_matrix<T>& X, const dense_col<index_t>& L, const dense_matrix<T>& C)
+{
+	T s(0);
+	for (index_t j = 0; j < X.ncolumns(); ++j)
+	{
+		index_t l = L[j];
+		for (index_t i = 0; i < X.nrows(); ++i)
+		{
+			T v = X(i, j) - C(i, l);
+			s += v * v;
+		}
+	}
+	return s;
+}
+
+
+T_CASE( test_kmeans_run )
+{
+	const index_t n = K * npc;
+	dense_matrix<T> X(2, n);
+	dense_col<index_t> L0(n);
+	make_clustered_data(X, L0);
+
+	dense_matrix<T> C(2, K);
+	for (index_t k = 0; k < K; ++k)
+	{
+		C(0, k) = X(0, k * npc);
+		C(1, k) = X(1, k * npc);
+	}
+
+	dense_col<index_t> L(n);
+	dense_col<index_t> cnts(K);
+
+	kmeans<T> km(K);
+	km.block_size.set(16);
+	kmeans_silent_monitor mon;
+	T objv = km.run(X, C, L, cnts, mon);
+
+	ASSERT_VEC_EQ(n, L, L0);
+	for (index_t k = 0; k < K; ++k) ASSERT_EQ( cnts[k], npc );
+
+	dense_matrix<T> C0(2, K, zero());
+	for (index_t j = 0; j < n; ++j)
+	{
+		C0(0, L0[j]) += X(0, j) / T(npc);
+		C0(1, L0[j]) += X(1, j) / T(npc);
+	}
+
+	T tol = T(sizeof(T) == 4 ? 1.0e-4 : 1.0e-10);
+	ASSERT_MAT_APPROX(2, K, C, C0, tol);
+	ASSERT_APPROX(objv, my_objective(X, L0, C0), tol * T(n));
+}
+
+
+T_CASE( test_kmeans_restarts )
+{
+	const index_t n = K * npc;
+	dense_matrix<T> X(2, n);
+	dense_col<index_t> L0(n);
+	make_clustered_data(X, L0);
+
+	// restart 0 starts with a duplicated seed (one center stays empty),
+	// restart 1 starts with one seed in each cluster
+
+	const index_t R = 2;
+	dense_matrix<T> S(2, K * R);
+	const index_t s0[K] = {0, 0, 2 * npc};
+	for (index_t k = 0; k < K; ++k)
+	{
+		S(0, k) = X(0, s0[k]);
+		S(1, k) = X(1, s0[k]);
+		S(0, K + k) = X(0, k * npc);
+		S(1, K + k) = X(1, k * npc);
+	}
+
+	kmeans<T> km(K);
+	kmeans_silent_monitor mon;
+
+	dense_matrix<T> C1(2, K);
+	for (index_t k = 0; k < K; ++k)
+	{
+		C1(0, k) = S(0, K + k);
+		C1(1, k) = S(1, K + k);
+	}
+	dense_col<index_t> L1(n);
+	dense_col<index_t> cnts1(K);
+	T objv1 = km.run(X, C1, L1, cnts1, mon);
+
+	dense_matrix<T> C(2, K);
+	dense_col<index_t> L(n);
+	dense_col<index_t> cnts(K);
+	T objv = km.run_restarts(X, S, C, L, cnts, mon);
+
+	T tol = T(sizeof(T) == 4 ? 1.0e-4 : 1.0e-10);
+	ASSERT_APPROX(objv, objv1, tol * T(n));
+	ASSERT_VEC_EQ(n, L, L1);
+	ASSERT_VEC_EQ(K, cnts, cnts1);
+	ASSERT_MAT_APPROX(2, K, C, C1, tol);
+}
+
+
+T_CASE( test_kmeans_final_objective )
+{
+	const index_t n = K * npc;
+	dense_matrix<T> X(2, n);
+	dense_col<index_t> L0(n);
+	make_clustered_data(X, L0);
+
+	// a single iteration from poor seeds moves the centers, so the
+	// objective must be that of the returned centers and labels
+
+	dense_matrix<T> C(2, K);
+	const index_t s0[K] = {0, 1, 2};
+	for (index_t k = 0; k < K; ++k)
+	{
+		C(0, k) = X(0, s0[k]);
+		C(1, k) = X(1, s0[k]);
+	}
+
+	dense_col<index_t> L(n);
+	dense_col<index_t> cnts(K);
+
+	kmeans<T> km(K);
+	km.max_iters.set(1);
+	kmeans_silent_monitor mon;
+	T objv = km.run(X, C, L, cnts, mon);
+
+	T tol = T(sizeof(T) == 4 ? 1.0e-4 : 1.0e-10);
+	ASSERT_APPROX(objv, my_objective(X, L, C), tol * T(n));
+
+	// K == 0 is rejected
+
+	kmeans<T> km0(0);
+	dense_matrix<T> C0(2, 0);
+	dense_col<index_t> cnts0(0);
+
+	bool thrown = false;
+	try
+	{
+		km0.run(X, C0, L, cnts0, mon);
+	}
+	catch (invalid_argument&)
+	{
+		thrown = true;
+	}
+	ASSERT_TRUE( thrown );
+}
+
+
+SIMPLE_CASE( test_kmeans_random_seeds )
+{
+	const index_t n = 20;
+	const index_t R = 4;
+	const index_t Kr = 5;
+	dense_matrix<double> X(1, n);
+	for (index_t j = 0; j < n; ++j) X[j] = double(j);
+
+	dense_matrix<double> S(1, Kr * R);
+	std::mt19937 rng(17);
+	kmeans_random_seeds(X, Kr, S, rng);
+
+	for (index_t r = 0; r < R; ++r)
+	{
+		for (index_t k = 0; k < Kr; ++k)
+		{
+			double v = S(0, r * Kr + k);
+			ASSERT_TRUE( v >= 0 && v < n );
+			for (index_t k2 = 0; k2 < k; ++k2)
+				ASSERT_TRUE( S(0, r * Kr + k2) != v );
+		}
+	}
+}
+
+
+AUTO_TPACK( test_kmeans )
+{
+	ADD_T_CASE_FP( test_kmeans_run )
+	ADD_T_CASE_FP( test_kmeans_restarts )
+	ADD_T_CASE_FP( test_kmeans_final_objective )
+	ADD_T_CASE( test_kmeans_final_objective )
+{
+	const index_t n = K * npc;
+	dense_matrix<T> X(2, n);
+	dense_col<index_t> L0(n);
+	make_clustered_data(X, L0);
+
+	// a single iteration from poor seeds moves the centers, so the
+	// objective must be that of the returned centers and labels
+
+	dense_matrix<T> C(2, K);
+	const index_t s0[K] = {0, 1, 2};
+	for (index_t k = 0; k < K; ++k)
+	{
+		C(0, k) = X(0, s0[k]);
+		C(1, k) = X(1, s0[k]);
+	}
+
+	dense_col<index_t> L(n);
+	dense_col<index_t> cnts(K);
+
+	kmeans<T> km(K);
+	km.max_iters.set(1);
+	kmeans_silent_monitor mon;
+	T objv = km.run(X, C, L, cnts, mon);
+
+	T tol = T(sizeof(T) == 4 ? 1.0e-4 : 1.0e-10);
+	ASSERT_APPROX(objv, my_objective(X, L, C), tol * T(n));
+
+	// K == 0 is rejected
+
+	kmeans<T> km0(0);
+	dense_matrix<T> C0(2, 0);
+	dense_col<index_t> cnts0(0);
+
+	bool thrown = false;
+	try
+	{
+		km0.run(X, C0, L, cnts0, mon);
+	}
+	catch (invalid_argument&)
+	{
+		thrown = true;
+	}
+	ASSERT_TRUE( thrown );
+}
+
+
+SIMPLE_CASE( test_kmeans_random_seeds )
+}
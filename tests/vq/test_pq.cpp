@@ -0,0 +1,146 @@
+/**
+ * @file test_pq.cpp
+ *
+ * @brief Unit testing of product quantization
+ *
+ * @author Dahua Lin
+ */
+
+#include "../test_base.h"
+#include <dolphin/vq/pq.h>
+
+using namespace dolphin;
+using namespace dolphin::test;
+
+const index_t M = 4;
+const index_t ds = 2;
+const index_t ksub = 16;
+
+
+SIMPLE_CASE( test_pq_encode_and_adc )
+{
+	const index_t d = M * ds;
+	const index_t n = 37;
+
+	dense_matrix<float> C(ds, M * ksub);
+	fill_randr(C, -1.f, 1.f);
+
+	product_quantizer<float> pq(M, C);
+
+	ASSERT_EQ( pq.dim(), d );
+	ASSERT_EQ( pq.nsubspaces(), M );
+	ASSERT_EQ( pq.subdim(), ds );
+	ASSERT_EQ( pq.ksub(), ksub );
+
+	dense_matrix<float> X(d, n);
+	fill_randr(X, -1.f, 1.f);
+
+	dense_matrix<uint8_t> codes(M, n);
+	pq.encode(X, codes);
+
+	// codes against brute-force search in each subspace
+
+	dense_matrix<uint8_t> codes0(M, n);
+	for (index_t j = 0; j < n; ++j)
+	{
+		for (index_t m = 0; m < M; ++m)
+		{
+			index_t kmin = 0;
+			float dmin = 0;
+			for (index_t k = 0; k < ksub; ++k)
+			{
+				float s = 0;
+				for (index_t i = 0; i < ds; ++i)
+				{
+					float v = X(m * ds + i, j) - C(i, m * ksub + k);
+					s += v * v;
+				}
+				if (k == 0 || s < dmin) { dmin = s; kmin = k; }
+			}
+			codes0(m, j) = static_cast<uint8_t>(kmin);
+		}
+	}
+
+	ASSERT_MAT_EQ(M, n, codes, codes0);
+
+	// asymmetric distances against reconstructed vectors
+
+	dense_col<float> q(d);
+	fill_randr(q, -1.f, 1.f);
+
+	dense_col<float> r0(n);
+	for (index_t j = 0; j < n; ++j)
+	{
+		float s = 0;
+		for (index_t m = 0; m < M; ++m)
+		{
+			for (index_t i = 0; i < ds; ++i)
+			{
+				float v = q[m * ds + i] - C(i, m * ksub + codes0(m, j));
+				s += v * v;
+			}
+		}
+		r0[j] = s;
+	}
+
+	dense_col<float> r(n);
+	pq.adc_distances(q.ptr_data(), codes, r);
+
+	ASSERT_VEC_APPROX(n, r, r0, 1.0e-5f);
+}
+
+
+SIMPLE_CASE( test_pq_train )
+{
+	const index_t d = M * ds;
+	const index_t n = 200;
+
+	dense_matrix<double> X(d, n);
+	fill_randr(X, -1.0, 1.0);
+
+	pq_trainer<double> tr(M);
+	tr.ksub.set(ksub);
+	tr.max_iters.set(1000);
+	tr.tol.set(1.0e-12);
+	product_quantizer<double> pq = tr.run(X);
+
+	ASSERT_EQ( pq.dim(), d );
+	ASSERT_EQ( pq.ksub(), ksub );
+	ASSERT_EQ( pq.centers().nrows(), ds );
+	ASSERT_EQ( pq.centers().ncolumns(), M * ksub );
+
+	// every trained center is the mean of the samples encoded to it
+
+	dense_matrix<uint8_t> codes(M, n);
+	pq.encode(X, codes);
+
+	for (index_t m = 0; m < M; ++m)
+	{
+		for (index_t k = 0; k < ksub; ++k)
+		{
+			double s[ds] = {0};
+			index_t c = 0;
+			for (index_t j = 0; j < n; ++j)
+			{
+				if (codes(m, j) == k)
+				{
+					for (index_t i = 0; i < ds; ++i) s[i] += X(m * ds + i, j);
+					++ c;
+				}
+			}
+
+			if (c > 0)
+			{
+				for (index_t i = 0; i < ds; ++i)
+					ASSERT_APPROX( pq.centers()(i, m * ksub + k), s[i] / double(c), 1.0e-10 );
+			}
+		}
+	}
+}
+
+
+AUTO_TPACK( test_pq )
+{
+	ADD_SIMPLE_CASE( test_pq_encode_and_adc )
+	ADD_SIMPLE_CASE( test_pq_train )
+}
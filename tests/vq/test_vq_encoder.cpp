@@ -0,0 +1,80 @@
+/**
+ * @file test_vq_encoder.cpp
+ *
+ * @brief Unit testing of vq_encoder
+ *
+ * @author Dahua Lin
+ */
+
+#include "../test_base.h"
+#include <dolphin/vq/vq_encoder.h>
+
+using namespace dolphin;
+using namespace dolphin::test;
+
+
+template<typename T>
+index_t my_nearest(const dense_matrix<T>& C, const dense_matrix<T>& X, index_t j, T& dmin)
+{
+	index_t kmin = -1;
+	for (index_t k = 0; k < C.ncolumns(); ++k)
+	{
+		T s(0);
+		for (index_t i = 0; i < C.nrows(); ++i)
+		{
+			T v = X(i, j) - C(i, k);
+			s += v * v;
+		}
+		if (kmin < 0 || s < dmin)
+		{
+			dmin = s;
+			kmin = k;
+		}
+	}
+	return kmin;
+}
+
+
+T_CASE( test_vq_encode )
+{
+	const index_t d = 7;
+	const index_t K = 13;	// not a multiple of the lane width
+	const index_t n = 5;
+
+	dense_matrix<T> C(d, K);
+	dense_matrix<T> X(d, n);
+	fill_randr(C, T(-1), T(1));
+	fill_randr(X, T(-1), T(1));
+
+	vq_encoder<T> enc(C);
+
+	ASSERT_EQ( enc.dim(), d );
+	ASSERT_EQ( enc.ncenters(), K );
+
+	dense_col<index_t> L0(n);
+	dense_col<T> D0(n);
+	for (index_t j = 0; j < n; ++j)
+	{
+		T dmin;
+		L0[j] = my_nearest(C, X, j, dmin);
+		D0[j] = dmin;
+	}
+
+	dense_col<index_t> L1(n);
+	for (index_t j = 0; j < n; ++j) L1[j] = enc.encode(X.ptr_col(j));
+	ASSERT_VEC_EQ(n, L1, L0);
+
+	dense_col<index_t> L2(n);
+	dense_col<T> D2(n);
+	enc.encode(X, L2, D2);
+
+	T tol = T(sizeof(T) == 4 ? 1.0e-5 : 1.0e-12);
+	ASSERT_VEC_EQ(n, L2, L0);
+	ASSERT_VEC_APPROX(n, D2, D0, tol);
+}
+
+
+AUTO_TPACK( test_vq_encoder )
+{
+	ADD_T_CASE_FP( test_vq_encode )
+}